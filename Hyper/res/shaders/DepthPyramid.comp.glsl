@@ -0,0 +1,40 @@
+#version 460 core
+#extension GL_EXT_samplerless_texture_functions : require
+
+// Builds one level of the depth pyramid, where every texel holds the (min, max) depth of the 2x2 texels below it.
+// The levels are rounded up when halving, so the last row and column of an odd sized level only cover one texel.
+// Level 0 is built from the depth buffer itself, which stores a single depth per texel.
+
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+layout(set = 0, binding = 0) uniform texture2D source;
+layout(set = 0, binding = 1, rg32f) uniform writeonly image2D destination;
+
+layout(push_constant) uniform constants
+{
+    uvec2 sourceSize;
+    uvec2 destinationSize;
+    uint sourceIsDepth;
+} ReduceSettings;
+
+vec2 LoadSource(uvec2 texel)
+{
+    vec2 value = texelFetch(source, ivec2(min(texel, ReduceSettings.sourceSize - 1)), 0).xy;
+    return ReduceSettings.sourceIsDepth != 0 ? value.xx : value;
+}
+
+void main()
+{
+    uvec2 texel = gl_GlobalInvocationID.xy;
+    if (any(greaterThanEqual(texel, ReduceSettings.destinationSize)))
+        return;
+
+    vec2 d0 = LoadSource(texel * 2 + uvec2(0, 0));
+    vec2 d1 = LoadSource(texel * 2 + uvec2(1, 0));
+    vec2 d2 = LoadSource(texel * 2 + uvec2(0, 1));
+    vec2 d3 = LoadSource(texel * 2 + uvec2(1, 1));
+
+    float minDepth = min(min(d0.x, d1.x), min(d2.x, d3.x));
+    float maxDepth = max(max(d0.y, d1.y), max(d2.y, d3.y));
+    imageStore(destination, ivec2(texel), vec4(minDepth, maxDepth, 0.0, 0.0));
+}
@@ -0,0 +1,38 @@
+// Builds one level of the depth pyramid, where every texel holds the (min, max) depth of the 2x2 texels below it.
+// The levels are rounded up when halving, so the last row and column of an odd sized level only cover one texel.
+// Level 0 is built from the depth buffer itself, which stores a single depth per texel.
+
+Texture2D<float2> source : register(t0, space0);
+RWTexture2D<float2> destination : register(u1, space0);
+
+struct ReduceSettings
+{
+	uint2 sourceSize;
+	uint2 destinationSize;
+	uint sourceIsDepth;
+};
+
+[[vk::push_constant]] ReduceSettings settings;
+
+float2 LoadSource(uint2 texel)
+{
+	float2 value = source.Load(int3(min(texel, settings.sourceSize - 1), 0));
+	return settings.sourceIsDepth != 0 ? value.xx : value;
+}
+
+[numthreads(8, 8, 1)]
+void main(uint3 dispatchId : SV_DispatchThreadID)
+{
+	uint2 texel = dispatchId.xy;
+	if (any(texel >= settings.destinationSize))
+		return;
+
+	float2 d0 = LoadSource(texel * 2 + uint2(0, 0));
+	float2 d1 = LoadSource(texel * 2 + uint2(1, 0));
+	float2 d2 = LoadSource(texel * 2 + uint2(0, 1));
+	float2 d3 = LoadSource(texel * 2 + uint2(1, 1));
+
+	float minDepth = min(min(d0.x, d1.x), min(d2.x, d3.x));
+	float maxDepth = max(max(d0.y, d1.y), max(d2.y, d3.y));
+	destination[texel] = float2(minDepth, maxDepth);
+}
@@ -0,0 +1,69 @@
+#version 460 core
+#extension GL_EXT_samplerless_texture_functions : require
+
+// Tests screen-space rectangles against the depth pyramid, for whoever needs occlusion results outside of the culling pass.
+// Writes 1 for every rectangle that is completely hidden behind the depth that was drawn there, and 0 otherwise.
+
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+layout(set = 0, binding = 0) uniform texture2D depthPyramid;
+
+struct DepthRect
+{
+    // (min u, min v, max u, max v) over the depth buffer.
+    vec4 uvRect;
+    // Depth of the closest point inside of the rectangle.
+    float nearestDepth;
+    uint padding0;
+    uint padding1;
+    uint padding2;
+};
+
+layout(std430, set = 0, binding = 1) readonly buffer Rects
+{
+    DepthRect rects[];
+};
+
+layout(std430, set = 0, binding = 2) writeonly buffer Results
+{
+    uint results[];
+};
+
+layout(push_constant) uniform constants
+{
+    uvec2 depthSize;
+    uint pyramidMipCount;
+    uint rectCount;
+} RectTestSettings;
+
+// Same test as DrawCulling.comp.glsl and DepthPyramid::IsRectOccluded.
+bool IsRectOccluded(vec4 uvRect, float nearestDepth)
+{
+    uvec2 size = RectTestSettings.depthSize;
+    uvec2 texelMin = min(uvec2(max(uvRect.xy, 0.0) * vec2(size)), size - 1);
+    uvec2 texelMax = min(uvec2(max(uvRect.zw, 0.0) * vec2(size)), size - 1);
+
+    // Pick the finest level where the rectangle covers at most 2x2 texels. Level N halves the depth buffer N + 1 times.
+    uint level = 0;
+    while (level + 1 < RectTestSettings.pyramidMipCount && any(greaterThan((texelMax >> (level + 1)) - (texelMin >> (level + 1)), uvec2(1))))
+        level++;
+
+    ivec2 t0 = ivec2(texelMin >> (level + 1));
+    ivec2 t1 = ivec2(texelMax >> (level + 1));
+    float maxDepth = max(
+        max(texelFetch(depthPyramid, ivec2(t0.x, t0.y), int(level)).y, texelFetch(depthPyramid, ivec2(t1.x, t0.y), int(level)).y),
+        max(texelFetch(depthPyramid, ivec2(t0.x, t1.y), int(level)).y, texelFetch(depthPyramid, ivec2(t1.x, t1.y), int(level)).y));
+
+    // The whole rectangle is behind the furthest depth that was drawn there.
+    return nearestDepth > maxDepth;
+}
+
+void main()
+{
+    uint rectIdx = gl_GlobalInvocationID.x;
+    if (rectIdx >= RectTestSettings.rectCount)
+        return;
+
+    DepthRect rect = rects[rectIdx];
+    results[rectIdx] = IsRectOccluded(rect.uvRect, rect.nearestDepth) ? 1 : 0;
+}
@@ -0,0 +1,60 @@
+// Tests screen-space rectangles against the depth pyramid, for whoever needs occlusion results outside of the culling pass.
+// Writes 1 for every rectangle that is completely hidden behind the depth that was drawn there, and 0 otherwise.
+
+Texture2D<float2> depthPyramid : register(t0, space0);
+
+struct DepthRect
+{
+	// (min u, min v, max u, max v) over the depth buffer.
+	float4 uvRect;
+	// Depth of the closest point inside of the rectangle.
+	float nearestDepth;
+	uint padding0;
+	uint padding1;
+	uint padding2;
+};
+StructuredBuffer<DepthRect> rects : register(t1, space0);
+
+RWStructuredBuffer<uint> results : register(u2, space0);
+
+struct RectTestSettings
+{
+	uint2 depthSize;
+	uint pyramidMipCount;
+	uint rectCount;
+};
+
+[[vk::push_constant]] RectTestSettings settings;
+
+// Same test as DrawCulling.comp.hlsl and DepthPyramid::IsRectOccluded.
+bool IsRectOccluded(float4 uvRect, float nearestDepth)
+{
+	uint2 size = settings.depthSize;
+	uint2 texelMin = min(uint2(max(uvRect.xy, 0.0) * float2(size)), size - 1);
+	uint2 texelMax = min(uint2(max(uvRect.zw, 0.0) * float2(size)), size - 1);
+
+	// Pick the finest level where the rectangle covers at most 2x2 texels. Level N halves the depth buffer N + 1 times.
+	uint level = 0;
+	while (level + 1 < settings.pyramidMipCount && any((texelMax >> (level + 1)) - (texelMin >> (level + 1)) > 1))
+		level++;
+
+	uint2 t0 = texelMin >> (level + 1);
+	uint2 t1 = texelMax >> (level + 1);
+	float maxDepth = max(
+		max(depthPyramid.Load(int3(t0.x, t0.y, level)).y, depthPyramid.Load(int3(t1.x, t0.y, level)).y),
+		max(depthPyramid.Load(int3(t0.x, t1.y, level)).y, depthPyramid.Load(int3(t1.x, t1.y, level)).y));
+
+	// The whole rectangle is behind the furthest depth that was drawn there.
+	return nearestDepth > maxDepth;
+}
+
+[numthreads(64, 1, 1)]
+void main(uint3 dispatchId : SV_DispatchThreadID)
+{
+	uint rectIdx = dispatchId.x;
+	if (rectIdx >= settings.rectCount)
+		return;
+
+	DepthRect rect = rects[rectIdx];
+	results[rectIdx] = IsRectOccluded(rect.uvRect, rect.nearestDepth) ? 1 : 0;
+}
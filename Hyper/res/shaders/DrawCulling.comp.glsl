@@ -0,0 +1,210 @@
+#version 460 core
+#extension GL_EXT_samplerless_texture_functions : require
+
+// Tests every object against the camera frustum, and appends the visible ones to the indirect draw buffer.
+// Every material has its own range in the output buffers and its own draw count, so the geometry pass can draw
+// each range with a single vkCmdDrawIndexedIndirectCount after binding the material.
+//
+// With occlusion culling the pass runs twice per frame. The early pass draws the objects that were visible last frame,
+// after which the depth pyramid is built from their depth. The late pass then tests every object against the pyramid,
+// draws the visible ones the early pass skipped, and remembers which objects are visible for the next frame.
+
+#define CULL_PHASE_SINGLE 0
+#define CULL_PHASE_EARLY 1
+#define CULL_PHASE_LATE 2
+
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+struct DrawObject
+{
+    vec3 boundsMin;
+    uint instanceIdx;
+    vec3 boundsMax;
+    uint materialIndex;
+    uint indexCount;
+    uint firstIndex;
+    int vertexOffset;
+    // First slot of the object's material range in the output buffers.
+    uint firstDraw;
+    uint rangeIdx;
+    uint padding0;
+    uint padding1;
+    uint padding2;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer Objects
+{
+    DrawObject objects[];
+};
+
+struct DrawData
+{
+    uint firstInstance;
+    uint materialIndex;
+};
+
+layout(std430, set = 0, binding = 1) writeonly buffer Draws
+{
+    DrawData drawData[];
+};
+
+// Matches VkDrawIndexedIndirectCommand.
+struct DrawIndexedCommand
+{
+    uint indexCount;
+    uint instanceCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint firstInstance;
+};
+
+layout(std430, set = 0, binding = 2) writeonly buffer DrawCommands
+{
+    DrawIndexedCommand drawCommands[];
+};
+
+// Draw count of every material range, cleared before the dispatch.
+layout(std430, set = 0, binding = 3) buffer DrawCounts
+{
+    uint drawCounts[];
+};
+
+layout(set = 0, binding = 4) uniform CullingData
+{
+    mat4 viewProj;
+    // World-space frustum planes as (normal, distance), with the normals pointing inwards.
+    vec4 frustumPlanes[6];
+    uint objectCount;
+    uint frustumCulling;
+    uint occlusionCulling;
+    uint pyramidMipCount;
+    uvec2 depthSize;
+    uvec2 padding;
+} cullingData;
+
+// (min, max) depth pyramid of the early pass' depth buffer.
+layout(set = 0, binding = 5) uniform texture2D depthPyramid;
+
+// Whether every object was visible after the last late pass.
+layout(std430, set = 0, binding = 6) buffer Visibility
+{
+    uint visibility[];
+};
+
+layout(push_constant) uniform constants
+{
+    uint phase;
+    // Offsets of the pass' output range in the draw buffers and in the draw counts.
+    uint drawOffset;
+    uint countOffset;
+} CullingPass;
+
+bool IsInFrustum(vec3 boundsMin, vec3 boundsMax)
+{
+    for (uint i = 0; i < 6; i++)
+    {
+        vec4 plane = cullingData.frustumPlanes[i];
+        // Test the corner that is furthest along the plane normal (the "positive vertex").
+        vec3 positive = vec3(
+            plane.x > 0.0 ? boundsMax.x : boundsMin.x,
+            plane.y > 0.0 ? boundsMax.y : boundsMin.y,
+            plane.z > 0.0 ? boundsMax.z : boundsMin.z);
+
+        if (dot(plane.xyz, positive) + plane.w < 0.0)
+            return false;
+    }
+
+    return true;
+}
+
+// Projects the box to a screen-space rectangle (min u, min v, max u, max v) and the depth of its closest point.
+// Returns false when part of the box is behind the camera, in which case it can't be tested against the pyramid.
+bool ProjectBox(vec3 boundsMin, vec3 boundsMax, out vec4 uvRect, out float nearestDepth)
+{
+    uvRect = vec4(1e30, 1e30, -1e30, -1e30);
+    nearestDepth = 1e30;
+
+    for (uint i = 0; i < 8; i++)
+    {
+        vec3 corner = vec3(
+            (i & 1) != 0 ? boundsMax.x : boundsMin.x,
+            (i & 2) != 0 ? boundsMax.y : boundsMin.y,
+            (i & 4) != 0 ? boundsMax.z : boundsMin.z);
+
+        vec4 clip = cullingData.viewProj * vec4(corner, 1.0);
+        if (clip.w <= 1e-5)
+            return false;
+
+        vec3 ndc = clip.xyz / clip.w;
+        vec2 uv = ndc.xy * 0.5 + 0.5;
+        uvRect.xy = min(uvRect.xy, uv);
+        uvRect.zw = max(uvRect.zw, uv);
+        nearestDepth = min(nearestDepth, ndc.z);
+    }
+
+    return true;
+}
+
+// Same test as DepthRectTest.comp.glsl and DepthPyramid::IsRectOccluded.
+bool IsRectOccluded(vec4 uvRect, float nearestDepth)
+{
+    uvec2 size = cullingData.depthSize;
+    uvec2 texelMin = min(uvec2(max(uvRect.xy, 0.0) * vec2(size)), size - 1);
+    uvec2 texelMax = min(uvec2(max(uvRect.zw, 0.0) * vec2(size)), size - 1);
+
+    // Pick the finest level where the rectangle covers at most 2x2 texels. Level N halves the depth buffer N + 1 times.
+    uint level = 0;
+    while (level + 1 < cullingData.pyramidMipCount && any(greaterThan((texelMax >> (level + 1)) - (texelMin >> (level + 1)), uvec2(1))))
+        level++;
+
+    ivec2 t0 = ivec2(texelMin >> (level + 1));
+    ivec2 t1 = ivec2(texelMax >> (level + 1));
+    float maxDepth = max(
+        max(texelFetch(depthPyramid, ivec2(t0.x, t0.y), int(level)).y, texelFetch(depthPyramid, ivec2(t1.x, t0.y), int(level)).y),
+        max(texelFetch(depthPyramid, ivec2(t0.x, t1.y), int(level)).y, texelFetch(depthPyramid, ivec2(t1.x, t1.y), int(level)).y));
+
+    // The whole rectangle is behind the furthest depth that was drawn there.
+    return nearestDepth > maxDepth;
+}
+
+void main()
+{
+    uint objectIdx = gl_GlobalInvocationID.x;
+    if (objectIdx >= cullingData.objectCount)
+        return;
+
+    // The early pass only draws what was visible last frame, the late pass decides about everything else.
+    if (CullingPass.phase == CULL_PHASE_EARLY && visibility[objectIdx] == 0)
+        return;
+
+    DrawObject object = objects[objectIdx];
+    bool visible = cullingData.frustumCulling == 0 || IsInFrustum(object.boundsMin, object.boundsMax);
+
+    // The pyramid of the early pass doesn't exist yet when the early pass itself runs.
+    if (visible && cullingData.occlusionCulling != 0 && CullingPass.phase != CULL_PHASE_EARLY)
+    {
+        vec4 uvRect;
+        float nearestDepth;
+        if (ProjectBox(object.boundsMin, object.boundsMax, uvRect, nearestDepth))
+            visible = !IsRectOccluded(uvRect, nearestDepth);
+    }
+
+    if (CullingPass.phase == CULL_PHASE_LATE)
+    {
+        // Objects that were visible last frame and are still in the frustum have already been drawn by the early pass.
+        bool drawnEarly = visibility[objectIdx] != 0;
+        visibility[objectIdx] = visible ? 1 : 0;
+        if (drawnEarly)
+            return;
+    }
+
+    if (!visible)
+        return;
+
+    uint drawIdx = CullingPass.drawOffset + object.firstDraw + atomicAdd(drawCounts[CullingPass.countOffset + object.rangeIdx], 1);
+
+    drawData[drawIdx] = DrawData(object.instanceIdx, object.materialIndex);
+
+    // The draw passes its own index as its first instance, so the vertex shader can find its draw data.
+    drawCommands[drawIdx] = DrawIndexedCommand(object.indexCount, 1, object.firstIndex, object.vertexOffset, drawIdx);
+}
@@ -0,0 +1,202 @@
+// Tests every object against the camera frustum, and appends the visible ones to the indirect draw buffer.
+// Every material has its own range in the output buffers and its own draw count, so the geometry pass can draw
+// each range with a single vkCmdDrawIndexedIndirectCount after binding the material.
+//
+// With occlusion culling the pass runs twice per frame. The early pass draws the objects that were visible last frame,
+// after which the depth pyramid is built from their depth. The late pass then tests every object against the pyramid,
+// draws the visible ones the early pass skipped, and remembers which objects are visible for the next frame.
+
+#define CULL_PHASE_SINGLE 0
+#define CULL_PHASE_EARLY 1
+#define CULL_PHASE_LATE 2
+
+struct DrawObject
+{
+	float3 boundsMin;
+	uint instanceIdx;
+	float3 boundsMax;
+	uint materialIndex;
+	uint indexCount;
+	uint firstIndex;
+	int vertexOffset;
+	// First slot of the object's material range in the output buffers.
+	uint firstDraw;
+	uint rangeIdx;
+	uint padding0;
+	uint padding1;
+	uint padding2;
+};
+StructuredBuffer<DrawObject> objects : register(t0, space0);
+
+struct DrawData
+{
+	uint firstInstance;
+	uint materialIndex;
+};
+RWStructuredBuffer<DrawData> drawData : register(u1, space0);
+
+// Matches VkDrawIndexedIndirectCommand.
+struct DrawIndexedCommand
+{
+	uint indexCount;
+	uint instanceCount;
+	uint firstIndex;
+	int vertexOffset;
+	uint firstInstance;
+};
+RWStructuredBuffer<DrawIndexedCommand> drawCommands : register(u2, space0);
+
+// Draw count of every material range, cleared before the dispatch.
+RWStructuredBuffer<uint> drawCounts : register(u3, space0);
+
+struct CullingData
+{
+	float4x4 viewProj;
+	// World-space frustum planes as (normal, distance), with the normals pointing inwards.
+	float4 frustumPlanes[6];
+	uint objectCount;
+	uint frustumCulling;
+	uint occlusionCulling;
+	uint pyramidMipCount;
+	uint2 depthSize;
+	uint2 padding;
+};
+cbuffer cullingData : register(b4, space0) { CullingData cullingData; }
+
+// (min, max) depth pyramid of the early pass' depth buffer.
+Texture2D<float2> depthPyramid : register(t5, space0);
+
+// Whether every object was visible after the last late pass.
+RWStructuredBuffer<uint> visibility : register(u6, space0);
+
+struct CullingPass
+{
+	uint phase;
+	// Offsets of the pass' output range in the draw buffers and in the draw counts.
+	uint drawOffset;
+	uint countOffset;
+};
+
+[[vk::push_constant]] CullingPass cullingPass;
+
+bool IsInFrustum(float3 boundsMin, float3 boundsMax)
+{
+	for (uint i = 0; i < 6; i++)
+	{
+		float4 plane = cullingData.frustumPlanes[i];
+		// Test the corner that is furthest along the plane normal (the "positive vertex").
+		float3 positive = float3(
+			plane.x > 0.0 ? boundsMax.x : boundsMin.x,
+			plane.y > 0.0 ? boundsMax.y : boundsMin.y,
+			plane.z > 0.0 ? boundsMax.z : boundsMin.z);
+
+		if (dot(plane.xyz, positive) + plane.w < 0.0)
+			return false;
+	}
+
+	return true;
+}
+
+// Projects the box to a screen-space rectangle (min u, min v, max u, max v) and the depth of its closest point.
+// Returns false when part of the box is behind the camera, in which case it can't be tested against the pyramid.
+bool ProjectBox(float3 boundsMin, float3 boundsMax, out float4 uvRect, out float nearestDepth)
+{
+	uvRect = float4(1e30, 1e30, -1e30, -1e30);
+	nearestDepth = 1e30;
+
+	for (uint i = 0; i < 8; i++)
+	{
+		float3 corner = float3(
+			(i & 1) != 0 ? boundsMax.x : boundsMin.x,
+			(i & 2) != 0 ? boundsMax.y : boundsMin.y,
+			(i & 4) != 0 ? boundsMax.z : boundsMin.z);
+
+		float4 clip = mul(cullingData.viewProj, float4(corner, 1.0));
+		if (clip.w <= 1e-5)
+			return false;
+
+		float3 ndc = clip.xyz / clip.w;
+		float2 uv = ndc.xy * 0.5 + 0.5;
+		uvRect.xy = min(uvRect.xy, uv);
+		uvRect.zw = max(uvRect.zw, uv);
+		nearestDepth = min(nearestDepth, ndc.z);
+	}
+
+	return true;
+}
+
+// Same test as DepthRectTest.comp.hlsl and DepthPyramid::IsRectOccluded.
+bool IsRectOccluded(float4 uvRect, float nearestDepth)
+{
+	uint2 size = cullingData.depthSize;
+	uint2 texelMin = min(uint2(max(uvRect.xy, 0.0) * float2(size)), size - 1);
+	uint2 texelMax = min(uint2(max(uvRect.zw, 0.0) * float2(size)), size - 1);
+
+	// Pick the finest level where the rectangle covers at most 2x2 texels. Level N halves the depth buffer N + 1 times.
+	uint level = 0;
+	while (level + 1 < cullingData.pyramidMipCount && any((texelMax >> (level + 1)) - (texelMin >> (level + 1)) > 1))
+		level++;
+
+	uint2 t0 = texelMin >> (level + 1);
+	uint2 t1 = texelMax >> (level + 1);
+	float maxDepth = max(
+		max(depthPyramid.Load(int3(t0.x, t0.y, level)).y, depthPyramid.Load(int3(t1.x, t0.y, level)).y),
+		max(depthPyramid.Load(int3(t0.x, t1.y, level)).y, depthPyramid.Load(int3(t1.x, t1.y, level)).y));
+
+	// The whole rectangle is behind the furthest depth that was drawn there.
+	return nearestDepth > maxDepth;
+}
+
+[numthreads(64, 1, 1)]
+void main(uint3 dispatchId : SV_DispatchThreadID)
+{
+	uint objectIdx = dispatchId.x;
+	if (objectIdx >= cullingData.objectCount)
+		return;
+
+	// The early pass only draws what was visible last frame, the late pass decides about everything else.
+	if (cullingPass.phase == CULL_PHASE_EARLY && visibility[objectIdx] == 0)
+		return;
+
+	DrawObject object = objects[objectIdx];
+	bool visible = cullingData.frustumCulling == 0 || IsInFrustum(object.boundsMin, object.boundsMax);
+
+	// The pyramid of the early pass doesn't exist yet when the early pass itself runs.
+	if (visible && cullingData.occlusionCulling != 0 && cullingPass.phase != CULL_PHASE_EARLY)
+	{
+		float4 uvRect;
+		float nearestDepth;
+		if (ProjectBox(object.boundsMin, object.boundsMax, uvRect, nearestDepth))
+			visible = !IsRectOccluded(uvRect, nearestDepth);
+	}
+
+	if (cullingPass.phase == CULL_PHASE_LATE)
+	{
+		// Objects that were visible last frame and are still in the frustum have already been drawn by the early pass.
+		bool drawnEarly = visibility[objectIdx] != 0;
+		visibility[objectIdx] = visible ? 1 : 0;
+		if (drawnEarly)
+			return;
+	}
+
+	if (!visible)
+		return;
+
+	uint slot;
+	InterlockedAdd(drawCounts[cullingPass.countOffset + object.rangeIdx], 1, slot);
+	uint drawIdx = cullingPass.drawOffset + object.firstDraw + slot;
+
+	DrawData draw;
+	draw.firstInstance = object.instanceIdx;
+	draw.materialIndex = object.materialIndex;
+	drawData[drawIdx] = draw;
+
+	// The draw passes its own index as its first instance, so the vertex shader can find its draw data.
+	DrawIndexedCommand command;
+	command.indexCount = object.indexCount;
+	command.instanceCount = 1;
+	command.firstIndex = object.firstIndex;
+	command.vertexOffset = object.vertexOffset;
+	command.firstInstance = drawIdx;
+	drawCommands[drawIdx] = command;
+}
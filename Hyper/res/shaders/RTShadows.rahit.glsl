@@ -0,0 +1,98 @@
+#version 460 core
+#extension GL_EXT_ray_tracing : require
+#extension GL_EXT_nonuniform_qualifier : require
+#extension GL_EXT_buffer_reference : require
+#extension GL_EXT_shader_explicit_arithmetic_types_int64 : require
+
+layout(binding = 0, set = 0) uniform accelerationStructureEXT accel;
+layout(binding = 1, set = 0, r8) uniform image2D image;
+layout(binding = 2, set = 0) uniform CameraProperties
+{
+    mat4 viewInverse;
+    mat4 projInverse;
+} camera;
+
+struct HitInfo
+{
+    bool hitAnything;
+};
+layout(location = 0) rayPayloadInEXT HitInfo payload;
+hitAttributeEXT vec2 attribs;
+
+layout(push_constant) uniform constants
+{
+    vec3 sunDir;
+    uint frameNr;
+    uint64_t vertexBufferAddress;
+    uint64_t indexBufferAddress;
+    uint64_t geometryBufferAddress;
+    uvec2 pixelStride;
+    uint checkerboard;
+} RTPushConstants;
+
+// Bindless table of every material texture, owned by the MaterialLibrary. Only the slots of loaded textures are written.
+layout(set = 1, binding = 0) uniform sampler2D materialTextures[];
+
+// Matches MaterialData in MaterialLibrary.h.
+struct MaterialData
+{
+    uint albedoTexture;
+    uint normalTexture;
+    float alphaCutoff;
+    uint padding;
+};
+
+layout(std430, set = 1, binding = 1) readonly buffer Materials
+{
+    MaterialData materials[];
+};
+
+// GeometryData in VulkanAccelerationStructure.h: vertexOffset, firstIndex, materialIndex and padding.
+layout(buffer_reference, std430, buffer_reference_align = 16) readonly buffer GeometryData
+{
+    uvec4 value;
+};
+layout(buffer_reference, std430, buffer_reference_align = 4) readonly buffer Indices
+{
+    uint values[];
+};
+layout(buffer_reference, std430, buffer_reference_align = 8) readonly buffer VertexUV
+{
+    vec2 value;
+};
+
+const uint GeometryDataSize = 16;
+// Size of VertexPosNormTex in Vertex.h, and the offset of its uv.
+const uint VertexStride = 56;
+const uint VertexUVOffset = 48;
+
+vec2 LoadUV(uint vertexIdx)
+{
+    return VertexUV(RTPushConstants.vertexBufferAddress + uint64_t(vertexIdx) * VertexStride + VertexUVOffset).value;
+}
+
+// Only runs for geometry that isn't opaque, which is the geometry of masked materials.
+void main()
+{
+    // Instances store the index of their BLAS' first geometry as their custom index.
+    uvec4 geometry = GeometryData(RTPushConstants.geometryBufferAddress + uint64_t(gl_InstanceCustomIndexEXT + gl_GeometryIndexEXT) * GeometryDataSize).value;
+    uint vertexOffset = geometry.x;
+    uint firstIndex = geometry.y + gl_PrimitiveID * 3;
+    MaterialData material = materials[geometry.z];
+
+    // Indices are relative to the mesh's first vertex.
+    Indices indices = Indices(RTPushConstants.indexBufferAddress);
+    uint i0 = indices.values[firstIndex + 0] + vertexOffset;
+    uint i1 = indices.values[firstIndex + 1] + vertexOffset;
+    uint i2 = indices.values[firstIndex + 2] + vertexOffset;
+
+    vec3 barycentrics = vec3(1.0 - attribs.x - attribs.y, attribs.x, attribs.y);
+    vec2 uv = LoadUV(i0) * barycentrics.x + LoadUV(i1) * barycentrics.y + LoadUV(i2) * barycentrics.z;
+
+    // Ray tracing shaders have no derivatives to pick a mip from, and different rays of a wave hit different materials.
+    float alpha = textureLod(materialTextures[nonuniformEXT(material.albedoTexture)], uv, 0.0).a;
+    if (alpha < material.alphaCutoff)
+    {
+        ignoreIntersectionEXT;
+    }
+}
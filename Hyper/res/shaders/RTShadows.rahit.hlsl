@@ -0,0 +1,83 @@
+RaytracingAccelerationStructure accel : register(t0);
+RWTexture2D<float> image : register(u1);
+
+struct CameraProperties
+{
+	float4x4 viewInverse;
+	float4x4 projInverse;
+};
+cbuffer camera : register(b2) { CameraProperties camera; };
+
+struct HitInfo
+{
+	bool hitAnything;
+};
+
+struct Payload
+{
+	[[vk::location(0)]] HitInfo hitInfo;
+};
+
+struct RTPushConstants
+{
+	float3 sunDir;
+	uint frameNr;
+	uint64_t vertexBufferAddress;
+	uint64_t indexBufferAddress;
+	uint64_t geometryBufferAddress;
+	uint2 pixelStride;
+	uint checkerboard;
+};
+[[vk::push_constant]] RTPushConstants pushConstants;
+
+// Bindless table of every material texture, owned by the MaterialLibrary. Only the slots of loaded textures are written.
+Texture2D materialTextures[] : register(t0, space1);
+SamplerState materialSamplers[] : register(s0, space1);
+
+// Matches MaterialData in MaterialLibrary.h.
+struct MaterialData
+{
+	uint albedoTexture;
+	uint normalTexture;
+	float alphaCutoff;
+	uint padding;
+};
+StructuredBuffer<MaterialData> materials : register(t1, space1);
+
+// GeometryData in VulkanAccelerationStructure.h is loaded as a uint4 of vertexOffset, firstIndex, materialIndex and padding.
+static const uint GeometryDataSize = 16;
+// Size of VertexPosNormTex in Vertex.h, and the offset of its uv.
+static const uint VertexStride = 56;
+static const uint VertexUVOffset = 48;
+
+float2 LoadUV(uint vertexIdx)
+{
+	return vk::RawBufferLoad<float2>(pushConstants.vertexBufferAddress + vertexIdx * VertexStride + VertexUVOffset);
+}
+
+// Only runs for geometry that isn't opaque, which is the geometry of masked materials.
+[shader("anyhit")]
+void main(inout Payload payload, in BuiltInTriangleIntersectionAttributes attribs)
+{
+	// Instances store the index of their BLAS' first geometry as their custom index.
+	const uint4 geometry = vk::RawBufferLoad<uint4>(pushConstants.geometryBufferAddress + (InstanceID() + GeometryIndex()) * GeometryDataSize);
+	const uint vertexOffset = geometry.x;
+	const uint firstIndex = geometry.y + PrimitiveIndex() * 3;
+	const MaterialData material = materials[geometry.z];
+
+	// Indices are relative to the mesh's first vertex.
+	const uint i0 = vk::RawBufferLoad<uint>(pushConstants.indexBufferAddress + (firstIndex + 0) * 4) + vertexOffset;
+	const uint i1 = vk::RawBufferLoad<uint>(pushConstants.indexBufferAddress + (firstIndex + 1) * 4) + vertexOffset;
+	const uint i2 = vk::RawBufferLoad<uint>(pushConstants.indexBufferAddress + (firstIndex + 2) * 4) + vertexOffset;
+
+	const float3 barycentrics = float3(1.0 - attribs.barycentrics.x - attribs.barycentrics.y, attribs.barycentrics.x, attribs.barycentrics.y);
+	const float2 uv = LoadUV(i0) * barycentrics.x + LoadUV(i1) * barycentrics.y + LoadUV(i2) * barycentrics.z;
+
+	// Ray tracing shaders have no derivatives to pick a mip from, and different rays of a wave hit different materials.
+	const uint textureIdx = material.albedoTexture;
+	const float alpha = materialTextures[NonUniformResourceIndex(textureIdx)].SampleLevel(materialSamplers[NonUniformResourceIndex(textureIdx)], uv, 0).a;
+	if (alpha < material.alphaCutoff)
+	{
+		IgnoreHit();
+	}
+}
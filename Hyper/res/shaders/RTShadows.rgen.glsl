@@ -1,18 +1,25 @@
 #version 460 core
 #extension GL_EXT_ray_tracing : require
+#extension GL_EXT_samplerless_texture_functions : require
+#extension GL_EXT_shader_explicit_arithmetic_types_int64 : require
 
 layout(binding = 0, set = 0) uniform accelerationStructureEXT accel;
-layout(binding = 1, set = 0, rgba32f) uniform image2D image;
+layout(binding = 1, set = 0, r8) uniform image2D image;
 layout(binding = 2, set = 0) uniform CameraProperties
 {
     mat4 viewInverse;
     mat4 projInverse;
 } camera;
 
+// Depth and world space normals of the geometry pass, the same size as the output image.
+layout(binding = 3, set = 0) uniform texture2D depthImage;
+layout(binding = 4, set = 0) uniform texture2D normalImage;
+// Modes that trace fewer pixels than the output has write here, and the upsample pass fills the output from it.
+layout(binding = 5, set = 0, r8) uniform image2D traceImage;
+
 struct HitInfo
 {
-    float rayT;
-    bool isSecondaryRay;
+    bool hitAnything;
 };
 layout(location = 0) rayPayloadEXT HitInfo payload;
 
@@ -20,27 +27,115 @@ layout(push_constant) uniform constants
 {
     vec3 sunDir;
     uint frameNr;
+    uint64_t vertexBufferAddress;
+    uint64_t indexBufferAddress;
+    uint64_t geometryBufferAddress;
+    uvec2 pixelStride;
+    uint checkerboard;
 } RTPushConstants;
 
-const float FLT_MAX = float(0x7F7FFFFF);
+// Generates a seed for a random number generator from 2 inputs plus a backoff
+// credit: Chris Wyman, from tutorial: http://cwyman.org/code/dxrTutors/tutors/Tutor5/tutorial05.md.html
+uint InitRand(uint val0, uint val1, uint backoff)
+{
+    uint v0 = val0, v1 = val1, s0 = 0;
+
+    for (uint n = 0; n < backoff; n++)
+    {
+        s0 += 0x9e3779b9;
+        v0 += ((v1 << 4) + 0xa341316c) ^ (v1 + s0) ^ ((v1 >> 5) + 0xc8013ea4);
+        v1 += ((v0 << 4) + 0xad90777d) ^ (v0 + s0) ^ ((v0 >> 5) + 0x7e95761e);
+    }
+    return v0;
+}
+
+// Takes our seed, updates it, and returns a pseudorandom float in [0..1]
+// credit: Chris Wyman, from tutorial: http://cwyman.org/code/dxrTutors/tutors/Tutor5/tutorial05.md.html
+float NextRand(inout uint s)
+{
+    s = (1664525u * s + 1013904223u);
+    return float(s & 0x00FFFFFF) / float(0x01000000);
+}
+
+// Returns a random direction on the unit sphere, uniformly distributed.
+// credit: http://corysimon.github.io/articles/uniformdistn-on-sphere/
+vec3 GetRandomOnUnitSphere(inout uint randSeed)
+{
+    const float theta = 2 * 3.14159265f * NextRand(randSeed);
+    const float phi = acos(1 - 2 * NextRand(randSeed));
+    const float x = sin(phi) * cos(theta);
+    const float y = sin(phi) * sin(theta);
+    const float z = cos(phi);
+    return vec3(x, y, z);
+}
+
+// Offset of the shadow ray's origin along the normal, per unit of distance to the camera, because the depth loses precision further away.
+const float NormalOffsetScale = 0.001;
+
+void WriteResult(uvec2 launchIdx, uvec2 pixel, float value)
+{
+    if (all(equal(RTPushConstants.pixelStride, uvec2(1))))
+        imageStore(image, ivec2(pixel), vec4(value));
+    else
+        imageStore(traceImage, ivec2(launchIdx), vec4(value));
+}
 
 void main()
 {
-    const vec2 pixelCenter = vec2(gl_LaunchIDEXT.xy) + vec2(0.5);
-    const vec2 inUV = pixelCenter / vec2(gl_LaunchSizeEXT.xy);
+    uvec2 launchIdx = gl_LaunchIDEXT.xy;
+
+    // Every launch traces one pixel of the output, which is the size of the G-buffer. Matches TracedPixel in RTUpsample.comp.glsl.
+    uvec2 outputSize = uvec2(textureSize(depthImage, 0));
+    uvec2 pixel = launchIdx * RTPushConstants.pixelStride;
+    if (RTPushConstants.checkerboard != 0)
+        pixel.x += (launchIdx.y + RTPushConstants.frameNr) & 1u;
+    if (any(greaterThanEqual(pixel, outputSize)))
+        return;
+
+    // The geometry pass cleared the depth to the far plane, so nothing covers the pixel and the sky is lit.
+    float depth = texelFetch(depthImage, ivec2(pixel), 0).r;
+    if (depth >= 1.0)
+    {
+        WriteResult(launchIdx, pixel, 1.0);
+        return;
+    }
+
+    vec2 pixelCenter = vec2(pixel) + vec2(0.5);
+    vec2 inUV = pixelCenter / vec2(outputSize);
     vec2 d = inUV * 2.0 - 1.0;
 
-    vec4 origin = camera.viewInverse * vec4(0, 0, 0, 1);
-    vec4 target = camera.projInverse * vec4(d.x, d.y, 1, 1);
-    vec4 direction = camera.viewInverse * vec4(normalize(target.xyz), 0);
+    vec4 viewPos = camera.projInverse * vec4(d.x, d.y, depth, 1);
+    vec3 worldPos = (camera.viewInverse * vec4(viewPos.xyz / viewPos.w, 1)).xyz;
+    vec3 cameraPos = (camera.viewInverse * vec4(0, 0, 0, 1)).xyz;
+
+    // Geometry isn't culled, so the back faces of two-sided geometry are visible too. Their normal is turned towards the camera.
+    vec3 normal = normalize(texelFetch(normalImage, ivec2(pixel), 0).xyz * 2.0 - 1.0);
+    if (dot(normal, cameraPos - worldPos) < 0.0)
+        normal = -normal;
+
+    // A surface facing away from the sun shadows itself, there's no need to trace a ray for it.
+    vec3 sunDir = normalize(RTPushConstants.sunDir);
+    if (dot(normal, sunDir) <= 0.0)
+    {
+        WriteResult(launchIdx, pixel, 0.0);
+        return;
+    }
+
+    // TODO: realistic sun shadow "size"
+    // Sun size in the sky (from earth) is 0.53°
+    // Seeded by the output pixel, so every mode traces the same ray for it.
+    uint randSeed = InitRand(pixel.x + pixel.y * outputSize.x, RTPushConstants.frameNr, 16);
+    vec3 randomOffset = GetRandomOnUnitSphere(randSeed);
 
     float tmin = 0.001;
     float tmax = 10000.0;
+    vec3 origin = worldPos + normal * (NormalOffsetScale * length(cameraPos - worldPos));
+    vec3 direction = normalize(sunDir * 10.0 + randomOffset * 0.1);
 
-    payload.isSecondaryRay = false;
+    payload.hitAnything = true;
 
-    traceRayEXT(accel, gl_RayFlagsOpaqueEXT, 0xFF, 0, 0, 0, origin.xyz, tmin, direction.xyz, tmax, 0);
+    // Any hit that the any-hit shader accepts shadows the pixel, so the search ends there. Only the miss shader clears hitAnything.
+    traceRayEXT(accel, gl_RayFlagsTerminateOnFirstHitEXT | gl_RayFlagsSkipClosestHitShaderEXT, 0xFF, 0, 0, 0, origin, tmin, direction, tmax, 0);
 
-    float outputColor = float(payload.rayT == FLT_MAX) * 1.0;
-    imageStore(image, ivec2(gl_LaunchIDEXT.xy), vec4(outputColor));
+    WriteResult(launchIdx, pixel, float(!payload.hitAnything));
 }
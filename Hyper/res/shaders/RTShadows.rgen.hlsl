@@ -8,10 +8,15 @@ struct CameraProperties
 };
 cbuffer camera : register(b2) { CameraProperties camera; };
 
+// Depth and world space normals of the geometry pass, the same size as the output image.
+Texture2D<float> depthImage : register(t3);
+Texture2D<float4> normalImage : register(t4);
+// Modes that trace fewer pixels than the output has write here, and the upsample pass fills the output from it.
+RWTexture2D<float> traceImage : register(u5);
+
 struct HitInfo
 {
 	bool hitAnything;
-	bool isSecondaryRay;
 };
 
 struct Payload
@@ -23,33 +28,130 @@ struct RTPushConstants
 {
 	float3 sunDir;
 	uint frameNr;
+	uint64_t vertexBufferAddress;
+	uint64_t indexBufferAddress;
+	uint64_t geometryBufferAddress;
+	uint2 pixelStride;
+	uint checkerboard;
 };
 [[vk::push_constant]] RTPushConstants pushConstants;
 
+// Generates a seed for a random number generator from 2 inputs plus a backoff
+// credit: Chris Wyman, from tutorial: http://cwyman.org/code/dxrTutors/tutors/Tutor5/tutorial05.md.html
+uint InitRand(uint val0, uint val1, uint backoff = 16)
+{
+	uint v0 = val0, v1 = val1, s0 = 0;
+
+	[unroll]
+	for (uint n = 0; n < backoff; n++)
+	{
+		s0 += 0x9e3779b9;
+		v0 += ((v1 << 4) + 0xa341316c) ^ (v1 + s0) ^ ((v1 >> 5) + 0xc8013ea4);
+		v1 += ((v0 << 4) + 0xad90777d) ^ (v0 + s0) ^ ((v0 >> 5) + 0x7e95761e);
+	}
+	return v0;
+}
+
+// Takes our seed, updates it, and returns a pseudorandom float in [0..1]
+// credit: Chris Wyman, from tutorial: http://cwyman.org/code/dxrTutors/tutors/Tutor5/tutorial05.md.html
+float NextRand(inout uint s)
+{
+	s = (1664525u * s + 1013904223u);
+	return float(s & 0x00FFFFFF) / float(0x01000000);
+}
+
+// Returns a random direction on the unit sphere, uniformly distributed.
+// credit: http://corysimon.github.io/articles/uniformdistn-on-sphere/
+float3 GetRandomOnUnitSphere(inout uint randSeed)
+{
+	const float theta = 2 * 3.14159265f * NextRand(randSeed);
+	const float phi = acos(1 - 2 * NextRand(randSeed));
+	const float x = sin(phi) * cos(theta);
+	const float y = sin(phi) * sin(theta);
+	const float z = cos(phi);
+	return float3(x, y, z);
+}
+
+// Offset of the shadow ray's origin along the normal, per unit of distance to the camera, because the depth loses precision further away.
+static const float NormalOffsetScale = 0.001;
+
+void WriteResult(uint2 launchIdx, uint2 pixel, float value)
+{
+	if (all(pushConstants.pixelStride == 1))
+	{
+		image[pixel] = value;
+	}
+	else
+	{
+		traceImage[launchIdx] = value;
+	}
+}
+
 [shader("raygeneration")]
 void main()
 {
-	const uint3 launchId = DispatchRaysIndex();
-	const uint3 launchSize = DispatchRaysDimensions();
+	const uint2 launchIdx = DispatchRaysIndex().xy;
+
+	// Every launch traces one pixel of the output, which is the size of the G-buffer. Matches TracedPixel in RTUpsample.comp.hlsl.
+	uint2 outputSize;
+	depthImage.GetDimensions(outputSize.x, outputSize.y);
+	uint2 pixel = launchIdx * pushConstants.pixelStride;
+	if (pushConstants.checkerboard != 0)
+	{
+		pixel.x += (launchIdx.y + pushConstants.frameNr) & 1;
+	}
+	if (any(pixel >= outputSize))
+	{
+		return;
+	}
 
-	const float2 pixelCenter = launchId.xy + float2(0.5, 0.5);
-	const float2 inUV = pixelCenter / launchSize.xy;
+	// The geometry pass cleared the depth to the far plane, so nothing covers the pixel and the sky is lit.
+	const float depth = depthImage.Load(int3(pixel, 0));
+	if (depth >= 1.0)
+	{
+		WriteResult(launchIdx, pixel, 1.0);
+		return;
+	}
+
+	const float2 pixelCenter = pixel + float2(0.5, 0.5);
+	const float2 inUV = pixelCenter / outputSize;
 	const float2 d = inUV * 2.0 - 1.0;
 
-	const float4 origin = mul(camera.viewInverse, float4(0, 0, 0, 1));
-	const float4 target = mul(camera.projInverse, float4(d.x, d.y, 1, 1));
-	const float4 direction = mul(camera.viewInverse, float4(normalize(target.xyz), 0));
+	const float4 viewPos = mul(camera.projInverse, float4(d.x, d.y, depth, 1));
+	const float3 worldPos = mul(camera.viewInverse, float4(viewPos.xyz / viewPos.w, 1)).xyz;
+	const float3 cameraPos = mul(camera.viewInverse, float4(0, 0, 0, 1)).xyz;
+
+	// Geometry isn't culled, so the back faces of two-sided geometry are visible too. Their normal is turned towards the camera.
+	float3 normal = normalize(normalImage.Load(int3(pixel, 0)).xyz * 2.0 - 1.0);
+	if (dot(normal, cameraPos - worldPos) < 0.0)
+	{
+		normal = -normal;
+	}
+
+	// A surface facing away from the sun shadows itself, there's no need to trace a ray for it.
+	const float3 sunDir = normalize(pushConstants.sunDir);
+	if (dot(normal, sunDir) <= 0.0)
+	{
+		WriteResult(launchIdx, pixel, 0.0);
+		return;
+	}
+
+	// TODO: realistic sun shadow "size"
+	// Sun size in the sky (from earth) is 0.53°
+	// Seeded by the output pixel, so every mode traces the same ray for it.
+	uint randSeed = InitRand(pixel.x + pixel.y * outputSize.x, pushConstants.frameNr);
+	const float3 randomOffset = GetRandomOnUnitSphere(randSeed);
 
 	Payload payload = (Payload)0;
-	payload.hitInfo.hitAnything = false;
-	payload.hitInfo.isSecondaryRay = false;
+	payload.hitInfo.hitAnything = true;
 
 	RayDesc rayDesc;
-	rayDesc.Origin = origin.xyz;
-	rayDesc.Direction = direction.xyz;
+	rayDesc.Origin = worldPos + normal * (NormalOffsetScale * length(cameraPos - worldPos));
+	rayDesc.Direction = normalize(sunDir * 10.0 + randomOffset * 0.1);
 	rayDesc.TMin = 0.001;
 	rayDesc.TMax = 10000.0;
-	TraceRay(accel, RAY_FLAG_FORCE_OPAQUE, 0xFF, 0, 0, 0, rayDesc, payload);
+	// Any hit that the any-hit shader accepts shadows the pixel, so the search ends there. Only the miss shader clears hitAnything.
+	TraceRay(accel, RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH | RAY_FLAG_SKIP_CLOSEST_HIT_SHADER, 0xFF, 0, 0, 0, rayDesc, payload);
 
-	image[int2(launchId.xy)] = float(!payload.hitInfo.hitAnything) * 1.0;
+	WriteResult(launchIdx, pixel, float(!payload.hitInfo.hitAnything));
 }
\ No newline at end of file
@@ -1,8 +1,9 @@
 #version 460 core
 #extension GL_EXT_ray_tracing : require
+#extension GL_EXT_shader_explicit_arithmetic_types_int64 : require
 
 layout(binding = 0, set = 0) uniform accelerationStructureEXT accel;
-layout(binding = 1, set = 0, rgba32f) uniform image2D image;
+layout(binding = 1, set = 0, r8) uniform image2D image;
 layout(binding = 2, set = 0) uniform CameraProperties
 {
     mat4 viewInverse;
@@ -11,8 +12,7 @@ layout(binding = 2, set = 0) uniform CameraProperties
 
 struct HitInfo
 {
-    float rayT;
-    bool isSecondaryRay;
+    bool hitAnything;
 };
 layout(location = 0) rayPayloadInEXT HitInfo payload;
 
@@ -20,11 +20,14 @@ layout(push_constant) uniform constants
 {
     vec3 sunDir;
     uint frameNr;
+    uint64_t vertexBufferAddress;
+    uint64_t indexBufferAddress;
+    uint64_t geometryBufferAddress;
+    uvec2 pixelStride;
+    uint checkerboard;
 } RTPushConstants;
 
-const float FLT_MAX = float(0x7F7FFFFF);
-
 void main()
 {
-    payload.rayT = FLT_MAX;
+    payload.hitAnything = false;
 }
@@ -11,7 +11,6 @@ cbuffer camera : register(b2) { CameraProperties camera; };
 struct HitInfo
 {
 	bool hitAnything;
-	bool isSecondaryRay;
 };
 
 struct Payload
@@ -23,6 +22,11 @@ struct RTPushConstants
 {
 	float3 sunDir;
 	uint frameNr;
+	uint64_t vertexBufferAddress;
+	uint64_t indexBufferAddress;
+	uint64_t geometryBufferAddress;
+	uint2 pixelStride;
+	uint checkerboard;
 };
 [[vk::push_constant]] RTPushConstants pushConstants;
 
@@ -0,0 +1,113 @@
+#version 460 core
+#extension GL_EXT_samplerless_texture_functions : require
+
+// Fills every pixel of the shadow mask from the pixels the ray tracer traced, when it traced fewer than the mask has.
+// Traced pixels keep their own result. The others blend the traced pixels around them, weighted by how close they are
+// and by how close their depth is, so shadows don't bleed over the edges of the geometry.
+
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+layout(set = 0, binding = 0) uniform texture2D traceImage;
+layout(set = 0, binding = 1) uniform texture2D depthImage;
+layout(set = 0, binding = 2, r8) uniform writeonly image2D outputImage;
+
+layout(push_constant) uniform constants
+{
+    uvec2 outputSize;
+    uvec2 traceSize;
+    uvec2 pixelStride;
+    uint checkerboard;
+    uint frameNr;
+    float zNear;
+    float zFar;
+} UpsampleSettings;
+
+// Relative depth difference at which a traced pixel counts half.
+const float DepthTolerance = 0.01;
+// Traced pixels on the far side of the pixel still count a little, for when the close ones are on another surface.
+const float MinDistanceWeight = 0.01;
+
+// The projection maps the near and far planes to -1 and 1.
+float LinearDepth(float depth)
+{
+    float zNear = UpsampleSettings.zNear;
+    float zFar = UpsampleSettings.zFar;
+    return 2.0 * zNear * zFar / (zFar + zNear - depth * (zFar - zNear));
+}
+
+// Matches the pixel the raygen shader traces for a texel of the trace image.
+ivec2 TracedPixel(ivec2 traceTexel)
+{
+    ivec2 pixel = traceTexel * ivec2(UpsampleSettings.pixelStride);
+    if (UpsampleSettings.checkerboard != 0)
+        pixel.x += (traceTexel.y + int(UpsampleSettings.frameNr)) & 1;
+    return pixel;
+}
+
+void AddSample(ivec2 traceTexel, float linearDepth, float distanceWeight, inout float valueSum, inout float weightSum)
+{
+    if (any(lessThan(traceTexel, ivec2(0))) || any(greaterThanEqual(traceTexel, ivec2(UpsampleSettings.traceSize))))
+        return;
+
+    ivec2 pixel = TracedPixel(traceTexel);
+    if (any(greaterThanEqual(pixel, ivec2(UpsampleSettings.outputSize))))
+        return;
+
+    float depthDifference = abs(LinearDepth(texelFetch(depthImage, pixel, 0).r) - linearDepth) / (linearDepth * DepthTolerance);
+    float weight = max(distanceWeight, MinDistanceWeight) / (1.0 + depthDifference * depthDifference);
+    valueSum += texelFetch(traceImage, traceTexel, 0).r * weight;
+    weightSum += weight;
+}
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(pixel, ivec2(UpsampleSettings.outputSize))))
+        return;
+
+    // The sky is lit, like the raygen shader writes it.
+    float depth = texelFetch(depthImage, pixel, 0).r;
+    if (depth >= 1.0)
+    {
+        imageStore(outputImage, pixel, vec4(1.0));
+        return;
+    }
+    float linearDepth = LinearDepth(depth);
+
+    float valueSum = 0.0;
+    float weightSum = 0.0;
+    if (UpsampleSettings.checkerboard != 0)
+    {
+        ivec2 traceTexel = ivec2(pixel.x / 2, pixel.y);
+        if (TracedPixel(traceTexel) == pixel)
+        {
+            imageStore(outputImage, pixel, vec4(texelFetch(traceImage, traceTexel, 0).r));
+            return;
+        }
+
+        // The traced pixels of the rows above and below are shifted by one, so all four pixels next to this one are traced.
+        AddSample(ivec2((pixel.x - 1) >> 1, pixel.y), linearDepth, 1.0, valueSum, weightSum);
+        AddSample(ivec2((pixel.x + 1) >> 1, pixel.y), linearDepth, 1.0, valueSum, weightSum);
+        AddSample(ivec2(pixel.x >> 1, pixel.y - 1), linearDepth, 1.0, valueSum, weightSum);
+        AddSample(ivec2(pixel.x >> 1, pixel.y + 1), linearDepth, 1.0, valueSum, weightSum);
+    }
+    else
+    {
+        ivec2 stride = ivec2(UpsampleSettings.pixelStride);
+        ivec2 baseTexel = pixel / stride;
+        if (TracedPixel(baseTexel) == pixel)
+        {
+            imageStore(outputImage, pixel, vec4(texelFetch(traceImage, baseTexel, 0).r));
+            return;
+        }
+
+        // The traced pixels on the corners of the block the pixel is in, weighted bilinearly.
+        vec2 t = vec2(pixel - baseTexel * stride) / vec2(stride);
+        AddSample(baseTexel + ivec2(0, 0), linearDepth, (1.0 - t.x) * (1.0 - t.y), valueSum, weightSum);
+        AddSample(baseTexel + ivec2(1, 0), linearDepth, t.x * (1.0 - t.y), valueSum, weightSum);
+        AddSample(baseTexel + ivec2(0, 1), linearDepth, (1.0 - t.x) * t.y, valueSum, weightSum);
+        AddSample(baseTexel + ivec2(1, 1), linearDepth, t.x * t.y, valueSum, weightSum);
+    }
+
+    imageStore(outputImage, pixel, vec4(weightSum > 0.0 ? valueSum / weightSum : 1.0));
+}
@@ -0,0 +1,111 @@
+// Fills every pixel of the shadow mask from the pixels the ray tracer traced, when it traced fewer than the mask has.
+// Traced pixels keep their own result. The others blend the traced pixels around them, weighted by how close they are
+// and by how close their depth is, so shadows don't bleed over the edges of the geometry.
+
+Texture2D<float> traceImage : register(t0, space0);
+Texture2D<float> depthImage : register(t1, space0);
+RWTexture2D<float> outputImage : register(u2, space0);
+
+struct UpsampleSettings
+{
+	uint2 outputSize;
+	uint2 traceSize;
+	uint2 pixelStride;
+	uint checkerboard;
+	uint frameNr;
+	float zNear;
+	float zFar;
+};
+
+[[vk::push_constant]] UpsampleSettings settings;
+
+// Relative depth difference at which a traced pixel counts half.
+static const float DepthTolerance = 0.01;
+// Traced pixels on the far side of the pixel still count a little, for when the close ones are on another surface.
+static const float MinDistanceWeight = 0.01;
+
+// The projection maps the near and far planes to -1 and 1.
+float LinearDepth(float depth)
+{
+	return 2.0 * settings.zNear * settings.zFar / (settings.zFar + settings.zNear - depth * (settings.zFar - settings.zNear));
+}
+
+// Matches the pixel the raygen shader traces for a texel of the trace image.
+int2 TracedPixel(int2 traceTexel)
+{
+	int2 pixel = traceTexel * int2(settings.pixelStride);
+	if (settings.checkerboard != 0)
+	{
+		pixel.x += (traceTexel.y + settings.frameNr) & 1;
+	}
+	return pixel;
+}
+
+void AddSample(int2 traceTexel, float linearDepth, float distanceWeight, inout float valueSum, inout float weightSum)
+{
+	if (any(traceTexel < 0) || any(traceTexel >= int2(settings.traceSize)))
+		return;
+
+	const int2 pixel = TracedPixel(traceTexel);
+	if (any(pixel >= int2(settings.outputSize)))
+		return;
+
+	const float depthDifference = abs(LinearDepth(depthImage.Load(int3(pixel, 0))) - linearDepth) / (linearDepth * DepthTolerance);
+	const float weight = max(distanceWeight, MinDistanceWeight) / (1.0 + depthDifference * depthDifference);
+	valueSum += traceImage.Load(int3(traceTexel, 0)) * weight;
+	weightSum += weight;
+}
+
+[numthreads(8, 8, 1)]
+void main(uint3 dispatchId : SV_DispatchThreadID)
+{
+	const int2 pixel = int2(dispatchId.xy);
+	if (any(pixel >= int2(settings.outputSize)))
+		return;
+
+	// The sky is lit, like the raygen shader writes it.
+	const float depth = depthImage.Load(int3(pixel, 0));
+	if (depth >= 1.0)
+	{
+		outputImage[pixel] = 1.0;
+		return;
+	}
+	const float linearDepth = LinearDepth(depth);
+
+	float valueSum = 0.0;
+	float weightSum = 0.0;
+	if (settings.checkerboard != 0)
+	{
+		const int2 traceTexel = int2(pixel.x / 2, pixel.y);
+		if (all(TracedPixel(traceTexel) == pixel))
+		{
+			outputImage[pixel] = traceImage.Load(int3(traceTexel, 0));
+			return;
+		}
+
+		// The traced pixels of the rows above and below are shifted by one, so all four pixels next to this one are traced.
+		AddSample(int2((pixel.x - 1) >> 1, pixel.y), linearDepth, 1.0, valueSum, weightSum);
+		AddSample(int2((pixel.x + 1) >> 1, pixel.y), linearDepth, 1.0, valueSum, weightSum);
+		AddSample(int2(pixel.x >> 1, pixel.y - 1), linearDepth, 1.0, valueSum, weightSum);
+		AddSample(int2(pixel.x >> 1, pixel.y + 1), linearDepth, 1.0, valueSum, weightSum);
+	}
+	else
+	{
+		const int2 stride = int2(settings.pixelStride);
+		const int2 baseTexel = pixel / stride;
+		if (all(TracedPixel(baseTexel) == pixel))
+		{
+			outputImage[pixel] = traceImage.Load(int3(baseTexel, 0));
+			return;
+		}
+
+		// The traced pixels on the corners of the block the pixel is in, weighted bilinearly.
+		const float2 t = float2(pixel - baseTexel * stride) / float2(stride);
+		AddSample(baseTexel + int2(0, 0), linearDepth, (1.0 - t.x) * (1.0 - t.y), valueSum, weightSum);
+		AddSample(baseTexel + int2(1, 0), linearDepth, t.x * (1.0 - t.y), valueSum, weightSum);
+		AddSample(baseTexel + int2(0, 1), linearDepth, (1.0 - t.x) * t.y, valueSum, weightSum);
+		AddSample(baseTexel + int2(1, 1), linearDepth, t.x * t.y, valueSum, weightSum);
+	}
+
+	outputImage[pixel] = weightSum > 0.0 ? valueSum / weightSum : 1.0;
+}
@@ -1,4 +1,5 @@
 #version 460 core
+#extension GL_EXT_nonuniform_qualifier : require
 
 layout(location = 0) in vec3 inWorldPos;
 layout(location = 1) in vec3 inNormal;
@@ -7,21 +8,38 @@ layout(location = 3) in vec2 inUV;
 layout(location = 4) in vec3 inTangent;
 layout(location = 5) in vec3 inBinormal;
 layout(location = 6) in mat3 inTBN;
+layout(location = 9) flat in uint inMaterialIndex;
 
 layout(location = 0) out vec4 fragColor;
+// World space normal of the surface, packed into [0, 1]. The ray tracer starts its shadow rays from it.
+layout(location = 1) out vec4 outNormal;
 
-layout(set = 1, binding = 0) uniform sampler2D texAlbedo;
-layout(set = 1, binding = 1) uniform sampler2D texNormal;
+// Bindless table of every material texture, owned by the MaterialLibrary. Only the slots of loaded textures are written.
+layout(set = 1, binding = 0) uniform sampler2D materialTextures[];
+
+// Matches MaterialData in MaterialLibrary.h.
+struct MaterialData
+{
+    uint albedoTexture;
+    uint normalTexture;
+    float alphaCutoff;
+    uint padding;
+};
+
+layout(std430, set = 1, binding = 1) readonly buffer Materials
+{
+    MaterialData materials[];
+};
 
 layout(push_constant) uniform constants
 {
-    // Explicit offset to leave room for vertex shader push constant.
-    layout(offset = 64) vec3 sunDir;
+    vec3 sunDir;
 } LightingSettings;
 
-vec3 CalculateWorldNormal()
+vec3 CalculateWorldNormal(MaterialData material)
 {
-    vec3 sampledNormal = texture(texNormal, inUV).xyz;
+    // Multi-draw indirect can put fragments of different draws, and so different materials, in the same subgroup.
+    vec3 sampledNormal = texture(materialTextures[nonuniformEXT(material.normalTexture)], inUV).xyz;
     
     vec3 worldNormal = inTBN * normalize(sampledNormal * 2.0 - 1.0);
 
@@ -30,16 +48,18 @@ vec3 CalculateWorldNormal()
 
 void main()
 {
-    vec4 sampledAlbedo = texture(texAlbedo, inUV).rgba;
+    MaterialData material = materials[inMaterialIndex];
+
+    vec4 sampledAlbedo = texture(materialTextures[nonuniformEXT(material.albedoTexture)], inUV).rgba;
     vec3 albedo = sampledAlbedo.rgb;
     float alpha = sampledAlbedo.a;
 
-    if (alpha < 0.8)
+    if (alpha < material.alphaCutoff)
     {
         discard;
     }
 
-    vec3 normal = CalculateWorldNormal();
+    vec3 normal = CalculateWorldNormal(material);
     
     // Simple HalfLambert diffuse
     float NdotL = max(0.0, dot(normal, normalize(LightingSettings.sunDir)));
@@ -48,4 +68,6 @@ void main()
     vec3 outputColor = albedo * halfLambert;
 
     fragColor = vec4(outputColor, 1.0);
+    // Shadow rays follow the geometry rather than the normal map, which would let them start inside the surface.
+    outNormal = vec4(normalize(inNormal) * 0.5 + 0.5, 1.0);
 }
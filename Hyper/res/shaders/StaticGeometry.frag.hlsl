@@ -6,25 +6,47 @@ struct PSInput
 	[[vk::location(3)]] float2 uv : TEXCOORD0;
 	[[vk::location(4)]] float3 tangent : TANGENT0;
 	[[vk::location(5)]] float3 binormal : BINORMAL0;
+	[[vk::location(6)]] nointerpolation uint materialIndex : MATERIAL0;
 };
 
-Texture2D textureAlbedo : register(t0, space1);
-SamplerState samplerAlbedo : register(s0, space1);
-Texture2D textureNormal : register(t1, space1);
-SamplerState samplerNormal : register(s1, space1);
+// Bindless table of every material texture, owned by the MaterialLibrary. Only the slots of loaded textures are written.
+Texture2D materialTextures[] : register(t0, space1);
+SamplerState materialSamplers[] : register(s0, space1);
+
+// Matches MaterialData in MaterialLibrary.h.
+struct MaterialData
+{
+	uint albedoTexture;
+	uint normalTexture;
+	float alphaCutoff;
+	uint padding;
+};
+StructuredBuffer<MaterialData> materials : register(t1, space1);
 
 struct LightingSettings
 {
-	// Explicit offset to leave room for vertex shader push constant.
-	[[vk::offset(64)]] float3 sunDir;
+	float3 sunDir;
 };
 
 [[vk::push_constant]] LightingSettings lightingSettings;
 
+struct PSOutput
+{
+	float4 color : SV_TARGET0;
+	// World space normal of the surface, packed into [0, 1]. The ray tracer starts its shadow rays from it.
+	float4 normal : SV_TARGET1;
+};
+
 
-float3 CalculateWorldNormal(PSInput input)
+float4 SampleMaterialTexture(uint textureIdx, float2 uv)
 {
-	float3 tangentNormal = normalize(textureNormal.Sample(samplerNormal, input.uv).rgb * 2.0 - 1.0);
+	// Multi-draw indirect can put fragments of different draws, and so different materials, in the same wave.
+	return materialTextures[NonUniformResourceIndex(textureIdx)].Sample(materialSamplers[NonUniformResourceIndex(textureIdx)], uv);
+}
+
+float3 CalculateWorldNormal(PSInput input, MaterialData material)
+{
+	float3 tangentNormal = normalize(SampleMaterialTexture(material.normalTexture, input.uv).rgb * 2.0 - 1.0);
 
 	float3 T = normalize(input.tangent);
 	float3 B = normalize(input.binormal);
@@ -34,20 +56,22 @@ float3 CalculateWorldNormal(PSInput input)
 	return normalize(mul(TBN, tangentNormal));
 }
 
-float4 main(PSInput input) : SV_TARGET
+PSOutput main(PSInput input)
 {
-	float4 sampledAlbedo = textureAlbedo.Sample(samplerAlbedo, input.uv);
+	MaterialData material = materials[input.materialIndex];
+
+	float4 sampledAlbedo = SampleMaterialTexture(material.albedoTexture, input.uv);
 	float3 albedo = sampledAlbedo.rgb;
 	float alpha = sampledAlbedo.a;
 	
 	// albedo *= input.color;
 
-	if (alpha < 0.8)
+	if (alpha < material.alphaCutoff)
 	{
 		discard;
 	}
 
-	float3 normal = CalculateWorldNormal(input);
+	float3 normal = CalculateWorldNormal(input, material);
 
 	// Simple HalfLambert diffuse
 	float NdotL = max(0.0, dot(normal, normalize(lightingSettings.sunDir)));
@@ -55,5 +79,10 @@ float4 main(PSInput input) : SV_TARGET
 
 	// float3 pixelColor = albedo * halfLambert;
 	float3 pixelColor = albedo;
-	return float4(pixelColor, 1.0);
+
+	PSOutput output;
+	output.color = float4(pixelColor, 1.0);
+	// Shadow rays follow the geometry rather than the normal map, which would let them start inside the surface.
+	output.normal = float4(normalize(input.normal) * 0.5 + 0.5, 1.0);
+	return output;
 }
@@ -13,6 +13,8 @@ layout(location = 3) out vec2 outUV;
 layout(location = 4) out vec3 outTangent;
 layout(location = 5) out vec3 outBinormal;
 layout(location = 6) out mat3 outTBN;
+// Index into the material buffer, constant over the draw.
+layout(location = 9) flat out uint outMaterialIndex;
 
 layout(set = 0, binding = 0) uniform CameraData
 {
@@ -21,21 +23,42 @@ layout(set = 0, binding = 0) uniform CameraData
     mat4 viewProj;
 } cameraData;
 
-layout(push_constant) uniform constants
+struct InstanceData
 {
     mat4 modelMatrix;
-} PushConstants;
+};
+
+layout(std430, set = 0, binding = 1) readonly buffer Instances
+{
+    InstanceData instances[];
+};
+
+struct DrawData
+{
+    uint firstInstance;
+    uint materialIndex;
+};
+
+layout(std430, set = 0, binding = 2) readonly buffer Draws
+{
+    DrawData draws[];
+};
 
 void main()
 {
-    mat4 transformMatrix = cameraData.viewProj * PushConstants.modelMatrix;
+    // Every draw uses its index in the draw data buffer as its first instance, and gl_InstanceIndex includes it.
+    DrawData draw = draws[gl_BaseInstance];
+    mat4 modelMatrix = instances[draw.firstInstance + gl_InstanceIndex - gl_BaseInstance].modelMatrix;
+
+    mat4 transformMatrix = cameraData.viewProj * modelMatrix;
     gl_Position = transformMatrix * vec4(inPosition, 1.0);
 
+    outMaterialIndex = draw.materialIndex;
     outColor = vec3(1.0);
     outUV = inUV;
-    outWorldPos = vec3(PushConstants.modelMatrix * vec4(inPosition, 1.0));
+    outWorldPos = vec3(modelMatrix * vec4(inPosition, 1.0));
 
-    mat3 M = mat3(PushConstants.modelMatrix);
+    mat3 M = mat3(modelMatrix);
     vec3 N = inNormal;
     vec3 T = inTangent;
     vec3 B = inBinormal;
@@ -5,6 +5,10 @@ struct VSInput
 	[[vk::location(2)]] float3 tangent : TANGENT0;
 	[[vk::location(3)]] float3 binormal : BINORMAL0;
 	[[vk::location(4)]] float2 uv : TEXCOORD0;
+	// Includes the first instance of the draw.
+	uint instanceId : SV_InstanceID;
+	// Every draw uses its index in the draw data buffer as its first instance.
+	[[vk::builtin("BaseInstance")]] uint drawIdx : BASEINSTANCE;
 };
 
 struct VSOutput
@@ -16,6 +20,8 @@ struct VSOutput
 	[[vk::location(3)]] float2 uv : TEXCOORD0;
 	[[vk::location(4)]] float3 tangent : TANGENT0;
 	[[vk::location(5)]] float3 binormal : BINORMAL0;
+	// Index into the material buffer, constant over the draw.
+	[[vk::location(6)]] nointerpolation uint materialIndex : MATERIAL0;
 };
 
 struct CameraData
@@ -26,25 +32,35 @@ struct CameraData
 };
 cbuffer cameraData : register(b0, space0) { CameraData cameraData; }
 
-struct PushConstants
+struct InstanceData
 {
 	float4x4 modelMatrix;
 };
+StructuredBuffer<InstanceData> instances : register(t1, space0);
 
-[[vk::push_constant]] PushConstants pushConstants;
+struct DrawData
+{
+	uint firstInstance;
+	uint materialIndex;
+};
+StructuredBuffer<DrawData> draws : register(t2, space0);
 
 VSOutput main(VSInput input)
 {
 	VSOutput output = (VSOutput)0;
 
-	float4x4 transformMatrix = mul(cameraData.viewProj, pushConstants.modelMatrix);
+	DrawData draw = draws[input.drawIdx];
+	float4x4 modelMatrix = instances[draw.firstInstance + input.instanceId - input.drawIdx].modelMatrix;
+
+	float4x4 transformMatrix = mul(cameraData.viewProj, modelMatrix);
 	output.position = mul(transformMatrix, float4(input.position, 1.0));
 
+	output.materialIndex = draw.materialIndex;
 	output.color = float3(1.0, 1.0, 1.0);
 	output.uv = input.uv;
-	output.worldPos = mul(float4(input.position, 1.0), pushConstants.modelMatrix).xyz;
+	output.worldPos = mul(float4(input.position, 1.0), modelMatrix).xyz;
 
-	float3x3 M = (float3x3)pushConstants.modelMatrix;
+	float3x3 M = (float3x3)modelMatrix;
 	output.tangent = mul(M, input.tangent);
 	output.binormal = mul(M, input.binormal);
 	output.normal = mul(M, input.normal);
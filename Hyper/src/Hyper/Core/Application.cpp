@@ -2,6 +2,7 @@
 #include "Application.h"
 
 #include "Context.h"
+#include "JobSystem.h"
 #include "Logger.h"
 #include "Window.h"
 #include "Hyper/Debug/Profiler.h"
@@ -18,6 +19,7 @@ namespace Hyper
 		m_pContext = std::make_shared<Context>();
 
 		// Add subsystems. Order matters: first in, first initialized.
+		m_pContext->AddSubsystem<JobSystem>();
 		m_pContext->AddSubsystem<Window>();
 		m_pContext->AddSubsystem<Input>();
 		m_pContext->AddSubsystem<Renderer>();
@@ -0,0 +1,36 @@
+﻿#pragma once
+#include <span>
+
+#include "Hyper/Defines.h"
+
+namespace Hyper::Hash
+{
+	static constexpr u64 s_FnvOffsetBasis = 14695981039346656037ull;
+	static constexpr u64 s_FnvPrime = 1099511628211ull;
+
+	// 64-bit FNV-1a. Unlike std::hash it's the same on every run, so it can name data that's cached on disk.
+	// Pass the result of an earlier call as the seed to hash several ranges as one.
+	inline u64 Fnv1a(const void* pData, size_t size, u64 seed = s_FnvOffsetBasis)
+	{
+		const u8* pBytes = static_cast<const u8*>(pData);
+		u64 hash = seed;
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= pBytes[i];
+			hash *= s_FnvPrime;
+		}
+		return hash;
+	}
+
+	template<typename T>
+	u64 Fnv1a(std::span<const T> values, u64 seed = s_FnvOffsetBasis)
+	{
+		return Fnv1a(values.data(), values.size_bytes(), seed);
+	}
+
+	template<typename T>
+	u64 Fnv1aValue(const T& value, u64 seed = s_FnvOffsetBasis)
+	{
+		return Fnv1a(&value, sizeof(T), seed);
+	}
+}
@@ -0,0 +1,117 @@
+﻿#include "HyperPCH.h"
+#include "JobSystem.h"
+
+#include "Hyper/Debug/Profiler.h"
+
+namespace Hyper
+{
+	JobSystem::JobSystem(Context* pContext)
+		: Subsystem(pContext)
+	{
+	}
+
+	bool JobSystem::OnInitialize()
+	{
+		// Leave one hardware thread for the main thread, which also helps out during ParallelFor.
+		const u32 hardwareThreads = std::max(std::thread::hardware_concurrency(), 2u);
+		const u32 workerCount = hardwareThreads - 1;
+
+		m_IsRunning = true;
+		m_Workers.reserve(workerCount);
+		for (u32 i = 0; i < workerCount; i++)
+		{
+			m_Workers.emplace_back(&JobSystem::WorkerLoop, this, i + 1);
+		}
+
+		HPR_CORE_LOG_INFO("Job system started with {} worker threads", workerCount);
+
+		return true;
+	}
+
+	void JobSystem::OnShutdown()
+	{
+		{
+			std::lock_guard lock(m_JobsMutex);
+			m_IsRunning = false;
+		}
+		m_JobsCondition.notify_all();
+
+		for (std::thread& worker : m_Workers)
+		{
+			worker.join();
+		}
+		m_Workers.clear();
+	}
+
+	void JobSystem::ParallelFor(u32 count, const ParallelForFunc& func)
+	{
+		HPR_PROFILE_SCOPE();
+
+		if (count == 0)
+			return;
+
+		// Shared between all threads working on this loop. It lives on our stack, which is safe because we don't
+		// return before every helper that picked up a job has signalled that it's done touching it.
+		struct LoopState
+		{
+			std::atomic<u32> nextIndex{ 0 };
+			std::atomic<u32> activeHelpers{ 0 };
+			std::mutex doneMutex;
+			std::condition_variable doneCondition;
+		} state;
+
+		const auto runIndices = [&](u32 threadIdx)
+		{
+			for (u32 idx = state.nextIndex.fetch_add(1); idx < count; idx = state.nextIndex.fetch_add(1))
+			{
+				func(idx, threadIdx);
+			}
+		};
+
+		const u32 helperCount = std::min(static_cast<u32>(m_Workers.size()), count - 1);
+		if (helperCount > 0)
+		{
+			state.activeHelpers = helperCount;
+			{
+				std::lock_guard lock(m_JobsMutex);
+				for (u32 i = 0; i < helperCount; i++)
+				{
+					m_Jobs.emplace_back([&](u32 threadIdx)
+					{
+						runIndices(threadIdx);
+
+						std::lock_guard doneLock(state.doneMutex);
+						if (--state.activeHelpers == 0)
+							state.doneCondition.notify_one();
+					});
+				}
+			}
+			m_JobsCondition.notify_all();
+		}
+
+		runIndices(0);
+
+		std::unique_lock doneLock(state.doneMutex);
+		state.doneCondition.wait(doneLock, [&]() { return state.activeHelpers == 0; });
+	}
+
+	void JobSystem::WorkerLoop(u32 threadIdx)
+	{
+		while (true)
+		{
+			std::function<void(u32)> job;
+			{
+				std::unique_lock lock(m_JobsMutex);
+				m_JobsCondition.wait(lock, [this]() { return !m_Jobs.empty() || !m_IsRunning; });
+
+				if (!m_IsRunning && m_Jobs.empty())
+					return;
+
+				job = std::move(m_Jobs.front());
+				m_Jobs.pop_front();
+			}
+
+			job(threadIdx);
+		}
+	}
+}
@@ -0,0 +1,44 @@
+﻿#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "Subsystem.h"
+
+namespace Hyper
+{
+	// Small fixed-size thread pool. The main thread always has thread index 0, worker threads are numbered 1..N,
+	// so systems can keep per-thread data in a plain array of GetThreadCount() elements.
+	class JobSystem final : public Subsystem
+	{
+	public:
+		using ParallelForFunc = std::function<void(u32 index, u32 threadIdx)>;
+
+	public:
+		JobSystem(Context* pContext);
+		virtual ~JobSystem() override = default;
+
+		bool OnInitialize() override;
+		void OnShutdown() override;
+
+		// Runs func for every index in [0, count), spread over the workers and the calling thread.
+		// Blocks until all indices have been processed. Must be called from the main thread, jobs can't spawn more jobs.
+		void ParallelFor(u32 count, const ParallelForFunc& func);
+
+		// Amount of threads that can run jobs, including the main thread.
+		[[nodiscard]] u32 GetThreadCount() const { return static_cast<u32>(m_Workers.size()) + 1; }
+
+	private:
+		void WorkerLoop(u32 threadIdx);
+
+	private:
+		std::vector<std::thread> m_Workers;
+		std::deque<std::function<void(u32)>> m_Jobs;
+		std::mutex m_JobsMutex;
+		std::condition_variable m_JobsCondition;
+		bool m_IsRunning{ false };
+	};
+}
@@ -0,0 +1,374 @@
+﻿#include "HyperPCH.h"
+#include "Benchmarks.h"
+
+#include <random>
+#include <glm/geometric.hpp>
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/ext/matrix_transform.hpp>
+
+#include "Hyper/Renderer/RenderQueue.h"
+#include "Hyper/Scene/DynamicAABBTree.h"
+#include "Hyper/Scene/Frustum.h"
+
+namespace Hyper::Benchmarks
+{
+	using Clock = std::chrono::high_resolution_clock;
+
+	static f64 ToMs(Clock::duration duration)
+	{
+		return std::chrono::duration<f64, std::milli>(duration).count();
+	}
+
+	static void LogQueryResult(const char* name, u32 queryCount, f64 treeMs, f64 bruteForceMs, u64 treeResults, u64 bruteForceResults)
+	{
+		HPR_CORE_LOG_INFO("  {:<10} {:>10.0f} queries/s (brute force {:>10.0f} queries/s, {:.1f}x) - {} results{}",
+			name,
+			queryCount / (treeMs / 1000.0), queryCount / (bruteForceMs / 1000.0), bruteForceMs / treeMs,
+			treeResults, treeResults == bruteForceResults ? "" : fmt::format(" MISMATCH, brute force found {}", bruteForceResults));
+	}
+
+	void RunSpatialIndexBenchmark(u32 objectCount, u32 seed)
+	{
+		static constexpr f32 worldSize = 200.0f;
+		static constexpr u32 frameCount = 60;
+		static constexpr f32 frameTime = 1.0f / 60.0f;
+		static constexpr u32 queryCount = 1000;
+		static constexpr u32 nearestCount = 8;
+
+		std::mt19937 rng{ seed };
+		std::uniform_real_distribution<f32> unit{ 0.0f, 1.0f };
+		const auto randomPoint = [&]() { return glm::vec3{ unit(rng), unit(rng), unit(rng) } * worldSize; };
+		const auto randomDirection = [&]() { return glm::normalize(glm::vec3{ unit(rng), unit(rng), unit(rng) } * 2.0f - 1.0f + glm::vec3{ 0.0f, 0.0f, 1e-4f }); };
+
+		std::vector<AABB> boxes(objectCount);
+		std::vector<glm::vec3> velocities(objectCount);
+		for (u32 i = 0; i < objectCount; i++)
+		{
+			const glm::vec3 center = randomPoint();
+			const glm::vec3 extents = glm::vec3{ 0.25f } + glm::vec3{ unit(rng), unit(rng), unit(rng) } * 1.25f;
+			boxes[i] = AABB{ center - extents, center + extents };
+			velocities[i] = randomDirection() * (unit(rng) * 5.0f);
+		}
+
+		HPR_CORE_LOG_INFO("Spatial index benchmark: {} objects, seed {}", objectCount, seed);
+
+		// Build
+		DynamicAABBTree tree{};
+		std::vector<i32> proxies(objectCount);
+		auto startTime = Clock::now();
+		for (u32 i = 0; i < objectCount; i++)
+		{
+			proxies[i] = tree.CreateProxy(boxes[i], i);
+		}
+		HPR_CORE_LOG_INFO("  build: {:.3f} ms, height {}, area ratio {:.1f}", ToMs(Clock::now() - startTime), tree.GetHeight(), tree.GetAreaRatio());
+
+		// Incremental updates, every object moves every frame.
+		u32 reinsertCount = 0;
+		startTime = Clock::now();
+		for (u32 frame = 0; frame < frameCount; frame++)
+		{
+			for (u32 i = 0; i < objectCount; i++)
+			{
+				const glm::vec3 offset = velocities[i] * frameTime;
+				boxes[i] = AABB{ boxes[i].min + offset, boxes[i].max + offset };
+				if (tree.MoveProxy(proxies[i], boxes[i]))
+					reinsertCount++;
+			}
+		}
+		HPR_CORE_LOG_INFO("  update: {:.3f} ms per frame with all objects moving, {:.1f}% reinserted per frame, height {}, area ratio {:.1f}",
+			ToMs(Clock::now() - startTime) / frameCount, 100.0 * reinsertCount / (static_cast<f64>(frameCount) * objectCount),
+			tree.GetHeight(), tree.GetAreaRatio());
+
+		std::vector<u32> results;
+		results.reserve(objectCount);
+
+		// Frustum queries
+		{
+			glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, worldSize * 0.5f);
+			projection[1][1] *= -1;
+
+			std::vector<Frustum> frustums(queryCount);
+			for (Frustum& frustum : frustums)
+			{
+				const glm::vec3 eye = randomPoint();
+				frustum = Frustum{ projection * glm::lookAtRH(eye, eye + randomDirection(), glm::vec3{ 0.0f, 0.0f, 1.0f }) };
+			}
+
+			u64 treeResults = 0;
+			startTime = Clock::now();
+			for (const Frustum& frustum : frustums)
+			{
+				results.clear();
+				tree.QueryFrustum(frustum, results);
+				treeResults += results.size();
+			}
+			const f64 treeMs = ToMs(Clock::now() - startTime);
+
+			u64 bruteForceResults = 0;
+			startTime = Clock::now();
+			for (const Frustum& frustum : frustums)
+			{
+				for (const AABB& box : boxes)
+				{
+					if (frustum.Intersects(box))
+						bruteForceResults++;
+				}
+			}
+			LogQueryResult("frustum", queryCount, treeMs, ToMs(Clock::now() - startTime), treeResults, bruteForceResults);
+		}
+
+		// AABB overlap queries
+		{
+			std::vector<AABB> queries(queryCount);
+			for (AABB& query : queries)
+			{
+				const glm::vec3 center = randomPoint();
+				query = AABB{ center - glm::vec3{ 5.0f }, center + glm::vec3{ 5.0f } };
+			}
+
+			u64 treeResults = 0;
+			startTime = Clock::now();
+			for (const AABB& query : queries)
+			{
+				results.clear();
+				tree.QueryOverlaps(query, results);
+				treeResults += results.size();
+			}
+			const f64 treeMs = ToMs(Clock::now() - startTime);
+
+			u64 bruteForceResults = 0;
+			startTime = Clock::now();
+			for (const AABB& query : queries)
+			{
+				for (const AABB& box : boxes)
+				{
+					if (box.Overlaps(query))
+						bruteForceResults++;
+				}
+			}
+			LogQueryResult("overlap", queryCount, treeMs, ToMs(Clock::now() - startTime), treeResults, bruteForceResults);
+		}
+
+		// Closest hit ray queries
+		{
+			std::vector<Ray> rays(queryCount);
+			for (Ray& ray : rays)
+			{
+				ray = Ray{ randomPoint(), randomDirection() };
+			}
+
+			static constexpr u32 noHit = ~0u;
+			static constexpr f32 distanceEpsilon = 1e-4f;
+
+			u64 treeResults = 0;
+			std::vector<DynamicAABBTree::RayHit> treeHits(queryCount, DynamicAABBTree::RayHit{ noHit, 0.0f });
+			startTime = Clock::now();
+			for (u32 i = 0; i < queryCount; i++)
+			{
+				if (tree.RaycastClosest(rays[i], worldSize, treeHits[i]))
+					treeResults++;
+			}
+			const f64 treeMs = ToMs(Clock::now() - startTime);
+
+			u64 bruteForceResults = 0;
+			std::vector<DynamicAABBTree::RayHit> bruteForceHits(queryCount, DynamicAABBTree::RayHit{ noHit, 0.0f });
+			startTime = Clock::now();
+			for (u32 i = 0; i < queryCount; i++)
+			{
+				DynamicAABBTree::RayHit& hit = bruteForceHits[i];
+				f32 closest = worldSize;
+				for (u32 j = 0; j < objectCount; j++)
+				{
+					f32 distance;
+					if (boxes[j].IntersectRay(rays[i], closest, distance))
+					{
+						closest = distance;
+						hit = { j, distance };
+					}
+				}
+				if (hit.userData != noHit)
+					bruteForceResults++;
+			}
+			LogQueryResult("raycast", queryCount, treeMs, ToMs(Clock::now() - startTime), treeResults, bruteForceResults);
+
+			// Every ray has to hit the same object at the same distance. Rays starting inside of several boxes hit all of them
+			// at the same distance, so another object is only a mismatch if the ray doesn't hit it at that distance too.
+			u32 mismatchCount = 0;
+			for (u32 i = 0; i < queryCount; i++)
+			{
+				const DynamicAABBTree::RayHit& treeHit = treeHits[i];
+				const DynamicAABBTree::RayHit& bruteForceHit = bruteForceHits[i];
+
+				bool isMatch = treeHit.userData == bruteForceHit.userData;
+				if (treeHit.userData != noHit && bruteForceHit.userData != noHit)
+				{
+					isMatch = std::abs(treeHit.distance - bruteForceHit.distance) <= distanceEpsilon;
+					if (isMatch && treeHit.userData != bruteForceHit.userData)
+					{
+						f32 distance;
+						isMatch = boxes[treeHit.userData].IntersectRay(rays[i], worldSize, distance) &&
+							std::abs(distance - bruteForceHit.distance) <= distanceEpsilon;
+					}
+				}
+				if (!isMatch)
+					mismatchCount++;
+			}
+			if (mismatchCount > 0)
+			{
+				HPR_CORE_LOG_ERROR("  raycast: {} of {} rays hit another object or distance than brute force", mismatchCount, queryCount);
+			}
+		}
+
+		// k-nearest queries
+		{
+			std::vector<glm::vec3> points(queryCount);
+			for (glm::vec3& point : points)
+			{
+				point = randomPoint();
+			}
+
+			u64 treeResults = 0;
+			startTime = Clock::now();
+			for (const glm::vec3& point : points)
+			{
+				results.clear();
+				tree.QueryNearest(point, nearestCount, results);
+				treeResults += results.size();
+			}
+			const f64 treeMs = ToMs(Clock::now() - startTime);
+
+			u64 bruteForceResults = 0;
+			std::vector<std::pair<f32, u32>> distances(objectCount);
+			startTime = Clock::now();
+			for (const glm::vec3& point : points)
+			{
+				for (u32 i = 0; i < objectCount; i++)
+				{
+					distances[i] = { boxes[i].DistanceSquared(point), i };
+				}
+				const u32 k = std::min(nearestCount, objectCount);
+				std::partial_sort(distances.begin(), distances.begin() + k, distances.end());
+				bruteForceResults += k;
+			}
+			LogQueryResult("k-nearest", queryCount, treeMs, ToMs(Clock::now() - startTime), treeResults, bruteForceResults);
+
+			// The counts match for any k objects, so the neighbours themselves are compared by their distances.
+			// Objects at the same distance can come out in either order, their distances can't.
+			u32 mismatchCount = 0;
+			std::vector<f32> treeDistances;
+			for (const glm::vec3& point : points)
+			{
+				results.clear();
+				tree.QueryNearest(point, nearestCount, results);
+				treeDistances.clear();
+				for (const u32 id : results)
+				{
+					treeDistances.push_back(boxes[id].DistanceSquared(point));
+				}
+				std::ranges::sort(treeDistances);
+
+				for (u32 i = 0; i < objectCount; i++)
+				{
+					distances[i] = { boxes[i].DistanceSquared(point), i };
+				}
+				const u32 k = std::min(nearestCount, objectCount);
+				std::partial_sort(distances.begin(), distances.begin() + k, distances.end());
+
+				bool isMatch = treeDistances.size() == k;
+				for (u32 i = 0; isMatch && i < k; i++)
+				{
+					isMatch = treeDistances[i] == distances[i].first;
+				}
+				if (!isMatch)
+					mismatchCount++;
+			}
+			if (mismatchCount > 0)
+			{
+				HPR_CORE_LOG_ERROR("  k-nearest: {} of {} queries found other neighbours than brute force", mismatchCount, queryCount);
+			}
+		}
+	}
+
+	void RunRenderQueueBenchmark(u32 drawCount, u32 materialCount, u32 seed)
+	{
+		static constexpr u32 passCount = 2;
+		static constexpr u32 pipelineCount = 4;
+		static constexpr u32 iterationCount = 20;
+
+		std::mt19937 rng{ seed };
+		std::uniform_int_distribution<u32> pass{ 0, passCount - 1 };
+		std::uniform_int_distribution<u32> pipeline{ 0, pipelineCount - 1 };
+		std::uniform_int_distribution<u32> material{ 0, materialCount - 1 };
+		std::uniform_real_distribution<f32> depth{ 0.1f, 200.0f };
+
+		std::vector<u64> keys(drawCount);
+		for (u64& key : keys)
+		{
+			key = RenderQueue::MakeKey(pass(rng), pipeline(rng), material(rng), depth(rng));
+		}
+
+		// A bind is needed whenever the pipeline or the material differs from the previous draw.
+		const auto countBinds = [](const std::vector<u64>& drawKeys, u32& outPipelineBinds, u32& outMaterialBinds)
+		{
+			outPipelineBinds = 0;
+			outMaterialBinds = 0;
+			for (size_t i = 0; i < drawKeys.size(); i++)
+			{
+				const bool pipelineChanged = i == 0 || RenderQueue::GetPipeline(drawKeys[i]) != RenderQueue::GetPipeline(drawKeys[i - 1])
+					|| RenderQueue::GetPass(drawKeys[i]) != RenderQueue::GetPass(drawKeys[i - 1]);
+				if (pipelineChanged)
+					outPipelineBinds++;
+				if (pipelineChanged || RenderQueue::GetMaterial(drawKeys[i]) != RenderQueue::GetMaterial(drawKeys[i - 1]))
+					outMaterialBinds++;
+			}
+		};
+
+		HPR_CORE_LOG_INFO("Render queue benchmark: {} draws, {} passes, {} pipelines, {} materials, seed {}", drawCount, passCount, pipelineCount, materialCount, seed);
+
+		RenderQueue queue;
+		queue.Reserve(drawCount);
+		f64 radixMs = 0.0;
+		for (u32 iteration = 0; iteration < iterationCount; iteration++)
+		{
+			queue.Clear();
+			for (u32 i = 0; i < drawCount; i++)
+			{
+				queue.Add(keys[i], i);
+			}
+
+			const auto startTime = Clock::now();
+			queue.Sort();
+			radixMs += ToMs(Clock::now() - startTime);
+		}
+
+		std::vector<std::pair<u64, u32>> pairs(drawCount);
+		f64 stdSortMs = 0.0;
+		for (u32 iteration = 0; iteration < iterationCount; iteration++)
+		{
+			for (u32 i = 0; i < drawCount; i++)
+			{
+				pairs[i] = { keys[i], i };
+			}
+
+			const auto startTime = Clock::now();
+			std::sort(pairs.begin(), pairs.end());
+			stdSortMs += ToMs(Clock::now() - startTime);
+		}
+
+		bool isSorted = std::is_sorted(queue.GetKeys().begin(), queue.GetKeys().end());
+		for (u32 i = 0; i < drawCount && isSorted; i++)
+		{
+			isSorted = queue.GetKeys()[i] == pairs[i].first && keys[queue.GetDrawIndices()[i]] == queue.GetKeys()[i];
+		}
+
+		u32 unsortedPipelineBinds, unsortedMaterialBinds, sortedPipelineBinds, sortedMaterialBinds;
+		countBinds(keys, unsortedPipelineBinds, unsortedMaterialBinds);
+		countBinds(queue.GetKeys(), sortedPipelineBinds, sortedMaterialBinds);
+
+		HPR_CORE_LOG_INFO("  radix sort: {:.3f} ms, std::sort: {:.3f} ms ({:.1f}x){}", radixMs / iterationCount, stdSortMs / iterationCount,
+			stdSortMs / radixMs, isSorted ? "" : " - WRONG ORDER");
+		HPR_CORE_LOG_INFO("  pipeline binds: {} unsorted, {} sorted", unsortedPipelineBinds, sortedPipelineBinds);
+		HPR_CORE_LOG_INFO("  material binds: {} unsorted, {} sorted ({} saved)", unsortedMaterialBinds, sortedMaterialBinds,
+			unsortedMaterialBinds - sortedMaterialBinds);
+	}
+}
@@ -0,0 +1,16 @@
+﻿#pragma once
+
+namespace Hyper
+{
+	// CPU benchmarks for the scene systems, that don't need anything loaded. Results are written to the log.
+	namespace Benchmarks
+	{
+		// Fills a DynamicAABBTree with randomly moving boxes, and measures the update cost and the throughput of every
+		// query type. Every query is compared against a brute force loop over all boxes, for both speed and correctness.
+		void RunSpatialIndexBenchmark(u32 objectCount = 10000, u32 seed = 1337);
+
+		// Fills a RenderQueue with random draws, spread over a few passes and pipelines and many materials, and measures
+		// the radix sort against std::sort. Also reports how many pipeline and material binds the sorted order saves.
+		void RunRenderQueueBenchmark(u32 drawCount = 100000, u32 materialCount = 512, u32 seed = 1337);
+	}
+}
@@ -0,0 +1,130 @@
+﻿#include "HyperPCH.h"
+#include "HeadlessChecks.h"
+
+#include <random>
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/ext/matrix_transform.hpp>
+
+#include "Hyper/Renderer/DepthPyramid.h"
+#include "Hyper/Renderer/GpuDrawCuller.h"
+#include "Hyper/Renderer/RenderContext.h"
+#include "Hyper/Renderer/RenderTarget.h"
+#include "Hyper/Renderer/ShaderLibrary.h"
+#include "Hyper/Renderer/UniformRing.h"
+#include "Hyper/Renderer/Vulkan/VulkanDevice.h"
+#include "Hyper/Scene/Frustum.h"
+#include "Hyper/Scene/Scene.h"
+
+namespace Hyper::HeadlessChecks
+{
+	bool RunGpuCullingCheck(u32 objectCount, u32 seed)
+	{
+		static constexpr f32 worldSize = 200.0f;
+		static constexpr u32 materialCount = 16;
+		static constexpr u32 depthSize = 256;
+
+		HPR_CORE_LOG_INFO("GPU culling check: {} objects, seed {}", objectCount, seed);
+
+		std::mt19937 rng{ seed };
+		std::uniform_real_distribution<f32> unit{ 0.0f, 1.0f };
+
+		// The objects are sorted by material like the scene sorts them, so every material is one range of draws.
+		std::vector<GpuDrawObject> objects(objectCount);
+		AABBList boxes{};
+		boxes.Resize(objectCount);
+		u32 rangeCount = 0;
+		for (u32 i = 0; i < objectCount; i++)
+		{
+			const glm::vec3 center = glm::vec3{ unit(rng), unit(rng), unit(rng) } * worldSize;
+			const glm::vec3 extents = glm::vec3{ 0.25f } + glm::vec3{ unit(rng), unit(rng), unit(rng) } * 1.25f;
+			const AABB bounds{ center - extents, center + extents };
+			boxes.Set(i, bounds);
+
+			const u32 rangeIdx = static_cast<u32>(static_cast<u64>(i) * materialCount / objectCount);
+			if (rangeIdx == rangeCount)
+			{
+				objects[i].firstDraw = i;
+				rangeCount++;
+			}
+			else
+			{
+				objects[i].firstDraw = objects[i - 1].firstDraw;
+			}
+
+			objects[i].boundsMin = bounds.min;
+			objects[i].instanceIdx = i;
+			objects[i].boundsMax = bounds.max;
+			objects[i].materialIndex = rangeIdx;
+			objects[i].indexCount = 36;
+			objects[i].rangeIdx = rangeIdx;
+		}
+
+		// Inside of the boxes, at the edge and outside looking in, so the frustum contains everything from none to most of them.
+		glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, worldSize);
+		projection[1][1] *= -1;
+		const std::array cameras{
+			std::pair{ glm::vec3{ 0.5f, 0.5f, 0.5f }, glm::vec3{ 1.0f, 0.2f, 0.1f } },
+			std::pair{ glm::vec3{ 0.5f, 0.5f, 0.5f }, glm::vec3{ -0.3f, 1.0f, -0.4f } },
+			std::pair{ glm::vec3{ 0.0f, 0.0f, 0.0f }, glm::vec3{ 1.0f, 1.0f, 1.0f } },
+			std::pair{ glm::vec3{ -0.5f, 0.5f, 0.5f }, glm::vec3{ 1.0f, 0.0f, 0.0f } },
+			std::pair{ glm::vec3{ -0.5f, 0.5f, 0.5f }, glm::vec3{ -1.0f, 0.0f, 0.0f } },
+		};
+
+		RenderContext renderCtx{};
+		renderCtx.drawImGui = false;
+
+		// Everything that uses the device is destroyed before it.
+		VulkanDevice device{ &renderCtx, true };
+		if (!renderCtx.device)
+		{
+			HPR_CORE_LOG_ERROR("  Failed to create a headless device");
+			return false;
+		}
+
+		u32 mismatchCount = 0;
+		{
+			VulkanCommandPool commandPool{ &renderCtx };
+			renderCtx.commandPool = &commandPool;
+			ShaderLibrary shaderLibrary{ &renderCtx };
+			renderCtx.pShaderLibrary = &shaderLibrary;
+			DescriptorAllocator descriptorAllocator{ renderCtx.device, 1 };
+			renderCtx.pDescriptorAllocator = &descriptorAllocator;
+			UniformRing uniformRing{ &renderCtx, 1 };
+			renderCtx.pUniformRing = &uniformRing;
+
+			// The pyramid is never built, so only frustum culling is checked.
+			RenderTarget depthTarget{ &renderCtx, vk::Format::eR8G8B8A8Unorm, "GPU culling check render target", depthSize, depthSize };
+			DepthPyramid depthPyramid{ &renderCtx, depthTarget.GetDepthImage() };
+			GpuDrawCuller culler{ &renderCtx, 1, &depthPyramid };
+			culler.Upload(0, objects, rangeCount);
+
+			std::vector<u32> visibleIndices;
+			for (const auto& [eye, direction] : cameras)
+			{
+				const glm::vec3 eyePosition = eye * worldSize;
+				const glm::mat4 viewProjection = projection * glm::lookAtRH(eyePosition, eyePosition + direction, glm::vec3{ 0.0f, 0.0f, 1.0f });
+
+				// The GPU is idle after every check, so the uniform ring can start over.
+				uniformRing.BeginFrame(0);
+				const u32 gpuCount = culler.CullAndReadBack(0, viewProjection, false);
+
+				visibleIndices.clear();
+				const u32 cpuCount = Frustum{ viewProjection }.Cull(boxes, visibleIndices);
+
+				HPR_CORE_LOG_INFO("  eye ({:.0f}, {:.0f}, {:.0f}): GPU drew {}, CPU found {} visible{}", eyePosition.x, eyePosition.y, eyePosition.z,
+					gpuCount, cpuCount, gpuCount == cpuCount ? "" : " MISMATCH");
+				if (gpuCount != cpuCount)
+					mismatchCount++;
+			}
+		}
+
+		if (mismatchCount > 0)
+		{
+			HPR_CORE_LOG_ERROR("GPU culling check failed for {} of {} cameras", mismatchCount, cameras.size());
+			return false;
+		}
+
+		HPR_CORE_LOG_INFO("GPU culling check passed for {} cameras", cameras.size());
+		return true;
+	}
+}
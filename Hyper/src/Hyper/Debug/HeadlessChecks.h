@@ -0,0 +1,13 @@
+﻿#pragma once
+
+namespace Hyper
+{
+	// GPU checks that create their own headless device, without a window, swap chain or ImGui, so they can run on any
+	// driver, including a software one. Results are written to the log, and every check returns whether it passed.
+	namespace HeadlessChecks
+	{
+		// Culls a fixed set of random boxes in the GPU culling pass from a few fixed cameras, reads back the draw counts and
+		// compares them with the CPU frustum culling of the same boxes.
+		[[nodiscard]] bool RunGpuCullingCheck(u32 objectCount = 10000, u32 seed = 1337);
+	}
+}
@@ -0,0 +1,350 @@
+﻿#include "HyperPCH.h"
+#include "DepthPyramid.h"
+
+#include "RenderContext.h"
+#include "ShaderLibrary.h"
+#include "Hyper/Debug/Profiler.h"
+#include "Vulkan/VulkanBuffer.h"
+#include "Vulkan/VulkanDebug.h"
+#include "Vulkan/VulkanUtility.h"
+
+namespace Hyper
+{
+	static constexpr u32 s_ReduceGroupSize = 8;
+	static constexpr u32 s_RectTestGroupSize = 64;
+
+	// Matches ReduceSettings in DepthPyramid.comp.hlsl.
+	struct ReduceSettings
+	{
+		glm::uvec2 sourceSize;
+		glm::uvec2 destinationSize;
+		u32 sourceIsDepth;
+	};
+
+	// Matches RectTestSettings in DepthRectTest.comp.hlsl.
+	struct RectTestSettings
+	{
+		glm::uvec2 depthSize;
+		u32 pyramidMipCount;
+		u32 rectCount;
+	};
+
+	DepthPyramid::DepthPyramid(RenderContext* pRenderCtx, VulkanImage* pDepthImage)
+		: m_pRenderCtx(pRenderCtx)
+		, m_pDepthImage(pDepthImage)
+	{
+		m_pReduceShader = m_pRenderCtx->pShaderLibrary->GetShader("DepthPyramid");
+		m_pReducePipeline = std::make_unique<VulkanComputePipeline>(m_pRenderCtx, ComputePipelineSpecification{
+			.debugName = "Depth pyramid pipeline",
+			.pShader = m_pReduceShader,
+			.flags = {}
+		});
+
+		m_pRectTestShader = m_pRenderCtx->pShaderLibrary->GetShader("DepthRectTest");
+		m_pRectTestPipeline = std::make_unique<VulkanComputePipeline>(m_pRenderCtx, ComputePipelineSpecification{
+			.debugName = "Depth rect test pipeline",
+			.pShader = m_pRectTestShader,
+			.flags = {}
+		});
+		m_RectTestDescriptor = m_pRenderCtx->pDescriptorAllocator->Allocate(m_pRectTestShader->GetAllDescriptorSetLayouts()[0]);
+
+		CreateResources();
+	}
+
+	DepthPyramid::~DepthPyramid()
+	{
+		DestroyResources();
+	}
+
+	void DepthPyramid::Resize()
+	{
+		DestroyResources();
+		CreateResources();
+	}
+
+	void DepthPyramid::Build(const vk::CommandBuffer& cmd)
+	{
+		HPR_PROFILE_SCOPE();
+
+		VkDebug::BeginRegion(cmd, "Depth pyramid", { 0.6f, 0.6f, 0.6f, 1.0f });
+
+		m_pDepthImage->TransitionLayout(cmd, vk::AccessFlagBits::eShaderRead, vk::ImageLayout::eGeneral, vk::PipelineStageFlagBits::eComputeShader);
+		m_pPyramid->TransitionLayout(cmd, vk::AccessFlagBits::eShaderWrite, vk::ImageLayout::eGeneral, vk::PipelineStageFlagBits::eComputeShader);
+
+		cmd.bindPipeline(vk::PipelineBindPoint::eCompute, m_pReducePipeline->GetPipeline());
+
+		for (u32 level = 0; level < m_LevelSizes.size(); level++)
+		{
+			ReduceSettings settings{};
+			settings.sourceSize = level == 0 ? m_DepthSize : m_LevelSizes[level - 1];
+			settings.destinationSize = m_LevelSizes[level];
+			settings.sourceIsDepth = level == 0 ? 1 : 0;
+
+			cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_pReducePipeline->GetLayout(), 0, { m_ReduceDescriptors[level] }, {});
+			cmd.pushConstants<ReduceSettings>(m_pReducePipeline->GetLayout(), vk::ShaderStageFlagBits::eCompute, 0, settings);
+			cmd.dispatch((settings.destinationSize.x + s_ReduceGroupSize - 1) / s_ReduceGroupSize,
+				(settings.destinationSize.y + s_ReduceGroupSize - 1) / s_ReduceGroupSize, 1);
+
+			// The next level reads this one. The barrier after the last level is the transition below.
+			if (level + 1 < m_LevelSizes.size())
+			{
+				vk::MemoryBarrier levelBarrier{};
+				levelBarrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+				levelBarrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+				cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, levelBarrier, {}, {});
+			}
+		}
+
+		m_pPyramid->TransitionLayout(cmd, vk::AccessFlagBits::eShaderRead, vk::ImageLayout::eGeneral, vk::PipelineStageFlagBits::eComputeShader);
+		m_pDepthImage->TransitionLayout(cmd, vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+			vk::ImageLayout::eGeneral, vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests);
+
+		VkDebug::EndRegion(cmd);
+	}
+
+	bool DepthPyramid::ProjectBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& viewProjection, DepthRect& outRect)
+	{
+		glm::vec2 uvMin{ std::numeric_limits<f32>::max() };
+		glm::vec2 uvMax{ std::numeric_limits<f32>::lowest() };
+		f32 nearestDepth = std::numeric_limits<f32>::max();
+
+		for (u32 i = 0; i < 8; i++)
+		{
+			const glm::vec3 corner{
+				(i & 1) != 0 ? boundsMax.x : boundsMin.x,
+				(i & 2) != 0 ? boundsMax.y : boundsMin.y,
+				(i & 4) != 0 ? boundsMax.z : boundsMin.z
+			};
+
+			const glm::vec4 clip = viewProjection * glm::vec4{ corner, 1.0f };
+			if (clip.w <= 1e-5f)
+				return false;
+
+			const glm::vec3 ndc = glm::vec3{ clip } / clip.w;
+			const glm::vec2 uv = glm::vec2{ ndc } * 0.5f + 0.5f;
+			uvMin = glm::min(uvMin, uv);
+			uvMax = glm::max(uvMax, uv);
+			nearestDepth = std::min(nearestDepth, ndc.z);
+		}
+
+		outRect = DepthRect{ glm::vec4{ uvMin, uvMax }, nearestDepth, {} };
+		return true;
+	}
+
+	std::vector<bool> DepthPyramid::TestRects(const std::vector<DepthRect>& rects)
+	{
+		HPR_PROFILE_SCOPE();
+
+		const u32 rectCount = static_cast<u32>(rects.size());
+		if (rectCount == 0)
+			return {};
+
+		// Frames in flight could still be building the pyramid, and the descriptor set is rewritten below.
+		VulkanUtils::Check(m_pRenderCtx->device.waitIdle());
+
+		VulkanBuffer rectBuffer{ m_pRenderCtx, rects.data(), rectCount * sizeof(DepthRect), vk::BufferUsageFlagBits::eStorageBuffer,
+			VMA_MEMORY_USAGE_CPU_TO_GPU, "Depth rect test rect buffer" };
+		VulkanBuffer resultBuffer{ m_pRenderCtx, rectCount * sizeof(u32), vk::BufferUsageFlagBits::eStorageBuffer,
+			VMA_MEMORY_USAGE_GPU_TO_CPU, "Depth rect test result buffer" };
+
+		// The writer keeps pointers to the buffer infos until Write.
+		const vk::DescriptorBufferInfo rectInfo{ rectBuffer.GetBuffer(), 0, VK_WHOLE_SIZE };
+		const vk::DescriptorBufferInfo resultInfo{ resultBuffer.GetBuffer(), 0, VK_WHOLE_SIZE };
+
+		DescriptorWriter writer{ m_pRenderCtx->device, m_RectTestDescriptor };
+		writer.WriteBuffer(rectInfo, 1, vk::DescriptorType::eStorageBuffer);
+		writer.WriteBuffer(resultInfo, 2, vk::DescriptorType::eStorageBuffer);
+		writer.Write();
+
+		RectTestSettings settings{};
+		settings.depthSize = m_DepthSize;
+		settings.pyramidMipCount = GetMipCount();
+		settings.rectCount = rectCount;
+
+		const vk::CommandBuffer cmd = m_pRenderCtx->commandPool->GetCommandBuffer();
+		VulkanCommandBuffer::Begin(cmd, vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+
+		cmd.bindPipeline(vk::PipelineBindPoint::eCompute, m_pRectTestPipeline->GetPipeline());
+		cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_pRectTestPipeline->GetLayout(), 0, { m_RectTestDescriptor }, {});
+		cmd.pushConstants<RectTestSettings>(m_pRectTestPipeline->GetLayout(), vk::ShaderStageFlagBits::eCompute, 0, settings);
+		cmd.dispatch((rectCount + s_RectTestGroupSize - 1) / s_RectTestGroupSize, 1, 1);
+
+		vk::MemoryBarrier resultBarrier{};
+		resultBarrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+		resultBarrier.dstAccessMask = vk::AccessFlagBits::eHostRead;
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eHost, {}, resultBarrier, {}, {});
+
+		VulkanCommandBuffer::End(cmd);
+		m_pRenderCtx->graphicsQueue.Submit({}, {}, {}, cmd, nullptr);
+		m_pRenderCtx->graphicsQueue.WaitIdle();
+		m_pRenderCtx->commandPool->FreeCommandBuffer(cmd);
+
+		std::vector<bool> results(rectCount);
+		const u32* pResults = static_cast<const u32*>(resultBuffer.Map());
+		for (u32 i = 0; i < rectCount; i++)
+		{
+			results[i] = pResults[i] != 0;
+		}
+		resultBuffer.Unmap();
+
+		return results;
+	}
+
+	void DepthPyramid::ReadBack()
+	{
+		HPR_PROFILE_SCOPE();
+
+		// Frames in flight could still be building the pyramid.
+		VulkanUtils::Check(m_pRenderCtx->device.waitIdle());
+
+		std::vector<vk::BufferImageCopy> regions;
+		vk::DeviceSize size = 0;
+		for (u32 level = 0; level < m_LevelSizes.size(); level++)
+		{
+			vk::BufferImageCopy region{};
+			region.bufferOffset = size;
+			region.imageSubresource = vk::ImageSubresourceLayers{ vk::ImageAspectFlagBits::eColor, level, 0, 1 };
+			region.imageExtent = vk::Extent3D{ m_LevelSizes[level].x, m_LevelSizes[level].y, 1 };
+			regions.push_back(region);
+
+			size += static_cast<vk::DeviceSize>(m_LevelSizes[level].x) * m_LevelSizes[level].y * sizeof(glm::vec2);
+		}
+
+		VulkanBuffer readbackBuffer{ m_pRenderCtx, size, vk::BufferUsageFlagBits::eTransferDst, VMA_MEMORY_USAGE_GPU_TO_CPU, "Depth pyramid readback buffer" };
+
+		const vk::CommandBuffer cmd = m_pRenderCtx->commandPool->GetCommandBuffer();
+		VulkanCommandBuffer::Begin(cmd, vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+
+		m_pPyramid->TransitionLayout(cmd, vk::AccessFlagBits::eTransferRead, vk::ImageLayout::eGeneral, vk::PipelineStageFlagBits::eTransfer);
+		cmd.copyImageToBuffer(m_pPyramid->GetImage(), vk::ImageLayout::eGeneral, readbackBuffer.GetBuffer(), regions);
+		m_pPyramid->TransitionLayout(cmd, vk::AccessFlagBits::eShaderRead, vk::ImageLayout::eGeneral, vk::PipelineStageFlagBits::eComputeShader);
+
+		vk::MemoryBarrier readbackBarrier{};
+		readbackBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+		readbackBarrier.dstAccessMask = vk::AccessFlagBits::eHostRead;
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, {}, readbackBarrier, {}, {});
+
+		VulkanCommandBuffer::End(cmd);
+		m_pRenderCtx->graphicsQueue.Submit({}, {}, {}, cmd, nullptr);
+		m_pRenderCtx->graphicsQueue.WaitIdle();
+		m_pRenderCtx->commandPool->FreeCommandBuffer(cmd);
+
+		m_ReadbackLevels.resize(m_LevelSizes.size());
+		const glm::vec2* pTexels = static_cast<const glm::vec2*>(readbackBuffer.Map());
+		for (u32 level = 0; level < m_LevelSizes.size(); level++)
+		{
+			const u32 texelCount = m_LevelSizes[level].x * m_LevelSizes[level].y;
+			m_ReadbackLevels[level].assign(pTexels, pTexels + texelCount);
+			pTexels += texelCount;
+		}
+		readbackBuffer.Unmap();
+	}
+
+	bool DepthPyramid::IsRectOccluded(const DepthRect& rect) const
+	{
+		if (m_ReadbackLevels.empty())
+			return false;
+
+		const glm::uvec2 texelMin = glm::min(glm::uvec2{ glm::max(glm::vec2{ rect.uvRect.x, rect.uvRect.y }, 0.0f) * glm::vec2{ m_DepthSize } }, m_DepthSize - 1u);
+		const glm::uvec2 texelMax = glm::min(glm::uvec2{ glm::max(glm::vec2{ rect.uvRect.z, rect.uvRect.w }, 0.0f) * glm::vec2{ m_DepthSize } }, m_DepthSize - 1u);
+
+		// Pick the finest level where the rectangle covers at most 2x2 texels. Level N halves the depth buffer N + 1 times.
+		u32 level = 0;
+		while (level + 1 < m_ReadbackLevels.size()
+			&& ((texelMax.x >> (level + 1)) - (texelMin.x >> (level + 1)) > 1 || (texelMax.y >> (level + 1)) - (texelMin.y >> (level + 1)) > 1))
+		{
+			level++;
+		}
+
+		const glm::uvec2 t0 = texelMin >> (level + 1);
+		const glm::uvec2 t1 = texelMax >> (level + 1);
+		const std::vector<glm::vec2>& texels = m_ReadbackLevels[level];
+		const u32 width = m_LevelSizes[level].x;
+		const f32 maxDepth = std::max(
+			std::max(texels[t0.y * width + t0.x].y, texels[t0.y * width + t1.x].y),
+			std::max(texels[t1.y * width + t0.x].y, texels[t1.y * width + t1.x].y));
+
+		// The whole rectangle is behind the furthest depth that was drawn there.
+		return rect.nearestDepth > maxDepth;
+	}
+
+	void DepthPyramid::CreateResources()
+	{
+		m_DepthSize = glm::uvec2{ m_pDepthImage->GetWidth(), m_pDepthImage->GetHeight() };
+
+		m_LevelSizes.clear();
+		glm::uvec2 levelSize = m_DepthSize;
+		do
+		{
+			levelSize = (levelSize + 1u) / 2u;
+			m_LevelSizes.push_back(levelSize);
+		} while (levelSize.x > 1 || levelSize.y > 1);
+
+		m_pPyramid = std::make_unique<VulkanImage>(m_pRenderCtx, vk::Format::eR32G32Sfloat, vk::ImageType::e2D,
+			vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferSrc,
+			vk::ImageAspectFlagBits::eColor, "Depth pyramid", m_LevelSizes[0].x, m_LevelSizes[0].y, 1, GetMipCount());
+
+		vk::ImageViewCreateInfo viewInfo{};
+		viewInfo.viewType = vk::ImageViewType::e2D;
+		viewInfo.image = m_pDepthImage->GetImage();
+		viewInfo.format = m_pDepthImage->GetFormat();
+		viewInfo.subresourceRange = vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eDepth, 0, 1, 0, 1 };
+		m_DepthView = VulkanUtils::Check(m_pRenderCtx->device.createImageView(viewInfo));
+		VkDebug::SetObjectName(m_pRenderCtx->device, vk::ObjectType::eImageView, m_DepthView, "Depth pyramid source view");
+
+		viewInfo.image = m_pPyramid->GetImage();
+		viewInfo.format = m_pPyramid->GetFormat();
+		for (u32 level = 0; level < m_LevelSizes.size(); level++)
+		{
+			viewInfo.subresourceRange = vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, level, 1, 0, 1 };
+			m_LevelViews.push_back(VulkanUtils::Check(m_pRenderCtx->device.createImageView(viewInfo)));
+			VkDebug::SetObjectName(m_pRenderCtx->device, vk::ObjectType::eImageView, m_LevelViews.back(), fmt::format("Depth pyramid level {} view", level));
+		}
+
+		// Every level reads the level above it (or the depth image) and writes the level itself.
+		const vk::DescriptorSetLayout reduceLayout = m_pReduceShader->GetAllDescriptorSetLayouts()[0];
+		while (m_ReduceDescriptors.size() < m_LevelSizes.size())
+		{
+			m_ReduceDescriptors.push_back(m_pRenderCtx->pDescriptorAllocator->Allocate(reduceLayout));
+		}
+		for (u32 level = 0; level < m_LevelSizes.size(); level++)
+		{
+			const vk::DescriptorImageInfo sourceInfo{ {}, level == 0 ? m_DepthView : m_LevelViews[level - 1], vk::ImageLayout::eGeneral };
+			const vk::DescriptorImageInfo destinationInfo{ {}, m_LevelViews[level], vk::ImageLayout::eGeneral };
+
+			DescriptorWriter writer{ m_pRenderCtx->device, m_ReduceDescriptors[level] };
+			writer.WriteImage(sourceInfo, 0, vk::DescriptorType::eSampledImage);
+			writer.WriteImage(destinationInfo, 1, vk::DescriptorType::eStorageImage);
+			writer.Write();
+		}
+
+		// The rect test set outlives the pyramid, so it's pointed at the new image.
+		const vk::DescriptorImageInfo pyramidInfo{ {}, m_pPyramid->GetImageView(), vk::ImageLayout::eGeneral };
+		DescriptorWriter writer{ m_pRenderCtx->device, m_RectTestDescriptor };
+		writer.WriteImage(pyramidInfo, 0, vk::DescriptorType::eSampledImage);
+		writer.Write();
+
+		// The pyramid is never in any other layout, and starts out readable so it can be bound before it's first built.
+		const vk::CommandBuffer cmd = m_pRenderCtx->commandPool->GetCommandBuffer();
+		VulkanCommandBuffer::Begin(cmd, vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+		m_pPyramid->TransitionLayout(cmd, vk::AccessFlagBits::eShaderRead, vk::ImageLayout::eGeneral, vk::PipelineStageFlagBits::eComputeShader);
+		VulkanCommandBuffer::End(cmd);
+		m_pRenderCtx->graphicsQueue.Submit({}, {}, {}, cmd, nullptr);
+		m_pRenderCtx->graphicsQueue.WaitIdle();
+		m_pRenderCtx->commandPool->FreeCommandBuffer(cmd);
+
+		m_ReadbackLevels.clear();
+	}
+
+	void DepthPyramid::DestroyResources()
+	{
+		for (const vk::ImageView& view : m_LevelViews)
+		{
+			m_pRenderCtx->device.destroyImageView(view);
+		}
+		m_LevelViews.clear();
+		m_pRenderCtx->device.destroyImageView(m_DepthView);
+
+		m_pPyramid.reset();
+	}
+}
@@ -0,0 +1,86 @@
+﻿#pragma once
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+#include <vulkan/vulkan.hpp>
+
+#include "Vulkan/VulkanDescriptors.h"
+#include "Vulkan/VulkanImage.h"
+#include "Vulkan/VulkanPipeline.h"
+
+namespace Hyper
+{
+	struct RenderContext;
+
+	// Screen-space rectangle to test against the depth pyramid, matches DepthRect in DepthRectTest.comp.hlsl.
+	struct DepthRect
+	{
+		// (min u, min v, max u, max v) over the depth buffer.
+		glm::vec4 uvRect;
+		// Depth of the closest point inside of the rectangle.
+		f32 nearestDepth;
+		u32 padding[3];
+	};
+
+	// Hierarchical-Z pyramid of a depth buffer, where every texel holds the (min, max) depth of the 2x2 texels below it.
+	// Level 0 is half the size of the depth buffer, and sizes are rounded up when halving, so every texel covers all of the
+	// depth texels below it and a rectangle can be tested conservatively with four texel reads on a single level.
+	// The pyramid always stays in the general layout, so it can be written by the build pass and read by any compute shader.
+	class DepthPyramid
+	{
+	public:
+		DepthPyramid(RenderContext* pRenderCtx, VulkanImage* pDepthImage);
+		~DepthPyramid();
+
+		// Recreates the pyramid after the depth image was resized. The GPU must be idle.
+		void Resize();
+
+		// Builds every level from the depth image, which has to be in the general layout and contain the depth that was just drawn.
+		// Leaves the pyramid readable by compute shaders, and the depth image ready to be drawn to again.
+		void Build(const vk::CommandBuffer& cmd);
+
+		// Projects a world-space box onto the depth buffer. Returns false when part of the box is behind the camera,
+		// which means it can't be tested against the pyramid.
+		[[nodiscard]] static bool ProjectBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& viewProjection, DepthRect& outRect);
+
+		// Tests the rectangles against the last built pyramid in a submit of its own, and waits for the results.
+		[[nodiscard]] std::vector<bool> TestRects(const std::vector<DepthRect>& rects);
+
+		// Copies the last built pyramid to the CPU, for IsRectOccluded. Waits for the GPU to be idle.
+		void ReadBack();
+		// Same test as the GPU, against the pyramid of the last ReadBack. Rectangles are never occluded before the first one.
+		[[nodiscard]] bool IsRectOccluded(const DepthRect& rect) const;
+
+		[[nodiscard]] vk::ImageView GetImageView() const { return m_pPyramid->GetImageView(); }
+		[[nodiscard]] glm::uvec2 GetDepthSize() const { return m_DepthSize; }
+		[[nodiscard]] u32 GetMipCount() const { return static_cast<u32>(m_LevelSizes.size()); }
+
+	private:
+		void CreateResources();
+		void DestroyResources();
+
+	private:
+		RenderContext* m_pRenderCtx;
+		VulkanImage* m_pDepthImage;
+
+		VulkanShader* m_pReduceShader;
+		VulkanShader* m_pRectTestShader;
+		std::unique_ptr<VulkanComputePipeline> m_pReducePipeline;
+		std::unique_ptr<VulkanComputePipeline> m_pRectTestPipeline;
+
+		glm::uvec2 m_DepthSize{};
+		std::vector<glm::uvec2> m_LevelSizes;
+		std::unique_ptr<VulkanImage> m_pPyramid;
+		// The depth image's own view includes the stencil aspect, which can't be sampled.
+		vk::ImageView m_DepthView;
+		std::vector<vk::ImageView> m_LevelViews;
+
+		vk::DescriptorSet m_RectTestDescriptor;
+		// One set per level, only rewritten when the pyramid is recreated. Persistent sets can't be freed, so they're kept
+		// when the pyramid shrinks and reused when it grows again.
+		std::vector<vk::DescriptorSet> m_ReduceDescriptors;
+
+		std::vector<std::vector<glm::vec2>> m_ReadbackLevels;
+	};
+}
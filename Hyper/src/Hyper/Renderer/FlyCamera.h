@@ -26,6 +26,8 @@ namespace Hyper
 		[[nodiscard]] glm::mat4 GetProjectionInverse() const { return m_ProjectionI; }
 		[[nodiscard]] glm::mat4 GetViewProjection() const { return m_ViewProjection; }
 		[[nodiscard]] glm::mat4 GetViewProjectionInverse() const { return m_ViewProjectionI; }
+		[[nodiscard]] f32 GetZNear() const { return m_ZNear; }
+		[[nodiscard]] f32 GetZFar() const { return m_ZFar; }
 
 	private:
 		Context* m_pContext;
@@ -0,0 +1,111 @@
+﻿#include "HyperPCH.h"
+#include "GeometryPool.h"
+
+#include <bit>
+
+#include "RenderContext.h"
+#include "Hyper/Debug/Profiler.h"
+#include "Vulkan/VulkanUtility.h"
+
+namespace Hyper
+{
+	static constexpr vk::BufferUsageFlags s_VertexBufferUsage = vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst
+		| vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR;
+	static constexpr vk::BufferUsageFlags s_IndexBufferUsage = vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst
+		| vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR;
+
+	GeometryPool::GeometryPool(RenderContext* pRenderCtx, u32 vertexCapacity, u32 indexCapacity)
+		: m_pRenderCtx(pRenderCtx)
+		, m_VertexCapacity(vertexCapacity)
+		, m_IndexCapacity(indexCapacity)
+	{
+		m_pVertexBuffer = std::make_unique<VulkanBuffer>(m_pRenderCtx, m_VertexCapacity * sizeof(VertexPosNormTex), s_VertexBufferUsage,
+			VMA_MEMORY_USAGE_GPU_ONLY, "Geometry pool vertex buffer");
+		m_pIndexBuffer = std::make_unique<VulkanBuffer>(m_pRenderCtx, m_IndexCapacity * sizeof(u32), s_IndexBufferUsage,
+			VMA_MEMORY_USAGE_GPU_ONLY, "Geometry pool index buffer");
+	}
+
+	GeometryPool::Allocation GeometryPool::Upload(const std::vector<VertexPosNormTex>& vertices, const std::vector<u32>& indices)
+	{
+		HPR_PROFILE_SCOPE();
+
+		const u32 vertexCount = static_cast<u32>(vertices.size());
+		const u32 indexCount = static_cast<u32>(indices.size());
+
+		if (m_VertexCount + vertexCount > m_VertexCapacity)
+		{
+			const u32 newCapacity = std::bit_ceil(m_VertexCount + vertexCount);
+			Grow(m_pVertexBuffer, m_VertexCount * sizeof(VertexPosNormTex), newCapacity * sizeof(VertexPosNormTex), s_VertexBufferUsage, "Geometry pool vertex buffer");
+			m_VertexCapacity = newCapacity;
+		}
+
+		if (m_IndexCount + indexCount > m_IndexCapacity)
+		{
+			const u32 newCapacity = std::bit_ceil(m_IndexCount + indexCount);
+			Grow(m_pIndexBuffer, m_IndexCount * sizeof(u32), newCapacity * sizeof(u32), s_IndexBufferUsage, "Geometry pool index buffer");
+			m_IndexCapacity = newCapacity;
+		}
+
+		const Allocation allocation{ m_VertexCount, vertexCount, m_IndexCount, indexCount };
+
+		// Vertices and indices share a single staging buffer, so both are copied with one submit.
+		const vk::DeviceSize vertexSize = vertexCount * sizeof(VertexPosNormTex);
+		const vk::DeviceSize indexSize = indexCount * sizeof(u32);
+		if (vertexSize + indexSize > 0)
+		{
+			VulkanBuffer staging{ m_pRenderCtx, vertexSize + indexSize, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_ONLY, "Geometry pool staging buffer" };
+			u8* pMapped = static_cast<u8*>(staging.Map());
+			memcpy(pMapped, vertices.data(), vertexSize);
+			memcpy(pMapped + vertexSize, indices.data(), indexSize);
+			staging.Unmap();
+
+			const vk::CommandBuffer cmd = m_pRenderCtx->commandPool->GetCommandBuffer();
+			VulkanCommandBuffer::Begin(cmd, vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+
+			if (vertexSize > 0)
+				cmd.copyBuffer(staging.GetBuffer(), m_pVertexBuffer->GetBuffer(), vk::BufferCopy{ 0, allocation.vertexOffset * sizeof(VertexPosNormTex), vertexSize });
+			if (indexSize > 0)
+				cmd.copyBuffer(staging.GetBuffer(), m_pIndexBuffer->GetBuffer(), vk::BufferCopy{ vertexSize, allocation.firstIndex * sizeof(u32), indexSize });
+
+			VulkanCommandBuffer::End(cmd);
+			m_pRenderCtx->graphicsQueue.Submit({}, {}, {}, cmd, nullptr);
+			m_pRenderCtx->graphicsQueue.WaitIdle();
+			m_pRenderCtx->commandPool->FreeCommandBuffer(cmd);
+		}
+
+		m_VertexCount += vertexCount;
+		m_IndexCount += indexCount;
+
+		return allocation;
+	}
+
+	void GeometryPool::Bind(const vk::CommandBuffer& cmd) const
+	{
+		cmd.bindVertexBuffers(0, { m_pVertexBuffer->GetBuffer() }, { 0 });
+		cmd.bindIndexBuffer(m_pIndexBuffer->GetBuffer(), 0, vk::IndexType::eUint32);
+	}
+
+	void GeometryPool::Grow(std::unique_ptr<VulkanBuffer>& pBuffer, vk::DeviceSize usedSize, vk::DeviceSize newSize, vk::BufferUsageFlags usage, const std::string& name)
+	{
+		HPR_PROFILE_SCOPE();
+
+		HPR_VKLOG_INFO("Growing '{}' to {:.2f} MB", name, static_cast<f64>(newSize) / (1024.0 * 1024.0));
+
+		// Frames in flight could still be reading from the old buffer.
+		VulkanUtils::Check(m_pRenderCtx->device.waitIdle());
+
+		auto pNewBuffer = std::make_unique<VulkanBuffer>(m_pRenderCtx, newSize, usage, VMA_MEMORY_USAGE_GPU_ONLY, name);
+		if (usedSize > 0)
+		{
+			const vk::CommandBuffer cmd = m_pRenderCtx->commandPool->GetCommandBuffer();
+			VulkanCommandBuffer::Begin(cmd, vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+			cmd.copyBuffer(pBuffer->GetBuffer(), pNewBuffer->GetBuffer(), vk::BufferCopy{ 0, 0, usedSize });
+			VulkanCommandBuffer::End(cmd);
+			m_pRenderCtx->graphicsQueue.Submit({}, {}, {}, cmd, nullptr);
+			m_pRenderCtx->graphicsQueue.WaitIdle();
+			m_pRenderCtx->commandPool->FreeCommandBuffer(cmd);
+		}
+
+		pBuffer = std::move(pNewBuffer);
+	}
+}
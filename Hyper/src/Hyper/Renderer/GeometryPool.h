@@ -0,0 +1,56 @@
+﻿#pragma once
+#include <vulkan/vulkan.hpp>
+
+#include "Vulkan/Vertex.h"
+#include "Vulkan/VulkanBuffer.h"
+
+namespace Hyper
+{
+	struct RenderContext;
+
+	// Shared vertex and index buffer that all meshes are uploaded into. Draws of different meshes then only differ in their
+	// offsets into these buffers, so any number of them can be issued with a single multi-draw indirect call.
+	// Meshes live as long as the scene, so allocations are never freed. When a buffer is full it's replaced by one twice as large.
+	class GeometryPool
+	{
+	public:
+		struct Allocation
+		{
+			// Added to every index of the mesh, the indices themselves stay relative to the mesh's first vertex.
+			u32 vertexOffset;
+			u32 vertexCount;
+			u32 firstIndex;
+			u32 indexCount;
+		};
+
+	public:
+		explicit GeometryPool(RenderContext* pRenderCtx, u32 vertexCapacity = 1 << 18, u32 indexCapacity = 1 << 20);
+		~GeometryPool() = default;
+
+		// Copies the geometry to the end of the pool. Blocks until the upload is done.
+		[[nodiscard]] Allocation Upload(const std::vector<VertexPosNormTex>& vertices, const std::vector<u32>& indices);
+
+		void Bind(const vk::CommandBuffer& cmd) const;
+
+		// The buffers are replaced when the pool grows, so their addresses shouldn't be kept around.
+		[[nodiscard]] VulkanBuffer* GetVertexBuffer() const { return m_pVertexBuffer.get(); }
+		[[nodiscard]] VulkanBuffer* GetIndexBuffer() const { return m_pIndexBuffer.get(); }
+
+		[[nodiscard]] u32 GetVertexCount() const { return m_VertexCount; }
+		[[nodiscard]] u32 GetIndexCount() const { return m_IndexCount; }
+
+	private:
+		// Replaces the buffer by a larger one, and copies over the first usedSize bytes.
+		void Grow(std::unique_ptr<VulkanBuffer>& pBuffer, vk::DeviceSize usedSize, vk::DeviceSize newSize, vk::BufferUsageFlags usage, const std::string& name);
+
+	private:
+		RenderContext* m_pRenderCtx;
+
+		std::unique_ptr<VulkanBuffer> m_pVertexBuffer;
+		std::unique_ptr<VulkanBuffer> m_pIndexBuffer;
+		u32 m_VertexCapacity;
+		u32 m_IndexCapacity;
+		u32 m_VertexCount{};
+		u32 m_IndexCount{};
+	};
+}
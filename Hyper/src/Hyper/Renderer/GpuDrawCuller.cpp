@@ -0,0 +1,293 @@
+﻿#include "HyperPCH.h"
+#include "GpuDrawCuller.h"
+
+#include <bit>
+
+#include "DepthPyramid.h"
+#include "RenderContext.h"
+#include "ShaderLibrary.h"
+#include "UniformRing.h"
+#include "Hyper/Debug/Profiler.h"
+#include "Hyper/Scene/Frustum.h"
+#include "Hyper/Scene/Scene.h"
+#include "Vulkan/VulkanDebug.h"
+#include "Vulkan/VulkanUtility.h"
+
+namespace Hyper
+{
+	static constexpr u32 s_GroupSize = 64;
+	static constexpr u32 s_MinObjectCapacity = 1024;
+	static constexpr u32 s_MinRangeCapacity = 64;
+
+	// Matches CullingData in DrawCulling.comp.hlsl.
+	struct CullingData
+	{
+		glm::mat4 viewProj;
+		std::array<glm::vec4, Frustum::Plane::Count> frustumPlanes;
+		u32 objectCount;
+		u32 frustumCulling;
+		u32 occlusionCulling;
+		u32 pyramidMipCount;
+		glm::uvec2 depthSize;
+		glm::uvec2 padding;
+	};
+
+	// Matches CullingPass in DrawCulling.comp.hlsl.
+	struct CullingPass
+	{
+		CullPhase phase;
+		u32 drawOffset;
+		u32 countOffset;
+	};
+
+	GpuDrawCuller::GpuDrawCuller(RenderContext* pRenderCtx, u32 frameCount, const DepthPyramid* pDepthPyramid)
+		: m_pRenderCtx(pRenderCtx)
+		, m_pDepthPyramid(pDepthPyramid)
+	{
+		VulkanShader* pShader = m_pRenderCtx->pShaderLibrary->GetShader("DrawCulling");
+
+		m_pPipeline = std::make_unique<VulkanComputePipeline>(m_pRenderCtx, ComputePipelineSpecification{
+			.debugName = "Draw culling pipeline",
+			.pShader = pShader,
+			.flags = {}
+		});
+
+		m_Frames.resize(frameCount);
+		for (u32 i = 0; i < frameCount; i++)
+		{
+			FrameResources& frame = m_Frames[i];
+			frame.descriptor = m_pRenderCtx->pDescriptorAllocator->Allocate(pShader->GetAllDescriptorSetLayouts()[0]);
+
+			const vk::DescriptorBufferInfo settingsInfo = m_pRenderCtx->pUniformRing->GetDescriptorInfo<CullingData>(i);
+			DescriptorWriter writer{ m_pRenderCtx->device, frame.descriptor };
+			writer.WriteBuffer(settingsInfo, 4, vk::DescriptorType::eUniformBufferDynamic);
+			writer.Write();
+
+			ResizeObjectBuffers(frame, 0, i);
+			ResizeCountBuffers(frame, 0, i);
+		}
+
+		ResizeVisibilityBuffer(0);
+		UpdateDepthPyramid();
+	}
+
+	bool GpuDrawCuller::Upload(u32 frameIdx, const std::vector<GpuDrawObject>& objects, u32 rangeCount)
+	{
+		HPR_PROFILE_SCOPE();
+
+		FrameResources& frame = m_Frames[frameIdx];
+		const u32 objectCount = static_cast<u32>(objects.size());
+
+		bool recreated = false;
+		if (objectCount > frame.objectCapacity)
+		{
+			ResizeObjectBuffers(frame, objectCount, frameIdx);
+			recreated = true;
+		}
+		if (rangeCount > frame.rangeCapacity)
+		{
+			ResizeCountBuffers(frame, rangeCount, frameIdx);
+		}
+		if (objectCount > m_VisibilityCapacity)
+		{
+			ResizeVisibilityBuffer(objectCount);
+		}
+
+		if (objectCount > 0)
+		{
+			frame.pObjectBuffer->WriteSpan(std::span<const GpuDrawObject>{ objects });
+		}
+		frame.objectCount = objectCount;
+		frame.rangeCount = rangeCount;
+
+		return recreated;
+	}
+
+	void GpuDrawCuller::Cull(const vk::CommandBuffer& cmd, u32 frameIdx, CullPhase phase, const glm::mat4& viewProjection, bool frustumCulling, bool occlusionCulling)
+	{
+		HPR_PROFILE_SCOPE();
+
+		FrameResources& frame = m_Frames[frameIdx];
+		const u32 countOffset = GetCountOffset(frameIdx, phase);
+
+		// Both phases of a frame use the same settings.
+		if (phase != CullPhase::Late)
+		{
+			CullingData data{};
+			data.viewProj = viewProjection;
+			data.frustumPlanes = Frustum{ viewProjection }.GetPlanes();
+			data.objectCount = frame.objectCount;
+			data.frustumCulling = frustumCulling ? 1 : 0;
+			data.occlusionCulling = occlusionCulling ? 1 : 0;
+			data.pyramidMipCount = m_pDepthPyramid->GetMipCount();
+			data.depthSize = m_pDepthPyramid->GetDepthSize();
+			frame.settingsOffset = m_pRenderCtx->pUniformRing->Write(frameIdx, data);
+		}
+		frame.lateCulled = phase == CullPhase::Late;
+
+		VkDebug::BeginRegion(cmd, phase == CullPhase::Late ? "GPU culling (late)" : "GPU culling", { 0.2f, 0.6f, 0.8f, 1.0f });
+
+		cmd.fillBuffer(frame.pCountBuffer->GetBuffer(), countOffset * sizeof(u32), frame.rangeCapacity * sizeof(u32), 0);
+		if (m_ClearVisibility)
+		{
+			// Nothing was visible yet, so the first early phase draws nothing and the late phase draws everything.
+			cmd.fillBuffer(m_pVisibilityBuffer->GetBuffer(), 0, VK_WHOLE_SIZE, 0);
+			m_ClearVisibility = false;
+		}
+
+		// Also waits for the visibility written by the previous frame's late phase.
+		vk::MemoryBarrier clearBarrier{};
+		clearBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite | vk::AccessFlagBits::eShaderWrite;
+		clearBarrier.dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader,
+			{}, clearBarrier, {}, {});
+
+		if (frame.objectCount > 0)
+		{
+			CullingPass pass{};
+			pass.phase = phase;
+			pass.drawOffset = GetDrawOffset(frameIdx, phase);
+			pass.countOffset = countOffset;
+
+			cmd.bindPipeline(vk::PipelineBindPoint::eCompute, m_pPipeline->GetPipeline());
+			cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_pPipeline->GetLayout(), 0, { frame.descriptor }, { frame.settingsOffset });
+			cmd.pushConstants<CullingPass>(m_pPipeline->GetLayout(), vk::ShaderStageFlagBits::eCompute, 0, pass);
+			cmd.dispatch((frame.objectCount + s_GroupSize - 1) / s_GroupSize, 1, 1);
+		}
+
+		// The geometry pass reads the commands and counts as indirect arguments, and the draw data in its vertex shader.
+		vk::MemoryBarrier cullBarrier{};
+		cullBarrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+		cullBarrier.dstAccessMask = vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eTransferRead;
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+			vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eTransfer,
+			{}, cullBarrier, {}, {});
+
+		if (frame.rangeCount > 0)
+		{
+			const vk::DeviceSize countsOffset = countOffset * sizeof(u32);
+			cmd.copyBuffer(frame.pCountBuffer->GetBuffer(), frame.pCountReadbackBuffer->GetBuffer(),
+				vk::BufferCopy{ countsOffset, countsOffset, frame.rangeCount * sizeof(u32) });
+
+			vk::MemoryBarrier readbackBarrier{};
+			readbackBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+			readbackBarrier.dstAccessMask = vk::AccessFlagBits::eHostRead;
+			cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, {}, readbackBarrier, {}, {});
+		}
+
+		VkDebug::EndRegion(cmd);
+	}
+
+	u32 GpuDrawCuller::ReadDrawCount(u32 frameIdx) const
+	{
+		const FrameResources& frame = m_Frames[frameIdx];
+
+		frame.pCountReadbackBuffer->Invalidate();
+		const u32* pCounts = static_cast<const u32*>(frame.pCountReadbackBuffer->GetMappedData());
+		u32 drawCount = 0;
+		for (u32 i = 0; i < frame.rangeCount; i++)
+		{
+			drawCount += pCounts[i];
+			if (frame.lateCulled)
+				drawCount += pCounts[frame.rangeCapacity + i];
+		}
+
+		return drawCount;
+	}
+
+	u32 GpuDrawCuller::CullAndReadBack(u32 frameIdx, const glm::mat4& viewProjection, bool occlusionCulling)
+	{
+		HPR_PROFILE_SCOPE();
+
+		// The frame's buffers could still be in use by a frame in flight.
+		VulkanUtils::Check(m_pRenderCtx->device.waitIdle());
+
+		const vk::CommandBuffer cmd = m_pRenderCtx->commandPool->GetCommandBuffer();
+		VulkanCommandBuffer::Begin(cmd, vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+		Cull(cmd, frameIdx, CullPhase::Single, viewProjection, true, occlusionCulling);
+		VulkanCommandBuffer::End(cmd);
+
+		m_pRenderCtx->graphicsQueue.Submit({}, {}, {}, cmd, nullptr);
+		m_pRenderCtx->graphicsQueue.WaitIdle();
+		m_pRenderCtx->commandPool->FreeCommandBuffer(cmd);
+
+		return ReadDrawCount(frameIdx);
+	}
+
+	void GpuDrawCuller::UpdateDepthPyramid()
+	{
+		const vk::DescriptorImageInfo pyramidInfo{ {}, m_pDepthPyramid->GetImageView(), vk::ImageLayout::eGeneral };
+
+		for (const FrameResources& frame : m_Frames)
+		{
+			DescriptorWriter writer{ m_pRenderCtx->device, frame.descriptor };
+			writer.WriteImage(pyramidInfo, 5, vk::DescriptorType::eSampledImage);
+			writer.Write();
+		}
+	}
+
+	void GpuDrawCuller::ResizeObjectBuffers(FrameResources& frame, u32 objectCount, u32 frameIdx)
+	{
+		frame.objectCapacity = std::max(s_MinObjectCapacity, std::bit_ceil(objectCount));
+
+		// The draw buffers hold the draws of both phases.
+		frame.pObjectBuffer = std::make_unique<VulkanBuffer>(m_pRenderCtx, frame.objectCapacity * sizeof(GpuDrawObject),
+			vk::BufferUsageFlagBits::eStorageBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU, fmt::format("Culling object buffer {}", frameIdx), vk::BufferCreateFlags{},
+			VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
+		frame.pDrawDataBuffer = std::make_unique<VulkanBuffer>(m_pRenderCtx, 2 * frame.objectCapacity * sizeof(DrawData),
+			vk::BufferUsageFlagBits::eStorageBuffer, VMA_MEMORY_USAGE_GPU_ONLY, fmt::format("Culled draw data buffer {}", frameIdx));
+		frame.pIndirectBuffer = std::make_unique<VulkanBuffer>(m_pRenderCtx, 2 * frame.objectCapacity * sizeof(vk::DrawIndexedIndirectCommand),
+			vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer, VMA_MEMORY_USAGE_GPU_ONLY,
+			fmt::format("Culled indirect draw buffer {}", frameIdx));
+
+		// The writer keeps pointers to the buffer infos until Write.
+		const vk::DescriptorBufferInfo objectInfo{ frame.pObjectBuffer->GetBuffer(), 0, VK_WHOLE_SIZE };
+		const vk::DescriptorBufferInfo drawDataInfo{ frame.pDrawDataBuffer->GetBuffer(), 0, VK_WHOLE_SIZE };
+		const vk::DescriptorBufferInfo indirectInfo{ frame.pIndirectBuffer->GetBuffer(), 0, VK_WHOLE_SIZE };
+
+		DescriptorWriter writer{ m_pRenderCtx->device, frame.descriptor };
+		writer.WriteBuffer(objectInfo, 0, vk::DescriptorType::eStorageBuffer);
+		writer.WriteBuffer(drawDataInfo, 1, vk::DescriptorType::eStorageBuffer);
+		writer.WriteBuffer(indirectInfo, 2, vk::DescriptorType::eStorageBuffer);
+		writer.Write();
+	}
+
+	void GpuDrawCuller::ResizeCountBuffers(FrameResources& frame, u32 rangeCount, u32 frameIdx)
+	{
+		frame.rangeCapacity = std::max(s_MinRangeCapacity, std::bit_ceil(rangeCount));
+
+		// Like the draw buffers, the counts of the late phase come after the ones of the early phase.
+		frame.pCountBuffer = std::make_unique<VulkanBuffer>(m_pRenderCtx, 2 * frame.rangeCapacity * sizeof(u32),
+			vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferSrc
+			| vk::BufferUsageFlagBits::eTransferDst, VMA_MEMORY_USAGE_GPU_ONLY, fmt::format("Culled draw count buffer {}", frameIdx));
+		frame.pCountReadbackBuffer = std::make_unique<VulkanBuffer>(m_pRenderCtx, 2 * frame.rangeCapacity * sizeof(u32),
+			vk::BufferUsageFlagBits::eTransferDst, VMA_MEMORY_USAGE_GPU_TO_CPU, fmt::format("Culled draw count readback buffer {}", frameIdx), vk::BufferCreateFlags{},
+			VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT);
+
+		const vk::DescriptorBufferInfo countInfo{ frame.pCountBuffer->GetBuffer(), 0, VK_WHOLE_SIZE };
+
+		DescriptorWriter writer{ m_pRenderCtx->device, frame.descriptor };
+		writer.WriteBuffer(countInfo, 3, vk::DescriptorType::eStorageBuffer);
+		writer.Write();
+		frame.lateCulled = false;
+	}
+
+	void GpuDrawCuller::ResizeVisibilityBuffer(u32 objectCount)
+	{
+		// Every frame's descriptor set points at the buffer.
+		VulkanUtils::Check(m_pRenderCtx->device.waitIdle());
+
+		m_VisibilityCapacity = std::max(s_MinObjectCapacity, std::bit_ceil(objectCount));
+		m_pVisibilityBuffer = std::make_unique<VulkanBuffer>(m_pRenderCtx, m_VisibilityCapacity * sizeof(u32),
+			vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst, VMA_MEMORY_USAGE_GPU_ONLY, "Culling visibility buffer");
+		m_ClearVisibility = true;
+
+		const vk::DescriptorBufferInfo visibilityInfo{ m_pVisibilityBuffer->GetBuffer(), 0, VK_WHOLE_SIZE };
+		for (const FrameResources& frame : m_Frames)
+		{
+			DescriptorWriter writer{ m_pRenderCtx->device, frame.descriptor };
+			writer.WriteBuffer(visibilityInfo, 6, vk::DescriptorType::eStorageBuffer);
+			writer.Write();
+		}
+	}
+}
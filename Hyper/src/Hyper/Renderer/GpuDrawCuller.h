@@ -0,0 +1,101 @@
+﻿#pragma once
+#include <glm/mat4x4.hpp>
+#include <vulkan/vulkan.hpp>
+
+#include "Vulkan/VulkanBuffer.h"
+#include "Vulkan/VulkanDescriptors.h"
+#include "Vulkan/VulkanPipeline.h"
+
+namespace Hyper
+{
+	class DepthPyramid;
+	struct GpuDrawObject;
+	struct RenderContext;
+
+	// Matches the CULL_PHASE defines in DrawCulling.comp.hlsl.
+	enum class CullPhase : u32
+	{
+		// Culls every object and draws all visible ones.
+		Single = 0,
+		// Two-phase occlusion culling: draws the objects that were visible last frame, only testing them against the frustum.
+		Early,
+		// Two-phase occlusion culling: tests every object against the depth pyramid of the early pass, draws the visible ones
+		// the early pass skipped and remembers which objects are visible for the next frame's early pass.
+		Late,
+	};
+
+	// Culls the scene's mesh instances in a compute shader, and compacts the visible ones into indirect draw commands.
+	// Every material range has its own draw count, incremented with atomics, which the geometry pass passes to
+	// vkCmdDrawIndexedIndirectCount. The buffers exist once per frame in flight, like the rest of the geometry pass' frame data,
+	// and hold two sets of draws: one for the single or early phase, and one for the late phase.
+	// Which objects were visible is shared by all frames, so the early pass always starts from the last frame that was culled.
+	class GpuDrawCuller
+	{
+	public:
+		GpuDrawCuller(RenderContext* pRenderCtx, u32 frameCount, const DepthPyramid* pDepthPyramid);
+		~GpuDrawCuller() = default;
+
+		// Copies the objects into the frame's object buffer, which must no longer be in use by the GPU. The output buffers can
+		// hold every object, so they can't overflow. Returns whether the draw data buffer was recreated, which invalidates
+		// descriptor sets that point at it.
+		bool Upload(u32 frameIdx, const std::vector<GpuDrawObject>& objects, u32 rangeCount);
+
+		// Clears the phase's draw counts, culls the frame's objects and makes the results visible to indirect draws and vertex shaders.
+		// Occlusion culling tests against the depth pyramid, which must have been built earlier in the frame unless this is the early phase.
+		// The draw counts are also copied to a host visible buffer, which can be read once the frame's fence has been waited on.
+		void Cull(const vk::CommandBuffer& cmd, u32 frameIdx, CullPhase phase, const glm::mat4& viewProjection, bool frustumCulling, bool occlusionCulling);
+
+		// Sum of the draw counts written by the last frame's culling phases.
+		[[nodiscard]] u32 ReadDrawCount(u32 frameIdx) const;
+		// Culls the frame's objects in a single phase in a submit of its own, waits for it and returns the visible count.
+		// Doesn't need a swap chain, so it can check the culling pass against the CPU on any device.
+		[[nodiscard]] u32 CullAndReadBack(u32 frameIdx, const glm::mat4& viewProjection, bool occlusionCulling);
+
+		// Points the culling pass at the depth pyramid's current image, after it was recreated. The GPU must be idle.
+		void UpdateDepthPyramid();
+
+		// Where the phase's draws and draw counts start, in draws and in material ranges.
+		[[nodiscard]] u32 GetDrawOffset(u32 frameIdx, CullPhase phase) const { return phase == CullPhase::Late ? m_Frames[frameIdx].objectCapacity : 0; }
+		[[nodiscard]] u32 GetCountOffset(u32 frameIdx, CullPhase phase) const { return phase == CullPhase::Late ? m_Frames[frameIdx].rangeCapacity : 0; }
+
+		[[nodiscard]] vk::Buffer GetDrawDataBuffer(u32 frameIdx) const { return m_Frames[frameIdx].pDrawDataBuffer->GetBuffer(); }
+		[[nodiscard]] vk::Buffer GetIndirectBuffer(u32 frameIdx) const { return m_Frames[frameIdx].pIndirectBuffer->GetBuffer(); }
+		[[nodiscard]] vk::Buffer GetCountBuffer(u32 frameIdx) const { return m_Frames[frameIdx].pCountBuffer->GetBuffer(); }
+		[[nodiscard]] u32 GetObjectCount(u32 frameIdx) const { return m_Frames[frameIdx].objectCount; }
+
+	private:
+		struct FrameResources
+		{
+			vk::DescriptorSet descriptor;
+			// Dynamic offset of the culling settings in the frame's uniform ring, written by the single or early phase.
+			u32 settingsOffset{};
+			std::unique_ptr<VulkanBuffer> pObjectBuffer;
+			std::unique_ptr<VulkanBuffer> pDrawDataBuffer;
+			std::unique_ptr<VulkanBuffer> pIndirectBuffer;
+			std::unique_ptr<VulkanBuffer> pCountBuffer;
+			std::unique_ptr<VulkanBuffer> pCountReadbackBuffer;
+			u32 objectCapacity{};
+			u32 rangeCapacity{};
+			u32 objectCount{};
+			u32 rangeCount{};
+			// Whether the last frame also ran the late phase, which means the second set of draw counts is valid.
+			bool lateCulled{};
+		};
+
+		void ResizeObjectBuffers(FrameResources& frame, u32 objectCount, u32 frameIdx);
+		void ResizeCountBuffers(FrameResources& frame, u32 rangeCount, u32 frameIdx);
+		// Shared by all frames, so the GPU has to be idle when it grows.
+		void ResizeVisibilityBuffer(u32 objectCount);
+
+	private:
+		RenderContext* m_pRenderCtx;
+		const DepthPyramid* m_pDepthPyramid;
+
+		std::unique_ptr<VulkanComputePipeline> m_pPipeline;
+		std::vector<FrameResources> m_Frames;
+
+		std::unique_ptr<VulkanBuffer> m_pVisibilityBuffer;
+		u32 m_VisibilityCapacity{};
+		bool m_ClearVisibility{ true };
+	};
+}
@@ -1,16 +1,17 @@
 ﻿#include "HyperPCH.h"
 #include "Material.h"
 
+#include "MaterialLibrary.h"
 #include "RenderContext.h"
-#include "Renderer.h"
 #include "Texture.h"
-#include "Vulkan/VulkanDebug.h"
-#include "Vulkan/VulkanDescriptors.h"
 
 namespace Hyper
 {
-	Material::Material(RenderContext* pRenderCtx, const std::string& name)
+	static constexpr f32 s_AlphaCutoff = 0.8f;
+
+	Material::Material(RenderContext* pRenderCtx, const std::string& name, u32 index)
 		: m_pRenderCtx(pRenderCtx)
+		, m_Index(index)
 		, m_Name(name)
 	{
 	}
@@ -21,24 +22,15 @@ namespace Hyper
 		{
 			texture.reset();
 		}
-
-		m_DescriptorPool.reset();
-		if (m_pLayout != nullptr)
-		{
-			m_pRenderCtx->device.destroyDescriptorSetLayout(*m_pLayout);
-			m_pLayout = nullptr;
-		}
 	}
 
 	Material::Material(Material&& other) noexcept: m_pRenderCtx(other.m_pRenderCtx),
 		m_Id(other.m_Id),
+		m_Index(other.m_Index),
 		m_Name(std::move(other.m_Name)),
-		m_Textures(std::move(other.m_Textures)),
-		m_pLayout(std::move(other.m_pLayout)),
-		m_DescriptorPool(std::move(other.m_DescriptorPool)),
-		m_DescriptorSet(std::move(other.m_DescriptorSet))
+		m_AlphaMode(other.m_AlphaMode),
+		m_Textures(std::move(other.m_Textures))
 	{
-		other.m_pLayout = nullptr;
 	}
 
 	Material& Material::operator=(Material&& other) noexcept
@@ -47,13 +39,11 @@ namespace Hyper
 			return *this;
 		m_pRenderCtx = other.m_pRenderCtx;
 		m_Id = other.m_Id;
+		m_Index = other.m_Index;
 		m_Name = std::move(other.m_Name);
+		m_AlphaMode = other.m_AlphaMode;
 		m_Textures = std::move(other.m_Textures);
-		m_pLayout = std::move(other.m_pLayout);
-		m_DescriptorSet = std::move(other.m_DescriptorSet);
-		m_DescriptorPool = std::move(other.m_DescriptorPool);
 
-		other.m_pLayout = nullptr;
 		return *this;
 	}
 
@@ -72,39 +62,19 @@ namespace Hyper
 
 	void Material::PostLoadInititalize()
 	{
-		// 1. Create descriptors etc
-		m_DescriptorPool = std::make_unique<DescriptorPool>(
-			DescriptorPool::Builder(m_pRenderCtx->device)
-			.AddSize(vk::DescriptorType::eCombinedImageSampler, 10)
-			.SetMaxSets(10)
-			.SetFlags({})
-			.Build());
-		VkDebug::SetObjectName(m_pRenderCtx->device, vk::ObjectType::eDescriptorPool, m_DescriptorPool->GetPool(), fmt::format("'{}' Descriptor Pool", m_Name));
-
-		m_pLayout = std::make_unique<vk::DescriptorSetLayout>(
-			DescriptorSetLayoutBuilder(m_pRenderCtx->device)
-			.AddBinding(vk::DescriptorType::eCombinedImageSampler, 0, 1, vk::ShaderStageFlagBits::eFragment)
-			.AddBinding(vk::DescriptorType::eCombinedImageSampler, 1, 1, vk::ShaderStageFlagBits::eFragment)
-			.Build());
-		VkDebug::SetObjectName(m_pRenderCtx->device, vk::ObjectType::eDescriptorSetLayout, *m_pLayout, fmt::format("'{}' Descriptor Set Layout", m_Name));
-
-		m_DescriptorSet = m_DescriptorPool->Allocate({ *m_pLayout })[0];
-		VkDebug::SetObjectName(m_pRenderCtx->device, vk::ObjectType::eDescriptorSet, m_DescriptorSet, fmt::format("'{}' Descriptor Set", m_Name));
+		MaterialLibrary* pMaterialLibrary = m_pRenderCtx->pMaterialLibrary;
 
-		// 2. Write descriptors
-		DescriptorWriter writer{ m_pRenderCtx->device, m_DescriptorSet };
-		const auto& albedoTexture = m_Textures.at(MaterialTextureType::Albedo);
-		const auto albedoImageInfo = albedoTexture->GetDescriptorImageInfo();
-
-		const auto& normalTexture = m_Textures.at(MaterialTextureType::Normal);
-		const auto normalImageInfo = normalTexture->GetDescriptorImageInfo();
-		writer.WriteImage(albedoImageInfo, 0, vk::DescriptorType::eCombinedImageSampler);
-		writer.WriteImage(normalImageInfo, 1, vk::DescriptorType::eCombinedImageSampler);
-		writer.Write();
-	}
+		const Texture& albedo = *m_Textures.at(MaterialTextureType::Albedo);
+		m_AlphaMode = albedo.GetMinAlpha() < s_AlphaCutoff ? MaterialAlphaMode::Masked : MaterialAlphaMode::Opaque;
+		if (m_AlphaMode == MaterialAlphaMode::Masked)
+		{
+			HPR_CORE_LOG_INFO("Material '{}' is alpha masked", m_Name);
+		}
 
-	void Material::Bind(const vk::CommandBuffer& cmd, const vk::PipelineLayout& layout) const
-	{
-		cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 1, m_DescriptorSet, {});
+		MaterialData data{};
+		data.albedoTexture = pMaterialLibrary->AddTexture(albedo);
+		data.normalTexture = pMaterialLibrary->AddTexture(*m_Textures.at(MaterialTextureType::Normal));
+		data.alphaCutoff = s_AlphaCutoff;
+		pMaterialLibrary->SetMaterialData(m_Index, data);
 	}
 }
@@ -1,5 +1,4 @@
 ﻿#pragma once
-#include "Vulkan/VulkanDescriptors.h"
 
 namespace Hyper
 {
@@ -13,10 +12,17 @@ namespace Hyper
 		Normal
 	};
 
+	// Masked materials have albedo pixels below the alpha cutoff, which are discarded when rasterizing and ignored by rays.
+	enum class MaterialAlphaMode
+	{
+		Opaque,
+		Masked
+	};
+
 	class Material
 	{
 	public:
-		Material(RenderContext* pRenderCtx, const std::string& name);
+		Material(RenderContext* pRenderCtx, const std::string& name, u32 index);
 		~Material();
 		Material(Material&& other) noexcept;
 		Material& operator=(Material&& other) noexcept;
@@ -25,21 +31,23 @@ namespace Hyper
 		Material& operator=(const Material& other) = delete;
 
 		UUID GetId() const { return m_Id; }
+		// Compact index of the material in the library, in creation order. Used where a small integer is needed, like sort keys.
+		u32 GetIndex() const { return m_Index; }
+		// Known once the material is initialized, until then every material is opaque.
+		MaterialAlphaMode GetAlphaMode() const { return m_AlphaMode; }
 
 		void LoadTexture(MaterialTextureType type, const std::filesystem::path& fileName, bool srgb = true);
+		// Adds the textures to the material library's bindless table, and stores the material's parameters there.
+		// Classifies the material as masked when its albedo has any pixel below the alpha cutoff.
 		void PostLoadInititalize();
 
-		void Bind(const vk::CommandBuffer& cmd, const vk::PipelineLayout& layout) const;
-
 	private:
 		RenderContext* m_pRenderCtx;
 
 		UUID m_Id;
+		u32 m_Index;
 		std::string m_Name;
+		MaterialAlphaMode m_AlphaMode{ MaterialAlphaMode::Opaque };
 		std::unordered_map<MaterialTextureType, std::unique_ptr<Texture>> m_Textures;
-
-		std::unique_ptr<vk::DescriptorSetLayout> m_pLayout;
-		std::unique_ptr<DescriptorPool> m_DescriptorPool;
-		vk::DescriptorSet m_DescriptorSet;
 	};
 }
@@ -1,22 +1,88 @@
 ﻿#include "HyperPCH.h"
 #include "MaterialLibrary.h"
 
+#include <bit>
+
+#include "RenderContext.h"
+#include "Texture.h"
+#include "Vulkan/VulkanDebug.h"
+#include "Vulkan/VulkanUtility.h"
+
 namespace Hyper
 {
+	static constexpr u32 s_MinMaterialCapacity = 64;
+
 	MaterialLibrary::MaterialLibrary(RenderContext* pRenderCtx)
 		: m_pRenderCtx(pRenderCtx)
 	{
+		// Has to match the layout the shader reflection creates for set 1 of the geometry pass.
+		m_DescriptorLayout = DescriptorSetLayoutBuilder(m_pRenderCtx->device)
+			.AddBinding(vk::DescriptorType::eCombinedImageSampler, 0, BindlessDescriptorCount, vk::ShaderStageFlagBits::eFragment,
+				vk::DescriptorBindingFlagBits::ePartiallyBound | vk::DescriptorBindingFlagBits::eUpdateAfterBind)
+			.AddBinding(vk::DescriptorType::eStorageBuffer, 1, 1, vk::ShaderStageFlagBits::eFragment)
+			.SetFlags(vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool)
+			.Build();
+		VkDebug::SetObjectName(m_pRenderCtx->device, vk::ObjectType::eDescriptorSetLayout, m_DescriptorLayout, "Material library descriptor set layout");
+
+		m_RayTracingDescriptorLayout = DescriptorSetLayoutBuilder(m_pRenderCtx->device)
+			.AddBinding(vk::DescriptorType::eCombinedImageSampler, 0, BindlessDescriptorCount, vk::ShaderStageFlagBits::eAnyHitKHR,
+				vk::DescriptorBindingFlagBits::ePartiallyBound | vk::DescriptorBindingFlagBits::eUpdateAfterBind)
+			.AddBinding(vk::DescriptorType::eStorageBuffer, 1, 1, vk::ShaderStageFlagBits::eAnyHitKHR)
+			.SetFlags(vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool)
+			.Build();
+		VkDebug::SetObjectName(m_pRenderCtx->device, vk::ObjectType::eDescriptorSetLayout, m_RayTracingDescriptorLayout, "Material library ray tracing descriptor set layout");
+
+		m_pDescriptorPool = std::make_unique<DescriptorPool>(
+			DescriptorPool::Builder(m_pRenderCtx->device)
+			.AddSize(vk::DescriptorType::eCombinedImageSampler, 2 * BindlessDescriptorCount)
+			.AddSize(vk::DescriptorType::eStorageBuffer, 2)
+			.SetMaxSets(2)
+			.SetFlags(vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind)
+			.Build());
+		VkDebug::SetObjectName(m_pRenderCtx->device, vk::ObjectType::eDescriptorPool, m_pDescriptorPool->GetPool(), "Material library descriptor pool");
+
+		const std::vector<vk::DescriptorSet> descriptorSets = m_pDescriptorPool->Allocate({ m_DescriptorLayout, m_RayTracingDescriptorLayout });
+		m_DescriptorSet = descriptorSets[0];
+		m_RayTracingDescriptorSet = descriptorSets[1];
+		VkDebug::SetObjectName(m_pRenderCtx->device, vk::ObjectType::eDescriptorSet, m_DescriptorSet, "Material library descriptor set");
+		VkDebug::SetObjectName(m_pRenderCtx->device, vk::ObjectType::eDescriptorSet, m_RayTracingDescriptorSet, "Material library ray tracing descriptor set");
+
+		ResizeMaterialBuffer(s_MinMaterialCapacity);
 	}
 
 	MaterialLibrary::~MaterialLibrary()
 	{
 		m_Materials.clear();
+
+		m_pMaterialBuffer.reset();
+		m_pDescriptorPool.reset();
+		if (m_DescriptorLayout)
+		{
+			m_pRenderCtx->device.destroyDescriptorSetLayout(m_DescriptorLayout);
+			m_DescriptorLayout = nullptr;
+		}
+		if (m_RayTracingDescriptorLayout)
+		{
+			m_pRenderCtx->device.destroyDescriptorSetLayout(m_RayTracingDescriptorLayout);
+			m_RayTracingDescriptorLayout = nullptr;
+		}
 	}
 
 	MaterialLibrary::MaterialLibrary(MaterialLibrary&& other)
 		: m_pRenderCtx(other.m_pRenderCtx)
 		, m_Materials(std::move(other.m_Materials))
+		, m_pDescriptorPool(std::move(other.m_pDescriptorPool))
+		, m_DescriptorLayout(other.m_DescriptorLayout)
+		, m_DescriptorSet(other.m_DescriptorSet)
+		, m_RayTracingDescriptorLayout(other.m_RayTracingDescriptorLayout)
+		, m_RayTracingDescriptorSet(other.m_RayTracingDescriptorSet)
+		, m_TextureCount(other.m_TextureCount)
+		, m_MaterialData(std::move(other.m_MaterialData))
+		, m_pMaterialBuffer(std::move(other.m_pMaterialBuffer))
+		, m_MaterialCapacity(other.m_MaterialCapacity)
 	{
+		other.m_DescriptorLayout = nullptr;
+		other.m_RayTracingDescriptorLayout = nullptr;
 		HPR_VKLOG_WARN("MaterialLibrary moved!");
 	}
 
@@ -24,6 +90,17 @@ namespace Hyper
 	{
 		m_pRenderCtx = other.m_pRenderCtx;
 		m_Materials = std::move(other.m_Materials);
+		m_pDescriptorPool = std::move(other.m_pDescriptorPool);
+		m_DescriptorLayout = other.m_DescriptorLayout;
+		m_DescriptorSet = other.m_DescriptorSet;
+		m_RayTracingDescriptorLayout = other.m_RayTracingDescriptorLayout;
+		m_RayTracingDescriptorSet = other.m_RayTracingDescriptorSet;
+		m_TextureCount = other.m_TextureCount;
+		m_MaterialData = std::move(other.m_MaterialData);
+		m_pMaterialBuffer = std::move(other.m_pMaterialBuffer);
+		m_MaterialCapacity = other.m_MaterialCapacity;
+		other.m_DescriptorLayout = nullptr;
+		other.m_RayTracingDescriptorLayout = nullptr;
 
 		HPR_VKLOG_WARN("MaterialLibrary move-assigned!");
 
@@ -32,7 +109,7 @@ namespace Hyper
 
 	Material& MaterialLibrary::CreateMaterial(const std::string& name)
 	{
-		Material material = Material{ m_pRenderCtx, name };
+		Material material = Material{ m_pRenderCtx, name, static_cast<u32>(m_Materials.size()) };
 		UUID id = material.GetId();
 		m_Materials.emplace(id, std::move(material));
 
@@ -49,4 +126,55 @@ namespace Hyper
 		HPR_CORE_LOG_ERROR("Failed to get material with id '{}': no such material was found in the material library", id);
 		throw std::runtime_error(fmt::format("Failed to get material with id '{}': no such material was found in the material library", id));
 	}
+
+	u32 MaterialLibrary::AddTexture(const Texture& texture)
+	{
+		if (m_TextureCount >= BindlessDescriptorCount)
+		{
+			HPR_CORE_LOG_ERROR("Failed to add texture: the bindless texture table is full ({} textures)", BindlessDescriptorCount);
+			throw std::runtime_error(fmt::format("Failed to add texture: the bindless texture table is full ({} textures)", BindlessDescriptorCount));
+		}
+
+		const u32 slot = m_TextureCount++;
+		const vk::DescriptorImageInfo imageInfo = texture.GetDescriptorImageInfo();
+		for (const vk::DescriptorSet descriptorSet : { m_DescriptorSet, m_RayTracingDescriptorSet })
+		{
+			DescriptorWriter writer{ m_pRenderCtx->device, descriptorSet };
+			writer.WriteImage(imageInfo, 0, slot, vk::DescriptorType::eCombinedImageSampler);
+			writer.Write();
+		}
+
+		return slot;
+	}
+
+	void MaterialLibrary::SetMaterialData(u32 materialIndex, const MaterialData& data)
+	{
+		if (materialIndex >= m_MaterialData.size())
+			m_MaterialData.resize(materialIndex + 1);
+		m_MaterialData[materialIndex] = data;
+
+		if (m_MaterialData.size() > m_MaterialCapacity)
+			ResizeMaterialBuffer(static_cast<u32>(m_MaterialData.size()));
+
+		// Materials that are already drawn keep the same data, so frames in flight read the same values either way.
+		m_pMaterialBuffer->SetData(m_MaterialData.data(), m_MaterialData.size() * sizeof(MaterialData));
+	}
+
+	void MaterialLibrary::ResizeMaterialBuffer(u32 materialCount)
+	{
+		// Frames in flight could still be reading the old buffer.
+		VulkanUtils::Check(m_pRenderCtx->device.waitIdle());
+
+		m_MaterialCapacity = std::max(s_MinMaterialCapacity, std::bit_ceil(materialCount));
+		m_pMaterialBuffer = std::make_unique<VulkanBuffer>(m_pRenderCtx, m_MaterialCapacity * sizeof(MaterialData), vk::BufferUsageFlagBits::eStorageBuffer,
+			VMA_MEMORY_USAGE_CPU_TO_GPU, "Material buffer");
+
+		const vk::DescriptorBufferInfo bufferInfo{ m_pMaterialBuffer->GetBuffer(), 0, VK_WHOLE_SIZE };
+		for (const vk::DescriptorSet descriptorSet : { m_DescriptorSet, m_RayTracingDescriptorSet })
+		{
+			DescriptorWriter writer{ m_pRenderCtx->device, descriptorSet };
+			writer.WriteBuffer(bufferInfo, 1, vk::DescriptorType::eStorageBuffer);
+			writer.Write();
+		}
+	}
 }
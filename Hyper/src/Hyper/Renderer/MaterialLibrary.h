@@ -1,8 +1,26 @@
 ﻿#pragma once
 #include "Material.h"
+#include "Vulkan/VulkanBuffer.h"
+#include "Vulkan/VulkanDescriptors.h"
 
 namespace Hyper
 {
+	// Parameters of a material, indexed by Material::GetIndex. Matches MaterialData in StaticGeometry.frag.hlsl and RTShadows.rahit.hlsl.
+	struct MaterialData
+	{
+		// Slots in the bindless texture table.
+		u32 albedoTexture;
+		u32 normalTexture;
+		f32 alphaCutoff;
+		u32 padding;
+	};
+
+	// Owns every material, and a single descriptor set that holds all of their textures and parameters, so the geometry pass
+	// can bind it once and draw any material. Set 1 of the geometry pass:
+	//   binding 0: bindless table of every material texture, partially bound and updated after binding as textures are added.
+	//   binding 1: MaterialData of every material.
+	// The ray tracing pipeline's any-hit shader binds a copy of the set with the same bindings, since a set can only be bound
+	// to pipelines whose layout for it has the same shader stages.
 	class MaterialLibrary
 	{
 	public:
@@ -15,10 +33,36 @@ namespace Hyper
 
 		Material& CreateMaterial(const std::string& name);
 		[[nodiscard]] const Material& GetMaterial(UUID id) const;
+		[[nodiscard]] u32 GetMaterialCount() const { return static_cast<u32>(m_Materials.size()); }
+
+		// Adds the texture to the bindless table and returns its slot. Only writes a slot no draw can be using yet,
+		// so it doesn't have to wait for frames in flight.
+		u32 AddTexture(const Texture& texture);
+		// Stores the material's parameters. Waits for the GPU to be idle when the material buffer has to grow.
+		void SetMaterialData(u32 materialIndex, const MaterialData& data);
+
+		[[nodiscard]] vk::DescriptorSet GetDescriptorSet() const { return m_DescriptorSet; }
+		[[nodiscard]] vk::DescriptorSet GetRayTracingDescriptorSet() const { return m_RayTracingDescriptorSet; }
+		[[nodiscard]] vk::DescriptorSetLayout GetRayTracingDescriptorLayout() const { return m_RayTracingDescriptorLayout; }
+		[[nodiscard]] u32 GetTextureCount() const { return m_TextureCount; }
+
+	private:
+		void ResizeMaterialBuffer(u32 materialCount);
 
 	private:
 		RenderContext* m_pRenderCtx;
 
 		std::unordered_map<UUID, Material> m_Materials{};
+
+		std::unique_ptr<DescriptorPool> m_pDescriptorPool;
+		vk::DescriptorSetLayout m_DescriptorLayout;
+		vk::DescriptorSet m_DescriptorSet;
+		vk::DescriptorSetLayout m_RayTracingDescriptorLayout;
+		vk::DescriptorSet m_RayTracingDescriptorSet;
+		u32 m_TextureCount{};
+
+		std::vector<MaterialData> m_MaterialData;
+		std::unique_ptr<VulkanBuffer> m_pMaterialBuffer;
+		u32 m_MaterialCapacity{};
 	};
 }
@@ -1,9 +1,9 @@
 ﻿#include "HyperPCH.h"
 #include "Mesh.h"
 
+#include "RenderContext.h"
+#include "Hyper/Core/Hash.h"
 #include "Hyper/Debug/Profiler.h"
-#include "Vulkan/VulkanDebug.h"
-#include "Vulkan/VulkanIndexBuffer.h"
 
 namespace Hyper
 {
@@ -13,27 +13,33 @@ namespace Hyper
 		m_VertexCount = vertices.size();
 		m_IndexCount = indices.size();
 
-		// Vertex buffer
-		m_pVertexBuffer = std::make_unique<VulkanVertexBuffer>(m_pRenderCtx, "vertex buffer");
-		m_pVertexBuffer->CreateFrom(vertices);
+		m_LocalBounds = Bounds::ComputeAABB(vertices);
+		m_LocalSphere = Bounds::ComputeSphere(vertices, m_LocalBounds);
 
-		// Index buffer
-		m_pIndexBuffer = std::make_unique<VulkanIndexBuffer>(m_pRenderCtx, "index buffer");
-		m_pIndexBuffer->CreateFrom(indices);
-	}
+		m_Positions.reserve(vertices.size());
+		for (const VertexPosNormTex& vertex : vertices)
+		{
+			m_Positions.push_back(vertex.position);
+		}
+		m_Indices = indices;
 
-	Mesh::~Mesh()
-	{
-		m_pVertexBuffer.reset();
+		m_TriangleBVH.Build(m_Positions, m_Indices);
+
+		m_GeometryHash = Hash::Fnv1a(std::span<const glm::vec3>(m_Positions));
+		m_GeometryHash = Hash::Fnv1a(std::span<const u32>(m_Indices), m_GeometryHash);
+
+		m_Geometry = m_pRenderCtx->pGeometryPool->Upload(vertices, indices);
 	}
 
-	void Mesh::Draw(const vk::CommandBuffer& cmd) const
+	void Mesh::Draw(const vk::CommandBuffer& cmd, u32 instanceCount, u32 firstInstance) const
 	{
 		HPR_PROFILE_SCOPE();
 
-		m_pVertexBuffer->Bind(cmd);
-		m_pIndexBuffer->Bind(cmd);
+		cmd.drawIndexed(m_IndexCount, instanceCount, m_Geometry.firstIndex, static_cast<i32>(m_Geometry.vertexOffset), firstInstance);
+	}
 
-		cmd.drawIndexed(m_IndexCount, 1, 0, 0, 0);
+	vk::DrawIndexedIndirectCommand Mesh::GetIndirectCommand(u32 instanceCount, u32 firstInstance) const
+	{
+		return vk::DrawIndexedIndirectCommand{ m_IndexCount, instanceCount, m_Geometry.firstIndex, static_cast<i32>(m_Geometry.vertexOffset), firstInstance };
 	}
 }
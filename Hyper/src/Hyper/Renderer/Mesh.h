@@ -1,8 +1,8 @@
 ﻿#pragma once
+#include "GeometryPool.h"
 #include "Vulkan/Vertex.h"
-#include "Vulkan/VulkanBuffer.h"
-#include "Vulkan/VulkanIndexBuffer.h"
-#include "Vulkan/VulkanVertexBuffer.h"
+#include "Hyper/Scene/Bounds.h"
+#include "Hyper/Scene/TriangleBVH.h"
 
 namespace Hyper
 {
@@ -10,18 +10,32 @@ namespace Hyper
 	{
 	public:
 		explicit Mesh(RenderContext* pRenderCtx, const UUID& materialId, const std::vector<VertexPosNormTex>& vertices, const std::vector<u32>& indices, u32 triCount);
-		~Mesh();
 
-		void Draw(const vk::CommandBuffer& cmd) const;
+		// Expects the geometry pool to be bound.
+		void Draw(const vk::CommandBuffer& cmd, u32 instanceCount = 1, u32 firstInstance = 0) const;
+		// The same draw as Draw, as a command for an indirect draw.
+		[[nodiscard]] vk::DrawIndexedIndirectCommand GetIndirectCommand(u32 instanceCount = 1, u32 firstInstance = 0) const;
 		
 		[[nodiscard]] UUID GetMaterialId() const { return m_MaterialId; }
 
-		[[nodiscard]] VulkanVertexBuffer* GetVertexBuffer() const { return m_pVertexBuffer.get(); }
-		[[nodiscard]] VulkanIndexBuffer* GetIndexBuffer() const { return m_pIndexBuffer.get(); }
+		// Where the mesh's vertices and indices are stored in the geometry pool.
+		[[nodiscard]] const GeometryPool::Allocation& GetGeometry() const { return m_Geometry; }
 
 		[[nodiscard]] u32 GetVertexCount() const { return m_VertexCount; }
 		[[nodiscard]] u32 GetTriCount() const { return m_TriCount; }
 
+		// Object-space bounds, computed once from the vertices when the mesh is created.
+		[[nodiscard]] const AABB& GetLocalBounds() const { return m_LocalBounds; }
+		[[nodiscard]] const BoundingSphere& GetLocalSphere() const { return m_LocalSphere; }
+
+		// CPU copies of the geometry, used by CPU-side systems like the occlusion culler.
+		[[nodiscard]] const std::vector<glm::vec3>& GetPositions() const { return m_Positions; }
+		[[nodiscard]] const std::vector<u32>& GetIndices() const { return m_Indices; }
+		// Object-space triangle hierarchy, for exact ray casts on the CPU.
+		[[nodiscard]] const TriangleBVH& GetTriangleBVH() const { return m_TriangleBVH; }
+		// Hash of the positions and indices, the same on every run, so data built from the geometry can be cached on disk.
+		[[nodiscard]] u64 GetGeometryHash() const { return m_GeometryHash; }
+
 	private:
 		RenderContext* m_pRenderCtx;
 
@@ -34,7 +48,14 @@ namespace Hyper
 		u32 m_IndexCount{};
 		u32 m_TriCount{};
 
-		std::unique_ptr<VulkanVertexBuffer> m_pVertexBuffer{};
-		std::unique_ptr<VulkanIndexBuffer> m_pIndexBuffer{};
+		AABB m_LocalBounds{};
+		BoundingSphere m_LocalSphere{};
+
+		std::vector<glm::vec3> m_Positions{};
+		std::vector<u32> m_Indices{};
+		TriangleBVH m_TriangleBVH{};
+		u64 m_GeometryHash{};
+
+		GeometryPool::Allocation m_Geometry{};
 	};
 }
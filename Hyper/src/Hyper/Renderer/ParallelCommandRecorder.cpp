@@ -0,0 +1,103 @@
+﻿#include "HyperPCH.h"
+#include "ParallelCommandRecorder.h"
+
+#include "RenderContext.h"
+#include "Hyper/Core/JobSystem.h"
+#include "Hyper/Debug/Profiler.h"
+
+namespace Hyper
+{
+	ParallelCommandRecorder::ParallelCommandRecorder(RenderContext* pRenderCtx, JobSystem* pJobSystem, u32 frameCount)
+		: m_pRenderCtx(pRenderCtx)
+		, m_pJobSystem(pJobSystem)
+		, m_ThreadCount(pJobSystem->GetThreadCount())
+	{
+		m_Pools.resize(static_cast<size_t>(frameCount) * m_ThreadCount);
+		for (ThreadPool& pool : m_Pools)
+		{
+			pool.pPool = std::make_unique<VulkanCommandPool>(m_pRenderCtx);
+			pool.usedCount = 0;
+		}
+
+		HPR_VKLOG_INFO("Created {} command pools for parallel recording ({} threads, {} frames)", m_Pools.size(), m_ThreadCount, frameCount);
+	}
+
+	ParallelCommandRecorder::~ParallelCommandRecorder()
+	{
+		for (ThreadPool& pool : m_Pools)
+		{
+			if (!pool.commandBuffers.empty())
+				pool.pPool->FreeCommandBuffers(pool.commandBuffers);
+		}
+		m_Pools.clear();
+	}
+
+	void ParallelCommandRecorder::BeginFrame(u32 frameIdx)
+	{
+		HPR_PROFILE_SCOPE();
+
+		m_FrameIdx = frameIdx;
+		for (u32 threadIdx = 0; threadIdx < m_ThreadCount; threadIdx++)
+		{
+			ThreadPool& pool = m_Pools[m_FrameIdx * m_ThreadCount + threadIdx];
+			pool.pPool->Reset();
+			pool.usedCount = 0;
+		}
+	}
+
+	const std::vector<vk::CommandBuffer>& ParallelCommandRecorder::Record(const vk::CommandBufferInheritanceRenderingInfo& renderingInfo,
+		u32 count, u32 maxChunkCount, const RecordFunc& func)
+	{
+		HPR_PROFILE_SCOPE();
+
+		m_RecordedBuffers.clear();
+		if (count == 0)
+			return m_RecordedBuffers;
+
+		const u32 chunkCount = std::clamp((count + MinChunkSize - 1) / MinChunkSize, 1u, std::max(maxChunkCount, 1u));
+		const u32 chunkSize = (count + chunkCount - 1) / chunkCount;
+		m_RecordedBuffers.resize(chunkCount);
+
+		vk::CommandBufferInheritanceInfo inheritanceInfo = {};
+		inheritanceInfo.pNext = &renderingInfo;
+
+		const auto recordChunk = [&](u32 chunkIdx, u32 threadIdx)
+		{
+			const u32 first = chunkIdx * chunkSize;
+			if (first >= count)
+				return;
+
+			const vk::CommandBuffer cmd = GetCommandBuffer(threadIdx);
+			VulkanCommandBuffer::Begin(cmd, vk::CommandBufferUsageFlagBits::eOneTimeSubmit | vk::CommandBufferUsageFlagBits::eRenderPassContinue, &inheritanceInfo);
+			func(cmd, first, std::min(chunkSize, count - first));
+			VulkanCommandBuffer::End(cmd);
+
+			m_RecordedBuffers[chunkIdx] = cmd;
+		};
+
+		if (chunkCount == 1)
+		{
+			recordChunk(0, 0);
+		}
+		else
+		{
+			m_pJobSystem->ParallelFor(chunkCount, recordChunk);
+		}
+
+		// Rounding up the chunk size can leave the last chunks empty.
+		std::erase(m_RecordedBuffers, vk::CommandBuffer{});
+
+		return m_RecordedBuffers;
+	}
+
+	vk::CommandBuffer ParallelCommandRecorder::GetCommandBuffer(u32 threadIdx)
+	{
+		ThreadPool& pool = m_Pools[m_FrameIdx * m_ThreadCount + threadIdx];
+		if (pool.usedCount == pool.commandBuffers.size())
+		{
+			pool.commandBuffers.push_back(pool.pPool->GetCommandBuffer(vk::CommandBufferLevel::eSecondary));
+		}
+
+		return pool.commandBuffers[pool.usedCount++];
+	}
+}
@@ -0,0 +1,60 @@
+﻿#pragma once
+#include <functional>
+#include <vulkan/vulkan.hpp>
+
+#include "Vulkan/VulkanCommands.h"
+
+namespace Hyper
+{
+	class JobSystem;
+	struct RenderContext;
+
+	// Records a list of draws into secondary command buffers on all threads of the job system.
+	// Command pools can only be used from one thread at a time, so every thread gets its own pool for every frame in flight.
+	// Pools are reset as a whole at the start of their frame, and the command buffers allocated from them are reused.
+	class ParallelCommandRecorder
+	{
+	public:
+		using RecordFunc = std::function<void(const vk::CommandBuffer& cmd, u32 first, u32 count)>;
+
+		// Chunks smaller than this cost more in command buffer overhead than they gain from running in parallel.
+		static constexpr u32 MinChunkSize = 256;
+
+	public:
+		ParallelCommandRecorder(RenderContext* pRenderCtx, JobSystem* pJobSystem, u32 frameCount);
+		~ParallelCommandRecorder();
+
+		// Resets all command buffers of the given frame, which must no longer be in use by the GPU.
+		void BeginFrame(u32 frameIdx);
+
+		// Splits [0, count) into at most maxChunkCount chunks, and records every chunk into its own secondary command buffer.
+		// The buffers continue the dynamic rendering scope described by renderingInfo, but don't inherit any other state,
+		// so func has to bind the pipeline and set the dynamic state itself. Returns the buffers in chunk order, for executeCommands.
+		[[nodiscard]] const std::vector<vk::CommandBuffer>& Record(const vk::CommandBufferInheritanceRenderingInfo& renderingInfo,
+			u32 count, u32 maxChunkCount, const RecordFunc& func);
+
+		[[nodiscard]] u32 GetThreadCount() const { return m_ThreadCount; }
+
+	private:
+		struct ThreadPool
+		{
+			std::unique_ptr<VulkanCommandPool> pPool;
+			std::vector<vk::CommandBuffer> commandBuffers;
+			// Amount of command buffers handed out since the last reset.
+			u32 usedCount;
+		};
+
+		[[nodiscard]] vk::CommandBuffer GetCommandBuffer(u32 threadIdx);
+
+	private:
+		RenderContext* m_pRenderCtx;
+		JobSystem* m_pJobSystem;
+		u32 m_ThreadCount;
+
+		// frameCount * threadCount pools, indexed by frameIdx * threadCount + threadIdx.
+		std::vector<ThreadPool> m_Pools;
+		u32 m_FrameIdx{};
+
+		std::vector<vk::CommandBuffer> m_RecordedBuffers;
+	};
+}
@@ -9,14 +9,20 @@ namespace Hyper
 {
 	class ShaderLibrary;
 	class MaterialLibrary;
+	class GeometryPool;
+	class DescriptorAllocator;
+	class UniformRing;
 
 	struct RenderContext
 	{
 		vk::Instance instance;
 		vk::PhysicalDevice physicalDevice;
 		vk::PhysicalDeviceRayTracingPipelinePropertiesKHR rtProperties;
+		vk::PhysicalDeviceAccelerationStructurePropertiesKHR asProperties;
 		vk::Device device;
 		VulkanQueue graphicsQueue;
+		// Builds the acceleration structures. From a family without graphics when the device has one, otherwise the graphics queue.
+		VulkanQueue computeQueue;
 		VulkanCommandPool* commandPool;
 		VmaAllocator allocator;
 		u32 imagesInFlight;
@@ -31,6 +37,9 @@ namespace Hyper
 
 		ShaderLibrary* pShaderLibrary;
 		MaterialLibrary* pMaterialLibrary;
+		GeometryPool* pGeometryPool;
+		DescriptorAllocator* pDescriptorAllocator;
+		UniformRing* pUniformRing;
 
 		bool drawImGui{ true };
 	};
@@ -0,0 +1,100 @@
+﻿#include "HyperPCH.h"
+#include "RenderQueue.h"
+
+#include <bit>
+#include <cassert>
+
+#include "Hyper/Debug/Profiler.h"
+
+namespace Hyper
+{
+	static constexpr u32 s_RadixBits = 8;
+	static constexpr u32 s_RadixSize = 1 << s_RadixBits;
+	static constexpr u32 s_RadixPasses = 64 / s_RadixBits;
+
+	u64 RenderQueue::MakeKey(u32 pass, u32 pipeline, u32 material, f32 viewDepth)
+	{
+		assert(pass < (1u << PassBits));
+		assert(pipeline < (1u << PipelineBits));
+		assert(material < (1u << MaterialBits));
+
+		// The bits of a positive float sort the same way as the float itself. Dropping the lowest mantissa bits turns that
+		// into buckets that grow with the distance, so far away draws are grouped more coarsely than close ones.
+		const u32 depthBits = std::bit_cast<u32>(std::max(viewDepth, 0.0f));
+		const u32 depthBucket = depthBits >> (32 - DepthBits - 1);
+
+		return static_cast<u64>(pass) << PassShift
+			| static_cast<u64>(pipeline) << PipelineShift
+			| static_cast<u64>(material) << MaterialShift
+			| static_cast<u64>(depthBucket) << DepthShift;
+	}
+
+	void RenderQueue::Clear()
+	{
+		m_Keys.clear();
+		m_DrawIndices.clear();
+	}
+
+	void RenderQueue::Reserve(u32 count)
+	{
+		m_Keys.reserve(count);
+		m_DrawIndices.reserve(count);
+	}
+
+	void RenderQueue::Add(u64 key, u32 drawIdx)
+	{
+		m_Keys.push_back(key);
+		m_DrawIndices.push_back(drawIdx);
+	}
+
+	void RenderQueue::Sort()
+	{
+		HPR_PROFILE_SCOPE();
+
+		const size_t count = m_Keys.size();
+		if (count < 2)
+			return;
+
+		std::array<std::array<u32, s_RadixSize>, s_RadixPasses> histograms{};
+		for (const u64 key : m_Keys)
+		{
+			for (u32 pass = 0; pass < s_RadixPasses; pass++)
+			{
+				histograms[pass][(key >> (pass * s_RadixBits)) & (s_RadixSize - 1)]++;
+			}
+		}
+
+		m_TempKeys.resize(count);
+		m_TempDrawIndices.resize(count);
+
+		for (u32 pass = 0; pass < s_RadixPasses; pass++)
+		{
+			std::array<u32, s_RadixSize>& histogram = histograms[pass];
+
+			// Every key has the same byte here, so this pass wouldn't move anything.
+			const u32 firstByte = static_cast<u32>(m_Keys[0] >> (pass * s_RadixBits)) & (s_RadixSize - 1);
+			if (histogram[firstByte] == count)
+				continue;
+
+			// Turn the histogram into the output offset of each bucket.
+			u32 offset = 0;
+			for (u32& bucket : histogram)
+			{
+				const u32 bucketCount = bucket;
+				bucket = offset;
+				offset += bucketCount;
+			}
+
+			for (size_t i = 0; i < count; i++)
+			{
+				const u64 key = m_Keys[i];
+				const u32 destination = histogram[(key >> (pass * s_RadixBits)) & (s_RadixSize - 1)]++;
+				m_TempKeys[destination] = key;
+				m_TempDrawIndices[destination] = m_DrawIndices[i];
+			}
+
+			m_Keys.swap(m_TempKeys);
+			m_DrawIndices.swap(m_TempDrawIndices);
+		}
+	}
+}
@@ -0,0 +1,49 @@
+﻿#pragma once
+
+namespace Hyper
+{
+	// Collects draws as (sort key, draw index) pairs and sorts them, so they can be recorded with as few state changes as possible.
+	// Keys are compared as plain integers. From the most to the least significant bits they contain:
+	//   pass (4 bits) | pipeline (12 bits) | material (24 bits) | depth bucket (24 bits)
+	// so draws are grouped per pass, then per pipeline and material, and drawn front to back within a material.
+	class RenderQueue
+	{
+	public:
+		static constexpr u32 PassBits = 4;
+		static constexpr u32 PipelineBits = 12;
+		static constexpr u32 MaterialBits = 24;
+		static constexpr u32 DepthBits = 24;
+
+		static constexpr u32 DepthShift = 0;
+		static constexpr u32 MaterialShift = DepthShift + DepthBits;
+		static constexpr u32 PipelineShift = MaterialShift + MaterialBits;
+		static constexpr u32 PassShift = PipelineShift + PipelineBits;
+
+		// viewDepth is the distance along the view direction, negative depths are clamped to 0.
+		[[nodiscard]] static u64 MakeKey(u32 pass, u32 pipeline, u32 material, f32 viewDepth);
+
+		[[nodiscard]] static u32 GetPass(u64 key) { return static_cast<u32>(key >> PassShift) & ((1u << PassBits) - 1); }
+		[[nodiscard]] static u32 GetPipeline(u64 key) { return static_cast<u32>(key >> PipelineShift) & ((1u << PipelineBits) - 1); }
+		[[nodiscard]] static u32 GetMaterial(u64 key) { return static_cast<u32>(key >> MaterialShift) & ((1u << MaterialBits) - 1); }
+
+		void Clear();
+		void Reserve(u32 count);
+		void Add(u64 key, u32 drawIdx);
+
+		// Stable LSD radix sort on the keys, one byte per pass. All byte histograms are built in a single pass over the keys,
+		// and passes in which every key has the same byte are skipped, which is common for the pass and pipeline bytes.
+		void Sort();
+
+		[[nodiscard]] u32 GetCount() const { return static_cast<u32>(m_Keys.size()); }
+		[[nodiscard]] const std::vector<u64>& GetKeys() const { return m_Keys; }
+		[[nodiscard]] const std::vector<u32>& GetDrawIndices() const { return m_DrawIndices; }
+
+	private:
+		std::vector<u64> m_Keys;
+		std::vector<u32> m_DrawIndices;
+
+		// Ping-pong buffers for the sort, kept around to avoid allocating every frame.
+		std::vector<u64> m_TempKeys;
+		std::vector<u32> m_TempDrawIndices;
+	};
+}
@@ -6,7 +6,7 @@
 
 namespace Hyper
 {
-	RenderTarget::RenderTarget(RenderContext* pRenderCtx, vk::Format format, const std::string& debugName, u32 width, u32 height)
+	RenderTarget::RenderTarget(RenderContext* pRenderCtx, vk::Format format, const std::string& debugName, u32 width, u32 height, vk::Format normalFormat)
 		: m_pRenderCtx(pRenderCtx)
 	{
 		// Color Image
@@ -26,12 +26,28 @@ namespace Hyper
 			m_pRenderCtx,
 			vk::Format::eD24UnormS8Uint,
 			vk::ImageType::e2D,
-			vk::ImageUsageFlagBits::eDepthStencilAttachment,
+			// Sampled by the depth pyramid and the ray tracer.
+			vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled,
 			vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil,
 			fmt::format("{} (depth)", debugName),
 			width,
 			height
 		);
+		CreateDepthSampleView();
+
+		if (normalFormat != vk::Format::eUndefined)
+		{
+			m_pNormalImage = std::make_unique<VulkanImage>(
+				m_pRenderCtx,
+				normalFormat,
+				vk::ImageType::e2D,
+				vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled,
+				vk::ImageAspectFlagBits::eColor,
+				fmt::format("{} (normal)", debugName),
+				width,
+				height
+			);
+		}
 
 		// Sampler
 		vk::SamplerCreateInfo samplerInfo = {};
@@ -47,6 +63,10 @@ namespace Hyper
 		VulkanCommandBuffer::Begin(cmd, vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
 		m_pColorImage->TransitionLayout(cmd, {}, vk::ImageLayout::eGeneral, vk::PipelineStageFlagBits::eAllGraphics);
 		m_pDepthImage->TransitionLayout(cmd, {}, vk::ImageLayout::eGeneral, vk::PipelineStageFlagBits::eAllGraphics);
+		if (m_pNormalImage)
+		{
+			m_pNormalImage->TransitionLayout(cmd, {}, vk::ImageLayout::eGeneral, vk::PipelineStageFlagBits::eAllGraphics);
+		}
 		VulkanCommandBuffer::End(cmd);
 		m_pRenderCtx->graphicsQueue.Submit({}, {}, {}, cmd, {});
 		m_pRenderCtx->graphicsQueue.WaitIdle();
@@ -55,32 +75,47 @@ namespace Hyper
 
 	RenderTarget::~RenderTarget()
 	{
+		m_pRenderCtx->device.destroyImageView(m_DepthSampleView);
 		m_pColorImage.reset();
 		m_pDepthImage.reset();
+		m_pNormalImage.reset();
 		m_pRenderCtx->device.destroySampler(m_ColorSampler);
 	}
 
-	std::array<vk::RenderingAttachmentInfo, 2> RenderTarget::GetRenderingAttachments() const
+	std::array<vk::RenderingAttachmentInfo, 2> RenderTarget::GetRenderingAttachments(vk::AttachmentLoadOp loadOp) const
 	{
 		std::array<vk::RenderingAttachmentInfo, 2> attachments{};
 
 		attachments[0].imageView = m_pColorImage->GetImageView();
 		attachments[0].imageLayout = vk::ImageLayout::eColorAttachmentOptimal;
 		attachments[0].resolveMode = vk::ResolveModeFlagBits::eNone;
-		attachments[0].loadOp = vk::AttachmentLoadOp::eClear;
+		attachments[0].loadOp = loadOp;
 		attachments[0].storeOp = vk::AttachmentStoreOp::eStore;
 		attachments[0].clearValue = vk::ClearColorValue(std::array{ 0.0f, 0.0f, 0.0f, 1.0f });
 
 		attachments[1].imageView = m_pDepthImage->GetImageView();
 		attachments[1].imageLayout = vk::ImageLayout::eDepthAttachmentOptimal;
 		attachments[1].resolveMode = vk::ResolveModeFlagBits::eNone;
-		attachments[1].loadOp = vk::AttachmentLoadOp::eClear;
+		attachments[1].loadOp = loadOp;
 		attachments[1].storeOp = vk::AttachmentStoreOp::eStore;
 		attachments[1].clearValue = vk::ClearDepthStencilValue(1.0f);
 
 		return attachments;
 	}
 
+	vk::RenderingAttachmentInfo RenderTarget::GetNormalAttachment(vk::AttachmentLoadOp loadOp) const
+	{
+		vk::RenderingAttachmentInfo attachment{};
+		attachment.imageView = m_pNormalImage->GetImageView();
+		attachment.imageLayout = vk::ImageLayout::eColorAttachmentOptimal;
+		attachment.resolveMode = vk::ResolveModeFlagBits::eNone;
+		attachment.loadOp = loadOp;
+		attachment.storeOp = vk::AttachmentStoreOp::eStore;
+		attachment.clearValue = vk::ClearColorValue(std::array{ 0.0f, 0.0f, 0.0f, 0.0f });
+
+		return attachment;
+	}
+
 	void RenderTarget::Resize(u32 newWidth, u32 newHeight)
 	{
 		if (newWidth == 0 || newHeight == 0)
@@ -90,5 +125,23 @@ namespace Hyper
 
 		m_pColorImage->Resize(newWidth, newHeight);
 		m_pDepthImage->Resize(newWidth, newHeight);
+		if (m_pNormalImage)
+		{
+			m_pNormalImage->Resize(newWidth, newHeight);
+		}
+
+		// The view belongs to the old depth image.
+		m_pRenderCtx->device.destroyImageView(m_DepthSampleView);
+		CreateDepthSampleView();
+	}
+
+	void RenderTarget::CreateDepthSampleView()
+	{
+		vk::ImageViewCreateInfo viewInfo{};
+		viewInfo.viewType = vk::ImageViewType::e2D;
+		viewInfo.image = m_pDepthImage->GetImage();
+		viewInfo.format = m_pDepthImage->GetFormat();
+		viewInfo.subresourceRange = vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eDepth, 0, 1, 0, 1 };
+		m_DepthSampleView = VulkanUtils::Check(m_pRenderCtx->device.createImageView(viewInfo));
 	}
 }
@@ -6,21 +6,33 @@ namespace Hyper
 	class RenderTarget
 	{
 	public:
-		RenderTarget(RenderContext* pRenderCtx, vk::Format format, const std::string& debugName, u32 width, u32 height);
+		// A normal format adds a second color attachment, for passes that write a G-buffer.
+		RenderTarget(RenderContext* pRenderCtx, vk::Format format, const std::string& debugName, u32 width, u32 height, vk::Format normalFormat = vk::Format::eUndefined);
 		~RenderTarget();
 
-		[[nodiscard]] std::array<vk::RenderingAttachmentInfo, 2> GetRenderingAttachments() const;
+		// Loading instead of clearing lets a second rendering scope draw on top of the first, like the late occlusion culling pass.
+		[[nodiscard]] std::array<vk::RenderingAttachmentInfo, 2> GetRenderingAttachments(vk::AttachmentLoadOp loadOp = vk::AttachmentLoadOp::eClear) const;
+		// Only valid when the target has a normal image. Cleared to zero, which isn't a valid normal.
+		[[nodiscard]] vk::RenderingAttachmentInfo GetNormalAttachment(vk::AttachmentLoadOp loadOp = vk::AttachmentLoadOp::eClear) const;
 		[[nodiscard]] VulkanImage* GetColorImage() const { return m_pColorImage.get(); }
 		[[nodiscard]] VulkanImage* GetDepthImage() const { return m_pDepthImage.get(); }
+		[[nodiscard]] VulkanImage* GetNormalImage() const { return m_pNormalImage.get(); }
+		// The depth image's own view includes the stencil aspect, which can't be sampled together with the depth.
+		[[nodiscard]] vk::ImageView GetDepthSampleView() const { return m_DepthSampleView; }
 		[[nodiscard]] vk::Sampler GetColorSampler() const { return m_ColorSampler; }
 
 		void Resize(u32 newWidth, u32 newHeight);
 
+	private:
+		void CreateDepthSampleView();
+
 	private:
 		RenderContext* m_pRenderCtx;
 
 		std::unique_ptr<VulkanImage> m_pColorImage;
 		std::unique_ptr<VulkanImage> m_pDepthImage;
+		std::unique_ptr<VulkanImage> m_pNormalImage;
+		vk::ImageView m_DepthSampleView;
 		vk::Sampler m_ColorSampler;
 	};
 }
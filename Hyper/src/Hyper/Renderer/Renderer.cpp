@@ -1,11 +1,13 @@
 ﻿#include "HyperPCH.h"
 #include "Renderer.h"
 
+#include <bit>
 #include <imgui.h>
 
 #include "ShaderLibrary.h"
 #include "MaterialLibrary.h"
 #include "Hyper/Core/Context.h"
+#include "Hyper/Core/JobSystem.h"
 #include "Hyper/Core/Window.h"
 #include "Hyper/Debug/Profiler.h"
 #include "Hyper/Scene/Scene.h"
@@ -44,10 +46,13 @@ namespace Hyper
 		m_pRenderContext = std::make_unique<RenderContext>();
 		m_pDevice = std::make_unique<VulkanDevice>(m_pRenderContext.get());
 		m_pCommandPool = std::make_unique<VulkanCommandPool>(m_pRenderContext.get());
+		m_pRenderContext->commandPool = m_pCommandPool.get();
 		m_pShaderLibrary = std::make_unique<ShaderLibrary>(m_pRenderContext.get());
 		m_pMaterialLibrary = std::make_unique<MaterialLibrary>(m_pRenderContext.get());
+		m_pGeometryPool = std::make_unique<GeometryPool>(m_pRenderContext.get());
 		m_pRenderContext->pShaderLibrary = m_pShaderLibrary.get();
 		m_pRenderContext->pMaterialLibrary = m_pMaterialLibrary.get();
+		m_pRenderContext->pGeometryPool = m_pGeometryPool.get();
 
 		// Create the default sampler
 		{
@@ -64,6 +69,11 @@ namespace Hyper
 		Window* pWindow = m_pContext->GetSubsystem<Window>();
 		m_pSwapChain = std::make_unique<VulkanSwapChain>(pWindow, m_pRenderContext.get(), pWindow->GetWidth(), pWindow->GetHeight());
 
+		m_pDescriptorAllocator = std::make_unique<DescriptorAllocator>(m_pRenderContext->device, m_pSwapChain->GetNumFrames());
+		m_pRenderContext->pDescriptorAllocator = m_pDescriptorAllocator.get();
+		m_pUniformRing = std::make_unique<UniformRing>(m_pRenderContext.get(), m_pSwapChain->GetNumFrames());
+		m_pRenderContext->pUniformRing = m_pUniformRing.get();
+
 		// Setup camera
 		m_pCamera->Setup();
 
@@ -73,6 +83,9 @@ namespace Hyper
 		// Get command buffers. 1 for each frame in flight.
 		m_CommandBuffers = m_pCommandPool->GetCommandBuffers(m_pSwapChain->GetNumFrames());
 
+		// The geometry pass draws are recorded in parallel into secondary command buffers.
+		m_pCommandRecorder = std::make_unique<ParallelCommandRecorder>(m_pRenderContext.get(), m_pContext->GetSubsystem<JobSystem>(), m_pSwapChain->GetNumFrames());
+
 		// Create sync objects
 		{
 			m_RenderFinishedSemaphores.resize(m_pRenderContext->imagesInFlight);
@@ -95,46 +108,47 @@ namespace Hyper
 	{
 		Window* pWindow = m_pContext->GetSubsystem<Window>();
 
-		m_pRayTracer = std::make_unique<VulkanRaytracer>(m_pRenderContext.get(), m_pScene->GetAccelerationStructure(), m_pSwapChain->GetNumFrames(), pWindow->GetWidth(), pWindow->GetHeight());
+		m_pRayTracer = std::make_unique<VulkanRaytracer>(m_pRenderContext.get(), m_pSwapChain->GetNumFrames(), pWindow->GetWidth(), pWindow->GetHeight());
 
 		// Initialize the geometry pass
 		{
 			m_pGeometryShader = m_pShaderLibrary->GetShader("StaticGeometry");
 
-			// Render target
-			m_pGeometryRenderTarget = std::make_unique<RenderTarget>(m_pRenderContext.get(), vk::Format::eR8G8B8A8Unorm, "Geometry pass render target", m_pRenderContext->imageExtent.width, m_pRenderContext->imageExtent.height);
+			// Render target, its normals let the ray tracer start shadow rays at the visible surfaces.
+			m_pGeometryRenderTarget = std::make_unique<RenderTarget>(m_pRenderContext.get(), vk::Format::eR8G8B8A8Unorm, "Geometry pass render target",
+				m_pRenderContext->imageExtent.width, m_pRenderContext->imageExtent.height, vk::Format::eA2B10G10R10UnormPack32);
+
+			// Occlusion culling tests against the depth of the geometry pass.
+			m_pDepthPyramid = std::make_unique<DepthPyramid>(m_pRenderContext.get(), m_pGeometryRenderTarget->GetDepthImage());
+			m_pGpuCuller = std::make_unique<GpuDrawCuller>(m_pRenderContext.get(), m_pSwapChain->GetNumFrames(), m_pDepthPyramid.get());
 
 			// Create the frame data
 			{
-				// TODO: this pool should be centralized somewhere.
-				m_pGeometryDescriptorPool = std::make_unique<DescriptorPool>(
-					DescriptorPool::Builder(m_pRenderContext->device)
-					.AddSize(vk::DescriptorType::eUniformBuffer, 10 * m_pSwapChain->GetNumFrames())
-					.AddSize(vk::DescriptorType::eCombinedImageSampler, 1000)
-					.SetMaxSets(10 * m_pSwapChain->GetNumFrames())
-					.Build());
-
 				for (u32 i = 0; i < m_pSwapChain->GetNumFrames(); i++)
 				{
-					std::vector<vk::DescriptorSet> descriptorSets = m_pGeometryDescriptorPool->Allocate(m_pGeometryShader->GetAllDescriptorSetLayouts());
+					// Set 1 holds the materials, which belong to the material library.
+					const vk::DescriptorSetLayout frameLayout = m_pGeometryShader->GetAllDescriptorSetLayouts()[0];
 					m_GeometryFrameDatas.emplace_back<FrameData>(FrameData{
-						VulkanBuffer(m_pRenderContext.get(), sizeof(CameraData), vk::BufferUsageFlagBits::eUniformBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU,
-							fmt::format("Camera buffer {}", i)),
-						descriptorSets[0]
+						m_pDescriptorAllocator->Allocate(frameLayout)
 						});
+					m_GeometryFrameDatas.back().gpuCullingDescriptor = m_pDescriptorAllocator->Allocate(frameLayout);
 				}
 
 				for (u32 i = 0; i < m_pSwapChain->GetNumFrames(); i++)
 				{
 					DescriptorWriter writer{ m_pRenderContext->device, m_GeometryFrameDatas[i].descriptor };
 
-					vk::DescriptorBufferInfo bufferInfo = {};
-					bufferInfo.buffer = m_GeometryFrameDatas[i].cameraBuffer.GetBuffer();
-					bufferInfo.offset = 0;
-					bufferInfo.range = sizeof(CameraData);
+					// The camera data is written to the uniform ring every frame, the descriptors only point at the frame's ring buffer.
+					const vk::DescriptorBufferInfo bufferInfo = m_pUniformRing->GetDescriptorInfo<CameraData>(i);
 
-					writer.WriteBuffer(bufferInfo, 0, vk::DescriptorType::eUniformBuffer);
+					writer.WriteBuffer(bufferInfo, 0, vk::DescriptorType::eUniformBufferDynamic);
 					writer.Write();
+
+					DescriptorWriter gpuCullingWriter{ m_pRenderContext->device, m_GeometryFrameDatas[i].gpuCullingDescriptor };
+					gpuCullingWriter.WriteBuffer(bufferInfo, 0, vk::DescriptorType::eUniformBufferDynamic);
+					gpuCullingWriter.Write();
+
+					UploadDrawData(m_GeometryFrameDatas[i]);
 				}
 			}
 
@@ -151,7 +165,7 @@ namespace Hyper
 				.viewport = {},
 				.scissor = {},
 				.blendEnable = true,
-				.colorFormats = { m_pGeometryRenderTarget->GetColorImage()->GetFormat() },
+				.colorFormats = { m_pGeometryRenderTarget->GetColorImage()->GetFormat(), m_pGeometryRenderTarget->GetNormalImage()->GetFormat() },
 				.depthStencilFormat = m_pGeometryRenderTarget->GetDepthImage()->GetFormat(),
 				.dynamicStates = { vk::DynamicState::eViewport, vk::DynamicState::eScissor },
 				.flags = {}
@@ -165,14 +179,7 @@ namespace Hyper
 
 			// Create the composite descriptors
 			{
-				// TODO: this pool should be centralized somewhere.
-				m_pCompositeDescriptorPool = std::make_unique<DescriptorPool>(
-					DescriptorPool::Builder(m_pRenderContext->device)
-					.AddSize(vk::DescriptorType::eCombinedImageSampler, 2 * m_pSwapChain->GetNumFrames())
-					.SetMaxSets(10 * m_pSwapChain->GetNumFrames())
-					.Build());
-
-				m_CompositeDescriptorSet = m_pCompositeDescriptorPool->Allocate(m_pCompositeShader->GetAllDescriptorSetLayouts())[0];
+				m_CompositeDescriptorSet = m_pDescriptorAllocator->Allocate(m_pCompositeShader->GetAllDescriptorSetLayouts()[0]);
 
 				DescriptorWriter writer{ m_pRenderContext->device, m_CompositeDescriptorSet };
 
@@ -247,6 +254,10 @@ namespace Hyper
 			}
 		}
 
+		// The frame's transient descriptor sets and uniforms are no longer in use.
+		m_pDescriptorAllocator->BeginFrame(m_FrameIdx);
+		m_pUniformRing->BeginFrame(m_FrameIdx);
+
 		// Resize the swap chain if necessary.
 		{
 			const Window* window = m_pContext->GetSubsystem<Window>();
@@ -259,6 +270,8 @@ namespace Hyper
 				m_pSwapChain->Resize(width, height);
 				m_pRayTracer->Resize(width, height);
 				m_pGeometryRenderTarget->Resize(width, height);
+				m_pDepthPyramid->Resize();
+				m_pGpuCuller->UpdateDepthPyramid();
 
 				// test: Update the composite pass descriptors
 				// TODO: this shouldn't have to be done manually like this.
@@ -291,6 +304,13 @@ namespace Hyper
 		// Only reset fences if we're submitting any work.
 		m_pRenderContext->device.resetFences(m_InFlightFences[m_FrameIdx]);
 
+		// Traces the G-buffer of the last frame, so it has to run before the camera moves.
+		if (m_RunRayTracingComparison)
+		{
+			m_pRayTracer->CompareModes(m_pScene->GetAccelerationStructure(), m_pGeometryRenderTarget.get(), m_pCamera.get(), m_FrameIdx, m_pScene->GetLightingSettings());
+			m_RunRayTracingComparison = false;
+		}
+
 		// Update camera just for test
 		m_pCamera->Update(dt);
 
@@ -355,53 +375,240 @@ namespace Hyper
 				vk::ImageLayout::eGeneral,
 				vk::PipelineStageFlagBits::eColorAttachmentOutput
 			);
+			// The ray tracer of the last frame read the normals.
+			m_pGeometryRenderTarget->GetNormalImage()->TransitionLayout(
+				cmd,
+				vk::AccessFlagBits::eColorAttachmentWrite,
+				vk::ImageLayout::eGeneral,
+				vk::PipelineStageFlagBits::eColorAttachmentOutput
+			);
+			// The ray tracer of the last frame read the depth buffer.
+			m_pGeometryRenderTarget->GetDepthImage()->TransitionLayout(
+				cmd,
+				vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+				vk::ImageLayout::eGeneral,
+				vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests
+			);
+
+			FrameData& currentFrameData = m_GeometryFrameDatas[m_FrameIdx];
+
+			// Update global uniform buffers
+			{
+				CameraData camData{};
+				camData.view = m_pCamera->GetView();
+				camData.proj = m_pCamera->GetProjection();
+				camData.viewProj = m_pCamera->GetViewProjection();
+				currentFrameData.cameraOffset = m_pUniformRing->Write(m_FrameIdx, camData);
+
+				if (m_RunGpuCullingCheck)
+				{
+					RunGpuCullingCheck(currentFrameData);
+					m_RunGpuCullingCheck = false;
+				}
+
+				if (m_EnableGpuCulling)
+				{
+					// The fence of this frame has been waited on, so the counts of its last culling pass can be read.
+					m_GpuCullingStats.visibleCount = m_pGpuCuller->ReadDrawCount(m_FrameIdx);
+
+					// The CPU only touches the objects when the scene changed, culling them is left to the GPU.
+					m_pScene->PrepareGpuDraws();
+					UploadGpuDrawData(currentFrameData, m_FrameIdx);
+					// With occlusion culling, this only draws what was visible last frame. The rest is culled after the depth pyramid is built.
+					m_pGpuCuller->Cull(cmd, m_FrameIdx, m_EnableOcclusionCulling ? CullPhase::Early : CullPhase::Single, m_pCamera->GetViewProjection(),
+						m_pScene->IsFrustumCullingEnabled(), m_EnableOcclusionCulling);
+				}
+				else
+				{
+					// Cull and batch the scene, and upload the instances and draw commands of the visible meshes.
+					m_pScene->PrepareDraws(m_pCamera->GetViewProjection());
+					UploadDrawData(currentFrameData);
+				}
+			}
+
+			// Secondary command buffers have to know the attachment formats of the rendering scope they're executed in.
+			const std::array colorFormats = { m_pGeometryRenderTarget->GetColorImage()->GetFormat(), m_pGeometryRenderTarget->GetNormalImage()->GetFormat() };
+			vk::CommandBufferInheritanceRenderingInfo inheritanceInfo{};
+			inheritanceInfo.setColorAttachmentFormats(colorFormats);
+			inheritanceInfo.depthAttachmentFormat = m_pGeometryRenderTarget->GetDepthImage()->GetFormat();
+			inheritanceInfo.rasterizationSamples = vk::SampleCountFlagBits::e1;
+
+			if (m_RunRecordingBenchmark)
+			{
+				// The CPU draw list isn't built while culling on the GPU.
+				if (!m_EnableGpuCulling)
+					RunRecordingBenchmark(currentFrameData, inheritanceInfo);
+				m_RunRecordingBenchmark = false;
+			}
+
+			// Small draw lists aren't worth the overhead of the extra command buffers.
+			// Multi-draw indirect records a handful of commands regardless of the draw count, so there's nothing to spread over threads.
+			const u32 drawCount = m_EnableGpuCulling ? m_GpuCullingStats.visibleCount : m_pScene->GetDrawCount();
+			const bool recordParallel = !m_EnableGpuCulling && !m_EnableIndirectDraws && m_EnableParallelRecording
+				&& drawCount > ParallelCommandRecorder::MinChunkSize;
 
 			// Begin rendering
 			const auto attachments = m_pGeometryRenderTarget->GetRenderingAttachments();
+			const std::array colorAttachments = { attachments[0], m_pGeometryRenderTarget->GetNormalAttachment() };
 
 			vk::RenderingInfo renderingInfo{};
 			renderingInfo.renderArea = vk::Rect2D(vk::Offset2D(), m_pRenderContext->imageExtent);
 			renderingInfo.layerCount = 1;
 			renderingInfo.viewMask = 0;
-			renderingInfo.colorAttachmentCount = 1;
-			renderingInfo.setPColorAttachments(&attachments[0]);
+			renderingInfo.setColorAttachments(colorAttachments);
 			renderingInfo.setPDepthAttachment(&attachments[1]);
+			if (recordParallel)
+			{
+				// The whole scope then consists of executeCommands, no draws can be recorded into the primary buffer itself.
+				renderingInfo.flags = vk::RenderingFlagBits::eContentsSecondaryCommandBuffers;
+			}
 
 			cmd.beginRendering(renderingInfo);
 
-			cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, m_pGeometryPipeline->GetPipeline());
+			// Draw the model to the screen
+			using Clock = std::chrono::high_resolution_clock;
+			const auto startTime = Clock::now();
 
-			// draw stuff here
+			const CullPhase firstPhase = m_EnableOcclusionCulling ? CullPhase::Early : CullPhase::Single;
+			if (m_EnableGpuCulling)
+			{
+				BindGeometryPassState(cmd, currentFrameData.gpuCullingDescriptor, currentFrameData.cameraOffset);
+				m_pScene->RecordIndirectCountDraws(cmd, m_pGpuCuller->GetIndirectBuffer(m_FrameIdx), m_pGpuCuller->GetCountBuffer(m_FrameIdx),
+					m_pGpuCuller->GetDrawOffset(m_FrameIdx, firstPhase), m_pGpuCuller->GetCountOffset(m_FrameIdx, firstPhase));
+				m_RecordingStats.drawCallCount = m_pScene->GetGpuMaterialRangeCount();
+				m_RecordingStats.commandBufferCount = 0;
+				m_RecordingStats.descriptorBindCount = 1;
+			}
+			else if (m_EnableIndirectDraws)
+			{
+				BindGeometryPassState(cmd, currentFrameData.descriptor, currentFrameData.cameraOffset);
+				m_pScene->RecordIndirectDraws(cmd, currentFrameData.indirectBuffer.pBuffer->GetBuffer());
+				m_RecordingStats.drawCallCount = drawCount > 0 ? 1 : 0;
+				m_RecordingStats.commandBufferCount = 0;
+				m_RecordingStats.descriptorBindCount = 1;
+			}
+			else if (recordParallel)
+			{
+				m_pCommandRecorder->BeginFrame(m_FrameIdx);
+				const std::vector<vk::CommandBuffer>& commandBuffers = m_pCommandRecorder->Record(inheritanceInfo, drawCount, m_pCommandRecorder->GetThreadCount() * 2,
+					[&](const vk::CommandBuffer& secondaryCmd, u32 first, u32 count)
+					{
+						BindGeometryPassState(secondaryCmd, currentFrameData.descriptor, currentFrameData.cameraOffset);
+						m_pScene->RecordDraws(secondaryCmd, first, count);
+					});
+
+				cmd.executeCommands(commandBuffers);
+				m_RecordingStats.drawCallCount = drawCount;
+				m_RecordingStats.commandBufferCount = static_cast<u32>(commandBuffers.size());
+				m_RecordingStats.descriptorBindCount = static_cast<u32>(commandBuffers.size());
+			}
+			else
+			{
+				BindGeometryPassState(cmd, currentFrameData.descriptor, currentFrameData.cameraOffset);
+				m_pScene->RecordDraws(cmd, 0, drawCount);
+				m_RecordingStats.drawCallCount = drawCount;
+				m_RecordingStats.commandBufferCount = 0;
+				m_RecordingStats.descriptorBindCount = 1;
+			}
 
-			FrameData& currentFrameData = m_GeometryFrameDatas[m_FrameIdx];
+			m_RecordingStats.drawCount = drawCount;
+			m_RecordingStats.recordTimeMs = std::chrono::duration<f32, std::milli>(Clock::now() - startTime).count();
 
-			// Update global uniform buffers
-			{
-				CameraData camData{};
-				camData.view = m_pCamera->GetView();
-				camData.proj = m_pCamera->GetProjection();
-				camData.viewProj = m_pCamera->GetViewProjection();
-				currentFrameData.cameraBuffer.SetData(&camData, sizeof(CameraData));
+			// End rendering
+			cmd.endRendering();
 
-				DescriptorWriter writer{ m_pRenderContext->device, m_GeometryFrameDatas[m_FrameIdx].descriptor };
-				vk::DescriptorBufferInfo cameraBufferInfo = {};
-				cameraBufferInfo.buffer = currentFrameData.cameraBuffer.GetBuffer();
-				cameraBufferInfo.offset = 0;
-				cameraBufferInfo.range = sizeof(CameraData);
-				writer.WriteBuffer(cameraBufferInfo, 0, vk::DescriptorType::eUniformBuffer);
+			// With two-phase occlusion culling, the pyramid only contains the depth of the early pass.
+			m_pDepthPyramid->Build(cmd);
 
-				cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_pGeometryPipeline->GetLayout(), 0, { currentFrameData.descriptor }, {});
+			if (m_EnableGpuCulling && m_EnableOcclusionCulling)
+			{
+				m_pGpuCuller->Cull(cmd, m_FrameIdx, CullPhase::Late, m_pCamera->GetViewProjection(), m_pScene->IsFrustumCullingEnabled(), true);
+
+				// Draw on top of the early pass.
+				m_pGeometryRenderTarget->GetColorImage()->TransitionLayout(cmd, vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite,
+					vk::ImageLayout::eGeneral, vk::PipelineStageFlagBits::eColorAttachmentOutput);
+				m_pGeometryRenderTarget->GetNormalImage()->TransitionLayout(cmd, vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite,
+					vk::ImageLayout::eGeneral, vk::PipelineStageFlagBits::eColorAttachmentOutput);
+
+				const auto lateAttachments = m_pGeometryRenderTarget->GetRenderingAttachments(vk::AttachmentLoadOp::eLoad);
+				const std::array lateColorAttachments = { lateAttachments[0], m_pGeometryRenderTarget->GetNormalAttachment(vk::AttachmentLoadOp::eLoad) };
+				vk::RenderingInfo lateRenderingInfo{};
+				lateRenderingInfo.renderArea = vk::Rect2D(vk::Offset2D(), m_pRenderContext->imageExtent);
+				lateRenderingInfo.layerCount = 1;
+				lateRenderingInfo.viewMask = 0;
+				lateRenderingInfo.setColorAttachments(lateColorAttachments);
+				lateRenderingInfo.setPDepthAttachment(&lateAttachments[1]);
+
+				cmd.beginRendering(lateRenderingInfo);
+				BindGeometryPassState(cmd, currentFrameData.gpuCullingDescriptor, currentFrameData.cameraOffset);
+				m_pScene->RecordIndirectCountDraws(cmd, m_pGpuCuller->GetIndirectBuffer(m_FrameIdx), m_pGpuCuller->GetCountBuffer(m_FrameIdx),
+					m_pGpuCuller->GetDrawOffset(m_FrameIdx, CullPhase::Late), m_pGpuCuller->GetCountOffset(m_FrameIdx, CullPhase::Late));
+				cmd.endRendering();
+
+				m_RecordingStats.drawCallCount += m_pScene->GetGpuMaterialRangeCount();
+				m_RecordingStats.descriptorBindCount++;
 			}
 
-			// TEMP pushconst garbage
-			const u32 offset = m_pGeometryShader->GetAllPushConstantRanges()[1].offset;
-			cmd.pushConstants<LightingSettings>(m_pGeometryPipeline->GetLayout(), vk::ShaderStageFlagBits::eFragment, offset, m_pScene->GetLightingSettings());
+			m_pScene->DrawImGui();
 
-			// Draw the model to the screen
-			m_pScene->Draw(cmd, m_pGeometryPipeline->GetLayout());
+			if (m_pRenderContext->drawImGui)
+			{
+				if (ImGui::Begin("Command recording"))
+				{
+					ImGui::Checkbox("Multi-draw indirect", &m_EnableIndirectDraws);
+					if (!m_EnableGpuCulling && !m_EnableIndirectDraws)
+						ImGui::Checkbox("Parallel recording", &m_EnableParallelRecording);
+					ImGui::Text("Threads: %u", m_pCommandRecorder->GetThreadCount());
+					ImGui::Text("Draws: %u, draw calls: %u", m_RecordingStats.drawCount, m_RecordingStats.drawCallCount);
+					ImGui::Text("Secondary command buffers: %u", m_RecordingStats.commandBufferCount);
+					ImGui::Text("Descriptor set binds: %u", m_RecordingStats.descriptorBindCount);
+					ImGui::Text("Bindless textures: %u (%u materials)", m_pMaterialLibrary->GetTextureCount(), m_pMaterialLibrary->GetMaterialCount());
+					const DescriptorAllocatorStats& descriptorStats = m_pDescriptorAllocator->GetStats();
+					ImGui::Text("Descriptor pools: %u, sets allocated: %u", descriptorStats.poolCount, descriptorStats.frameSetCount);
+					ImGui::Text("Descriptor allocation time: %.3f ms (slowest %.3f ms)", descriptorStats.frameAllocationTimeMs, descriptorStats.maxAllocationTimeMs);
+					const UniformRingStats& uniformStats = m_pUniformRing->GetStats();
+					ImGui::Text("Uniform writes: %u (%u bytes), %.3f ms", uniformStats.writeCount, uniformStats.writtenBytes, uniformStats.writeTimeMs);
+					ImGui::Text("CPU time: %.3f ms", m_RecordingStats.recordTimeMs);
+
+					ImGui::Separator();
+					if (ImGui::Button("Run recording benchmark"))
+						m_RunRecordingBenchmark = true;
+
+					if (m_BenchmarkSerialStats.drawCount > 0)
+					{
+						ImGui::Text("Average over the benchmark runs (%u draws):", m_BenchmarkSerialStats.drawCount);
+						ImGui::Text("  1 thread: %.3f ms", m_BenchmarkSerialStats.recordTimeMs);
+						ImGui::Text("  %u threads: %.3f ms (%u command buffers)", m_pCommandRecorder->GetThreadCount(),
+							m_BenchmarkParallelStats.recordTimeMs, m_BenchmarkParallelStats.commandBufferCount);
+						ImGui::Text("  Multi-draw indirect: %.3f ms (%u draw calls)", m_BenchmarkIndirectStats.recordTimeMs, m_BenchmarkIndirectStats.drawCallCount);
+					}
+				}
+				ImGui::End();
 
-			// End rendering
-			cmd.endRendering();
+				if (ImGui::Begin("GPU culling"))
+				{
+					ImGui::Checkbox("Cull on the GPU", &m_EnableGpuCulling);
+					ImGui::Checkbox("Two-phase occlusion culling", &m_EnableOcclusionCulling);
+					ImGui::Text("Depth pyramid: %u levels", m_pDepthPyramid->GetMipCount());
+					ImGui::Text("Objects: %u, visible: %u", m_pGpuCuller->GetObjectCount(m_FrameIdx), m_GpuCullingStats.visibleCount);
+					ImGui::Text("Indirect count draws: %u", m_pScene->GetGpuMaterialRangeCount());
+
+					ImGui::Separator();
+					if (ImGui::Button("Check against CPU culling"))
+						m_RunGpuCullingCheck = true;
+
+					if (m_GpuCullingStats.hasCheckResult)
+					{
+						ImGui::Text("Last check: %u visible on the GPU, %u on the CPU (%s)", m_GpuCullingStats.checkGpuCount,
+							m_GpuCullingStats.checkCpuCount, m_GpuCullingStats.checkGpuCount == m_GpuCullingStats.checkCpuCount ? "match" : "mismatch");
+						if (m_GpuCullingStats.checkOcclusion)
+						{
+							ImGui::Text("Depth rect tests: %u, GPU and CPU disagree on %u", m_GpuCullingStats.checkRectCount, m_GpuCullingStats.checkRectMismatchCount);
+						}
+					}
+				}
+				ImGui::End();
+			}
 
 			VkDebug::EndRegion(cmd);
 		}
@@ -410,8 +617,111 @@ namespace Hyper
 		{
 			VkDebug::BeginRegion(cmd, "RT Pass", { 0.3f, 0.3f, 0.8f, 1.0f });
 
-			// Trace them rays
-			m_pRayTracer->RayTrace(cmd, m_pCamera.get(), m_FrameIdx, m_pScene->GetLightingSettings());
+			// Refit the TLAS to the nodes that moved.
+			m_pScene->UpdateAccelerationStructure(cmd, m_FrameIdx);
+
+			// Trace shadow rays from the surfaces the geometry pass left in its depth and normals.
+			m_pRayTracer->RayTrace(cmd, m_pScene->GetAccelerationStructure(), m_pGeometryRenderTarget.get(), m_pCamera.get(), m_FrameIdx, m_pScene->GetLightingSettings());
+
+			// Keep the cost of the scene's current BLAS mode, to compare it against the other one.
+			{
+				const VulkanAccelerationStructure::BuildStats& buildStats = m_pScene->GetAccelerationStructure()->GetBuildStats();
+				RayTracingModeStats& modeStats = m_RayTracingModeStats[m_pScene->IsMergingStaticMeshes() ? 1 : 0];
+				modeStats.instanceCount = buildStats.instanceCount;
+				modeStats.blasCount = buildStats.blasCount;
+				modeStats.buildTimeMs = buildStats.blasBuildTimeMs + buildStats.compactionTimeMs + buildStats.tlasBuildTimeMs;
+				const f32 traceTimeMs = m_pRayTracer->GetTraceTimeMs();
+				modeStats.traceTimeMs = modeStats.isValid ? modeStats.traceTimeMs * 0.95f + traceTimeMs * 0.05f : traceTimeMs;
+				modeStats.isValid = true;
+			}
+
+			if (m_pRenderContext->drawImGui)
+			{
+				if (ImGui::Begin("Ray tracing"))
+				{
+					const f32 pixels = static_cast<f32>(m_pRayTracer->GetPixelCount());
+					const f32 traceTimeMs = m_pRayTracer->GetTraceTimeMs();
+					ImGui::Text("Trace and upsample: %.3f ms, %.1f M pixels/s", traceTimeMs, traceTimeMs > 0.0f ? pixels / (traceTimeMs * 1000.0f) : 0.0f);
+
+					// The mode only changes what the next frames record, so it can change at any time.
+					RTResolutionMode resolutionMode = m_pRayTracer->GetResolutionMode();
+					if (ImGui::BeginCombo("Resolution", VulkanRaytracer::GetResolutionModeName(resolutionMode)))
+					{
+						for (u32 mode = 0; mode < static_cast<u32>(RTResolutionMode::Count); mode++)
+						{
+							const bool isSelected = mode == static_cast<u32>(resolutionMode);
+							if (ImGui::Selectable(VulkanRaytracer::GetResolutionModeName(static_cast<RTResolutionMode>(mode)), isSelected))
+								resolutionMode = static_cast<RTResolutionMode>(mode);
+						}
+						ImGui::EndCombo();
+					}
+					m_pRayTracer->SetResolutionMode(resolutionMode);
+
+					// Traces the last frame in every mode, and compares each output with the full resolution one.
+					if (ImGui::Button("Compare resolutions"))
+						m_RunRayTracingComparison = true;
+
+					if (m_pRayTracer->GetModeComparisons()[0].isValid && ImGui::BeginTable("Resolution modes", 4))
+					{
+						ImGui::TableSetupColumn("Mode");
+						ImGui::TableSetupColumn("GPU (ms)");
+						ImGui::TableSetupColumn("Mean difference");
+						ImGui::TableSetupColumn("Flipped pixels");
+						ImGui::TableHeadersRow();
+
+						for (u32 mode = 0; mode < static_cast<u32>(RTResolutionMode::Count); mode++)
+						{
+							const RTModeComparison& comparison = m_pRayTracer->GetModeComparisons()[mode];
+							ImGui::TableNextRow();
+							ImGui::TableSetColumnIndex(0);
+							ImGui::Text("%s", VulkanRaytracer::GetResolutionModeName(static_cast<RTResolutionMode>(mode)));
+							ImGui::TableSetColumnIndex(1);
+							ImGui::Text("%.3f", comparison.gpuTimeMs);
+							ImGui::TableSetColumnIndex(2);
+							ImGui::Text("%.4f", comparison.meanDifference);
+							ImGui::TableSetColumnIndex(3);
+							ImGui::Text("%.2f%%", comparison.flippedPixels * 100.0f);
+						}
+						ImGui::EndTable();
+					}
+
+					ImGui::Separator();
+					ImGui::Text("BLAS modes, switched with \"Merge static meshes\" in the Acceleration structures window:");
+					if (ImGui::BeginTable("BLAS modes", 6))
+					{
+						ImGui::TableSetupColumn("Mode");
+						ImGui::TableSetupColumn("Instances");
+						ImGui::TableSetupColumn("BLASes");
+						ImGui::TableSetupColumn("Build (ms)");
+						ImGui::TableSetupColumn("Trace (ms)");
+						ImGui::TableSetupColumn("M pixels/s");
+						ImGui::TableHeadersRow();
+
+						for (u32 mode = 0; mode < m_RayTracingModeStats.size(); mode++)
+						{
+							const RayTracingModeStats& modeStats = m_RayTracingModeStats[mode];
+							if (!modeStats.isValid)
+								continue;
+
+							ImGui::TableNextRow();
+							ImGui::TableSetColumnIndex(0);
+							ImGui::Text(mode == 1 ? "Merged static meshes" : "BLAS per mesh");
+							ImGui::TableSetColumnIndex(1);
+							ImGui::Text("%u", modeStats.instanceCount);
+							ImGui::TableSetColumnIndex(2);
+							ImGui::Text("%u", modeStats.blasCount);
+							ImGui::TableSetColumnIndex(3);
+							ImGui::Text("%.2f", modeStats.buildTimeMs);
+							ImGui::TableSetColumnIndex(4);
+							ImGui::Text("%.3f", modeStats.traceTimeMs);
+							ImGui::TableSetColumnIndex(5);
+							ImGui::Text("%.1f", modeStats.traceTimeMs > 0.0f ? pixels / (modeStats.traceTimeMs * 1000.0f) : 0.0f);
+						}
+						ImGui::EndTable();
+					}
+				}
+				ImGui::End();
+			}
 
 			VkDebug::EndRegion(cmd);
 		}
@@ -485,10 +795,15 @@ namespace Hyper
 		// Submit
 		m_pRenderContext->device.resetFences(m_InFlightFences[m_FrameIdx]);
 
+		// The TLAS is built on the compute queue. The scene only traces it once its build is done, but waiting for the build
+		// makes the compute queue's writes visible to this one.
+		const VulkanAccelerationStructure* pAcceleration = m_pScene->GetAccelerationStructure();
 		m_pRenderContext->graphicsQueue.Submit(
-			{ vk::PipelineStageFlagBits::eColorAttachmentOutput },
-			{ m_pSwapChain->GetSemaphore() },
+			{ vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::PipelineStageFlagBits::eRayTracingShaderKHR | vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR },
+			{ m_pSwapChain->GetSemaphore(), pAcceleration->GetBuildSemaphore() },
+			{ 0, pAcceleration->GetBuildValue() },
 			{ m_RenderFinishedSemaphores[m_FrameIdx] },
+			{},
 			cmd,
 			m_InFlightFences[m_FrameIdx]);
 
@@ -512,21 +827,25 @@ namespace Hyper
 		}
 
 		m_pRayTracer.reset();
+		m_pCommandRecorder.reset();
+		m_pGpuCuller.reset();
+		m_pDepthPyramid.reset();
 
-		m_pGeometryDescriptorPool.reset();
 		m_GeometryFrameDatas.clear();
 		m_pGeometryPipeline.reset();
 		m_pGeometryRenderTarget.reset();
 
-		m_pCompositeDescriptorPool.reset();
 		m_pCompositePipeline.reset();
 
+		m_pUniformRing.reset();
+		m_pDescriptorAllocator.reset();
 		m_pSwapChain.reset();
 
 		m_pCamera.reset();
 
 		m_pRenderContext->device.destroySampler(m_pRenderContext->defaultSampler);
 
+		m_pGeometryPool.reset();
 		m_pMaterialLibrary.reset();
 		m_pShaderLibrary.reset();
 		// TODO: automatically keep track of allocated command buffers and destroy them all.
@@ -539,4 +858,234 @@ namespace Hyper
 	{
 		VulkanUtils::Check(m_pRenderContext->device.waitIdle());
 	}
+
+	bool Renderer::UploadToBuffer(GrowableBuffer& buffer, const void* pData, u32 count, u32 stride, vk::BufferUsageFlags usage, const std::string& name) const
+	{
+		static constexpr u32 minCapacity = 1024;
+
+		bool recreated = false;
+		if (!buffer.pBuffer || count > buffer.capacity)
+		{
+			// The buffer belongs to a frame whose fence has been waited on, so it can be replaced right away.
+			// It's written every frame, so it stays mapped.
+			buffer.capacity = std::max(minCapacity, std::bit_ceil(count));
+			buffer.pBuffer = std::make_unique<VulkanBuffer>(m_pRenderContext.get(), static_cast<vk::DeviceSize>(buffer.capacity) * stride, usage,
+				VMA_MEMORY_USAGE_CPU_TO_GPU, name, vk::BufferCreateFlags{}, VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
+			recreated = true;
+		}
+
+		if (count > 0)
+		{
+			buffer.pBuffer->SetData(pData, static_cast<size_t>(count) * stride);
+		}
+
+		return recreated;
+	}
+
+	void Renderer::UploadDrawData(FrameData& frameData)
+	{
+		HPR_PROFILE_SCOPE();
+
+		const std::vector<InstanceData>& instanceData = m_pScene->GetInstanceData();
+		const std::vector<DrawData>& drawData = m_pScene->GetDrawData();
+		const std::vector<vk::DrawIndexedIndirectCommand>& indirectCommands = m_pScene->GetIndirectCommands();
+
+		const bool instanceBufferRecreated = UploadToBuffer(frameData.instanceBuffer, instanceData.data(), static_cast<u32>(instanceData.size()),
+			sizeof(InstanceData), vk::BufferUsageFlagBits::eStorageBuffer, "Instance buffer");
+		const bool drawDataBufferRecreated = UploadToBuffer(frameData.drawDataBuffer, drawData.data(), static_cast<u32>(drawData.size()),
+			sizeof(DrawData), vk::BufferUsageFlagBits::eStorageBuffer, "Draw data buffer");
+		UploadToBuffer(frameData.indirectBuffer, indirectCommands.data(), static_cast<u32>(indirectCommands.size()), sizeof(vk::DrawIndexedIndirectCommand),
+			vk::BufferUsageFlagBits::eIndirectBuffer, "Indirect draw buffer");
+
+		if (instanceBufferRecreated || drawDataBufferRecreated)
+		{
+			WriteDrawBuffers(frameData.descriptor, frameData.instanceBuffer.pBuffer->GetBuffer(), frameData.drawDataBuffer.pBuffer->GetBuffer());
+		}
+	}
+
+	void Renderer::UploadGpuDrawData(FrameData& frameData, u32 frameIdx)
+	{
+		HPR_PROFILE_SCOPE();
+
+		// Static scenes are only uploaded once to every frame's buffers.
+		if (frameData.gpuDrawVersion == m_pScene->GetGpuDrawVersion())
+			return;
+
+		const std::vector<InstanceData>& instanceData = m_pScene->GetGpuInstanceData();
+		const bool instanceBufferRecreated = UploadToBuffer(frameData.gpuInstanceBuffer, instanceData.data(), static_cast<u32>(instanceData.size()),
+			sizeof(InstanceData), vk::BufferUsageFlagBits::eStorageBuffer, "GPU culling instance buffer");
+		const bool drawDataBufferRecreated = m_pGpuCuller->Upload(frameIdx, m_pScene->GetGpuDrawObjects(), m_pScene->GetGpuMaterialRangeCount());
+
+		if (instanceBufferRecreated || drawDataBufferRecreated)
+		{
+			WriteDrawBuffers(frameData.gpuCullingDescriptor, frameData.gpuInstanceBuffer.pBuffer->GetBuffer(), m_pGpuCuller->GetDrawDataBuffer(frameIdx));
+		}
+
+		frameData.gpuDrawVersion = m_pScene->GetGpuDrawVersion();
+	}
+
+	void Renderer::WriteDrawBuffers(const vk::DescriptorSet& descriptor, const vk::Buffer& instanceBuffer, const vk::Buffer& drawDataBuffer) const
+	{
+		// The buffers belong to a frame whose fence has been waited on, so the descriptor set can be updated right away.
+		DescriptorWriter writer{ m_pRenderContext->device, descriptor };
+
+		vk::DescriptorBufferInfo instanceBufferInfo = {};
+		instanceBufferInfo.buffer = instanceBuffer;
+		instanceBufferInfo.offset = 0;
+		instanceBufferInfo.range = VK_WHOLE_SIZE;
+
+		vk::DescriptorBufferInfo drawDataBufferInfo = {};
+		drawDataBufferInfo.buffer = drawDataBuffer;
+		drawDataBufferInfo.offset = 0;
+		drawDataBufferInfo.range = VK_WHOLE_SIZE;
+
+		writer.WriteBuffer(instanceBufferInfo, 1, vk::DescriptorType::eStorageBuffer);
+		writer.WriteBuffer(drawDataBufferInfo, 2, vk::DescriptorType::eStorageBuffer);
+		writer.Write();
+	}
+
+	void Renderer::BindGeometryPassState(const vk::CommandBuffer& cmd, const vk::DescriptorSet& descriptor, u32 cameraOffset) const
+	{
+		const f32 imageWidth = static_cast<f32>(m_pRenderContext->imageExtent.width);
+		const f32 imageHeight = static_cast<f32>(m_pRenderContext->imageExtent.height);
+		cmd.setViewport(0, vk::Viewport{ 0, 0, imageWidth, imageHeight, 0.0f, 1.0f });
+		cmd.setScissor(0, vk::Rect2D{ vk::Offset2D{ 0, 0 }, m_pRenderContext->imageExtent });
+
+		cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, m_pGeometryPipeline->GetPipeline());
+		// Every material is in the material library's set, so nothing has to be bound per draw.
+		cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_pGeometryPipeline->GetLayout(), 0, { descriptor, m_pMaterialLibrary->GetDescriptorSet() }, { cameraOffset });
+		cmd.pushConstants<LightingSettings>(m_pGeometryPipeline->GetLayout(), vk::ShaderStageFlagBits::eFragment, 0, m_pScene->GetLightingSettings());
+
+		m_pGeometryPool->Bind(cmd);
+	}
+
+	void Renderer::RunGpuCullingCheck(FrameData& frameData)
+	{
+		HPR_PROFILE_SCOPE();
+
+		m_pScene->PrepareGpuDraws();
+		UploadGpuDrawData(frameData, m_FrameIdx);
+
+		const glm::mat4 viewProjection = m_pCamera->GetViewProjection();
+		m_GpuCullingStats.checkGpuCount = m_pGpuCuller->CullAndReadBack(m_FrameIdx, viewProjection, m_EnableOcclusionCulling);
+		m_GpuCullingStats.checkOcclusion = m_EnableOcclusionCulling;
+		m_GpuCullingStats.hasCheckResult = true;
+
+		if (!m_EnableOcclusionCulling)
+		{
+			m_GpuCullingStats.checkCpuCount = m_pScene->CountFrustumVisible(viewProjection);
+		}
+		else
+		{
+			// Repeat the culling pass' tests on the CPU, against a copy of the same pyramid.
+			m_pDepthPyramid->ReadBack();
+
+			const Frustum frustum{ viewProjection };
+			std::vector<DepthRect> rects;
+			std::vector<bool> cpuOccluded;
+			u32 cpuCount = 0;
+			for (const GpuDrawObject& object : m_pScene->GetGpuDrawObjects())
+			{
+				if (!frustum.Intersects(AABB{ object.boundsMin, object.boundsMax }))
+					continue;
+
+				DepthRect rect;
+				if (!DepthPyramid::ProjectBox(object.boundsMin, object.boundsMax, viewProjection, rect))
+				{
+					cpuCount++;
+					continue;
+				}
+
+				rects.push_back(rect);
+				cpuOccluded.push_back(m_pDepthPyramid->IsRectOccluded(rect));
+				if (!cpuOccluded.back())
+					cpuCount++;
+			}
+			m_GpuCullingStats.checkCpuCount = cpuCount;
+
+			// The rect test API has to agree with the CPU as well.
+			const std::vector<bool> gpuOccluded = m_pDepthPyramid->TestRects(rects);
+			m_GpuCullingStats.checkRectCount = static_cast<u32>(rects.size());
+			m_GpuCullingStats.checkRectMismatchCount = 0;
+			for (size_t i = 0; i < rects.size(); i++)
+			{
+				if (gpuOccluded[i] != cpuOccluded[i])
+					m_GpuCullingStats.checkRectMismatchCount++;
+			}
+
+			if (m_GpuCullingStats.checkRectMismatchCount > 0)
+			{
+				HPR_CORE_LOG_ERROR("Depth rect test check failed: GPU and CPU disagree on {} of {} rects", m_GpuCullingStats.checkRectMismatchCount, m_GpuCullingStats.checkRectCount);
+			}
+		}
+
+		if (m_GpuCullingStats.checkGpuCount == m_GpuCullingStats.checkCpuCount)
+		{
+			HPR_CORE_LOG_INFO("GPU culling check passed: {} of {} objects visible", m_GpuCullingStats.checkGpuCount, m_pGpuCuller->GetObjectCount(m_FrameIdx));
+		}
+		else
+		{
+			HPR_CORE_LOG_ERROR("GPU culling check failed: {} objects visible on the GPU, {} on the CPU", m_GpuCullingStats.checkGpuCount, m_GpuCullingStats.checkCpuCount);
+		}
+	}
+
+	void Renderer::RunRecordingBenchmark(const FrameData& frameData, const vk::CommandBufferInheritanceRenderingInfo& inheritanceInfo)
+	{
+		HPR_PROFILE_SCOPE();
+
+		static constexpr u32 runCount = 16;
+
+		using Clock = std::chrono::high_resolution_clock;
+		const u32 drawCount = m_pScene->GetDrawCount();
+
+		// The recorded command buffers are never submitted, they're reset again before the next run and before the real frame.
+		const auto measure = [&](u32 maxChunkCount)
+		{
+			CommandRecordingStats stats{ drawCount, drawCount, 0, 0.0f };
+			for (u32 run = 0; run < runCount; run++)
+			{
+				m_pCommandRecorder->BeginFrame(m_FrameIdx);
+
+				const auto startTime = Clock::now();
+				const std::vector<vk::CommandBuffer>& commandBuffers = m_pCommandRecorder->Record(inheritanceInfo, drawCount, maxChunkCount,
+					[&](const vk::CommandBuffer& cmd, u32 first, u32 count)
+					{
+						BindGeometryPassState(cmd, frameData.descriptor, frameData.cameraOffset);
+						m_pScene->RecordDraws(cmd, first, count);
+					});
+				stats.recordTimeMs += std::chrono::duration<f32, std::milli>(Clock::now() - startTime).count();
+				stats.commandBufferCount = static_cast<u32>(commandBuffers.size());
+			}
+
+			stats.recordTimeMs /= static_cast<f32>(runCount);
+			return stats;
+		};
+
+		m_BenchmarkSerialStats = measure(1);
+		m_BenchmarkParallelStats = measure(m_pCommandRecorder->GetThreadCount() * 2);
+
+		// The indirect commands are recorded into a single secondary command buffer, so it's timed the same way as the other two.
+		m_BenchmarkIndirectStats = { drawCount, drawCount > 0 ? 1u : 0u, 1, 0.0f };
+		for (u32 run = 0; run < runCount; run++)
+		{
+			m_pCommandRecorder->BeginFrame(m_FrameIdx);
+
+			const auto startTime = Clock::now();
+			m_pCommandRecorder->Record(inheritanceInfo, 1, 1,
+				[&](const vk::CommandBuffer& cmd, u32, u32)
+				{
+					BindGeometryPassState(cmd, frameData.descriptor, frameData.cameraOffset);
+					m_pScene->RecordIndirectDraws(cmd, frameData.indirectBuffer.pBuffer->GetBuffer());
+				});
+			m_BenchmarkIndirectStats.recordTimeMs += std::chrono::duration<f32, std::milli>(Clock::now() - startTime).count();
+		}
+		m_BenchmarkIndirectStats.recordTimeMs /= static_cast<f32>(runCount);
+
+		HPR_CORE_LOG_INFO("Command recording benchmark ({} runs, {} draws):", runCount, drawCount);
+		HPR_CORE_LOG_INFO("  1 thread: {:.3f} ms", m_BenchmarkSerialStats.recordTimeMs);
+		HPR_CORE_LOG_INFO("  {} threads: {:.3f} ms over {} command buffers ({:.2f}x)", m_pCommandRecorder->GetThreadCount(),
+			m_BenchmarkParallelStats.recordTimeMs, m_BenchmarkParallelStats.commandBufferCount,
+			m_BenchmarkSerialStats.recordTimeMs / std::max(m_BenchmarkParallelStats.recordTimeMs, 1e-6f));
+		HPR_CORE_LOG_INFO("  Multi-draw indirect: {:.3f} ms over {} draw calls", m_BenchmarkIndirectStats.recordTimeMs, m_BenchmarkIndirectStats.drawCallCount);
+	}
 }
@@ -1,12 +1,17 @@
 ﻿#pragma once
 #include <vulkan/vulkan.hpp>
 
+#include "DepthPyramid.h"
 #include "FlyCamera.h"
+#include "GeometryPool.h"
+#include "GpuDrawCuller.h"
 #include "ShaderLibrary.h"
 #include "MaterialLibrary.h"
 #include "Mesh.h"
+#include "ParallelCommandRecorder.h"
 #include "RenderContext.h"
 #include "RenderTarget.h"
+#include "UniformRing.h"
 #include "Hyper/Core/Subsystem.h"
 #include "ImGui/ImGuiWrapper.h"
 #include "Vulkan/VulkanCommands.h"
@@ -19,11 +24,7 @@
 namespace Hyper
 {
 	class Scene;
-
-	struct ModelMatrixPushConst
-	{
-		glm::mat4 modelMatrix;
-	};
+	struct InstanceData;
 
 	struct CameraData
 	{
@@ -32,12 +33,68 @@ namespace Hyper
 		glm::mat4 viewProj;
 	};
 
+	// Buffer that's recreated with a larger capacity when more elements are written to it than fit.
+	struct GrowableBuffer
+	{
+		std::unique_ptr<VulkanBuffer> pBuffer{};
+		u32 capacity{};
+	};
+
 	struct FrameData
 	{
-		VulkanBuffer cameraBuffer;
 		vk::DescriptorSet descriptor;
+		// Dynamic offset of the frame's camera data in the uniform ring, shared by both descriptor sets.
+		u32 cameraOffset{};
+		// Per-instance and per-draw data of the geometry pass, and the indirect commands that draw it.
+		GrowableBuffer instanceBuffer{};
+		GrowableBuffer drawDataBuffer{};
+		GrowableBuffer indirectBuffer{};
+		// Used instead of the above when culling on the GPU. The instances of all meshes are uploaded when the scene changes,
+		// the draw data and indirect commands are written by the culling pass.
+		vk::DescriptorSet gpuCullingDescriptor{};
+		GrowableBuffer gpuInstanceBuffer{};
+		// Version of the scene's GPU draw objects that was last uploaded to this frame's buffers.
+		u32 gpuDrawVersion{};
+	};
+
+	struct CommandRecordingStats
+	{
+		u32 drawCount;
+		// Draw commands recorded on the CPU, a multi-draw indirect call counts as one.
+		u32 drawCallCount;
+		// Secondary command buffers the draws were split over, 0 if they were recorded directly into the primary one.
+		u32 commandBufferCount;
+		f32 recordTimeMs;
+		// Descriptor set binds, one per command buffer the geometry pass state is bound in. Materials are bindless.
+		u32 descriptorBindCount;
+	};
+
+	struct GpuCullingStats
+	{
+		// Read back from the last frame that culled on the GPU with the same frame index.
+		u32 visibleCount;
+		// Visible counts of the last check against CPU culling, for the same camera.
+		u32 checkGpuCount;
+		u32 checkCpuCount;
+		// With occlusion culling, the check also compares the GPU and CPU rect tests of every object in the frustum.
+		bool checkOcclusion;
+		u32 checkRectCount;
+		u32 checkRectMismatchCount;
+		bool hasCheckResult;
 	};
 	
+	// Acceleration structure and trace cost of one of the scene's BLAS modes, kept to compare them.
+	struct RayTracingModeStats
+	{
+		u32 instanceCount;
+		u32 blasCount;
+		// BLAS build, compaction and TLAS build.
+		f32 buildTimeMs;
+		// GPU time of the trace, smoothed over the frames that used the mode.
+		f32 traceTimeMs;
+		bool isValid;
+	};
+
 	class Renderer final : public Subsystem
 	{
 	public:
@@ -52,25 +109,61 @@ namespace Hyper
 		void WaitIdle();
 
 		[[nodiscard]] RenderContext* GetRenderContext() const { return m_pRenderContext.get(); }
+		[[nodiscard]] FlyCamera* GetCamera() const { return m_pCamera.get(); }
+
+	private:
+		// Copies the data into the buffer, and recreates the buffer if it's too small. Returns whether the buffer was recreated.
+		bool UploadToBuffer(GrowableBuffer& buffer, const void* pData, u32 count, u32 stride, vk::BufferUsageFlags usage, const std::string& name) const;
+		// Copies the instances, draw data and indirect commands prepared by the scene into the frame's buffers.
+		void UploadDrawData(FrameData& frameData);
+		// Copies the scene's GPU draw objects and their instances into the frame's buffers, if they changed since the last upload.
+		void UploadGpuDrawData(FrameData& frameData, u32 frameIdx);
+		// Points the instance and draw data bindings of a geometry pass descriptor set to the given buffers.
+		void WriteDrawBuffers(const vk::DescriptorSet& descriptor, const vk::Buffer& instanceBuffer, const vk::Buffer& drawDataBuffer) const;
+		// Sets all geometry pass state. Secondary command buffers don't inherit any, so each of them needs this before drawing.
+		void BindGeometryPassState(const vk::CommandBuffer& cmd, const vk::DescriptorSet& descriptor, u32 cameraOffset) const;
+		// Culls the current view on the GPU in a separate submit and on the CPU, and logs whether the visible counts match.
+		// With occlusion culling both test against the last built depth pyramid.
+		void RunGpuCullingCheck(FrameData& frameData);
+		// Records the current draws over and over, on one thread, spread over all threads and with multi-draw indirect, and logs the average times.
+		void RunRecordingBenchmark(const FrameData& frameData, const vk::CommandBufferInheritanceRenderingInfo& inheritanceInfo);
 
 	private:
 		std::unique_ptr<RenderContext> m_pRenderContext;
 		std::unique_ptr<VulkanDevice> m_pDevice;
 		std::unique_ptr<VulkanCommandPool> m_pCommandPool;
 		std::unique_ptr<VulkanSwapChain> m_pSwapChain;
+		std::unique_ptr<DescriptorAllocator> m_pDescriptorAllocator;
+		std::unique_ptr<UniformRing> m_pUniformRing;
 		std::unique_ptr<ImGuiWrapper> m_pImGuiWrapper;
 		std::unique_ptr<ShaderLibrary> m_pShaderLibrary;
 		std::unique_ptr<MaterialLibrary> m_pMaterialLibrary;
+		std::unique_ptr<GeometryPool> m_pGeometryPool;
 
 		std::unique_ptr<VulkanRaytracer> m_pRayTracer;
+		// Indexed by whether the scene merges static meshes.
+		std::array<RayTracingModeStats, 2> m_RayTracingModeStats{};
+		bool m_RunRayTracingComparison{ false };
 
 		std::vector<FrameData> m_GeometryFrameDatas;
 		std::unique_ptr<RenderTarget> m_pGeometryRenderTarget{};
-		std::unique_ptr<DescriptorPool> m_pGeometryDescriptorPool{};
 		VulkanShader* m_pGeometryShader;
 		std::unique_ptr<VulkanGraphicsPipeline> m_pGeometryPipeline;
+		std::unique_ptr<ParallelCommandRecorder> m_pCommandRecorder;
+		bool m_EnableIndirectDraws{ true };
+		bool m_EnableParallelRecording{ true };
+		CommandRecordingStats m_RecordingStats{};
+		bool m_RunRecordingBenchmark{ false };
+		CommandRecordingStats m_BenchmarkSerialStats{};
+		CommandRecordingStats m_BenchmarkParallelStats{};
+		CommandRecordingStats m_BenchmarkIndirectStats{};
+		std::unique_ptr<DepthPyramid> m_pDepthPyramid;
+		std::unique_ptr<GpuDrawCuller> m_pGpuCuller;
+		bool m_EnableGpuCulling{ false };
+		bool m_EnableOcclusionCulling{ false };
+		bool m_RunGpuCullingCheck{ false };
+		GpuCullingStats m_GpuCullingStats{};
 
-		std::unique_ptr<DescriptorPool> m_pCompositeDescriptorPool{};
 		vk::DescriptorSet m_CompositeDescriptorSet{};
 		VulkanShader* m_pCompositeShader;
 		std::unique_ptr<VulkanGraphicsPipeline> m_pCompositePipeline;
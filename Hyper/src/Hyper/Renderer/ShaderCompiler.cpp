@@ -37,9 +37,11 @@ namespace Hyper
 		{
 		case ShaderStageType::Vertex: return shaderc_shader_kind::shaderc_vertex_shader;
 		case ShaderStageType::Fragment: return shaderc_shader_kind::shaderc_fragment_shader;
+		case ShaderStageType::Compute: return shaderc_shader_kind::shaderc_compute_shader;
 		case ShaderStageType::RayGen: return shaderc_shader_kind::shaderc_raygen_shader;
 		case ShaderStageType::Miss: return shaderc_shader_kind::shaderc_miss_shader;
 		case ShaderStageType::ClosestHit: return shaderc_shader_kind::shaderc_closesthit_shader;
+		case ShaderStageType::AnyHit: return shaderc_shader_kind::shaderc_anyhit_shader;
 		}
 
 		throw std::runtime_error("Unsupported shader type!");
@@ -251,11 +253,17 @@ namespace Hyper
 		case ShaderStageType::Fragment:
 			targetProfile = L"ps_6_1";
 			break;
+		case ShaderStageType::Compute:
+			targetProfile = L"cs_6_1";
+			break;
 		case ShaderStageType::RayGen:
 		case ShaderStageType::ClosestHit:
 		case ShaderStageType::Miss:
 			targetProfile = L"lib_6_3"; // requires shader model 6.3 or later...
 			break;
+		case ShaderStageType::AnyHit:
+			targetProfile = L"lib_6_5"; // GeometryIndex() requires shader model 6.5
+			break;
 		default:
 			HPR_CORE_LOG_ERROR("Unsupported shader stage");
 			throw std::runtime_error("Unsupported shader stage");
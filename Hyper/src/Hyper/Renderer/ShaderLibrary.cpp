@@ -24,7 +24,23 @@ namespace Hyper
 		LoadShader("RTShadows", std::unordered_map<ShaderStageType, std::filesystem::path>{
 			{ ShaderStageType::RayGen, "res/shaders/RTShadows.rgen.hlsl" },
 			{ ShaderStageType::Miss, "res/shaders/RTShadows.rmiss.hlsl" },
-			{ ShaderStageType::ClosestHit, "res/shaders/RTShadows.rchit.hlsl" },
+			{ ShaderStageType::AnyHit, "res/shaders/RTShadows.rahit.hlsl" },
+		});
+
+		LoadShader("RTUpsample", std::unordered_map<ShaderStageType, std::filesystem::path>{
+			{ ShaderStageType::Compute, "res/shaders/RTUpsample.comp.hlsl" },
+		});
+
+		LoadShader("DrawCulling", std::unordered_map<ShaderStageType, std::filesystem::path>{
+			{ ShaderStageType::Compute, "res/shaders/DrawCulling.comp.hlsl" },
+		});
+
+		LoadShader("DepthPyramid", std::unordered_map<ShaderStageType, std::filesystem::path>{
+			{ ShaderStageType::Compute, "res/shaders/DepthPyramid.comp.hlsl" },
+		});
+
+		LoadShader("DepthRectTest", std::unordered_map<ShaderStageType, std::filesystem::path>{
+			{ ShaderStageType::Compute, "res/shaders/DepthRectTest.comp.hlsl" },
 		});
 	}
 
@@ -48,6 +64,11 @@ namespace Hyper
 		m_ShaderDependencies[shaderId].graphicsPipelines.push_back(graphicsPipeline);
 	}
 
+	void ShaderLibrary::RegisterShaderDependency(const UUID& shaderId, VulkanComputePipeline* computePipeline)
+	{
+		m_ShaderDependencies[shaderId].computePipelines.push_back(computePipeline);
+	}
+
 	void ShaderLibrary::RegisterShaderDependency(const UUID& shaderId, VulkanRayTracingPipeline* rtPipeline)
 	{
 		m_ShaderDependencies[shaderId].rayTracingPipelines.push_back(rtPipeline);
@@ -58,6 +79,11 @@ namespace Hyper
 		std::erase(m_ShaderDependencies[shaderId].graphicsPipelines, graphicsPipeline);
 	}
 
+	void ShaderLibrary::UnRegisterShaderDependency(const UUID& shaderId, VulkanComputePipeline* computePipeline)
+	{
+		std::erase(m_ShaderDependencies[shaderId].computePipelines, computePipeline);
+	}
+
 	void ShaderLibrary::UnRegisterShaderDependency(const UUID& shaderId, VulkanRayTracingPipeline* rtPipeline)
 	{
 		std::erase(m_ShaderDependencies[shaderId].rayTracingPipelines, rtPipeline);
@@ -86,6 +112,10 @@ namespace Hyper
 							{
 								graphicsPipeline->Recreate();
 							}
+							for (VulkanComputePipeline* computePipeline : m_ShaderDependencies[pShader->GetId()].computePipelines)
+							{
+								computePipeline->Recreate();
+							}
 							for (VulkanRayTracingPipeline* rtPipeline : m_ShaderDependencies[pShader->GetId()].rayTracingPipelines)
 							{
 								rtPipeline->Recreate();
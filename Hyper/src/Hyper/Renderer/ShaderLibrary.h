@@ -4,6 +4,7 @@
 namespace Hyper
 {
 	class VulkanGraphicsPipeline;
+	class VulkanComputePipeline;
 	class VulkanRayTracingPipeline;
 	struct RenderContext;
 	class VulkanShader;
@@ -11,6 +12,7 @@ namespace Hyper
 	struct ShaderDependencies
 	{
 		std::vector<VulkanGraphicsPipeline*> graphicsPipelines;
+		std::vector<VulkanComputePipeline*> computePipelines;
 		std::vector<VulkanRayTracingPipeline*> rayTracingPipelines;
 	};
 
@@ -22,9 +24,11 @@ namespace Hyper
 
 		VulkanShader* GetShader(const std::string& shaderName) const;
 		void RegisterShaderDependency(const UUID& shaderId, VulkanGraphicsPipeline* graphicsPipeline);
+		void RegisterShaderDependency(const UUID& shaderId, VulkanComputePipeline* computePipeline);
 		void RegisterShaderDependency(const UUID& shaderId, VulkanRayTracingPipeline* rtPipeline);
 
 		void UnRegisterShaderDependency(const UUID& shaderId, VulkanGraphicsPipeline* graphicsPipeline);
+		void UnRegisterShaderDependency(const UUID& shaderId, VulkanComputePipeline* computePipeline);
 		void UnRegisterShaderDependency(const UUID& shaderId, VulkanRayTracingPipeline* rtPipeline);
 
 		void DrawImGui();
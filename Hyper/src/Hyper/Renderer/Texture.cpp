@@ -31,6 +31,12 @@ namespace Hyper
 				HPR_CORE_LOG_ERROR("Failed to load image file '{}'", filePath.string());
 				return;
 			}
+
+			// Lets materials tell whether alpha testing can ever discard a pixel.
+			for (i32 i = 0; i < width * height; i++)
+			{
+				m_MinAlpha = std::min(m_MinAlpha, pixels[i * 4 + 3]);
+			}
 		}
 
 		// Copy pixels to a staging buffer.
@@ -69,7 +75,8 @@ namespace Hyper
 	}
 
 	Texture::Texture(Texture&& other) noexcept: m_pRenderCtx(other.m_pRenderCtx),
-		m_pImage(std::move(other.m_pImage))
+		m_pImage(std::move(other.m_pImage)),
+		m_MinAlpha(other.m_MinAlpha)
 	{
 	}
 
@@ -80,6 +87,7 @@ namespace Hyper
 
 		m_pRenderCtx = other.m_pRenderCtx;
 		m_pImage = std::move(other.m_pImage);
+		m_MinAlpha = other.m_MinAlpha;
 		
 		return *this;
 	}
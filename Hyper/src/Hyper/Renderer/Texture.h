@@ -17,11 +17,14 @@ namespace Hyper
 
 		[[nodiscard]] VulkanImage* GetImage() const { return m_pImage.get(); }
 		[[nodiscard]] vk::DescriptorImageInfo GetDescriptorImageInfo() const;
+		// Lowest alpha of any pixel, in [0, 1].
+		[[nodiscard]] f32 GetMinAlpha() const { return static_cast<f32>(m_MinAlpha) / 255.0f; }
 
 	private:
 		RenderContext* m_pRenderCtx{};
 
 		std::filesystem::path m_FilePath;
 		std::unique_ptr<VulkanImage> m_pImage;
+		u8 m_MinAlpha{ 255 };
 	};
 }
@@ -0,0 +1,53 @@
+﻿#include "HyperPCH.h"
+#include "UniformRing.h"
+
+#include "RenderContext.h"
+
+namespace Hyper
+{
+	UniformRing::UniformRing(RenderContext* pRenderCtx, u32 frameCount, vk::DeviceSize frameCapacity)
+		: m_pRenderCtx(pRenderCtx)
+		, m_FrameCapacity(frameCapacity)
+	{
+		m_Alignment = m_pRenderCtx->physicalDevice.getProperties().limits.minUniformBufferOffsetAlignment;
+
+		m_Frames.resize(frameCount);
+		for (u32 i = 0; i < frameCount; i++)
+		{
+			FrameBuffer& frame = m_Frames[i];
+			frame.pBuffer = std::make_unique<VulkanBuffer>(m_pRenderCtx, m_FrameCapacity, vk::BufferUsageFlagBits::eUniformBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU,
+				fmt::format("Uniform ring {}", i), vk::BufferCreateFlags{}, VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
+		}
+	}
+
+	void UniformRing::BeginFrame(u32 frameIdx)
+	{
+		m_Frames[frameIdx].offset = 0;
+
+		m_LastFrameStats = m_Stats;
+		m_Stats = {};
+	}
+
+	u32 UniformRing::Write(u32 frameIdx, const void* pData, vk::DeviceSize size)
+	{
+		using Clock = std::chrono::high_resolution_clock;
+		const auto startTime = Clock::now();
+
+		FrameBuffer& frame = m_Frames[frameIdx];
+		const vk::DeviceSize offset = (frame.offset + m_Alignment - 1) / m_Alignment * m_Alignment;
+		if (offset + size > m_FrameCapacity)
+		{
+			HPR_CORE_LOG_ERROR("Uniform ring is full: {} bytes written this frame, {} more don't fit in {}", frame.offset, size, m_FrameCapacity);
+			throw std::runtime_error(fmt::format("Uniform ring is full ({} bytes per frame)", m_FrameCapacity));
+		}
+
+		frame.pBuffer->Write(pData, size, offset);
+		frame.offset = offset + size;
+
+		m_Stats.writeCount++;
+		m_Stats.writtenBytes += static_cast<u32>(size);
+		m_Stats.writeTimeMs += std::chrono::duration<f32, std::milli>(Clock::now() - startTime).count();
+
+		return static_cast<u32>(offset);
+	}
+}
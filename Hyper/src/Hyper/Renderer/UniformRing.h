@@ -0,0 +1,64 @@
+﻿#pragma once
+#include <vulkan/vulkan.hpp>
+
+#include "Vulkan/VulkanBuffer.h"
+
+namespace Hyper
+{
+	struct RenderContext;
+
+	struct UniformRingStats
+	{
+		// Uniform writes during the last frame.
+		u32 writeCount;
+		u32 writtenBytes;
+		// CPU time spent copying them into the ring.
+		f32 writeTimeMs;
+	};
+
+	// Per-frame uniform data, written into one persistently mapped buffer per frame in flight. Every write gets its own aligned slice,
+	// which shaders read through a dynamic uniform buffer descriptor. The descriptor sets are written once and point at the frame's buffer,
+	// the offset of the slice is passed when they're bound, so updating uniforms never maps memory or writes descriptors.
+	// All slices of a frame are freed at once, when BeginFrame is called with its index again.
+	class UniformRing
+	{
+	public:
+		UniformRing(RenderContext* pRenderCtx, u32 frameCount, vk::DeviceSize frameCapacity = 64 * 1024);
+		~UniformRing() = default;
+
+		UniformRing(const UniformRing& other) = delete;
+		UniformRing& operator=(const UniformRing& other) = delete;
+
+		// Frees the slices of the frame, whose fence must have been waited on.
+		void BeginFrame(u32 frameIdx);
+
+		// Copies the data into a new slice of the frame's buffer, and returns the dynamic offset to bind it with.
+		[[nodiscard]] u32 Write(u32 frameIdx, const void* pData, vk::DeviceSize size);
+		template<typename T>
+		[[nodiscard]] u32 Write(u32 frameIdx, const T& data) { return Write(frameIdx, &data, sizeof(T)); }
+
+		// Descriptor info for a dynamic uniform buffer of type T. The offset is always 0, the slice's offset is added when binding.
+		template<typename T>
+		[[nodiscard]] vk::DescriptorBufferInfo GetDescriptorInfo(u32 frameIdx) const { return vk::DescriptorBufferInfo{ GetBuffer(frameIdx), 0, sizeof(T) }; }
+		[[nodiscard]] vk::Buffer GetBuffer(u32 frameIdx) const { return m_Frames[frameIdx].pBuffer->GetBuffer(); }
+
+		[[nodiscard]] const UniformRingStats& GetStats() const { return m_LastFrameStats; }
+
+	private:
+		struct FrameBuffer
+		{
+			std::unique_ptr<VulkanBuffer> pBuffer;
+			vk::DeviceSize offset{};
+		};
+
+	private:
+		RenderContext* m_pRenderCtx;
+
+		std::vector<FrameBuffer> m_Frames;
+		vk::DeviceSize m_FrameCapacity;
+		vk::DeviceSize m_Alignment;
+
+		UniformRingStats m_Stats{};
+		UniformRingStats m_LastFrameStats{};
+	};
+}
@@ -1,260 +1,1040 @@
 ﻿#include "HyperPCH.h"
 #include "VulkanAccelerationStructure.h"
 
+#include "imgui.h"
 #include "VulkanDebug.h"
 #include "VulkanUtility.h"
+#include "Hyper/Core/Hash.h"
+#include "Hyper/Debug/Profiler.h"
+#include "Hyper/IO/FileUtils.h"
 #include "Hyper/Renderer/FlyCamera.h"
+#include "Hyper/Renderer/MaterialLibrary.h"
 #include "Hyper/Renderer/Mesh.h"
 #include "Hyper/Renderer/RenderContext.h"
 
 namespace Hyper
 {
-	VulkanAccelerationStructure::VulkanAccelerationStructure(RenderContext* pRenderCtx)
+	// Scratch memory shared by a batch of BLAS builds.
+	static constexpr vk::DeviceSize s_ScratchBudget = 256ull * 1024 * 1024;
+
+	// The TLAS is refit every frame that instances move, and rebuilt from scratch once refitting degraded it too much.
+	static constexpr vk::BuildAccelerationStructureFlagsKHR s_TlasBuildFlags = vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace
+		| vk::BuildAccelerationStructureFlagBitsKHR::eAllowUpdate;
+
+	// Shared by every acceleration structure, so the versions of TLASes that replace each other never collide.
+	static u32 s_LastTlasVersion = 0;
+
+	// Serialized BLASes are stored in files named after their cache key. Bump the version whenever the BLAS build inputs change,
+	// so BLASes cached by older builds are never loaded.
+	static constexpr const char* s_BlasCacheDirectory = "cache/blas";
+	static constexpr u32 s_BlasCacheVersion = 1;
+	// Serialized data starts with the driver UUID and the compatibility UUID, followed by the serialized size, the deserialized size
+	// and the number of BLAS handles a TLAS references.
+	static constexpr size_t s_SerializedSizeOffset = 2 * VK_UUID_SIZE;
+	static constexpr size_t s_DeserializedSizeOffset = s_SerializedSizeOffset + sizeof(u64);
+	static constexpr size_t s_SerializedHeaderSize = s_DeserializedSizeOffset + 2 * sizeof(u64);
+	static constexpr vk::DeviceSize s_SerializedDataAlignment = 256;
+
+	static vk::DeviceSize AlignScratch(vk::DeviceSize offset, vk::DeviceSize alignment)
+	{
+		return (offset + alignment - 1) / alignment * alignment;
+	}
+
+	// Makes the acceleration structures written by earlier builds and copies, including the ones of earlier submits on the queue,
+	// readable by the following ones, and keeps those from overwriting scratch memory that's still in use.
+	static void InsertBuildBarrier(const vk::CommandBuffer& cmd)
+	{
+		vk::MemoryBarrier barrier{};
+		barrier.srcAccessMask = vk::AccessFlagBits::eAccelerationStructureWriteKHR;
+		barrier.dstAccessMask = vk::AccessFlagBits::eAccelerationStructureReadKHR | vk::AccessFlagBits::eAccelerationStructureWriteKHR;
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR, vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
+			{}, barrier, {}, {});
+	}
+
+	// Masked geometry isn't opaque, so rays run the any-hit shader for it, which alpha tests it.
+	static bool IsMeshMasked(const RenderContext* pRenderCtx, const Mesh* pMesh)
+	{
+		return pRenderCtx->pMaterialLibrary->GetMaterial(pMesh->GetMaterialId()).GetAlphaMode() == MaterialAlphaMode::Masked;
+	}
+
+	static std::filesystem::path GetBlasCachePath(u64 cacheKey)
+	{
+		return std::filesystem::path(s_BlasCacheDirectory) / fmt::format("{:016x}.blas", cacheKey);
+	}
+
+	// Whether the data is a whole serialized BLAS that the device can deserialize. Data serialized by another driver version isn't.
+	static bool IsSerializedBlasCompatible(const vk::Device& device, const std::string& data)
+	{
+		if (data.size() < s_SerializedHeaderSize)
+			return false;
+
+		u64 serializedSize = 0;
+		memcpy(&serializedSize, data.data() + s_SerializedSizeOffset, sizeof(u64));
+		if (serializedSize != data.size())
+			return false;
+
+		vk::AccelerationStructureVersionInfoKHR versionInfo{};
+		versionInfo.pVersionData = reinterpret_cast<const u8*>(data.data());
+		return device.getAccelerationStructureCompatibilityKHR(versionInfo) == vk::AccelerationStructureCompatibilityKHR::eCompatible;
+	}
+
+	// GLM is column-major, but VkTransformMatrixKHR is row-major, so we need to convert.
+	static vk::TransformMatrixKHR ToTransformMatrix(const glm::mat4& transform)
+	{
+		return std::array{
+			std::array{transform[0][0], transform[1][0], transform[2][0], transform[3][0]},
+			std::array{transform[0][1], transform[1][1], transform[2][1], transform[3][1]},
+			std::array{transform[0][2], transform[1][2], transform[2][2], transform[3][2]},
+		};
+	}
+
+	VulkanAccelerationStructure::VulkanAccelerationStructure(RenderContext* pRenderCtx, u32 frameCount)
 		: m_pRenderCtx(pRenderCtx)
+		, m_FrameCount(frameCount)
 	{
+		vk::QueryPoolCreateInfo queryPoolInfo{};
+		queryPoolInfo.queryType = vk::QueryType::eTimestamp;
+		queryPoolInfo.queryCount = frameCount * 2;
+		m_TimestampPool = VulkanUtils::Check(m_pRenderCtx->device.createQueryPool(queryPoolInfo));
+		m_TimestampsWritten.resize(frameCount, false);
+		m_TimestampPeriod = m_pRenderCtx->physicalDevice.getProperties().limits.timestampPeriod;
+
+		m_pBuildCommandPool = std::make_unique<VulkanCommandPool>(m_pRenderCtx, m_pRenderCtx->computeQueue.familyIndex);
+
+		vk::SemaphoreTypeCreateInfo semaphoreTypeInfo{};
+		semaphoreTypeInfo.semaphoreType = vk::SemaphoreType::eTimeline;
+		semaphoreTypeInfo.initialValue = 0;
+		vk::SemaphoreCreateInfo semaphoreInfo{};
+		semaphoreInfo.pNext = &semaphoreTypeInfo;
+		m_BuildSemaphore = VulkanUtils::Check(m_pRenderCtx->device.createSemaphore(semaphoreInfo));
+		VkDebug::SetObjectName(m_pRenderCtx->device, vk::ObjectType::eSemaphore, m_BuildSemaphore, "Acceleration structure build semaphore");
+
+		const auto properties = m_pRenderCtx->physicalDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceIDProperties>();
+		const vk::PhysicalDeviceIDProperties& idProperties = properties.get<vk::PhysicalDeviceIDProperties>();
+		m_DeviceHash = Hash::Fnv1aValue(idProperties.deviceUUID);
+		m_DeviceHash = Hash::Fnv1aValue(idProperties.driverUUID, m_DeviceHash);
 	}
 
 	VulkanAccelerationStructure::~VulkanAccelerationStructure()
 	{
+		// Only the submitted stage can still be running, the later ones are never submitted.
+		if (m_BuildStage != BuildStage::None && m_BuildStage != BuildStage::Done)
+		{
+			WaitForBuildStage();
+		}
+
+		Clear();
+		m_pBuildCommandPool.reset();
+		m_pRenderCtx->device.destroySemaphore(m_BuildSemaphore);
+		m_pRenderCtx->device.destroyQueryPool(m_TimestampPool);
+	}
+
+	void VulkanAccelerationStructure::AddMesh(const Mesh* mesh, const glm::mat4& transform, const std::string& name)
+	{
+		// Staged BLASes get the indices after the BLASes that were already built, in the order they're staged.
+		const auto [it, inserted] = m_MeshBlases.try_emplace(mesh, static_cast<u32>(m_BLASes.size() + m_StagedBlases.size()));
+		if (inserted)
+		{
+			m_StagedBlases.push_back(StagedBlas{ { mesh }, {}, name });
+		}
+		m_Instances.push_back(Instance{ it->second, transform, mesh->GetLocalBounds() });
+	}
+
+	void VulkanAccelerationStructure::AddMergedMeshes(const std::vector<std::pair<const Mesh*, glm::mat4>>& meshes, const glm::mat4& transform, const std::string& name)
+	{
+		const u32 blasIndex = static_cast<u32>(m_BLASes.size() + m_StagedBlases.size());
+
+		StagedBlas& staged = m_StagedBlases.emplace_back();
+		staged.name = name;
+		AABB localBounds{};
+		for (const auto& [pMesh, meshTransform] : meshes)
+		{
+			staged.meshes.push_back(pMesh);
+			staged.transforms.push_back(meshTransform);
+			localBounds.Grow(pMesh->GetLocalBounds().Transformed(meshTransform));
+		}
+		m_Instances.push_back(Instance{ blasIndex, transform, localBounds });
+	}
+
+	void VulkanAccelerationStructure::BeginBuild()
+	{
+		HPR_PROFILE_SCOPE();
+
+		if (m_BuildStage != BuildStage::None && m_BuildStage != BuildStage::Done)
+		{
+			HPR_CORE_LOG_WARN("Can't start a build of the acceleration structures while they're still building!");
+			return;
+		}
+
+		m_BuildFirstBlas = static_cast<u32>(m_BLASes.size());
+		m_BuildCmd = m_pBuildCommandPool->GetCommandBuffer();
+		VulkanCommandBuffer::Begin(m_BuildCmd, vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+		if (m_StagedBlases.empty())
+		{
+			RecordTlasCreation(m_BuildCmd);
+			SubmitBuildStage(BuildStage::Tlas);
+			return;
+		}
+
+		LoadCachedBlases();
+		RecordBlasBuilds(m_BuildCmd);
+		SubmitBuildStage(BuildStage::Blases);
+	}
+
+	bool VulkanAccelerationStructure::PollBuild()
+	{
+		if (m_BuildStage == BuildStage::Done)
+			return true;
+		if (m_BuildStage == BuildStage::None)
+			return false;
+
+		if (VulkanUtils::Check(m_pRenderCtx->device.getSemaphoreCounterValue(m_BuildSemaphore)) < m_BuildValue)
+			return false;
+
+		HPR_PROFILE_SCOPE();
+
+		using Clock = std::chrono::high_resolution_clock;
+
+		const f32 stageTimeMs = std::chrono::duration<f32, std::milli>(Clock::now() - m_StageStartTime).count();
+		m_pBuildCommandPool->FreeCommandBuffer(m_BuildCmd);
+		m_BuildCmd = nullptr;
+
+		switch (m_BuildStage)
+		{
+		case BuildStage::Blases:
+			m_BuildStats.blasBuildTimeMs = stageTimeMs;
+			HPR_CORE_LOG_INFO("Created {} BLASes ({} from the cache) with {} geometries in {} batches in {:.2f} ms, peak scratch memory {:.2f} MiB, BLAS memory {:.2f} MiB",
+				m_BuildStats.blasCount, m_BuildStats.cachedBlasCount, m_BuildStats.geometryCount, m_BuildStats.batchCount, m_BuildStats.blasBuildTimeMs,
+				static_cast<f64>(m_BuildStats.peakScratchSize) / (1024.0 * 1024.0), static_cast<f64>(m_BuildStats.blasMemory) / (1024.0 * 1024.0));
+			m_pBlasScratchBuffer.reset();
+			m_pTransformBuffer.reset();
+			m_SerializedBlases.clear();
+
+			m_BuildCmd = m_pBuildCommandPool->GetCommandBuffer();
+			VulkanCommandBuffer::Begin(m_BuildCmd, vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+			// Cached BLASes were serialized after compaction, so only the ones that were built are compacted.
+			if (m_CompactBlases && !m_BuiltBlases.empty())
+			{
+				RecordBlasCompaction(m_BuildCmd);
+				SubmitBuildStage(BuildStage::Compaction);
+				return false;
+			}
+
+			if (!m_CompactBlases)
+			{
+				m_BuildStats.compactedBlasMemory = m_BuildStats.blasMemory;
+			}
+			RecordTlasCreation(m_BuildCmd);
+			RecordBlasSerialization(m_BuildCmd);
+			SubmitBuildStage(BuildStage::Tlas);
+			return false;
+		case BuildStage::Compaction:
+			m_BuildStats.compactionTimeMs = stageTimeMs;
+			HPR_CORE_LOG_INFO("Compacted BLASes in {:.2f} ms, BLAS memory {:.2f} MiB -> {:.2f} MiB", m_BuildStats.compactionTimeMs,
+				static_cast<f64>(m_BuildStats.blasMemory) / (1024.0 * 1024.0), static_cast<f64>(m_BuildStats.compactedBlasMemory) / (1024.0 * 1024.0));
+			m_pRenderCtx->device.destroyQueryPool(m_CompactionQueryPool);
+			m_CompactionQueryPool = nullptr;
+			for (const Accel& blas : m_UncompactedBlases)
+			{
+				m_pRenderCtx->device.destroyAccelerationStructureKHR(blas.handle);
+			}
+			m_UncompactedBlases.clear();
+
+			m_BuildCmd = m_pBuildCommandPool->GetCommandBuffer();
+			VulkanCommandBuffer::Begin(m_BuildCmd, vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+			RecordTlasCreation(m_BuildCmd);
+			RecordBlasSerialization(m_BuildCmd);
+			SubmitBuildStage(BuildStage::Tlas);
+			return false;
+		default:
+			m_BuildStats.tlasBuildTimeMs = stageTimeMs;
+			HPR_CORE_LOG_INFO("Created TLAS with {} instances of {} BLASes in {:.2f} ms!", m_BuildStats.instanceCount, m_BuildStats.blasCount, m_BuildStats.tlasBuildTimeMs);
+			WriteCachedBlases();
+			ReleaseBuildResources();
+			m_StagedBlases.clear();
+			m_BuiltBlases.clear();
+			ResetRefitDegradation();
+			m_MovedInstanceCount = 0;
+			m_TlasVersion = ++s_LastTlasVersion;
+			m_BuildStage = BuildStage::Done;
+			return true;
+		}
+	}
+
+	void VulkanAccelerationStructure::Build()
+	{
+		BeginBuild();
+		while (!PollBuild())
+		{
+			WaitForBuildStage();
+		}
+	}
+
+	void VulkanAccelerationStructure::SubmitBuildStage(BuildStage stage)
+	{
+		VulkanCommandBuffer::End(m_BuildCmd);
+
+		m_BuildValue++;
+		m_pRenderCtx->computeQueue.Submit({}, {}, {}, { m_BuildSemaphore }, { m_BuildValue }, m_BuildCmd, {});
+		m_BuildStage = stage;
+		m_StageStartTime = std::chrono::high_resolution_clock::now();
+	}
+
+	void VulkanAccelerationStructure::WaitForBuildStage() const
+	{
+		HPR_PROFILE_SCOPE();
+
+		vk::SemaphoreWaitInfo waitInfo{};
+		waitInfo.setSemaphores(m_BuildSemaphore);
+		waitInfo.setValues(m_BuildValue);
+		VulkanUtils::Check(m_pRenderCtx->device.waitSemaphores(waitInfo, UINT64_MAX));
+	}
+
+	void VulkanAccelerationStructure::ReleaseBuildResources()
+	{
+		m_pBlasScratchBuffer.reset();
+		m_pTransformBuffer.reset();
+		m_pRenderCtx->device.destroyQueryPool(m_CompactionQueryPool);
+		m_CompactionQueryPool = nullptr;
+		for (const Accel& blas : m_UncompactedBlases)
+		{
+			m_pRenderCtx->device.destroyAccelerationStructureKHR(blas.handle);
+		}
+		m_UncompactedBlases.clear();
+		m_pRenderCtx->device.destroyQueryPool(m_SerializationQueryPool);
+		m_SerializationQueryPool = nullptr;
+		m_SerializedBlases.clear();
+	}
+
+	void VulkanAccelerationStructure::Clear()
+	{
+		ReleaseBuildResources();
+		if (m_BuildCmd)
+		{
+			m_pBuildCommandPool->FreeCommandBuffer(m_BuildCmd);
+			m_BuildCmd = nullptr;
+		}
+		m_BuildStage = BuildStage::None;
+
 		m_pRenderCtx->device.destroyAccelerationStructureKHR(m_Tlas.handle);
-		m_Tlas.pBuffer.reset();
+		m_Tlas = {};
 
 		for (auto& blas : m_BLASes)
 		{
 			m_pRenderCtx->device.destroyAccelerationStructureKHR(blas.handle);
 			blas.pBuffer.reset();
 		}
+		m_BLASes.clear();
+		m_BlasFirstGeometry.clear();
+		m_GeometryData.clear();
+		m_pGeometryBuffer.reset();
+
+		m_MeshBlases.clear();
+		m_StagedBlases.clear();
+		m_BuiltBlases.clear();
+		m_Instances.clear();
+		m_InstanceBuffers.clear();
+		m_pTlasScratchBuffer.reset();
+		m_MovedInstanceCount = 0;
+		m_BuildStats = {};
+		m_TlasUpdateStats = {};
 	}
 
-	void VulkanAccelerationStructure::AddMesh(const Mesh* mesh, const glm::mat4& transform, const std::string& name)
+	void VulkanAccelerationStructure::DrawImGui()
 	{
-		m_StagedMeshes.push_back(std::tuple(mesh, transform, name));
+		if (ImGui::Begin("Acceleration structures"))
+		{
+			const bool asyncCompute = m_pRenderCtx->computeQueue.familyIndex != m_pRenderCtx->graphicsQueue.familyIndex;
+			ImGui::Text("Build queue: %s (family %u)", asyncCompute ? "async compute" : "graphics", m_pRenderCtx->computeQueue.familyIndex);
+			ImGui::Text("BLASes: %u with %u geometries, for %u instances", m_BuildStats.blasCount, m_BuildStats.geometryCount, m_BuildStats.instanceCount);
+			ImGui::Text("Alpha tested geometries: %u", m_BuildStats.maskedGeometryCount);
+			ImGui::Text("BLAS memory: %.2f MiB", static_cast<f64>(m_BuildStats.compactedBlasMemory) / (1024.0 * 1024.0));
+			ImGui::Text("BLAS build: %.2f ms (%u batches)", m_BuildStats.blasBuildTimeMs, m_BuildStats.batchCount);
+			if (m_CompactBlases)
+			{
+				ImGui::Text("Compaction: %.2f ms, %.2f MiB before (%.1f%% saved)", m_BuildStats.compactionTimeMs,
+					static_cast<f64>(m_BuildStats.blasMemory) / (1024.0 * 1024.0),
+					m_BuildStats.blasMemory > 0 ? 100.0 * (1.0 - static_cast<f64>(m_BuildStats.compactedBlasMemory) / static_cast<f64>(m_BuildStats.blasMemory)) : 0.0);
+			}
+			ImGui::Text("Peak scratch memory: %.2f MiB", static_cast<f64>(m_BuildStats.peakScratchSize) / (1024.0 * 1024.0));
+			ImGui::Text("TLAS build: %.2f ms", m_BuildStats.tlasBuildTimeMs);
+			ImGui::Text("BLAS cache: %u loaded, %u written", m_BuildStats.cachedBlasCount, m_BuildStats.serializedBlasCount);
+			ImGui::Checkbox("Use BLAS cache", &m_UseBlasCache);
+
+			ImGui::Separator();
+			ImGui::Text("TLAS updates: %u refits, %u rebuilds", m_TlasUpdateStats.refitCount, m_TlasUpdateStats.rebuildCount);
+			ImGui::Text("Moved instances: %u / %u", m_TlasUpdateStats.movedCount, m_BuildStats.instanceCount);
+			ImGui::Text("Last update (%s): CPU %.3f ms, GPU %.3f ms", m_TlasUpdateStats.lastWasRebuild ? "rebuild" : "refit",
+				m_TlasUpdateStats.cpuTimeMs, m_TlasUpdateStats.gpuTimeMs);
+			ImGui::Text("Refit degradation: %.2f", m_TlasUpdateStats.refitDegradation);
+			ImGui::SliderFloat("Rebuild threshold", &m_MaxRefitDegradation, 1.0f, 4.0f);
+		}
+		ImGui::End();
 	}
 
-	void VulkanAccelerationStructure::Build()
+	void VulkanAccelerationStructure::RecordBlasBuilds(const vk::CommandBuffer& cmd)
+	{
+		HPR_PROFILE_SCOPE();
+
+		const u32 blasCount = static_cast<u32>(m_StagedBlases.size());
+
+		// The meshes live somewhere in the middle of the shared geometry buffers.
+		const GeometryPool* pGeometryPool = m_pRenderCtx->pGeometryPool;
+		const vk::DeviceAddress vertexBufferAddress = pGeometryPool->GetVertexBuffer()->GetDeviceAddress();
+		const vk::DeviceAddress indexBufferAddress = pGeometryPool->GetIndexBuffer()->GetDeviceAddress();
+
+		// Merged BLASes read the transforms of their geometries from a buffer, which only has to live until the BLAS stage is done.
+		// Only the BLASes that weren't found in the cache are built, the build arrays are indexed in their order.
+		u32 geometryCount = 0;
+		u32 buildGeometryCount = 0;
+		std::vector<vk::TransformMatrixKHR> geometryTransforms;
+		m_BuiltBlases.clear();
+		for (u32 i = 0; i < blasCount; i++)
+		{
+			const StagedBlas& staged = m_StagedBlases[i];
+			geometryCount += static_cast<u32>(staged.meshes.size());
+			if (!staged.serializedData.empty())
+				continue;
+
+			m_BuiltBlases.push_back(i);
+			buildGeometryCount += static_cast<u32>(staged.meshes.size());
+			for (const glm::mat4& transform : staged.transforms)
+			{
+				geometryTransforms.push_back(ToTransformMatrix(transform));
+			}
+		}
+		const u32 buildCount = static_cast<u32>(m_BuiltBlases.size());
+
+		vk::DeviceAddress transformBufferAddress = 0;
+		if (!geometryTransforms.empty())
+		{
+			m_pTransformBuffer = std::make_unique<VulkanBuffer>(
+				m_pRenderCtx,
+				geometryTransforms.data(),
+				geometryTransforms.size() * sizeof(vk::TransformMatrixKHR),
+				vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR,
+				VMA_MEMORY_USAGE_CPU_TO_GPU,
+				"BLAS transform buffer"
+			);
+			transformBufferAddress = m_pTransformBuffer->GetDeviceAddress();
+		}
+
+		// The build infos point at the geometries and are passed to the build commands in ranges, so all of them live in arrays.
+		// A BLAS' geometries and range infos are consecutive.
+		std::vector<vk::AccelerationStructureGeometryKHR> geometries(buildGeometryCount);
+		std::vector<vk::AccelerationStructureBuildRangeInfoKHR> rangeInfos(buildGeometryCount);
+		std::vector<u32> primitiveCounts(buildGeometryCount);
+		std::vector<vk::AccelerationStructureBuildGeometryInfoKHR> buildInfos(buildCount);
+		std::vector<const vk::AccelerationStructureBuildRangeInfoKHR*> pRangeInfos(buildCount);
+		std::vector<vk::DeviceSize> scratchSizes(buildCount);
+
+		u32 buildIdx = 0;
+		u32 geometryIdx = 0;
+		u32 transformIdx = 0;
+		m_BLASes.reserve(m_BLASes.size() + blasCount);
+		for (u32 i = 0; i < blasCount; i++)
+		{
+			const StagedBlas& staged = m_StagedBlases[i];
+
+			m_BlasFirstGeometry.push_back(static_cast<u32>(m_GeometryData.size()));
+			for (const Mesh* pMesh : staged.meshes)
+			{
+				const GeometryPool::Allocation& geometry = pMesh->GetGeometry();
+				const u32 materialIndex = m_pRenderCtx->pMaterialLibrary->GetMaterial(pMesh->GetMaterialId()).GetIndex();
+				m_GeometryData.push_back(GeometryData{ geometry.vertexOffset, geometry.firstIndex, materialIndex, 0 });
+				if (IsMeshMasked(m_pRenderCtx, pMesh))
+				{
+					m_BuildStats.maskedGeometryCount++;
+				}
+			}
+
+			if (!staged.serializedData.empty())
+			{
+				m_BLASes.push_back(RecordBlasDeserialization(cmd, staged));
+				continue;
+			}
+
+			const u32 firstGeometry = geometryIdx;
+			const u32 blasGeometryCount = static_cast<u32>(staged.meshes.size());
+
+			for (const Mesh* pMesh : staged.meshes)
+			{
+				const GeometryPool::Allocation& geometry = pMesh->GetGeometry();
+
+				vk::AccelerationStructureGeometryKHR& accelerationStructureGeometry = geometries[geometryIdx];
+				if (!IsMeshMasked(m_pRenderCtx, pMesh))
+				{
+					accelerationStructureGeometry.flags = vk::GeometryFlagBitsKHR::eOpaque;
+				}
+				accelerationStructureGeometry.geometryType = vk::GeometryTypeKHR::eTriangles;
+				accelerationStructureGeometry.geometry.triangles.vertexFormat = vk::Format::eR32G32B32A32Sfloat;
+				accelerationStructureGeometry.geometry.triangles.vertexData.deviceAddress = vertexBufferAddress + geometry.vertexOffset * sizeof(VertexPosNormTex);
+				accelerationStructureGeometry.geometry.triangles.maxVertex = pMesh->GetVertexCount();
+				accelerationStructureGeometry.geometry.triangles.vertexStride = sizeof(VertexPosNormTex);
+				accelerationStructureGeometry.geometry.triangles.indexType = vk::IndexType::eUint32;
+				accelerationStructureGeometry.geometry.triangles.indexData.deviceAddress = indexBufferAddress + geometry.firstIndex * sizeof(u32);
+
+				rangeInfos[geometryIdx].primitiveCount = pMesh->GetTriCount();
+				if (!staged.transforms.empty())
+				{
+					accelerationStructureGeometry.geometry.triangles.transformData.deviceAddress = transformBufferAddress;
+					rangeInfos[geometryIdx].transformOffset = transformIdx * sizeof(vk::TransformMatrixKHR);
+					transformIdx++;
+				}
+				primitiveCounts[geometryIdx] = rangeInfos[geometryIdx].primitiveCount;
+				geometryIdx++;
+			}
+			pRangeInfos[buildIdx] = &rangeInfos[firstGeometry];
+
+			vk::AccelerationStructureBuildGeometryInfoKHR& buildInfo = buildInfos[buildIdx];
+			buildInfo.type = vk::AccelerationStructureTypeKHR::eBottomLevel;
+			buildInfo.flags = vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace;
+			if (m_CompactBlases)
+				buildInfo.flags |= vk::BuildAccelerationStructureFlagBitsKHR::eAllowCompaction;
+			buildInfo.mode = vk::BuildAccelerationStructureModeKHR::eBuild;
+			buildInfo.geometryCount = blasGeometryCount;
+			buildInfo.pGeometries = &geometries[firstGeometry];
+
+			const vk::AccelerationStructureBuildSizesInfoKHR sizeInfo = m_pRenderCtx->device.getAccelerationStructureBuildSizesKHR(
+				vk::AccelerationStructureBuildTypeKHR::eDevice, buildInfo, vk::ArrayProxy<const u32>(blasGeometryCount, &primitiveCounts[firstGeometry]));
+
+			Accel bottomLevelAS;
+			bottomLevelAS.pBuffer = std::make_unique<VulkanBuffer>(
+				m_pRenderCtx,
+				sizeInfo.accelerationStructureSize,
+				vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR | vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eTransferDst,
+				VMA_MEMORY_USAGE_GPU_ONLY,
+				fmt::format("{} BLAS buffer", staged.name)
+			);
+
+			vk::AccelerationStructureCreateInfoKHR accelerationStructureCreateInfo = {};
+			accelerationStructureCreateInfo.buffer = bottomLevelAS.pBuffer->GetBuffer();
+			accelerationStructureCreateInfo.size = sizeInfo.accelerationStructureSize;
+			accelerationStructureCreateInfo.type = vk::AccelerationStructureTypeKHR::eBottomLevel;
+			bottomLevelAS.handle = VulkanUtils::Check(m_pRenderCtx->device.createAccelerationStructureKHR(accelerationStructureCreateInfo));
+			bottomLevelAS.deviceAddress = m_pRenderCtx->device.getAccelerationStructureAddressKHR(vk::AccelerationStructureDeviceAddressInfoKHR{ bottomLevelAS.handle });
+			VkDebug::SetObjectName(m_pRenderCtx->device, vk::ObjectType::eAccelerationStructureKHR, bottomLevelAS.handle, fmt::format("{}", staged.name));
+
+			buildInfo.dstAccelerationStructure = bottomLevelAS.handle;
+			scratchSizes[buildIdx] = sizeInfo.buildScratchSize;
+			m_BuildStats.blasMemory += sizeInfo.accelerationStructureSize;
+
+			m_BLASes.push_back(std::move(bottomLevelAS));
+			buildIdx++;
+		}
+
+		m_BuildStats.blasCount += blasCount;
+		m_BuildStats.geometryCount += geometryCount;
+		if (buildCount == 0)
+			return;
+
+		// Every build in a batch gets its own slice of the scratch buffer. A batch ends when the next build wouldn't fit in the budget,
+		// and the next batch reuses the scratch buffer from the start, so a single build that's larger than the budget gets a batch of its own.
+		struct BuildBatch
+		{
+			u32 firstBuild;
+			u32 buildCount;
+		};
+		std::vector<BuildBatch> batches;
+		std::vector<vk::DeviceSize> scratchOffsets(buildCount);
+
+		const vk::DeviceSize scratchAlignment = m_pRenderCtx->asProperties.minAccelerationStructureScratchOffsetAlignment;
+		vk::DeviceSize batchScratchSize = 0;
+		vk::DeviceSize peakScratchSize = 0;
+		for (u32 i = 0; i < buildCount; i++)
+		{
+			vk::DeviceSize offset = AlignScratch(batchScratchSize, scratchAlignment);
+			if (batches.empty() || offset + scratchSizes[i] > s_ScratchBudget)
+			{
+				batches.push_back(BuildBatch{ i, 0 });
+				offset = 0;
+			}
+
+			scratchOffsets[i] = offset;
+			batchScratchSize = offset + scratchSizes[i];
+			peakScratchSize = std::max(peakScratchSize, batchScratchSize);
+			batches.back().buildCount++;
+		}
+
+		// The buffer's own address doesn't have to be aligned, so it gets room to align it.
+		m_pBlasScratchBuffer = std::make_unique<VulkanBuffer>(m_pRenderCtx, peakScratchSize + scratchAlignment,
+			vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress, VMA_MEMORY_USAGE_GPU_ONLY, "BLAS scratch buffer");
+		const vk::DeviceAddress scratchAddress = AlignScratch(m_pBlasScratchBuffer->GetDeviceAddress(), scratchAlignment);
+		for (u32 i = 0; i < buildCount; i++)
+		{
+			buildInfos[i].scratchData.deviceAddress = scratchAddress + scratchOffsets[i];
+		}
+
+		for (u32 batchIdx = 0; batchIdx < batches.size(); batchIdx++)
+		{
+			const BuildBatch& batch = batches[batchIdx];
+
+			// The previous batch has to be done with the scratch buffer before this one overwrites it.
+			if (batchIdx > 0)
+			{
+				InsertBuildBarrier(cmd);
+			}
+
+			cmd.buildAccelerationStructuresKHR(
+				vk::ArrayProxy<const vk::AccelerationStructureBuildGeometryInfoKHR>(batch.buildCount, &buildInfos[batch.firstBuild]),
+				vk::ArrayProxy<const vk::AccelerationStructureBuildRangeInfoKHR* const>(batch.buildCount, &pRangeInfos[batch.firstBuild]));
+		}
+
+		// The compacted sizes are queried once the BLASes are built, and read back before the compaction stage. Without compaction,
+		// the BLASes are serialized as they are.
+		if (m_CompactBlases)
+		{
+			RecordBuiltBlasQueries(cmd, vk::QueryType::eAccelerationStructureCompactedSizeKHR, m_CompactionQueryPool);
+		}
+		else if (m_UseBlasCache)
+		{
+			RecordBuiltBlasQueries(cmd, vk::QueryType::eAccelerationStructureSerializationSizeKHR, m_SerializationQueryPool);
+		}
+
+		m_BuildStats.batchCount += static_cast<u32>(batches.size());
+		m_BuildStats.peakScratchSize = std::max(m_BuildStats.peakScratchSize, peakScratchSize);
+	}
+
+	void VulkanAccelerationStructure::RecordBlasCompaction(const vk::CommandBuffer& cmd)
 	{
-		for (auto&[mesh, transform, name] : m_StagedMeshes)
+		HPR_PROFILE_SCOPE();
+
+		const u32 buildCount = static_cast<u32>(m_BuiltBlases.size());
+
+		// The BLAS stage is done, so the sizes it queried are available without waiting.
+		const std::vector<vk::DeviceSize> compactedSizes = VulkanUtils::Check(m_pRenderCtx->device.getQueryPoolResults<vk::DeviceSize>(m_CompactionQueryPool, 0, buildCount,
+			buildCount * sizeof(vk::DeviceSize), sizeof(vk::DeviceSize), vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait));
+
+		// Copy every BLAS into a new one of its compacted size. The originals are destroyed once the copies are done.
+		InsertBuildBarrier(cmd);
+		m_UncompactedBlases.resize(buildCount);
+		for (u32 i = 0; i < buildCount; i++)
 		{
-			CreateBlas(mesh, transform, name);
+			Accel& blas = m_BLASes[m_BuildFirstBlas + m_BuiltBlases[i]];
+			const std::string& name = m_StagedBlases[m_BuiltBlases[i]].name;
+
+			m_UncompactedBlases[i].handle = blas.handle;
+			m_UncompactedBlases[i].pBuffer = std::move(blas.pBuffer);
+
+			blas.pBuffer = std::make_unique<VulkanBuffer>(
+				m_pRenderCtx,
+				compactedSizes[i],
+				vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR | vk::BufferUsageFlagBits::eShaderDeviceAddress,
+				VMA_MEMORY_USAGE_GPU_ONLY,
+				fmt::format("{} compacted BLAS buffer", name)
+			);
+
+			vk::AccelerationStructureCreateInfoKHR createInfo = {};
+			createInfo.buffer = blas.pBuffer->GetBuffer();
+			createInfo.size = compactedSizes[i];
+			createInfo.type = vk::AccelerationStructureTypeKHR::eBottomLevel;
+			blas.handle = VulkanUtils::Check(m_pRenderCtx->device.createAccelerationStructureKHR(createInfo));
+			blas.deviceAddress = m_pRenderCtx->device.getAccelerationStructureAddressKHR(vk::AccelerationStructureDeviceAddressInfoKHR{ blas.handle });
+			VkDebug::SetObjectName(m_pRenderCtx->device, vk::ObjectType::eAccelerationStructureKHR, blas.handle, fmt::format("{} (compacted)", name));
+
+			vk::CopyAccelerationStructureInfoKHR copyInfo{};
+			copyInfo.src = m_UncompactedBlases[i].handle;
+			copyInfo.dst = blas.handle;
+			copyInfo.mode = vk::CopyAccelerationStructureModeKHR::eCompact;
+			cmd.copyAccelerationStructureKHR(copyInfo);
+
+			m_BuildStats.compactedBlasMemory += compactedSizes[i];
 		}
-		HPR_CORE_LOG_INFO("Created all BLASes!");
 
-		CreateTlas();
-		HPR_CORE_LOG_INFO("Created TLAS!");
+		// The compacted copies are what gets cached.
+		if (m_UseBlasCache)
+		{
+			RecordBuiltBlasQueries(cmd, vk::QueryType::eAccelerationStructureSerializationSizeKHR, m_SerializationQueryPool);
+		}
 	}
 
-	void VulkanAccelerationStructure::CreateBlas(const Mesh* pMesh, const glm::mat4& transform, const std::string& name)
+	void VulkanAccelerationStructure::RecordBuiltBlasQueries(const vk::CommandBuffer& cmd, vk::QueryType queryType, vk::QueryPool& queryPool)
 	{
-		Accel bottomLevelAS;
-		bottomLevelAS.transform = transform;
-
-		vk::DeviceAddress vertexBufferDeviceAddress{};
-		vk::DeviceAddress indexBufferDeviceAddress{};
-
-		vertexBufferDeviceAddress = pMesh->GetVertexBuffer()->GetBuffer()->GetDeviceAddress();
-		indexBufferDeviceAddress = pMesh->GetIndexBuffer()->GetBuffer()->GetDeviceAddress();
-
-		// Build geometries
-		vk::AccelerationStructureGeometryKHR accelerationStructureGeometry = {};
-		accelerationStructureGeometry.flags = vk::GeometryFlagBitsKHR::eOpaque;
-		accelerationStructureGeometry.geometryType = vk::GeometryTypeKHR::eTriangles;
-		accelerationStructureGeometry.geometry.triangles.vertexFormat = vk::Format::eR32G32B32A32Sfloat;
-		accelerationStructureGeometry.geometry.triangles.vertexData.deviceAddress = vertexBufferDeviceAddress;
-		accelerationStructureGeometry.geometry.triangles.maxVertex = pMesh->GetVertexCount();
-		accelerationStructureGeometry.geometry.triangles.vertexStride = sizeof(VertexPosNormTex);
-		accelerationStructureGeometry.geometry.triangles.indexType = vk::IndexType::eUint32;
-		accelerationStructureGeometry.geometry.triangles.indexData.deviceAddress = indexBufferDeviceAddress;
-
-		// Build size info
-		vk::AccelerationStructureBuildGeometryInfoKHR accelerationStructureBuildGeometryInfo = {};
-		accelerationStructureBuildGeometryInfo.type = vk::AccelerationStructureTypeKHR::eBottomLevel;
-		accelerationStructureBuildGeometryInfo.flags = vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace;
-		accelerationStructureBuildGeometryInfo.setGeometries(accelerationStructureGeometry);
-
-		const u32 numTriangles = pMesh->GetTriCount();
-		vk::AccelerationStructureBuildSizesInfoKHR accelerationStructureBuildSizesInfo = m_pRenderCtx->device.getAccelerationStructureBuildSizesKHR(
-			vk::AccelerationStructureBuildTypeKHR::eDevice,
-			accelerationStructureBuildGeometryInfo,
-			{ numTriangles });
+		const u32 buildCount = static_cast<u32>(m_BuiltBlases.size());
 
-		bottomLevelAS.pBuffer = std::make_unique<VulkanBuffer>(
-			m_pRenderCtx,
-			accelerationStructureBuildSizesInfo.accelerationStructureSize,
-			vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR | vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eTransferDst,
-			VMA_MEMORY_USAGE_CPU_TO_GPU,
-			"BLAS test"
-		);
-		bottomLevelAS.deviceAddress = bottomLevelAS.pBuffer->GetDeviceAddress();
-
-		vk::AccelerationStructureCreateInfoKHR accelerationStructureCreateInfo = {};
-		accelerationStructureCreateInfo.buffer = bottomLevelAS.pBuffer->GetBuffer();
-		accelerationStructureCreateInfo.size = accelerationStructureBuildSizesInfo.accelerationStructureSize;
-		accelerationStructureCreateInfo.type = vk::AccelerationStructureTypeKHR::eBottomLevel;
-		bottomLevelAS.handle = VulkanUtils::Check(m_pRenderCtx->device.createAccelerationStructureKHR(accelerationStructureCreateInfo));
-
-		// Create a scratch buffer that will be used during the build of the BLAS.
-		RayTracingScratchBuffer scratchBuffer{};
-		scratchBuffer.pBuffer = std::make_unique<VulkanBuffer>(m_pRenderCtx,
-			accelerationStructureBuildSizesInfo.buildScratchSize,
-			vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress,
-			VMA_MEMORY_USAGE_GPU_ONLY,
-			"BLAS Scratch buffer");
-		scratchBuffer.deviceAddress = scratchBuffer.pBuffer->GetDeviceAddress();
-
-		vk::AccelerationStructureBuildGeometryInfoKHR accelerationBuildGeometryInfo = {};
-		accelerationBuildGeometryInfo.type = vk::AccelerationStructureTypeKHR::eBottomLevel;
-		accelerationBuildGeometryInfo.flags = vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace;
-		accelerationBuildGeometryInfo.mode = vk::BuildAccelerationStructureModeKHR::eBuild;
-		accelerationBuildGeometryInfo.dstAccelerationStructure = bottomLevelAS.handle;
-		accelerationBuildGeometryInfo.setGeometries(accelerationStructureGeometry);
-		accelerationBuildGeometryInfo.scratchData.deviceAddress = scratchBuffer.deviceAddress;
-
-		vk::AccelerationStructureBuildRangeInfoKHR accelerationStructureBuildRangeInfo = {};
-		accelerationStructureBuildRangeInfo.primitiveCount = numTriangles;
-		accelerationStructureBuildRangeInfo.primitiveOffset = 0;
-		accelerationStructureBuildRangeInfo.firstVertex = 0;
-		accelerationStructureBuildRangeInfo.transformOffset = 0;
-		std::vector accelerationStructureRangeInfos = { &accelerationStructureBuildRangeInfo };
-
-		vk::CommandBuffer cmd = m_pRenderCtx->commandPool->GetCommandBuffer();
-		VulkanCommandBuffer::Begin(cmd, vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
-		cmd.buildAccelerationStructuresKHR(accelerationBuildGeometryInfo, accelerationStructureRangeInfos);
-		VulkanCommandBuffer::End(cmd);
-		m_pRenderCtx->graphicsQueue.Submit({}, {}, {}, cmd, {});
-		m_pRenderCtx->graphicsQueue.WaitIdle();
-		m_pRenderCtx->commandPool->FreeCommandBuffer(cmd);
-
-		scratchBuffer.pBuffer.reset();
-
-		VkDebug::SetObjectName(m_pRenderCtx->device, vk::ObjectType::eAccelerationStructureKHR, bottomLevelAS.handle, fmt::format("{}", name));
-
-		m_BLASes.push_back(std::move(bottomLevelAS));
+		std::vector<vk::AccelerationStructureKHR> handles(buildCount);
+		for (u32 i = 0; i < buildCount; i++)
+		{
+			handles[i] = m_BLASes[m_BuildFirstBlas + m_BuiltBlases[i]].handle;
+		}
+
+		vk::QueryPoolCreateInfo queryPoolInfo{};
+		queryPoolInfo.queryType = queryType;
+		queryPoolInfo.queryCount = buildCount;
+		queryPool = VulkanUtils::Check(m_pRenderCtx->device.createQueryPool(queryPoolInfo));
+
+		InsertBuildBarrier(cmd);
+		cmd.resetQueryPool(queryPool, 0, buildCount);
+		cmd.writeAccelerationStructuresPropertiesKHR(handles, queryType, queryPool, 0);
 	}
 
-	void VulkanAccelerationStructure::CreateTlas()
+	void VulkanAccelerationStructure::LoadCachedBlases()
 	{
-		std::vector<vk::AccelerationStructureInstanceKHR> tlas;
-		tlas.reserve(m_BLASes.size());
+		HPR_PROFILE_SCOPE();
 
-		for (auto& blas : m_BLASes)
+		for (StagedBlas& staged : m_StagedBlases)
 		{
-			// GLM is column-major, but VkTransformMatrixKHR is row-major, so we need to convert.
-			vk::TransformMatrixKHR transformMatrix = std::array{
-				std::array{blas.transform[0][0], blas.transform[1][0], blas.transform[2][0], blas.transform[3][0]},
-				std::array{blas.transform[0][1], blas.transform[1][1], blas.transform[2][1], blas.transform[3][1]},
-				std::array{blas.transform[0][2], blas.transform[1][2], blas.transform[2][2], blas.transform[3][2]},
-			};
-			auto& instance = tlas.emplace_back(vk::AccelerationStructureInstanceKHR{});
-			instance.transform = transformMatrix;
-			instance.instanceCustomIndex = 0;
-			instance.mask = 0xFF;
-			instance.instanceShaderBindingTableRecordOffset = 0;
-			instance.setFlags(vk::GeometryInstanceFlagBitsKHR::eTriangleFacingCullDisable);
-			// VkHPP type doesn't work here: https://bytemeta.vip/repo/KhronosGroup/Vulkan-Hpp/issues/1002
-			instance.accelerationStructureReference = blas.deviceAddress;
+			// Compacted BLASes are built with other flags than uncompacted ones, so they're cached apart.
+			u64 cacheKey = Hash::Fnv1aValue(s_BlasCacheVersion, m_DeviceHash);
+			cacheKey = Hash::Fnv1aValue(m_CompactBlases, cacheKey);
+			for (const Mesh* pMesh : staged.meshes)
+			{
+				cacheKey = Hash::Fnv1aValue(pMesh->GetGeometryHash(), cacheKey);
+				cacheKey = Hash::Fnv1aValue(IsMeshMasked(m_pRenderCtx, pMesh), cacheKey);
+			}
+			cacheKey = Hash::Fnv1a(std::span<const glm::mat4>(staged.transforms), cacheKey);
+			staged.cacheKey = cacheKey;
+
+			const std::filesystem::path cachePath = GetBlasCachePath(cacheKey);
+			if (!m_UseBlasCache || !std::filesystem::exists(cachePath))
+				continue;
+
+			std::string data;
+			if (!IO::ReadFileSync(cachePath, data) || !IsSerializedBlasCompatible(m_pRenderCtx->device, data))
+			{
+				HPR_CORE_LOG_WARN("Ignoring cached BLAS {}, the device can't deserialize it, it's rebuilt instead.", cachePath.string());
+				continue;
+			}
+			staged.serializedData = std::move(data);
 		}
+	}
 
-		// Build the TLAS
+	VulkanAccelerationStructure::Accel VulkanAccelerationStructure::RecordBlasDeserialization(const vk::CommandBuffer& cmd, const StagedBlas& staged)
+	{
+		const std::string& data = staged.serializedData;
+		u64 deserializedSize = 0;
+		memcpy(&deserializedSize, data.data() + s_DeserializedSizeOffset, sizeof(u64));
 
-		u32 countInstance = static_cast<u32>(tlas.size());
+		Accel blas;
+		blas.pBuffer = std::make_unique<VulkanBuffer>(
+			m_pRenderCtx,
+			deserializedSize,
+			vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR | vk::BufferUsageFlagBits::eShaderDeviceAddress,
+			VMA_MEMORY_USAGE_GPU_ONLY,
+			fmt::format("{} BLAS buffer", staged.name)
+		);
 
-		vk::CommandBuffer cmd = m_pRenderCtx->commandPool->GetCommandBuffer();
-		VulkanCommandBuffer::Begin(cmd, vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+		vk::AccelerationStructureCreateInfoKHR createInfo = {};
+		createInfo.buffer = blas.pBuffer->GetBuffer();
+		createInfo.size = deserializedSize;
+		createInfo.type = vk::AccelerationStructureTypeKHR::eBottomLevel;
+		blas.handle = VulkanUtils::Check(m_pRenderCtx->device.createAccelerationStructureKHR(createInfo));
+		blas.deviceAddress = m_pRenderCtx->device.getAccelerationStructureAddressKHR(vk::AccelerationStructureDeviceAddressInfoKHR{ blas.handle });
+		VkDebug::SetObjectName(m_pRenderCtx->device, vk::ObjectType::eAccelerationStructureKHR, blas.handle, fmt::format("{} (cached)", staged.name));
 
-		VulkanRTBuffer instancesBuffer;
-		instancesBuffer.buffer = std::make_unique<VulkanBuffer>(
+		// The upload buffer lives until the BLAS stage is done.
+		SerializedBlas& upload = m_SerializedBlases.emplace_back();
+		upload.pBuffer = std::make_unique<VulkanBuffer>(
 			m_pRenderCtx,
-			tlas.data(),
-			tlas.size() * sizeof(vk::AccelerationStructureInstanceKHR),
-			vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR,
+			data.size() + s_SerializedDataAlignment,
+			vk::BufferUsageFlagBits::eShaderDeviceAddress,
 			VMA_MEMORY_USAGE_CPU_TO_GPU,
-			""
+			fmt::format("{} serialized BLAS upload buffer", staged.name)
 		);
+		const vk::DeviceAddress uploadAddress = upload.pBuffer->GetDeviceAddress();
+		upload.offset = AlignScratch(uploadAddress, s_SerializedDataAlignment) - uploadAddress;
+		upload.size = data.size();
+		upload.cacheKey = staged.cacheKey;
+		upload.pBuffer->Write(data.data(), data.size(), upload.offset);
+
+		vk::CopyMemoryToAccelerationStructureInfoKHR copyInfo{};
+		copyInfo.src.deviceAddress = uploadAddress + upload.offset;
+		copyInfo.dst = blas.handle;
+		copyInfo.mode = vk::CopyAccelerationStructureModeKHR::eDeserialize;
+		cmd.copyMemoryToAccelerationStructureKHR(copyInfo);
+
+		m_BuildStats.blasMemory += deserializedSize;
+		m_BuildStats.compactedBlasMemory += deserializedSize;
+		m_BuildStats.cachedBlasCount++;
+		return blas;
+	}
+
+	void VulkanAccelerationStructure::RecordBlasSerialization(const vk::CommandBuffer& cmd)
+	{
+		if (!m_SerializationQueryPool)
+			return;
 
-		vk::DeviceAddress instBufferAddr = instancesBuffer.buffer->GetDeviceAddress();
+		HPR_PROFILE_SCOPE();
+
+		const u32 buildCount = static_cast<u32>(m_BuiltBlases.size());
+
+		// The stage that queried the sizes is done, so they're available without waiting.
+		const std::vector<vk::DeviceSize> serializedSizes = VulkanUtils::Check(m_pRenderCtx->device.getQueryPoolResults<vk::DeviceSize>(m_SerializationQueryPool, 0, buildCount,
+			buildCount * sizeof(vk::DeviceSize), sizeof(vk::DeviceSize), vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait));
+
+		InsertBuildBarrier(cmd);
+		m_SerializedBlases.reserve(buildCount);
+		for (u32 i = 0; i < buildCount; i++)
+		{
+			const StagedBlas& staged = m_StagedBlases[m_BuiltBlases[i]];
+
+			SerializedBlas& readback = m_SerializedBlases.emplace_back();
+			readback.pBuffer = std::make_unique<VulkanBuffer>(
+				m_pRenderCtx,
+				serializedSizes[i] + s_SerializedDataAlignment,
+				vk::BufferUsageFlagBits::eShaderDeviceAddress,
+				VMA_MEMORY_USAGE_GPU_TO_CPU,
+				fmt::format("{} serialized BLAS readback buffer", staged.name),
+				vk::BufferCreateFlags{},
+				VMA_ALLOCATION_CREATE_MAPPED_BIT
+			);
+			const vk::DeviceAddress readbackAddress = readback.pBuffer->GetDeviceAddress();
+			readback.offset = AlignScratch(readbackAddress, s_SerializedDataAlignment) - readbackAddress;
+			readback.size = serializedSizes[i];
+			readback.cacheKey = staged.cacheKey;
+
+			vk::CopyAccelerationStructureToMemoryInfoKHR copyInfo{};
+			copyInfo.src = m_BLASes[m_BuildFirstBlas + m_BuiltBlases[i]].handle;
+			copyInfo.dst.deviceAddress = readbackAddress + readback.offset;
+			copyInfo.mode = vk::CopyAccelerationStructureModeKHR::eSerialize;
+			cmd.copyAccelerationStructureToMemoryKHR(copyInfo);
+		}
 
-		// Make sure the copy of the instance buffer is copied before triggering the acceleration structure build
 		vk::MemoryBarrier barrier{};
 		barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
-		barrier.dstAccessMask = vk::AccessFlagBits::eAccelerationStructureWriteKHR;
-		cmd.pipelineBarrier(
-			vk::PipelineStageFlagBits::eTransfer,
-			vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
-			{},
-			barrier,
-			{},
-			{}
-		);
+		barrier.dstAccessMask = vk::AccessFlagBits::eHostRead;
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR, vk::PipelineStageFlagBits::eHost, {}, barrier, {}, {});
+	}
+
+	void VulkanAccelerationStructure::WriteCachedBlases()
+	{
+		if (m_SerializedBlases.empty())
+			return;
+
+		HPR_PROFILE_SCOPE();
+
+		std::filesystem::create_directories(s_BlasCacheDirectory);
+		u32 writtenCount = 0;
+		for (const SerializedBlas& serialized : m_SerializedBlases)
+		{
+			serialized.pBuffer->Invalidate();
+			const char* pData = static_cast<const char*>(serialized.pBuffer->GetMappedData()) + serialized.offset;
+			if (!IO::WriteFileSync(GetBlasCachePath(serialized.cacheKey), std::string(pData, serialized.size)))
+			{
+				HPR_CORE_LOG_WARN("Failed to write BLAS {:016x} to the cache!", serialized.cacheKey);
+				continue;
+			}
+			writtenCount++;
+		}
+		m_BuildStats.serializedBlasCount += writtenCount;
+		HPR_CORE_LOG_INFO("Wrote {} BLASes to the cache in {}", writtenCount, s_BlasCacheDirectory);
+	}
 
-		// Creating the TLAS
+	void VulkanAccelerationStructure::RecordTlasCreation(const vk::CommandBuffer& cmd)
+	{
+		HPR_PROFILE_SCOPE();
 
-		vk::AccelerationStructureGeometryInstancesDataKHR instancesVk = {};
-		instancesVk.data.deviceAddress = instBufferAddr;
+		const u32 instanceCount = static_cast<u32>(m_Instances.size());
+		m_BuildStats.instanceCount = instanceCount;
 
+		// Persistently mapped, so updating the instances is a copy.
+		m_InstanceBuffers.resize(m_FrameCount);
+		for (u32 i = 0; i < m_FrameCount; i++)
+		{
+			m_InstanceBuffers[i] = std::make_unique<VulkanBuffer>(
+				m_pRenderCtx,
+				instanceCount * sizeof(vk::AccelerationStructureInstanceKHR),
+				vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR,
+				VMA_MEMORY_USAGE_CPU_TO_GPU,
+				fmt::format("TLAS instance buffer {}", i),
+				vk::BufferCreateFlags{},
+				VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT
+			);
+		}
+
+		// Find sizes
 		vk::AccelerationStructureGeometryKHR topASGeometry = {};
 		topASGeometry.geometryType = vk::GeometryTypeKHR::eInstances;
-		topASGeometry.geometry.instances = instancesVk;
 
-		// Find sizes
 		vk::AccelerationStructureBuildGeometryInfoKHR buildInfo = {};
-		buildInfo.flags = vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace;
+		buildInfo.flags = s_TlasBuildFlags;
 		buildInfo.setGeometries(topASGeometry);
 		buildInfo.mode = vk::BuildAccelerationStructureModeKHR::eBuild;
 		buildInfo.type = vk::AccelerationStructureTypeKHR::eTopLevel;
-		buildInfo.srcAccelerationStructure = nullptr;
 
 		vk::AccelerationStructureBuildSizesInfoKHR sizeInfo = m_pRenderCtx->device.getAccelerationStructureBuildSizesKHR(
 			vk::AccelerationStructureBuildTypeKHR::eDevice,
 			buildInfo,
-			countInstance
+			instanceCount
 		);
 
 		// Create TLAS
-		vk::AccelerationStructureCreateInfoKHR createInfo = {};
-		createInfo.size = sizeInfo.accelerationStructureSize;
-
 		m_Tlas.pBuffer = std::make_unique<VulkanBuffer>(
 			m_pRenderCtx,
 			sizeInfo.accelerationStructureSize,
-			vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR | vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eTransferDst,
-			VMA_MEMORY_USAGE_CPU_TO_GPU,
-			"TLAS test"
+			vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR | vk::BufferUsageFlagBits::eShaderDeviceAddress,
+			VMA_MEMORY_USAGE_GPU_ONLY,
+			"TLAS buffer"
 		);
 		m_Tlas.deviceAddress = m_Tlas.pBuffer->GetDeviceAddress();
+
+		vk::AccelerationStructureCreateInfoKHR createInfo = {};
 		createInfo.buffer = m_Tlas.pBuffer->GetBuffer();
+		createInfo.size = sizeInfo.accelerationStructureSize;
+		createInfo.type = vk::AccelerationStructureTypeKHR::eTopLevel;
 		m_Tlas.handle = VulkanUtils::Check(m_pRenderCtx->device.createAccelerationStructureKHR(createInfo));
+		VkDebug::SetObjectName(m_pRenderCtx->device, vk::ObjectType::eAccelerationStructureKHR, m_Tlas.handle, "Top Level Acceleration Structure");
 
-		// Allocate scratch memory
-		RayTracingScratchBuffer scratchBuffer = {};
-		scratchBuffer.pBuffer = std::make_unique<VulkanBuffer>(m_pRenderCtx,
-			sizeInfo.buildScratchSize,
+		// The scratch buffer is kept for the updates, which build into the same TLAS.
+		const vk::DeviceSize scratchAlignment = m_pRenderCtx->asProperties.minAccelerationStructureScratchOffsetAlignment;
+		m_pTlasScratchBuffer = std::make_unique<VulkanBuffer>(m_pRenderCtx,
+			std::max(sizeInfo.buildScratchSize, sizeInfo.updateScratchSize) + scratchAlignment,
 			vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress,
 			VMA_MEMORY_USAGE_GPU_ONLY,
 			"TLAS Scratch buffer");
-		scratchBuffer.deviceAddress = scratchBuffer.pBuffer->GetDeviceAddress();
+		m_TlasScratchAddress = AlignScratch(m_pTlasScratchBuffer->GetDeviceAddress(), scratchAlignment);
+
+		// Lives as long as the TLAS, the any-hit shader reads it while tracing.
+		if (!m_GeometryData.empty())
+		{
+			m_pGeometryBuffer = std::make_unique<VulkanBuffer>(
+				m_pRenderCtx,
+				m_GeometryData.data(),
+				m_GeometryData.size() * sizeof(GeometryData),
+				vk::BufferUsageFlagBits::eShaderDeviceAddress,
+				VMA_MEMORY_USAGE_CPU_TO_GPU,
+				"Acceleration structure geometry buffer"
+			);
+		}
+
+		// Build the TLAS, once the BLASes of the earlier stages are done.
+		WriteInstances(0);
+		InsertBuildBarrier(cmd);
+		RecordTlasBuild(cmd, 0, false);
+	}
+
+	void VulkanAccelerationStructure::SetInstanceTransform(u32 instanceIdx, const glm::mat4& transform)
+	{
+		Instance& instance = m_Instances[instanceIdx];
+		if (instance.transform == transform)
+			return;
+
+		instance.transform = transform;
+
+		AABB refitBounds = instance.buildBounds;
+		refitBounds.Grow(instance.localBounds.Transformed(transform));
+		const f32 refitArea = refitBounds.GetSurfaceArea();
+		m_RefitBoundsArea += refitArea - instance.refitArea;
+		instance.refitArea = refitArea;
+
+		m_MovedInstanceCount++;
+	}
+
+	void VulkanAccelerationStructure::UpdateTlas(const vk::CommandBuffer& cmd, u32 frameIdx)
+	{
+		HPR_PROFILE_SCOPE();
+
+		using Clock = std::chrono::high_resolution_clock;
+
+		// The frame's fence has been waited on, so the timestamps of its last update are available.
+		if (m_TimestampsWritten[frameIdx])
+		{
+			const std::vector<u64> timestamps = VulkanUtils::Check(m_pRenderCtx->device.getQueryPoolResults<u64>(m_TimestampPool, frameIdx * 2, 2,
+				2 * sizeof(u64), sizeof(u64), vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait));
+			m_TlasUpdateStats.gpuTimeMs = static_cast<f32>(static_cast<f64>(timestamps[1] - timestamps[0]) * m_TimestampPeriod / 1000000.0);
+			m_TimestampsWritten[frameIdx] = false;
+		}
+
+		m_TlasUpdateStats.movedCount = m_MovedInstanceCount;
+		if (m_MovedInstanceCount == 0 || m_BuildStage != BuildStage::Done)
+			return;
+
+		const auto startTime = Clock::now();
 
-		// Update build inforation
-		buildInfo.srcAccelerationStructure = nullptr;
+		m_TlasUpdateStats.refitDegradation = m_BuildBoundsArea > 0.0f ? m_RefitBoundsArea / m_BuildBoundsArea : 1.0f;
+		const bool rebuild = m_TlasUpdateStats.refitDegradation > m_MaxRefitDegradation;
+
+		WriteInstances(frameIdx);
+
+		// Earlier frames may still trace rays against the TLAS, or update it using the same scratch buffer.
+		vk::MemoryBarrier barrier{};
+		barrier.srcAccessMask = vk::AccessFlagBits::eAccelerationStructureReadKHR | vk::AccessFlagBits::eAccelerationStructureWriteKHR;
+		barrier.dstAccessMask = vk::AccessFlagBits::eAccelerationStructureReadKHR | vk::AccessFlagBits::eAccelerationStructureWriteKHR;
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eRayTracingShaderKHR | vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
+			vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR, {}, barrier, {}, {});
+
+		cmd.resetQueryPool(m_TimestampPool, frameIdx * 2, 2);
+		cmd.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, m_TimestampPool, frameIdx * 2);
+		RecordTlasBuild(cmd, frameIdx, !rebuild);
+		cmd.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, m_TimestampPool, frameIdx * 2 + 1);
+		m_TimestampsWritten[frameIdx] = true;
+
+		barrier.srcAccessMask = vk::AccessFlagBits::eAccelerationStructureWriteKHR;
+		barrier.dstAccessMask = vk::AccessFlagBits::eAccelerationStructureReadKHR;
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR, vk::PipelineStageFlagBits::eRayTracingShaderKHR, {}, barrier, {}, {});
+
+		if (rebuild)
+		{
+			ResetRefitDegradation();
+			m_TlasUpdateStats.rebuildCount++;
+		}
+		else
+		{
+			m_TlasUpdateStats.refitCount++;
+		}
+		m_TlasUpdateStats.lastWasRebuild = rebuild;
+		m_MovedInstanceCount = 0;
+
+		m_TlasUpdateStats.cpuTimeMs = std::chrono::duration<f32, std::milli>(Clock::now() - startTime).count();
+	}
+
+	void VulkanAccelerationStructure::RecordTlasBuild(const vk::CommandBuffer& cmd, u32 frameIdx, bool update)
+	{
+		vk::AccelerationStructureGeometryKHR topASGeometry = {};
+		topASGeometry.geometryType = vk::GeometryTypeKHR::eInstances;
+		topASGeometry.geometry.instances.data.deviceAddress = m_InstanceBuffers[frameIdx]->GetDeviceAddress();
+
+		// An update refits the TLAS in place, keeping the tree of its last build.
+		vk::AccelerationStructureBuildGeometryInfoKHR buildInfo = {};
+		buildInfo.flags = s_TlasBuildFlags;
+		buildInfo.setGeometries(topASGeometry);
+		buildInfo.mode = update ? vk::BuildAccelerationStructureModeKHR::eUpdate : vk::BuildAccelerationStructureModeKHR::eBuild;
+		buildInfo.type = vk::AccelerationStructureTypeKHR::eTopLevel;
+		buildInfo.srcAccelerationStructure = update ? m_Tlas.handle : nullptr;
 		buildInfo.dstAccelerationStructure = m_Tlas.handle;
-		buildInfo.scratchData.deviceAddress = scratchBuffer.deviceAddress;
+		buildInfo.scratchData.deviceAddress = m_TlasScratchAddress;
 
 		// Build offsets info: n instances
 		vk::AccelerationStructureBuildRangeInfoKHR buildOffsetInfo = {};
-		buildOffsetInfo.primitiveCount = countInstance;
-		buildOffsetInfo.primitiveOffset = 0;
-		buildOffsetInfo.firstVertex = 0;
-		buildOffsetInfo.transformOffset = 0;
+		buildOffsetInfo.primitiveCount = static_cast<u32>(m_Instances.size());
 		const vk::AccelerationStructureBuildRangeInfoKHR* pBuildOffsetInfo = &buildOffsetInfo;
 
 		cmd.buildAccelerationStructuresKHR(buildInfo, pBuildOffsetInfo);
+	}
 
-		VkDebug::SetObjectName(m_pRenderCtx->device, vk::ObjectType::eAccelerationStructureKHR, m_Tlas.handle, "Top Level Acceleration Structure");
+	void VulkanAccelerationStructure::WriteInstances(u32 frameIdx)
+	{
+		HPR_PROFILE_SCOPE();
 
-		VulkanCommandBuffer::End(cmd);
-		m_pRenderCtx->graphicsQueue.Submit({}, {}, {}, cmd, {});
-		m_pRenderCtx->graphicsQueue.WaitIdle();
-		m_pRenderCtx->commandPool->FreeCommandBuffer(cmd);
+		// Written straight into the mapped buffer, which is write-combined, so every instance is written once and in order.
+		VulkanBuffer* pBuffer = m_InstanceBuffers[frameIdx].get();
+		auto* pInstances = static_cast<vk::AccelerationStructureInstanceKHR*>(pBuffer->GetMappedData());
+		for (u32 i = 0; i < m_Instances.size(); i++)
+		{
+			const Instance& meshInstance = m_Instances[i];
+			vk::AccelerationStructureInstanceKHR instance{};
+			instance.transform = ToTransformMatrix(meshInstance.transform);
+			instance.instanceCustomIndex = m_BlasFirstGeometry[meshInstance.blasIndex];
+			instance.mask = 0xFF;
+			instance.instanceShaderBindingTableRecordOffset = 0;
+			instance.setFlags(vk::GeometryInstanceFlagBitsKHR::eTriangleFacingCullDisable);
+			// VkHPP type doesn't work here: https://bytemeta.vip/repo/KhronosGroup/Vulkan-Hpp/issues/1002
+			instance.accelerationStructureReference = m_BLASes[meshInstance.blasIndex].deviceAddress;
+			pInstances[i] = instance;
+		}
+		pBuffer->Flush(0, m_Instances.size() * sizeof(vk::AccelerationStructureInstanceKHR));
+	}
 
-		scratchBuffer.pBuffer.reset();
+	void VulkanAccelerationStructure::ResetRefitDegradation()
+	{
+		m_BuildBoundsArea = 0.0f;
+		for (Instance& instance : m_Instances)
+		{
+			instance.buildBounds = instance.localBounds.Transformed(instance.transform);
+			instance.refitArea = instance.buildBounds.GetSurfaceArea();
+			m_BuildBoundsArea += instance.refitArea;
+		}
+		m_RefitBoundsArea = m_BuildBoundsArea;
+		m_TlasUpdateStats.refitDegradation = 1.0f;
 	}
 }
@@ -2,6 +2,8 @@
 #include <glm/mat4x4.hpp>
 
 #include "VulkanBuffer.h"
+#include "VulkanCommands.h"
+#include "Hyper/Scene/Bounds.h"
 
 namespace Hyper
 {
@@ -14,7 +16,30 @@ namespace Hyper
 			vk::AccelerationStructureKHR handle;
 			u64 deviceAddress = 0;
 			std::unique_ptr<VulkanBuffer> pBuffer;
+		};
+
+		// A BLAS placed in the TLAS, instances of the same mesh share its BLAS.
+		struct Instance
+		{
+			u32 blasIndex;
 			glm::mat4 transform;
+			// Bounds of the BLAS' geometry, before the instance transform.
+			AABB localBounds;
+			// World bounds at the last full TLAS build, and the area of those grown by the current bounds.
+			AABB buildBounds;
+			f32 refitArea;
+		};
+
+		// A BLAS waiting for Build. Merged BLASes have a transform per mesh, BLASes of a single mesh are in the mesh's own space.
+		struct StagedBlas
+		{
+			std::vector<const Mesh*> meshes;
+			std::vector<glm::mat4> transforms;
+			std::string name;
+			// Hash of everything the BLAS is built from, which names it in the cache.
+			u64 cacheKey{};
+			// The BLAS serialized on an earlier run, empty when it has to be built.
+			std::string serializedData;
 		};
 
 		struct RayTracingScratchBuffer
@@ -31,24 +56,211 @@ namespace Hyper
 		};
 
 	public:
-		VulkanAccelerationStructure(RenderContext* pRenderCtx);
+		// Where the any-hit shader finds the triangles and the material of a BLAS geometry. Instances store the index of their BLAS'
+		// first geometry as their custom index. Matches the GeometryData loads in RTShadows.rahit.hlsl.
+		struct GeometryData
+		{
+			// Into the geometry pool's buffers.
+			u32 vertexOffset;
+			u32 firstIndex;
+			u32 materialIndex;
+			u32 padding;
+		};
+
+		struct BuildStats
+		{
+			u32 blasCount;
+			// Geometries in all BLASes, more than the BLAS count when meshes were merged.
+			u32 geometryCount;
+			// Geometries of masked materials, which aren't marked opaque so rays run the any-hit shader for them.
+			u32 maskedGeometryCount;
+			// TLAS instances, each referencing one of the BLASes.
+			u32 instanceCount;
+			// Builds that share a scratch buffer are recorded with a single build command, and all batches are submitted at once.
+			u32 batchCount;
+			// Wall time of each build stage, from its submit until PollBuild saw it finish on the compute queue. Builds in the
+			// background are polled once a frame, so their stages take at least a frame.
+			f32 blasBuildTimeMs;
+			f32 tlasBuildTimeMs;
+			// Size of the scratch buffer shared by the BLAS batches, which is the largest batch.
+			vk::DeviceSize peakScratchSize;
+			// BLAS memory at the worst-case size reported before the build.
+			vk::DeviceSize blasMemory;
+			// BLAS memory after compaction, the same as blasMemory when compaction is disabled.
+			vk::DeviceSize compactedBlasMemory;
+			f32 compactionTimeMs;
+			// BLASes deserialized from the cache instead of built, and BLASes that were built and written to it.
+			u32 cachedBlasCount;
+			u32 serializedBlasCount;
+		};
+
+		struct TlasUpdateStats
+		{
+			u32 refitCount;
+			u32 rebuildCount;
+			// Instances whose transform changed since the last update.
+			u32 movedCount;
+			// Sum of the instance bounds, grown by where they moved since the last full build, over their sum at that build.
+			// Refitting keeps the tree of the last build, so this estimates how much looser its nodes got.
+			f32 refitDegradation;
+			// CPU time spent writing the instances and recording the update, and GPU time of the last update of the frame.
+			f32 cpuTimeMs;
+			f32 gpuTimeMs;
+			bool lastWasRebuild;
+		};
+
+	public:
+		VulkanAccelerationStructure(RenderContext* pRenderCtx, u32 frameCount);
 		~VulkanAccelerationStructure();
 
+		// Adds an instance of the mesh to the TLAS. A mesh only gets a BLAS the first time it's added, which is named after that instance.
 		void AddMesh(const Mesh* mesh, const glm::mat4& transform, const std::string& name = "");
+		// Adds a single instance of a new BLAS with a geometry per mesh, pre-transformed by the mesh's transform. A few big BLASes
+		// trace faster than many instances of small ones, but the merged meshes can no longer move relative to each other.
+		void AddMergedMeshes(const std::vector<std::pair<const Mesh*, glm::mat4>>& meshes, const glm::mat4& transform, const std::string& name = "");
+		// Records the builds of the staged BLASes and the TLAS, and submits them to the compute queue without waiting for them.
+		// The build runs in stages, which PollBuild submits one after the other. Nothing can be added while it's building.
+		void BeginBuild();
+		// Submits the next stage of the build once the compute queue finished the last one, without ever blocking.
+		// Returns true once the TLAS is built, from then on it can be updated and traced.
+		bool PollBuild();
+		// Builds and waits for the build to finish, for startup when there's nothing to trace yet.
 		void Build();
+		// Destroys every BLAS and the TLAS, so the scene can be added again. The GPU must be idle, and no build may be running.
+		void Clear();
+
+		// Moves an instance, indexed in the order of AddMesh. Only changed transforms mark the TLAS for an update.
+		void SetInstanceTransform(u32 instanceIdx, const glm::mat4& transform);
+		// Writes the instances to the frame's instance buffer and records a refit of the TLAS, or a full rebuild once refitting
+		// degraded it too much. Does nothing when no instance moved. Has to be recorded before the frame traces any rays.
+		void UpdateTlas(const vk::CommandBuffer& cmd, u32 frameIdx);
+
+		// Whether builds copy the BLASes into buffers of their compacted size. Tracing is as fast, but building takes longer.
+		void SetCompactionEnabled(bool enabled) { m_CompactBlases = enabled; }
+		// Whether builds load BLASes they built on an earlier run from the disk, and write the ones they had to build.
+		void SetBlasCacheEnabled(bool enabled) { m_UseBlasCache = enabled; }
+
+		void DrawImGui();
 
 		[[nodiscard]] const Accel& GetTLAS() const { return m_Tlas; }
+		[[nodiscard]] const BuildStats& GetBuildStats() const { return m_BuildStats; }
+		[[nodiscard]] const TlasUpdateStats& GetTlasUpdateStats() const { return m_TlasUpdateStats; }
+		[[nodiscard]] u32 GetInstanceCount() const { return static_cast<u32>(m_Instances.size()); }
+		// GeometryData of every BLAS geometry, created with the TLAS.
+		[[nodiscard]] vk::DeviceAddress GetGeometryBufferAddress() const { return m_pGeometryBuffer ? m_pGeometryBuffer->GetDeviceAddress() : 0; }
+		// Changes whenever the TLAS is recreated, which invalidates descriptor sets that point at it.
+		[[nodiscard]] u32 GetTlasVersion() const { return m_TlasVersion; }
+		[[nodiscard]] bool IsBuilt() const { return m_BuildStage == BuildStage::Done; }
+		// Timeline semaphore signalled by every build stage. A queue that traces rays waits for GetBuildValue, which makes the writes of the
+		// compute queue visible to it. The value has always been reached once the build is done, so the wait never stalls.
+		[[nodiscard]] vk::Semaphore GetBuildSemaphore() const { return m_BuildSemaphore; }
+		[[nodiscard]] u64 GetBuildValue() const { return m_BuildValue; }
 
 	private:
-		void CreateBlas(const Mesh* pMesh, const glm::mat4& transform, const std::string& name);
-		void CreateTlas();
+		// Every stage is a submit of its own, which signals the next build value. Compaction needs the sizes the BLAS stage queried.
+		enum class BuildStage
+		{
+			None,
+			Blases,
+			Compaction,
+			Tlas,
+			Done,
+		};
+
+		// Keys every staged BLAS by its build inputs and the device, and reads the ones the device can deserialize from the cache.
+		void LoadCachedBlases();
+		// Records the builds of every staged BLAS that wasn't cached, the deserialization of the rest, and the queries of the
+		// compacted sizes when compaction is enabled.
+		void RecordBlasBuilds(const vk::CommandBuffer& cmd);
+		// Creates a BLAS of the size stored in the serialized data, and records the copy of the data into it.
+		Accel RecordBlasDeserialization(const vk::CommandBuffer& cmd, const StagedBlas& staged);
+		// Replaces the BLASes built by this build by compacted copies, they have to be built with eAllowCompaction.
+		// The originals are destroyed once the copies are done.
+		void RecordBlasCompaction(const vk::CommandBuffer& cmd);
+		// Creates a pool with a query per BLAS built by this build, and records the queries once the builds are done.
+		void RecordBuiltBlasQueries(const vk::CommandBuffer& cmd, vk::QueryType queryType, vk::QueryPool& queryPool);
+		// Records the copies of the BLASes built by this build into readback buffers of their queried serialization sizes.
+		void RecordBlasSerialization(const vk::CommandBuffer& cmd);
+		// Writes the serialized BLASes to the cache, once the stage that copied them is done.
+		void WriteCachedBlases();
+		// Creates the TLAS and its buffers, and records its build from the first instance buffer.
+		void RecordTlasCreation(const vk::CommandBuffer& cmd);
+		// Ends the build command buffer and submits it to the compute queue.
+		void SubmitBuildStage(BuildStage stage);
+		void WaitForBuildStage() const;
+		// Destroys what only the running build needed.
+		void ReleaseBuildResources();
+		// Records a build of the TLAS from the frame's instance buffer, refitting the last build when update is set.
+		void RecordTlasBuild(const vk::CommandBuffer& cmd, u32 frameIdx, bool update);
+		void WriteInstances(u32 frameIdx);
+		// Starts a new refit degradation measurement from the current instance bounds.
+		void ResetRefitDegradation();
 
 	private:
 		RenderContext* m_pRenderCtx;
+		u32 m_FrameCount;
 
 		std::vector<Accel> m_BLASes{};
 		Accel m_Tlas{};
+		// Index into m_GeometryData of the first geometry of every BLAS, in the same order as m_BLASes.
+		std::vector<u32> m_BlasFirstGeometry;
+		std::vector<GeometryData> m_GeometryData;
+		std::unique_ptr<VulkanBuffer> m_pGeometryBuffer;
 
-		std::vector<std::tuple<const Mesh*, glm::mat4, std::string>> m_StagedMeshes;
+		// Index into m_BLASes of every mesh that was added, including the ones that are still staged.
+		std::unordered_map<const Mesh*, u32> m_MeshBlases;
+		std::vector<StagedBlas> m_StagedBlases;
+		// Index into m_StagedBlases of the BLASes that are built rather than loaded from the cache.
+		std::vector<u32> m_BuiltBlases;
+		std::vector<Instance> m_Instances;
+
+		// Every frame in flight writes its own instances, so the CPU never overwrites ones that an earlier frame's update still reads.
+		std::vector<std::unique_ptr<VulkanBuffer>> m_InstanceBuffers;
+		// Fits both a build and an update of the TLAS.
+		std::unique_ptr<VulkanBuffer> m_pTlasScratchBuffer;
+		vk::DeviceAddress m_TlasScratchAddress{};
+		u32 m_MovedInstanceCount{};
+		u32 m_TlasVersion{};
+		f32 m_BuildBoundsArea{};
+		f32 m_RefitBoundsArea{};
+		// Refit degradation past which UpdateTlas rebuilds the TLAS instead.
+		f32 m_MaxRefitDegradation{ 1.5f };
+
+		// Two timestamps around the TLAS update of every frame in flight.
+		vk::QueryPool m_TimestampPool;
+		std::vector<bool> m_TimestampsWritten;
+		f32 m_TimestampPeriod{};
+		TlasUpdateStats m_TlasUpdateStats{};
+
+		bool m_CompactBlases{ true };
+		bool m_UseBlasCache{ true };
+		// Hash of the device and driver UUIDs. Serialized BLASes only load on a compatible driver, and this keeps others from overwriting them.
+		u64 m_DeviceHash{};
+		BuildStats m_BuildStats{};
+
+		// The compute queue has its own command pool, which builds only use from the main thread.
+		std::unique_ptr<VulkanCommandPool> m_pBuildCommandPool;
+		vk::CommandBuffer m_BuildCmd{};
+		vk::Semaphore m_BuildSemaphore{};
+		u64 m_BuildValue{};
+		BuildStage m_BuildStage{ BuildStage::None };
+		std::chrono::high_resolution_clock::time_point m_StageStartTime{};
+		// Everything the submitted stages still read or write, which lives until the stage that uses it is done.
+		u32 m_BuildFirstBlas{};
+		std::unique_ptr<VulkanBuffer> m_pBlasScratchBuffer;
+		std::unique_ptr<VulkanBuffer> m_pTransformBuffer;
+		vk::QueryPool m_CompactionQueryPool{};
+		std::vector<Accel> m_UncompactedBlases;
+		vk::QueryPool m_SerializationQueryPool{};
+		// Serialized BLASes in host-visible buffers, uploads from the cache during the BLAS stage and readbacks during the TLAS stage.
+		struct SerializedBlas
+		{
+			std::unique_ptr<VulkanBuffer> pBuffer;
+			// Serialized data has to be aligned to 256 bytes, which the buffer's address may not be.
+			vk::DeviceSize offset;
+			vk::DeviceSize size;
+			u64 cacheKey;
+		};
+		std::vector<SerializedBlas> m_SerializedBlases;
 	};
 }
@@ -9,17 +9,16 @@ namespace Hyper
 {
 	VulkanBuffer::VulkanBuffer(RenderContext* pRenderCtx, const void* data, vk::DeviceSize size,
 		vk::BufferUsageFlags bufferUsage, VmaMemoryUsage memoryUsage, const std::string& name,
-		vk::BufferCreateFlags flags)
-		: VulkanBuffer(pRenderCtx, size, bufferUsage, memoryUsage, name, flags)
+		vk::BufferCreateFlags flags, VmaAllocationCreateFlags allocationFlags)
+		: VulkanBuffer(pRenderCtx, size, bufferUsage, memoryUsage, name, flags, allocationFlags)
 	{
 		// Copy the data into the buffer
-		void* mapped = Map();
-		memcpy(mapped, data, size);
-		Unmap();
+		Write(data, size, 0);
 	}
 
 	VulkanBuffer::VulkanBuffer(RenderContext* pRenderCtx, vk::DeviceSize size, vk::BufferUsageFlags bufferUsage,
-	                           VmaMemoryUsage memoryUsage, const std::string& name, vk::BufferCreateFlags flags)
+	                           VmaMemoryUsage memoryUsage, const std::string& name, vk::BufferCreateFlags flags,
+	                           VmaAllocationCreateFlags allocationFlags)
 		: m_pRenderCtx(pRenderCtx)
 		, m_Size(size)
 		, m_UsageFlags(bufferUsage)
@@ -30,11 +29,21 @@ namespace Hyper
 		bufferInfo.usage = bufferUsage;
 		bufferInfo.sharingMode = vk::SharingMode::eExclusive;
 
+		const std::array queueFamilies{ pRenderCtx->graphicsQueue.familyIndex, pRenderCtx->computeQueue.familyIndex };
+		constexpr vk::BufferUsageFlags sharedUsage = vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR | vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR;
+		if ((bufferUsage & sharedUsage) && queueFamilies[0] != queueFamilies[1])
+		{
+			bufferInfo.sharingMode = vk::SharingMode::eConcurrent;
+			bufferInfo.setQueueFamilyIndices(queueFamilies);
+		}
+
 		VmaAllocationCreateInfo allocInfo{};
 		allocInfo.usage = memoryUsage;
+		allocInfo.flags = allocationFlags;
 
 		VkBuffer tempBuffer;
 		VmaAllocation tempAlloc;
+		VmaAllocationInfo tempAllocInfo;
 		
 		VulkanUtils::Check(vmaCreateBuffer(
 			pRenderCtx->allocator,
@@ -42,10 +51,16 @@ namespace Hyper
 			&allocInfo,
 			&tempBuffer,
 			&tempAlloc,
-			nullptr));
+			&tempAllocInfo));
 
 		m_Buffer = tempBuffer;
 		m_Allocation = tempAlloc;
+		// Only set when the buffer was created with VMA_ALLOCATION_CREATE_MAPPED_BIT.
+		m_pMapped = tempAllocInfo.pMappedData;
+
+		VkMemoryPropertyFlags memoryFlags;
+		vmaGetAllocationMemoryProperties(pRenderCtx->allocator, m_Allocation, &memoryFlags);
+		m_HostCoherent = (memoryFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
 
 		VkDebug::SetObjectName(m_pRenderCtx->device, vk::ObjectType::eBuffer, m_Buffer, name);
 	}
@@ -61,10 +76,13 @@ namespace Hyper
 		, m_UsageFlags(other.m_UsageFlags)
 		, m_Buffer(other.m_Buffer)
 		, m_Allocation(other.m_Allocation)
+		, m_pMapped(other.m_pMapped)
+		, m_HostCoherent(other.m_HostCoherent)
 	{
 		// Invalidate other's important data
 		other.m_Buffer = nullptr;
 		other.m_Allocation = nullptr;
+		other.m_pMapped = nullptr;
 	}
 	
 	VulkanBuffer& VulkanBuffer::operator=(VulkanBuffer&& other)
@@ -75,16 +93,22 @@ namespace Hyper
 		m_UsageFlags = other.m_UsageFlags;
 		m_Buffer = other.m_Buffer;
 		m_Allocation = other.m_Allocation;
+		m_pMapped = other.m_pMapped;
+		m_HostCoherent = other.m_HostCoherent;
 	
 		// Invalidate other's important data
 		other.m_Buffer = nullptr;
 		other.m_Allocation = nullptr;
+		other.m_pMapped = nullptr;
 	
 		return *this;
 	}
 
 	void* VulkanBuffer::Map()
 	{
+		if (m_pMapped)
+			return m_pMapped;
+
 		void* data;
 		VulkanUtils::Check(vmaMapMemory(m_pRenderCtx->allocator, m_Allocation, &data));
 
@@ -93,16 +117,41 @@ namespace Hyper
 
 	void VulkanBuffer::Unmap()
 	{
+		if (m_pMapped)
+			return;
+
 		vmaUnmapMemory(m_pRenderCtx->allocator, m_Allocation);
 	}
 
 	void VulkanBuffer::SetData(const void* data, size_t size)
+	{
+		Write(data, size, 0);
+	}
+
+	void VulkanBuffer::Write(const void* data, vk::DeviceSize size, vk::DeviceSize offset)
 	{
 		void* mapped = Map();
-		memcpy(mapped, data, size);
+		memcpy(static_cast<u8*>(mapped) + offset, data, size);
+		Flush(offset, size);
 		Unmap();
 	}
 
+	void VulkanBuffer::Flush(vk::DeviceSize offset, vk::DeviceSize size) const
+	{
+		if (m_HostCoherent)
+			return;
+
+		VulkanUtils::Check(vmaFlushAllocation(m_pRenderCtx->allocator, m_Allocation, offset, size));
+	}
+
+	void VulkanBuffer::Invalidate(vk::DeviceSize offset, vk::DeviceSize size) const
+	{
+		if (m_HostCoherent)
+			return;
+
+		VulkanUtils::Check(vmaInvalidateAllocation(m_pRenderCtx->allocator, m_Allocation, offset, size));
+	}
+
 	void VulkanBuffer::CopyFrom(const VulkanBuffer& srcBuffer)
 	{
 		// TODO: replace with asserts
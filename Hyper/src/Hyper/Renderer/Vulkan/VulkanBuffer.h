@@ -1,4 +1,5 @@
 ﻿#pragma once
+#include <span>
 #include <vulkan/vulkan.hpp>
 #include <vk_mem_alloc.h>
 
@@ -6,11 +7,17 @@ namespace Hyper
 {
 	struct RenderContext;
 
+	// Buffers created with VMA_ALLOCATION_CREATE_MAPPED_BIT stay mapped for their whole lifetime. Map then returns the same pointer
+	// without calling into VMA, Unmap does nothing, and writes are flushed when the memory isn't host coherent.
+	// Acceleration structure storage and build inputs are shared between the graphics and compute queue families, since the
+	// compute queue builds the acceleration structures that the graphics queue traces.
 	class VulkanBuffer
 	{
 	public:
-		VulkanBuffer(RenderContext* pRenderCtx, vk::DeviceSize size, vk::BufferUsageFlags bufferUsage, VmaMemoryUsage memoryUsage, const std::string& name, vk::BufferCreateFlags flags = {});
-		VulkanBuffer(RenderContext* pRenderCtx, const void* data, vk::DeviceSize size, vk::BufferUsageFlags bufferUsage, VmaMemoryUsage memoryUsage, const std::string& name, vk::BufferCreateFlags flags = {});
+		VulkanBuffer(RenderContext* pRenderCtx, vk::DeviceSize size, vk::BufferUsageFlags bufferUsage, VmaMemoryUsage memoryUsage, const std::string& name, vk::BufferCreateFlags flags = {},
+			VmaAllocationCreateFlags allocationFlags = 0);
+		VulkanBuffer(RenderContext* pRenderCtx, const void* data, vk::DeviceSize size, vk::BufferUsageFlags bufferUsage, VmaMemoryUsage memoryUsage, const std::string& name, vk::BufferCreateFlags flags = {},
+			VmaAllocationCreateFlags allocationFlags = 0);
 		~VulkanBuffer();
 		// Make sure we can't copy the buffer
 		VulkanBuffer(const VulkanBuffer& other) = delete;
@@ -24,6 +31,18 @@ namespace Hyper
 		void Unmap();
 
 		void SetData(const void* data, size_t size);
+		// Copies the data to the given offset, and flushes that range.
+		void Write(const void* data, vk::DeviceSize size, vk::DeviceSize offset);
+		template<typename T>
+		void WriteSpan(std::span<const T> values, vk::DeviceSize offset = 0) { Write(values.data(), values.size_bytes(), offset); }
+
+		// Makes host writes to the range visible to the device. Does nothing for host coherent memory.
+		void Flush(vk::DeviceSize offset = 0, vk::DeviceSize size = VK_WHOLE_SIZE) const;
+		// Makes device writes to the range visible to the host, before reading it back. Does nothing for host coherent memory.
+		void Invalidate(vk::DeviceSize offset = 0, vk::DeviceSize size = VK_WHOLE_SIZE) const;
+
+		// Pointer to the start of the buffer, only valid for persistently mapped buffers.
+		[[nodiscard]] void* GetMappedData() const { return m_pMapped; }
 
 		[[nodiscard]] vk::Buffer GetBuffer() const { return m_Buffer; }
 
@@ -37,5 +56,7 @@ namespace Hyper
 		vk::BufferUsageFlags m_UsageFlags{};
 		vk::Buffer m_Buffer{};
 		VmaAllocation m_Allocation{};
+		void* m_pMapped{};
+		bool m_HostCoherent{};
 	};
 }
@@ -7,17 +7,18 @@
 namespace Hyper
 {
 	VulkanCommandPool::VulkanCommandPool(RenderContext* pRenderCtx)
+		: VulkanCommandPool(pRenderCtx, pRenderCtx->graphicsQueue.familyIndex)
+	{
+	}
+
+	VulkanCommandPool::VulkanCommandPool(RenderContext* pRenderCtx, u32 queueFamilyIndex)
 		: m_pRenderCtx(pRenderCtx)
 	{
 		vk::CommandPoolCreateInfo info{};
 		info.flags=vk::CommandPoolCreateFlagBits::eResetCommandBuffer;
-		info.queueFamilyIndex = m_pRenderCtx->graphicsQueue.familyIndex;
+		info.queueFamilyIndex = queueFamilyIndex;
 		
 		m_Pool = VulkanUtils::Check(m_pRenderCtx->device.createCommandPool(info));
-
-		m_pRenderCtx->commandPool = this;
-
-		HPR_VKLOG_INFO("Successfully created the command pool");
 	}
 
 	VulkanCommandPool::~VulkanCommandPool()
@@ -52,12 +53,18 @@ namespace Hyper
 		FreeCommandBuffers({ cmd });
 	}
 
+	void VulkanCommandPool::Reset() const
+	{
+		VulkanUtils::Check(m_pRenderCtx->device.resetCommandPool(m_Pool));
+	}
+
 	namespace VulkanCommandBuffer
 	{
-		void Begin(vk::CommandBuffer cmd, vk::CommandBufferUsageFlags flags)
+		void Begin(vk::CommandBuffer cmd, vk::CommandBufferUsageFlags flags, const vk::CommandBufferInheritanceInfo* pInheritanceInfo)
 		{
 			vk::CommandBufferBeginInfo info = {};
 			info.flags = flags;
+			info.pInheritanceInfo = pInheritanceInfo;
 
 			VulkanUtils::Check(cmd.begin(info));
 		}
@@ -9,12 +9,16 @@ namespace Hyper
 	{
 	public:
 		VulkanCommandPool(RenderContext* pRenderCtx);
+		// Command buffers of the pool can only be submitted to queues of the given family.
+		VulkanCommandPool(RenderContext* pRenderCtx, u32 queueFamilyIndex);
 		~VulkanCommandPool();
 
 		[[nodiscard]] std::vector<vk::CommandBuffer> GetCommandBuffers(u32 count, vk::CommandBufferLevel level = vk::CommandBufferLevel::ePrimary);
 		[[nodiscard]] vk::CommandBuffer GetCommandBuffer(vk::CommandBufferLevel level = vk::CommandBufferLevel::ePrimary);
 		void FreeCommandBuffers(const std::vector<vk::CommandBuffer>& commandBuffers) const;
 		void FreeCommandBuffer(const vk::CommandBuffer& cmd) const;
+		// Puts every command buffer allocated from this pool back in the initial state. None of them may still be in use by the GPU.
+		void Reset() const;
 
 	private:
 		RenderContext* m_pRenderCtx;
@@ -24,7 +28,8 @@ namespace Hyper
 	// Helper functions for vulkan command buffers
 	namespace VulkanCommandBuffer
 	{
-		void Begin(vk::CommandBuffer cmd, vk::CommandBufferUsageFlags flags = {});
+		// Secondary command buffers need the inheritance info, to know which render pass or dynamic rendering scope they continue.
+		void Begin(vk::CommandBuffer cmd, vk::CommandBufferUsageFlags flags = {}, const vk::CommandBufferInheritanceInfo* pInheritanceInfo = nullptr);
 		void End(vk::CommandBuffer cmd);
 	}
 }
@@ -5,12 +5,25 @@
 
 namespace Hyper
 {
+	// Every pool fits this many sets, with enough descriptors for each of them to use the per-set counts below.
+	static constexpr u32 s_SetsPerPool = 64;
+	static constexpr std::array s_PoolSizesPerSet = {
+		vk::DescriptorPoolSize{ vk::DescriptorType::eUniformBuffer, 1 },
+		vk::DescriptorPoolSize{ vk::DescriptorType::eUniformBufferDynamic, 1 },
+		vk::DescriptorPoolSize{ vk::DescriptorType::eStorageBuffer, 4 },
+		vk::DescriptorPoolSize{ vk::DescriptorType::eCombinedImageSampler, 2 },
+		vk::DescriptorPoolSize{ vk::DescriptorType::eSampledImage, 2 },
+		vk::DescriptorPoolSize{ vk::DescriptorType::eStorageImage, 1 },
+		vk::DescriptorPoolSize{ vk::DescriptorType::eAccelerationStructureKHR, 1 },
+	};
+
 	DescriptorSetLayoutBuilder::DescriptorSetLayoutBuilder(vk::Device device)
 		: m_Device(device)
 	{
 	}
 
-	DescriptorSetLayoutBuilder DescriptorSetLayoutBuilder::AddBinding(vk::DescriptorType descriptorType, u32 binding, u32 count, vk::ShaderStageFlags stageFlags)
+	DescriptorSetLayoutBuilder DescriptorSetLayoutBuilder::AddBinding(vk::DescriptorType descriptorType, u32 binding, u32 count, vk::ShaderStageFlags stageFlags,
+		vk::DescriptorBindingFlags bindingFlags)
 	{
 		m_Bindings.emplace_back(vk::DescriptorSetLayoutBinding{
 			binding,
@@ -18,6 +31,13 @@ namespace Hyper
 			count,
 			stageFlags
 		});
+		m_BindingFlags.push_back(bindingFlags);
+		return *this;
+	}
+
+	DescriptorSetLayoutBuilder DescriptorSetLayoutBuilder::SetFlags(vk::DescriptorSetLayoutCreateFlags flags)
+	{
+		m_Flags = flags;
 		return *this;
 	}
 
@@ -25,6 +45,13 @@ namespace Hyper
 	{
 		vk::DescriptorSetLayoutCreateInfo info = {};
 		info.setBindings(m_Bindings);
+		info.flags = m_Flags;
+
+		// Only chain the binding flags when they're used, so plain layouts don't depend on descriptor indexing.
+		vk::DescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo = {};
+		bindingFlagsInfo.setBindingFlags(m_BindingFlags);
+		if (std::ranges::any_of(m_BindingFlags, [](vk::DescriptorBindingFlags flags) { return static_cast<bool>(flags); }))
+			info.pNext = &bindingFlagsInfo;
 
 		const vk::DescriptorSetLayout layout = VulkanUtils::Check(m_Device.createDescriptorSetLayout(info));
 
@@ -108,6 +135,110 @@ namespace Hyper
 		return sets;
 	}
 
+	DescriptorAllocator::DescriptorAllocator(vk::Device device, u32 frameCount)
+		: m_Device(device)
+		, m_FramePools(frameCount)
+	{
+	}
+
+	DescriptorAllocator::~DescriptorAllocator()
+	{
+		for (const vk::DescriptorPool& pool : m_PersistentPools)
+		{
+			m_Device.destroyDescriptorPool(pool);
+		}
+		for (const PoolList& pools : m_FramePools)
+		{
+			for (const vk::DescriptorPool& pool : pools)
+			{
+				m_Device.destroyDescriptorPool(pool);
+			}
+		}
+		for (const vk::DescriptorPool& pool : m_FreePools)
+		{
+			m_Device.destroyDescriptorPool(pool);
+		}
+	}
+
+	void DescriptorAllocator::BeginFrame(u32 frameIdx)
+	{
+		for (const vk::DescriptorPool& pool : m_FramePools[frameIdx])
+		{
+			m_Device.resetDescriptorPool(pool);
+			m_FreePools.push_back(pool);
+		}
+		m_FramePools[frameIdx].clear();
+
+		m_LastFrameStats = m_Stats;
+		m_Stats.frameSetCount = 0;
+		m_Stats.frameAllocationTimeMs = 0.0f;
+		m_Stats.maxAllocationTimeMs = 0.0f;
+	}
+
+	vk::DescriptorSet DescriptorAllocator::Allocate(vk::DescriptorSetLayout layout)
+	{
+		return AllocateFromList(m_PersistentPools, layout);
+	}
+
+	vk::DescriptorSet DescriptorAllocator::AllocateTransient(u32 frameIdx, vk::DescriptorSetLayout layout)
+	{
+		return AllocateFromList(m_FramePools[frameIdx], layout);
+	}
+
+	vk::DescriptorSet DescriptorAllocator::AllocateFromList(PoolList& pools, vk::DescriptorSetLayout layout)
+	{
+		using Clock = std::chrono::high_resolution_clock;
+		const auto startTime = Clock::now();
+
+		if (pools.empty())
+			pools.push_back(GetFreePool());
+
+		vk::DescriptorSetAllocateInfo info = {};
+		info.descriptorPool = pools.back();
+		info.setSetLayouts(layout);
+
+		vk::DescriptorSet set;
+		vk::Result result = m_Device.allocateDescriptorSets(&info, &set);
+		if (result == vk::Result::eErrorOutOfPoolMemory || result == vk::Result::eErrorFragmentedPool)
+		{
+			// The current pool is full, move on to the next one. A set that doesn't fit an empty pool never will.
+			pools.push_back(GetFreePool());
+			info.descriptorPool = pools.back();
+			result = m_Device.allocateDescriptorSets(&info, &set);
+		}
+		VulkanUtils::Check(result);
+
+		const f32 timeMs = std::chrono::duration<f32, std::milli>(Clock::now() - startTime).count();
+		m_Stats.frameSetCount++;
+		m_Stats.frameAllocationTimeMs += timeMs;
+		m_Stats.maxAllocationTimeMs = std::max(m_Stats.maxAllocationTimeMs, timeMs);
+
+		return set;
+	}
+
+	vk::DescriptorPool DescriptorAllocator::GetFreePool()
+	{
+		if (!m_FreePools.empty())
+		{
+			const vk::DescriptorPool pool = m_FreePools.back();
+			m_FreePools.pop_back();
+			return pool;
+		}
+
+		std::array<vk::DescriptorPoolSize, s_PoolSizesPerSet.size()> sizes;
+		for (u32 i = 0; i < sizes.size(); i++)
+		{
+			sizes[i] = vk::DescriptorPoolSize{ s_PoolSizesPerSet[i].type, s_PoolSizesPerSet[i].descriptorCount * s_SetsPerPool };
+		}
+
+		vk::DescriptorPoolCreateInfo info = {};
+		info.maxSets = s_SetsPerPool;
+		info.setPoolSizes(sizes);
+
+		m_Stats.poolCount++;
+		return VulkanUtils::Check(m_Device.createDescriptorPool(info));
+	}
+
 	DescriptorWriter::DescriptorWriter(vk::Device device, vk::DescriptorSet descriptorSet)
 		: m_Device(device), m_DescriptorSet(descriptorSet)
 	{
@@ -137,6 +268,19 @@ namespace Hyper
 		m_DescriptorWrites.push_back(setWrite);
 	}
 
+	void DescriptorWriter::WriteImage(const vk::DescriptorImageInfo& imageInfo, u32 dstBinding, u32 dstArrayElement, vk::DescriptorType type)
+	{
+		vk::WriteDescriptorSet setWrite = {};
+		setWrite.dstBinding = dstBinding;
+		setWrite.dstArrayElement = dstArrayElement;
+		setWrite.dstSet = m_DescriptorSet;
+		setWrite.descriptorCount = 1;
+		setWrite.descriptorType = type;
+		setWrite.setImageInfo(imageInfo);
+
+		m_DescriptorWrites.push_back(setWrite);
+	}
+
 	void DescriptorWriter::WriteAccelStructure(const vk::WriteDescriptorSetAccelerationStructureKHR* accelInfo, u32 dstBinding)
 	{
 		vk::WriteDescriptorSet setWrite = {};
@@ -5,17 +5,26 @@
 
 namespace Hyper
 {
+	// Descriptor count of unbounded descriptor arrays in shaders, like the bindless material textures.
+	// Both the shader reflection and the owner of the descriptor set use it, so their layouts are compatible.
+	inline constexpr u32 BindlessDescriptorCount = 4096;
+
 	class DescriptorSetLayoutBuilder
 	{
 	public:
 		DescriptorSetLayoutBuilder(vk::Device device);
 
-		DescriptorSetLayoutBuilder AddBinding(vk::DescriptorType descriptorType, u32 binding, u32 count, vk::ShaderStageFlags stageFlags);
+		DescriptorSetLayoutBuilder AddBinding(vk::DescriptorType descriptorType, u32 binding, u32 count, vk::ShaderStageFlags stageFlags,
+			vk::DescriptorBindingFlags bindingFlags = {});
+		// Layouts with update-after-bind bindings need the eUpdateAfterBindPool flag, and have to be allocated from a pool created with eUpdateAfterBind.
+		DescriptorSetLayoutBuilder SetFlags(vk::DescriptorSetLayoutCreateFlags flags);
 		vk::DescriptorSetLayout Build();
 
 	private:
 		vk::Device m_Device;
 		std::vector<vk::DescriptorSetLayoutBinding> m_Bindings{};
+		std::vector<vk::DescriptorBindingFlags> m_BindingFlags{};
+		vk::DescriptorSetLayoutCreateFlags m_Flags{};
 	};
 
 	class DescriptorPool
@@ -55,6 +64,59 @@ namespace Hyper
 		vk::DescriptorPool m_Pool;
 	};
 
+	struct DescriptorAllocatorStats
+	{
+		// Pools created since the allocator was created, recycled ones are only counted once.
+		u32 poolCount;
+		// Sets allocated during the last frame, persistent and transient.
+		u32 frameSetCount;
+		// Time spent in vkAllocateDescriptorSets during the last frame, including creating new pools.
+		f32 frameAllocationTimeMs;
+		// Slowest single allocation during the last frame.
+		f32 maxAllocationTimeMs;
+	};
+
+	// Hands out descriptor sets from a growing list of pools, which all have the same mix of descriptor types.
+	// When a pool runs out, the next one is taken from the recycled pools or created, so nothing has to be sized up front.
+	// Persistent sets live as long as the allocator. Transient sets are only valid for the frame they were allocated in:
+	// every frame in flight has its own pools, which are reset and recycled when BeginFrame is called with that frame index again.
+	// Not thread safe, allocate from the render thread only.
+	class DescriptorAllocator
+	{
+	public:
+		DescriptorAllocator(vk::Device device, u32 frameCount);
+		~DescriptorAllocator();
+
+		DescriptorAllocator(const DescriptorAllocator& other) = delete;
+		DescriptorAllocator& operator=(const DescriptorAllocator& other) = delete;
+
+		// Resets the transient sets of the frame, whose fence must have been waited on.
+		void BeginFrame(u32 frameIdx);
+
+		[[nodiscard]] vk::DescriptorSet Allocate(vk::DescriptorSetLayout layout);
+		[[nodiscard]] vk::DescriptorSet AllocateTransient(u32 frameIdx, vk::DescriptorSetLayout layout);
+
+		[[nodiscard]] const DescriptorAllocatorStats& GetStats() const { return m_LastFrameStats; }
+
+	private:
+		// The last pool is the one that's allocated from, the others are full.
+		using PoolList = std::vector<vk::DescriptorPool>;
+
+		vk::DescriptorSet AllocateFromList(PoolList& pools, vk::DescriptorSetLayout layout);
+		vk::DescriptorPool GetFreePool();
+
+	private:
+		vk::Device m_Device;
+
+		PoolList m_PersistentPools;
+		std::vector<PoolList> m_FramePools;
+		// Reset pools, ready to be used by any frame or by persistent sets.
+		std::vector<vk::DescriptorPool> m_FreePools;
+
+		DescriptorAllocatorStats m_Stats{};
+		DescriptorAllocatorStats m_LastFrameStats{};
+	};
+
 	class DescriptorWriter
 	{
 	public:
@@ -62,6 +124,8 @@ namespace Hyper
 
 		void WriteBuffer(const vk::DescriptorBufferInfo& bufferInfo, u32 dstBinding, vk::DescriptorType type);
 		void WriteImage(const vk::DescriptorImageInfo& imageInfo, u32 dstBinding, vk::DescriptorType type);
+		// Writes a single element of an arrayed binding.
+		void WriteImage(const vk::DescriptorImageInfo& imageInfo, u32 dstBinding, u32 dstArrayElement, vk::DescriptorType type);
 		void WriteAccelStructure(const vk::WriteDescriptorSetAccelerationStructureKHR* accelInfo, u32 dstBinding);
 		void Write();
 
@@ -8,7 +8,7 @@
 
 namespace Hyper
 {
-	VulkanDevice::VulkanDevice(RenderContext* pRenderCtx)
+	VulkanDevice::VulkanDevice(RenderContext* pRenderCtx, bool headless)
 		: m_pRenderCtx(pRenderCtx)
 #ifdef HYPER_USE_AFTERMATH
 		, m_MarkerMap{}
@@ -40,7 +40,11 @@ namespace Hyper
 
 			constexpr const char* VK_KHR_WIN32_SURFACE_EXTENSION_NAME = "VK_KHR_win32_surface";
 
-			std::vector extensions = { VK_KHR_SURFACE_EXTENSION_NAME, VK_KHR_WIN32_SURFACE_EXTENSION_NAME };
+			std::vector<const char*> extensions{};
+			if (!headless)
+			{
+				extensions = { VK_KHR_SURFACE_EXTENSION_NAME, VK_KHR_WIN32_SURFACE_EXTENSION_NAME };
+			}
 
 			if (HYPER_VALIDATE)
 			{
@@ -76,11 +80,15 @@ namespace Hyper
 		{
 			// Find physical device
 			auto availableDevices = VulkanUtils::Check(pRenderCtx->instance.enumeratePhysicalDevices());
-			const auto foundDevice = std::ranges::find_if(availableDevices, [](const vk::PhysicalDevice& device)
+			auto foundDevice = std::ranges::find_if(availableDevices, [](const vk::PhysicalDevice& device)
 				{
 					const vk::PhysicalDeviceProperties properties = device.getProperties();
 					return properties.deviceType == vk::PhysicalDeviceType::eDiscreteGpu;
 				});
+			if (headless && foundDevice == availableDevices.end())
+			{
+				foundDevice = availableDevices.begin();
+			}
 
 			if (foundDevice == availableDevices.end())
 			{
@@ -92,9 +100,10 @@ namespace Hyper
 
 			vk::PhysicalDeviceProperties2 properties{};
 			properties.pNext = &pRenderCtx->rtProperties;
+			pRenderCtx->rtProperties.pNext = &pRenderCtx->asProperties;
 			pRenderCtx->physicalDevice.getProperties2(&properties);
 
-			HPR_VKLOG_INFO("Found a physical device");
+			HPR_VKLOG_INFO("Found a physical device: {}", properties.properties.deviceName.data());
 
 			std::vector<vk::QueueFamilyProperties> queueFamilyProperties = pRenderCtx->physicalDevice.getQueueFamilyProperties();
 
@@ -108,11 +117,28 @@ namespace Hyper
 			u32 graphicsQueueFamilyIndex = static_cast<u32>(std::distance(queueFamilyProperties.begin(), graphicsPropertyIterator));
 			assert(graphicsQueueFamilyIndex < queueFamilyProperties.size());
 
+			// Acceleration structures are built on a compute queue, which overlaps with rendering when it's from a family without graphics.
+			// Devices without one build them on the graphics queue instead.
+			const auto computePropertyIterator = std::find_if(queueFamilyProperties.begin(), queueFamilyProperties.end(),
+				[](const vk::QueueFamilyProperties& qfp)
+				{
+					return (qfp.queueFlags & vk::QueueFlagBits::eCompute) && !(qfp.queueFlags & vk::QueueFlagBits::eGraphics);
+				});
+			const bool hasAsyncCompute = computePropertyIterator != queueFamilyProperties.end();
+			const u32 computeQueueFamilyIndex = hasAsyncCompute
+				? static_cast<u32>(std::distance(queueFamilyProperties.begin(), computePropertyIterator))
+				: graphicsQueueFamilyIndex;
+
 			// Create a device and retrieve the queues
 			constexpr f32 queuePriority = 0.0f;
 			std::vector<vk::DeviceQueueCreateInfo> queueCreateInfos{};
 			// Graphics queue
 			queueCreateInfos.emplace_back(vk::DeviceQueueCreateInfo{{}, graphicsQueueFamilyIndex, 1, &queuePriority});
+			// Async compute queue
+			if (hasAsyncCompute)
+			{
+				queueCreateInfos.emplace_back(vk::DeviceQueueCreateInfo{{}, computeQueueFamilyIndex, 1, &queuePriority});
+			}
 
 			auto deviceCreateInfoChain = vk::StructureChain<
 				vk::DeviceCreateInfo,
@@ -121,21 +147,39 @@ namespace Hyper
 				// Ray-tracing features
 				vk::PhysicalDeviceRayQueryFeaturesKHR,
 				vk::PhysicalDeviceRayTracingPipelineFeaturesKHR,
-				vk::PhysicalDeviceBufferDeviceAddressFeatures,
+				// Buffer device addresses, indirect draws with a GPU written draw count, the bindless material textures,
+				// and the timeline semaphores of the async acceleration structure builds
+				vk::PhysicalDeviceVulkan12Features,
 				vk::PhysicalDeviceAccelerationStructureFeaturesKHR,
 				// Device diagnostics for Nvidia Aftermath
 				// TODO: make this an optional feature
 				vk::DeviceDiagnosticsConfigCreateInfoNV,
-				vk::PhysicalDeviceShaderDemoteToHelperInvocationFeatures
+				vk::PhysicalDeviceShaderDemoteToHelperInvocationFeatures,
+				// BaseInstance in the geometry pass vertex shader
+				vk::PhysicalDeviceShaderDrawParametersFeatures
 			>();
 
+			// Multi-draw indirect, with the draw index passed as the first instance.
+			vk::PhysicalDeviceFeatures deviceFeatures{};
+			deviceFeatures.multiDrawIndirect = true;
+			deviceFeatures.drawIndirectFirstInstance = true;
+			// 64-bit buffer device addresses in the any-hit shader.
+			deviceFeatures.shaderInt64 = true;
+
 			// Enable dynamic rendering
 			deviceCreateInfoChain.get<vk::PhysicalDeviceDynamicRenderingFeatures>().dynamicRendering = true;
 
 			// Enable ray tracing features
 			deviceCreateInfoChain.get<vk::PhysicalDeviceRayQueryFeaturesKHR>().rayQuery = true;
 			deviceCreateInfoChain.get<vk::PhysicalDeviceRayTracingPipelineFeaturesKHR>().rayTracingPipeline = true;
-			deviceCreateInfoChain.get<vk::PhysicalDeviceBufferDeviceAddressFeatures>().bufferDeviceAddress = true;
+			deviceCreateInfoChain.get<vk::PhysicalDeviceVulkan12Features>().bufferDeviceAddress = true;
+			deviceCreateInfoChain.get<vk::PhysicalDeviceVulkan12Features>().drawIndirectCount = true;
+			deviceCreateInfoChain.get<vk::PhysicalDeviceVulkan12Features>().runtimeDescriptorArray = true;
+			deviceCreateInfoChain.get<vk::PhysicalDeviceVulkan12Features>().shaderSampledImageArrayNonUniformIndexing = true;
+			deviceCreateInfoChain.get<vk::PhysicalDeviceVulkan12Features>().descriptorBindingPartiallyBound = true;
+			deviceCreateInfoChain.get<vk::PhysicalDeviceVulkan12Features>().descriptorBindingSampledImageUpdateAfterBind = true;
+			deviceCreateInfoChain.get<vk::PhysicalDeviceVulkan12Features>().descriptorBindingUpdateUnusedWhilePending = true;
+			deviceCreateInfoChain.get<vk::PhysicalDeviceVulkan12Features>().timelineSemaphore = true;
 			deviceCreateInfoChain.get<vk::PhysicalDeviceAccelerationStructureFeaturesKHR>().accelerationStructure = true;
 
 			// Enable device diagnostics
@@ -145,17 +189,23 @@ namespace Hyper
 				vk::DeviceDiagnosticsConfigFlagBitsNV::eEnableShaderDebugInfo;
 			deviceCreateInfoChain.get<vk::DeviceDiagnosticsConfigCreateInfoNV>().flags = aftermathFlags;
 			deviceCreateInfoChain.get<vk::PhysicalDeviceShaderDemoteToHelperInvocationFeatures>().shaderDemoteToHelperInvocation = true;
+			deviceCreateInfoChain.get<vk::PhysicalDeviceShaderDrawParametersFeatures>().shaderDrawParameters = true;
 
 			if (HYPER_VALIDATE)
 			{
 				// Debug markers (for debugging)
 				m_RequiredDeviceExtensionNames.push_back(VK_EXT_DEBUG_MARKER_EXTENSION_NAME);
 			}
+			if (headless)
+			{
+				std::erase_if(m_RequiredDeviceExtensionNames, [](const char* name) { return strcmp(name, VK_KHR_SWAPCHAIN_EXTENSION_NAME) == 0; });
+			}
 
 			auto& deviceCreateInfo = deviceCreateInfoChain.get<vk::DeviceCreateInfo>()
 				.setQueueCreateInfos(queueCreateInfos)
 				.setPEnabledLayerNames(m_RequiredDeviceLayerNames)
-				.setPEnabledExtensionNames(m_RequiredDeviceExtensionNames);
+				.setPEnabledExtensionNames(m_RequiredDeviceExtensionNames)
+				.setPEnabledFeatures(&deviceFeatures);
 			pRenderCtx->device = VulkanUtils::Check(pRenderCtx->physicalDevice.createDevice(deviceCreateInfo));
 
 			HPR_VKLOG_INFO("Created the logical device");
@@ -169,6 +219,24 @@ namespace Hyper
 			pRenderCtx->graphicsQueue = m_GraphicsQueue;
 
 			HPR_VKLOG_INFO("Got the graphics queue");
+
+			m_ComputeQueue = hasAsyncCompute
+				? VulkanQueue{
+					.queue = pRenderCtx->device.getQueue(computeQueueFamilyIndex, 0),
+					.familyIndex = computeQueueFamilyIndex,
+					.flags = vk::QueueFlagBits::eCompute
+				}
+				: m_GraphicsQueue;
+			pRenderCtx->computeQueue = m_ComputeQueue;
+
+			if (hasAsyncCompute)
+			{
+				HPR_VKLOG_INFO("Got an async compute queue from family {}", computeQueueFamilyIndex);
+			}
+			else
+			{
+				HPR_VKLOG_WARN("No queue family without graphics, acceleration structures are built on the graphics queue");
+			}
 		}
 
 		// Init VMA
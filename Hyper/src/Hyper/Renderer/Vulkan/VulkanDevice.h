@@ -14,7 +14,9 @@ namespace Hyper
 	class VulkanDevice final
 	{
 	public:
-		VulkanDevice(RenderContext* pRenderCtx);
+		// Headless devices don't present, so they need no surface or swap chain, and fall back to any device when there's no
+		// discrete one, like a software driver. Used by checks that run without a window.
+		VulkanDevice(RenderContext* pRenderCtx, bool headless = false);
 		~VulkanDevice();
 
 	private:
@@ -55,7 +57,7 @@ namespace Hyper
 		VulkanQueue m_GraphicsQueue;
 		VulkanQueue m_ComputeQueue;
 		vk::CommandPool m_CommandPool;
-		VmaAllocator m_Allocator;
+		VmaAllocator m_Allocator{};
 
 #ifdef HYPER_USE_AFTERMATH
 		GpuCrashTracker::MarkerMap m_MarkerMap;
@@ -9,7 +9,7 @@
 namespace Hyper
 {
 	VulkanImage::VulkanImage(RenderContext* pRenderCtx, vk::Format format, vk::ImageType type, vk::ImageUsageFlags usage, vk::ImageAspectFlags aspectFlags,
-		const std::string& debugName, u32 width, u32 height, u32 depth)
+		const std::string& debugName, u32 width, u32 height, u32 depth, u32 mipLevels)
 		: m_pRenderCtx(pRenderCtx)
 		, m_Format(format)
 		, m_Type(type)
@@ -18,6 +18,7 @@ namespace Hyper
 		, m_Width(width)
 		, m_Height(height)
 		, m_Depth(depth)
+		, m_MipLevels(mipLevels)
 		, m_DebugName(debugName)
 	{
 		CreateImageAndView();
@@ -56,7 +57,7 @@ namespace Hyper
 		barrier.image = m_Image;
 		barrier.subresourceRange = vk::ImageSubresourceRange{
 			m_AspectFlags,
-			0, 1,
+			0, m_MipLevels,
 			0, 1
 		};
 
@@ -98,7 +99,7 @@ namespace Hyper
 		imageInfo.imageType = m_Type;
 		imageInfo.format = m_Format;
 		imageInfo.extent = vk::Extent3D{ m_Width, m_Height, m_Depth };
-		imageInfo.mipLevels = 1;
+		imageInfo.mipLevels = m_MipLevels;
 		imageInfo.arrayLayers = 1;
 		imageInfo.samples = vk::SampleCountFlagBits::e1;
 		imageInfo.tiling = vk::ImageTiling::eOptimal;
@@ -130,7 +131,7 @@ namespace Hyper
 
 		imageViewInfo.format = m_Format;
 		imageViewInfo.subresourceRange.baseMipLevel = 0;
-		imageViewInfo.subresourceRange.levelCount = 1;
+		imageViewInfo.subresourceRange.levelCount = m_MipLevels;
 		imageViewInfo.subresourceRange.baseArrayLayer = 0;
 		imageViewInfo.subresourceRange.layerCount = 1;
 		imageViewInfo.subresourceRange.aspectMask = m_AspectFlags;
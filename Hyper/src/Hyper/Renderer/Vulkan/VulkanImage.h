@@ -10,13 +10,16 @@ namespace Hyper
 	{
 	public:
 		VulkanImage(RenderContext* pRenderCtx, vk::Format format, vk::ImageType type, vk::ImageUsageFlags usage, vk::ImageAspectFlags aspectFlags,
-			const std::string& debugName, u32 width, u32 height, u32 depth = 1);
+			const std::string& debugName, u32 width, u32 height, u32 depth = 1, u32 mipLevels = 1);
 		~VulkanImage();
 
 		[[nodiscard]] vk::Image GetImage() const { return m_Image; }
 		[[nodiscard]] vk::ImageView GetImageView() const { return m_ImageView; }
 		[[nodiscard]] vk::ImageLayout GetImageLayout() const { return m_Layout; }
 		[[nodiscard]] vk::Format GetFormat() const { return m_Format; }
+		[[nodiscard]] u32 GetWidth() const { return m_Width; }
+		[[nodiscard]] u32 GetHeight() const { return m_Height; }
+		[[nodiscard]] u32 GetMipLevels() const { return m_MipLevels; }
 
 		void Resize(u32 width, u32 height, u32 depth = 1);
 
@@ -42,6 +45,7 @@ namespace Hyper
 		vk::ImageUsageFlags m_Usage;
 		vk::ImageAspectFlags m_AspectFlags;
 		u32 m_Width{}, m_Height{}, m_Depth{};
+		u32 m_MipLevels{};
 		std::string m_DebugName;
 	};
 }
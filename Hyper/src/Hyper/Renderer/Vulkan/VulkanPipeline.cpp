@@ -192,7 +192,9 @@ namespace Hyper
 		auto colorBlendingState = vk::PipelineColorBlendStateCreateInfo{};
 		colorBlendingState.logicOpEnable = false;
 		colorBlendingState.logicOp = vk::LogicOp::eCopy;
-		colorBlendingState.setAttachments(colorBlendAttachment);
+		// Every color attachment needs its own blend state, they all blend the same way.
+		const std::vector colorBlendAttachments(m_Specification.colorFormats.size(), colorBlendAttachment);
+		colorBlendingState.setAttachments(colorBlendAttachments);
 		colorBlendingState.setBlendConstants({ 0.0f, 0.0f, 0.0f, 0.0f });
 
 		pipelineInfo.pVertexInputState = &vertexInputInfo;
@@ -239,6 +241,106 @@ namespace Hyper
 		m_pRenderCtx->pShaderLibrary->UnRegisterShaderDependency(m_Specification.pShader->GetId(), this);
 	}
 
+	VulkanComputePipeline::VulkanComputePipeline(RenderContext* pRenderCtx, const ComputePipelineSpecification& spec)
+		: m_pRenderCtx(pRenderCtx), m_Specification(spec)
+	{
+		Create();
+	}
+
+	VulkanComputePipeline::~VulkanComputePipeline()
+	{
+		Destroy();
+	}
+
+	VulkanComputePipeline::VulkanComputePipeline(VulkanComputePipeline&& other) noexcept
+		: m_pRenderCtx(other.m_pRenderCtx)
+		, m_Specification(other.m_Specification)
+		, m_Pipeline(other.m_Pipeline)
+		, m_Cache(other.m_Cache)
+		, m_Layout(other.m_Layout)
+	{
+		// Invalidate other's data
+		other.m_Pipeline = nullptr;
+		other.m_Cache = nullptr;
+		other.m_Layout = nullptr;
+	}
+
+	VulkanComputePipeline& VulkanComputePipeline::operator=(VulkanComputePipeline&& other) noexcept
+	{
+		m_pRenderCtx = other.m_pRenderCtx;
+		m_Specification = other.m_Specification;
+		m_Pipeline = other.m_Pipeline;
+		m_Cache = other.m_Cache;
+		m_Layout = other.m_Layout;
+
+		// Invalidate other's data
+		other.m_Pipeline = nullptr;
+		other.m_Cache = nullptr;
+		other.m_Layout = nullptr;
+
+		return *this;
+	}
+
+	void VulkanComputePipeline::Recreate()
+	{
+		VulkanUtils::CheckResult(m_pRenderCtx->device.waitIdle());
+
+		// TODO: handle pipeline creation errors.
+		Destroy();
+		Create();
+	}
+
+	void VulkanComputePipeline::Create()
+	{
+		// First, create the pipeline layout
+		std::vector descriptorSetLayouts = m_Specification.pShader->GetAllDescriptorSetLayouts();
+		std::vector pushConstants = m_Specification.pShader->GetAllPushConstantRanges();
+
+		vk::PipelineLayoutCreateInfo layoutCreateInfo{};
+		layoutCreateInfo.setSetLayouts(descriptorSetLayouts);
+		layoutCreateInfo.setPushConstantRanges(pushConstants);
+		m_Layout = VulkanUtils::Check(m_pRenderCtx->device.createPipelineLayout(layoutCreateInfo));
+
+		const std::vector<vk::PipelineShaderStageCreateInfo> shaderStages = m_Specification.pShader->GetAllShaderStages();
+		assert(shaderStages.size() == 1 && "A compute shader has exactly one stage");
+
+		vk::ComputePipelineCreateInfo pipelineInfo{};
+		pipelineInfo.flags = m_Specification.flags;
+		pipelineInfo.stage = shaderStages[0];
+		pipelineInfo.layout = m_Layout;
+
+		m_Cache = VulkanUtils::Check(m_pRenderCtx->device.createPipelineCache(vk::PipelineCacheCreateInfo{}));
+		const vk::ResultValue<vk::Pipeline> pipelineResult = m_pRenderCtx->device.createComputePipeline(m_Cache, pipelineInfo);
+
+		if (pipelineResult.result != vk::Result::eSuccess)
+		{
+			throw std::runtime_error("Failed to create compute pipeline");
+		}
+		m_Pipeline = pipelineResult.value;
+
+		if (!m_Specification.debugName.empty())
+		{
+			VkDebug::SetObjectName(m_pRenderCtx->device, vk::ObjectType::ePipeline, pipelineResult.value, m_Specification.debugName);
+			VkDebug::SetObjectName(m_pRenderCtx->device, vk::ObjectType::ePipelineLayout, m_Layout, fmt::format("{} layout", m_Specification.debugName));
+		}
+
+		// Register shader dependency
+		m_pRenderCtx->pShaderLibrary->RegisterShaderDependency(m_Specification.pShader->GetId(), this);
+	}
+
+	void VulkanComputePipeline::Destroy()
+	{
+		if (m_Pipeline)
+			m_pRenderCtx->device.destroyPipeline(m_Pipeline);
+		if (m_Cache)
+			m_pRenderCtx->device.destroyPipelineCache(m_Cache);
+		if (m_Layout)
+			m_pRenderCtx->device.destroyPipelineLayout(m_Layout);
+
+		// Un-register shader dependency
+		m_pRenderCtx->pShaderLibrary->UnRegisterShaderDependency(m_Specification.pShader->GetId(), this);
+	}
+
 	VulkanRayTracingPipeline::VulkanRayTracingPipeline(RenderContext* pRenderCtx, const RayTracingPipelineSpecification& spec)
 		: m_pRenderCtx(pRenderCtx), m_Specification(spec)
 	{
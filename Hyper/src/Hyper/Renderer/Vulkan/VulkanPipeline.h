@@ -58,6 +58,44 @@ namespace Hyper
 	};
 
 
+	struct ComputePipelineSpecification
+	{
+		std::string debugName;
+		VulkanShader* pShader;
+		vk::PipelineCreateFlags flags;
+	};
+
+	class VulkanComputePipeline
+	{
+	public:
+		VulkanComputePipeline(RenderContext* pRenderCtx, const ComputePipelineSpecification& spec);
+		~VulkanComputePipeline();
+
+		VulkanComputePipeline(const VulkanComputePipeline& other) = delete;
+		VulkanComputePipeline& operator=(const VulkanComputePipeline& other) = delete;
+		VulkanComputePipeline(VulkanComputePipeline&& other) noexcept;
+		VulkanComputePipeline& operator=(VulkanComputePipeline&& other) noexcept;
+
+		void Recreate();
+
+		[[nodiscard]] const vk::Pipeline& GetPipeline() const { return m_Pipeline; }
+		[[nodiscard]] const vk::PipelineCache& GetCache() const { return m_Cache; }
+		[[nodiscard]] const vk::PipelineLayout& GetLayout() const { return m_Layout; }
+
+	private:
+		void Create();
+		void Destroy();
+
+	private:
+		RenderContext* m_pRenderCtx;
+		ComputePipelineSpecification m_Specification;
+
+		vk::Pipeline m_Pipeline;
+		vk::PipelineCache m_Cache;
+		vk::PipelineLayout m_Layout;
+	};
+
+
 	struct RayTracingPipelineSpecification
 	{
 		std::string debugName;
@@ -21,6 +21,26 @@ namespace Hyper
 		VulkanUtils::Check(queue.submit(1, &info, fence));
 	}
 
+	void VulkanQueue::Submit(const std::vector<vk::PipelineStageFlags>& waitStages, const std::vector<vk::Semaphore>& waitSemaphores,
+		const std::vector<u64>& waitValues, const std::vector<vk::Semaphore>& signalSemaphores, const std::vector<u64>& signalValues,
+		vk::CommandBuffer cmd, vk::Fence fence)
+	{
+		HPR_PROFILE_SCOPE();
+
+		vk::TimelineSemaphoreSubmitInfo timelineInfo = {};
+		timelineInfo.setWaitSemaphoreValues(waitValues);
+		timelineInfo.setSignalSemaphoreValues(signalValues);
+
+		vk::SubmitInfo info = {};
+		info.pNext = &timelineInfo;
+		info.setWaitDstStageMask(waitStages);
+		info.setWaitSemaphores(waitSemaphores);
+		info.setSignalSemaphores(signalSemaphores);
+		info.setCommandBuffers(cmd);
+
+		VulkanUtils::Check(queue.submit(1, &info, fence));
+	}
+
 	void VulkanQueue::WaitIdle()
 	{
 		HPR_PROFILE_SCOPE();
@@ -13,6 +13,9 @@ namespace Hyper
 
 		void Submit(const std::vector<vk::PipelineStageFlags>& waitStages, const std::vector<vk::Semaphore>& waitSemaphores,
 			const std::vector<vk::Semaphore>& signalSemaphores, vk::CommandBuffer cmd, vk::Fence fence);
+		// Timeline semaphores wait for and signal the value at their own index, binary semaphores ignore theirs.
+		void Submit(const std::vector<vk::PipelineStageFlags>& waitStages, const std::vector<vk::Semaphore>& waitSemaphores, const std::vector<u64>& waitValues,
+			const std::vector<vk::Semaphore>& signalSemaphores, const std::vector<u64>& signalValues, vk::CommandBuffer cmd, vk::Fence fence);
 		void WaitIdle();
 		vk::Result Present(const std::vector<vk::Semaphore>& waitSemaphores, const std::vector<u32>& imageIndices,
 			const std::vector<vk::SwapchainKHR>& swapchains);
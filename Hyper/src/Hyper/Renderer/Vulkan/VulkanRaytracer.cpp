@@ -7,22 +7,80 @@
 #include "VulkanDescriptors.h"
 #include "VulkanPipeline.h"
 #include "VulkanUtility.h"
+#include "Hyper/Debug/Profiler.h"
 #include "Hyper/Renderer/FlyCamera.h"
+#include "Hyper/Renderer/GeometryPool.h"
+#include "Hyper/Renderer/MaterialLibrary.h"
 #include "Hyper/Renderer/RenderContext.h"
 #include "Hyper/Renderer/RenderTarget.h"
 #include "Hyper/Renderer/ShaderLibrary.h"
+#include "Hyper/Renderer/UniformRing.h"
 #include "Hyper/Scene/Scene.h"
 
 namespace Hyper
 {
-	VulkanRaytracer::VulkanRaytracer(RenderContext* pRenderCtx, const VulkanAccelerationStructure* accel, u32 numFrames, u32 outputWidth, u32 outputHeight)
-		: m_pRenderCtx(pRenderCtx), m_AccelerationStructure(accel), m_NumFrames(numFrames), m_OutputWidth(outputWidth), m_OutputHeight(outputHeight)
+	static constexpr vk::ShaderStageFlags s_PushConstantStages = vk::ShaderStageFlagBits::eRaygenKHR | vk::ShaderStageFlagBits::eMissKHR
+		| vk::ShaderStageFlagBits::eAnyHitKHR;
+	static constexpr u32 s_UpsampleGroupSize = 8;
+	// Every mode is traced this many times by CompareModes, and its GPU time averaged.
+	static constexpr u32 s_CompareRunCount = 8;
+
+	// Matches UpsampleSettings in RTUpsample.comp.hlsl.
+	struct UpsampleSettings
+	{
+		glm::uvec2 outputSize;
+		glm::uvec2 traceSize;
+		glm::uvec2 pixelStride;
+		u32 checkerboard;
+		u32 frameNr;
+		f32 zNear;
+		f32 zFar;
+	};
+
+	static glm::uvec2 GetPixelStride(RTResolutionMode mode)
+	{
+		switch (mode)
+		{
+		case RTResolutionMode::Half: return { 2, 2 };
+		case RTResolutionMode::Quarter: return { 4, 4 };
+		case RTResolutionMode::Checkerboard: return { 2, 1 };
+		default: return { 1, 1 };
+		}
+	}
+
+	// Rounded up, so the last row and column of the output have traced pixels too.
+	static glm::uvec2 GetTraceSize(RTResolutionMode mode, u32 width, u32 height)
+	{
+		const glm::uvec2 stride = GetPixelStride(mode);
+		return { (width + stride.x - 1) / stride.x, (height + stride.y - 1) / stride.y };
+	}
+
+	// Shader groups refer to the shaders by their index in the pipeline's stages, which are in the order the shader returns them.
+	static u32 GetStageIndex(const std::vector<vk::PipelineShaderStageCreateInfo>& stages, vk::ShaderStageFlagBits stage)
+	{
+		const auto it = std::ranges::find(stages, stage, &vk::PipelineShaderStageCreateInfo::stage);
+		return it != stages.end() ? static_cast<u32>(std::distance(stages.begin(), it)) : VK_SHADER_UNUSED_KHR;
+	}
+
+	VulkanRaytracer::VulkanRaytracer(RenderContext* pRenderCtx, u32 numFrames, u32 outputWidth, u32 outputHeight)
+		: m_pRenderCtx(pRenderCtx), m_NumFrames(numFrames), m_OutputWidth(outputWidth), m_OutputHeight(outputHeight)
 	{
 		m_pOutputImage = std::make_unique<RenderTarget>(m_pRenderCtx, vk::Format::eR8Unorm, "Raytracing output image", m_OutputWidth, m_OutputHeight);
+		const glm::uvec2 traceSize = GetTraceSize(RTResolutionMode::Checkerboard, m_OutputWidth, m_OutputHeight);
+		m_pTraceImage = std::make_unique<VulkanImage>(m_pRenderCtx, vk::Format::eR8Unorm, vk::ImageType::e2D,
+			vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled, vk::ImageAspectFlagBits::eColor, "Raytracing trace image", traceSize.x, traceSize.y);
 
 		CreateDescriptorSet();
 		CreatePipeline();
 		CreateShaderBindingTable();
+		CreateUpsamplePipeline();
+
+		vk::QueryPoolCreateInfo queryPoolInfo{};
+		queryPoolInfo.queryType = vk::QueryType::eTimestamp;
+		queryPoolInfo.queryCount = m_NumFrames * 2 + 2;
+		m_TimestampPool = VulkanUtils::Check(m_pRenderCtx->device.createQueryPool(queryPoolInfo));
+		m_TimestampsWritten.resize(m_NumFrames, false);
+		m_TimestampPeriod = m_pRenderCtx->physicalDevice.getProperties().limits.timestampPeriod;
 	}
 
 	VulkanRaytracer::~VulkanRaytracer()
@@ -31,29 +89,220 @@ namespace Hyper
 
 		m_SbtBuffer.reset();
 		m_RtPipeline.reset();
+		m_pUpsamplePipeline.reset();
 		m_pOutputImage.reset();
-		m_pPool.reset();
+		m_pTraceImage.reset();
+		m_pRenderCtx->device.destroyQueryPool(m_TimestampPool);
 		m_pRenderCtx->device.destroyDescriptorSetLayout(m_DescLayout);
 	}
 
-	void VulkanRaytracer::RayTrace(vk::CommandBuffer cmd, FlyCamera* pCamera, u32 frameIdx, const LightingSettings& lightingSettings)
+	void VulkanRaytracer::RayTrace(vk::CommandBuffer cmd, const VulkanAccelerationStructure* pAcceleration, const RenderTarget* pGBuffer, FlyCamera* pCamera, u32 frameIdx,
+		const LightingSettings& lightingSettings)
 	{
 		m_CameraData.viewInv = pCamera->GetViewInverse();
 		m_CameraData.projInv = pCamera->GetProjectionInverse();
-		UpdateDescriptors(frameIdx);
+		const u32 cameraOffset = m_pRenderCtx->pUniformRing->Write(frameIdx, m_CameraData);
+
+		// The frame's fence has been waited on, so the timestamps of its last trace are available.
+		if (m_TimestampsWritten[frameIdx])
+		{
+			const std::vector<u64> timestamps = VulkanUtils::Check(m_pRenderCtx->device.getQueryPoolResults<u64>(m_TimestampPool, frameIdx * 2, 2,
+				2 * sizeof(u64), sizeof(u64), vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait));
+			m_TraceTimeMs = static_cast<f32>(static_cast<f64>(timestamps[1] - timestamps[0]) * m_TimestampPeriod / 1000000.0);
+		}
 
-		m_pOutputImage->GetColorImage()->TransitionLayout(cmd, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite, vk::ImageLayout::eGeneral,
+		Record(cmd, pAcceleration, pGBuffer, pCamera, frameIdx, cameraOffset, lightingSettings, m_ResolutionMode, frameIdx * 2);
+		m_TimestampsWritten[frameIdx] = true;
+
+		VkDebug::EndRegion(cmd);
+	}
+
+	void VulkanRaytracer::Record(vk::CommandBuffer cmd, const VulkanAccelerationStructure* pAcceleration, const RenderTarget* pGBuffer, FlyCamera* pCamera, u32 frameIdx,
+		u32 cameraOffset, const LightingSettings& lightingSettings, RTResolutionMode mode, u32 queryIdx)
+	{
+		// The scene swaps in a new TLAS while earlier frames still trace the old one, so every frame only rewrites its own set.
+		if (m_FrameDatas[frameIdx].tlasVersion != pAcceleration->GetTlasVersion())
+		{
+			UpdateDescriptors(frameIdx, pAcceleration, pGBuffer);
+		}
+
+		// Full resolution traces straight into the output, the other modes into the trace image.
+		VulkanImage* pTarget = mode == RTResolutionMode::Full ? m_pOutputImage->GetColorImage() : m_pTraceImage.get();
+		pTarget->TransitionLayout(cmd, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite, vk::ImageLayout::eGeneral,
 			vk::PipelineStageFlagBits::eRayTracingShaderKHR);
+		// The geometry pass has to be done writing the G-buffer.
+		pGBuffer->GetDepthImage()->TransitionLayout(cmd, vk::AccessFlagBits::eShaderRead, vk::ImageLayout::eGeneral, vk::PipelineStageFlagBits::eRayTracingShaderKHR);
+		pGBuffer->GetNormalImage()->TransitionLayout(cmd, vk::AccessFlagBits::eShaderRead, vk::ImageLayout::eGeneral, vk::PipelineStageFlagBits::eRayTracingShaderKHR);
 
 		m_RtPushConstants.sunDirection = lightingSettings.sunDir;
 		m_RtPushConstants.frameNr = m_pRenderCtx->frameNumber;
+		m_RtPushConstants.vertexBufferAddress = m_pRenderCtx->pGeometryPool->GetVertexBuffer()->GetDeviceAddress();
+		m_RtPushConstants.indexBufferAddress = m_pRenderCtx->pGeometryPool->GetIndexBuffer()->GetDeviceAddress();
+		m_RtPushConstants.geometryBufferAddress = pAcceleration->GetGeometryBufferAddress();
+		m_RtPushConstants.pixelStride = GetPixelStride(mode);
+		m_RtPushConstants.checkerboard = mode == RTResolutionMode::Checkerboard ? 1 : 0;
+
+		const glm::uvec2 traceSize = GetTraceSize(mode, m_OutputWidth, m_OutputHeight);
 
 		cmd.bindPipeline(vk::PipelineBindPoint::eRayTracingKHR, m_RtPipeline->GetPipeline());
-		cmd.bindDescriptorSets(vk::PipelineBindPoint::eRayTracingKHR, m_RtPipeline->GetLayout(), 0, { m_FrameDatas[frameIdx].descriptorSet }, {});
-		cmd.pushConstants<RTPushConstants>(m_RtPipeline->GetLayout(), vk::ShaderStageFlagBits::eRaygenKHR | vk::ShaderStageFlagBits::eClosestHitKHR | vk::ShaderStageFlagBits::eMissKHR, 0, m_RtPushConstants);
-		cmd.traceRaysKHR(m_RGenRegion, m_MissRegion, m_HitRegion, m_CallRegion, m_OutputWidth, m_OutputHeight, 1);
+		cmd.bindDescriptorSets(vk::PipelineBindPoint::eRayTracingKHR, m_RtPipeline->GetLayout(), 0, { m_FrameDatas[frameIdx].descriptorSet }, { cameraOffset });
+		cmd.bindDescriptorSets(vk::PipelineBindPoint::eRayTracingKHR, m_RtPipeline->GetLayout(), 1, { m_pRenderCtx->pMaterialLibrary->GetRayTracingDescriptorSet() }, {});
+		cmd.pushConstants<RTPushConstants>(m_RtPipeline->GetLayout(), s_PushConstantStages, 0, m_RtPushConstants);
+		cmd.resetQueryPool(m_TimestampPool, queryIdx, 2);
+		cmd.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, m_TimestampPool, queryIdx);
+		cmd.traceRaysKHR(m_RGenRegion, m_MissRegion, m_HitRegion, m_CallRegion, traceSize.x, traceSize.y, 1);
+		if (mode != RTResolutionMode::Full)
+		{
+			Upsample(cmd, pGBuffer, pCamera, frameIdx, mode);
+		}
+		cmd.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, m_TimestampPool, queryIdx + 1);
 
-		VkDebug::EndRegion(cmd);
+		// Sampled by the composite pass.
+		m_pOutputImage->GetColorImage()->TransitionLayout(cmd, vk::AccessFlagBits::eShaderRead, vk::ImageLayout::eGeneral, vk::PipelineStageFlagBits::eFragmentShader);
+	}
+
+	void VulkanRaytracer::Upsample(vk::CommandBuffer cmd, const RenderTarget* pGBuffer, FlyCamera* pCamera, u32 frameIdx, RTResolutionMode mode)
+	{
+		HPR_PROFILE_SCOPE();
+
+		m_pTraceImage->TransitionLayout(cmd, vk::AccessFlagBits::eShaderRead, vk::ImageLayout::eGeneral, vk::PipelineStageFlagBits::eComputeShader);
+		pGBuffer->GetDepthImage()->TransitionLayout(cmd, vk::AccessFlagBits::eShaderRead, vk::ImageLayout::eGeneral, vk::PipelineStageFlagBits::eComputeShader);
+		m_pOutputImage->GetColorImage()->TransitionLayout(cmd, vk::AccessFlagBits::eShaderWrite, vk::ImageLayout::eGeneral, vk::PipelineStageFlagBits::eComputeShader);
+
+		// The trace image's contents depend on the mode, so the set is only valid for the frame that's being recorded.
+		const vk::DescriptorSet descriptor = m_pRenderCtx->pDescriptorAllocator->AllocateTransient(frameIdx, m_pUpsampleShader->GetAllDescriptorSetLayouts()[0]);
+		const vk::DescriptorImageInfo traceInfo{ {}, m_pTraceImage->GetImageView(), vk::ImageLayout::eGeneral };
+		const vk::DescriptorImageInfo depthInfo{ {}, pGBuffer->GetDepthSampleView(), vk::ImageLayout::eGeneral };
+		const vk::DescriptorImageInfo outputInfo{ {}, m_pOutputImage->GetColorImage()->GetImageView(), vk::ImageLayout::eGeneral };
+
+		DescriptorWriter writer{ m_pRenderCtx->device, descriptor };
+		writer.WriteImage(traceInfo, 0, vk::DescriptorType::eSampledImage);
+		writer.WriteImage(depthInfo, 1, vk::DescriptorType::eSampledImage);
+		writer.WriteImage(outputInfo, 2, vk::DescriptorType::eStorageImage);
+		writer.Write();
+
+		UpsampleSettings settings{};
+		settings.outputSize = { m_OutputWidth, m_OutputHeight };
+		settings.traceSize = GetTraceSize(mode, m_OutputWidth, m_OutputHeight);
+		settings.pixelStride = GetPixelStride(mode);
+		settings.checkerboard = mode == RTResolutionMode::Checkerboard ? 1 : 0;
+		settings.frameNr = m_pRenderCtx->frameNumber;
+		settings.zNear = pCamera->GetZNear();
+		settings.zFar = pCamera->GetZFar();
+
+		cmd.bindPipeline(vk::PipelineBindPoint::eCompute, m_pUpsamplePipeline->GetPipeline());
+		cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_pUpsamplePipeline->GetLayout(), 0, { descriptor }, {});
+		cmd.pushConstants<UpsampleSettings>(m_pUpsamplePipeline->GetLayout(), vk::ShaderStageFlagBits::eCompute, 0, settings);
+		cmd.dispatch((m_OutputWidth + s_UpsampleGroupSize - 1) / s_UpsampleGroupSize, (m_OutputHeight + s_UpsampleGroupSize - 1) / s_UpsampleGroupSize, 1);
+	}
+
+	void VulkanRaytracer::CompareModes(const VulkanAccelerationStructure* pAcceleration, const RenderTarget* pGBuffer, FlyCamera* pCamera, u32 frameIdx,
+		const LightingSettings& lightingSettings)
+	{
+		HPR_PROFILE_SCOPE();
+
+		// Frames in flight could still be tracing.
+		VulkanUtils::Check(m_pRenderCtx->device.waitIdle());
+
+		m_CameraData.viewInv = pCamera->GetViewInverse();
+		m_CameraData.projInv = pCamera->GetProjectionInverse();
+		const u32 cameraOffset = m_pRenderCtx->pUniformRing->Write(frameIdx, m_CameraData);
+		// The queries after the ones of the frames in flight.
+		const u32 queryIdx = m_NumFrames * 2;
+
+		// Full resolution comes first, every other mode is compared against it.
+		std::vector<u8> fullOutput;
+		for (u32 modeIdx = 0; modeIdx < m_ModeComparisons.size(); modeIdx++)
+		{
+			const RTResolutionMode mode = static_cast<RTResolutionMode>(modeIdx);
+			RTModeComparison& comparison = m_ModeComparisons[modeIdx];
+
+			f64 totalTimeMs = 0.0;
+			for (u32 run = 0; run < s_CompareRunCount; run++)
+			{
+				const vk::CommandBuffer cmd = m_pRenderCtx->commandPool->GetCommandBuffer();
+				VulkanCommandBuffer::Begin(cmd, vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+				Record(cmd, pAcceleration, pGBuffer, pCamera, frameIdx, cameraOffset, lightingSettings, mode, queryIdx);
+				VulkanCommandBuffer::End(cmd);
+				m_pRenderCtx->graphicsQueue.Submit({}, {}, {}, cmd, nullptr);
+				m_pRenderCtx->graphicsQueue.WaitIdle();
+				m_pRenderCtx->commandPool->FreeCommandBuffer(cmd);
+
+				const std::vector<u64> timestamps = VulkanUtils::Check(m_pRenderCtx->device.getQueryPoolResults<u64>(m_TimestampPool, queryIdx, 2,
+					2 * sizeof(u64), sizeof(u64), vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait));
+				totalTimeMs += static_cast<f64>(timestamps[1] - timestamps[0]) * m_TimestampPeriod / 1000000.0;
+			}
+			comparison.gpuTimeMs = static_cast<f32>(totalTimeMs / s_CompareRunCount);
+
+			const std::vector<u8> output = ReadBackOutput();
+			if (mode == RTResolutionMode::Full)
+			{
+				fullOutput = output;
+			}
+
+			// Every pixel is either lit or in shadow before the upsample, so values on the other side of the middle flipped.
+			u64 differenceSum = 0;
+			u32 flippedCount = 0;
+			for (size_t i = 0; i < output.size(); i++)
+			{
+				differenceSum += static_cast<u64>(std::abs(static_cast<i32>(output[i]) - static_cast<i32>(fullOutput[i])));
+				if ((output[i] >= 128) != (fullOutput[i] >= 128))
+					flippedCount++;
+			}
+			comparison.meanDifference = static_cast<f32>(static_cast<f64>(differenceSum) / (255.0 * static_cast<f64>(output.size())));
+			comparison.flippedPixels = static_cast<f32>(flippedCount) / static_cast<f32>(output.size());
+			comparison.isValid = true;
+
+			HPR_CORE_LOG_INFO("Ray tracing mode '{}': {:.3f} ms, mean difference {:.4f}, {:.2f}% of the pixels flipped", GetResolutionModeName(mode),
+				comparison.gpuTimeMs, comparison.meanDifference, comparison.flippedPixels * 100.0f);
+		}
+	}
+
+	std::vector<u8> VulkanRaytracer::ReadBackOutput()
+	{
+		VulkanImage* pOutput = m_pOutputImage->GetColorImage();
+		const vk::DeviceSize size = static_cast<vk::DeviceSize>(m_OutputWidth) * m_OutputHeight;
+		VulkanBuffer readbackBuffer{ m_pRenderCtx, size, vk::BufferUsageFlagBits::eTransferDst, VMA_MEMORY_USAGE_GPU_TO_CPU, "Raytracing output readback buffer" };
+
+		vk::BufferImageCopy region{};
+		region.imageSubresource = vk::ImageSubresourceLayers{ vk::ImageAspectFlagBits::eColor, 0, 0, 1 };
+		region.imageExtent = vk::Extent3D{ m_OutputWidth, m_OutputHeight, 1 };
+
+		const vk::CommandBuffer cmd = m_pRenderCtx->commandPool->GetCommandBuffer();
+		VulkanCommandBuffer::Begin(cmd, vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+
+		pOutput->TransitionLayout(cmd, vk::AccessFlagBits::eTransferRead, vk::ImageLayout::eGeneral, vk::PipelineStageFlagBits::eTransfer);
+		cmd.copyImageToBuffer(pOutput->GetImage(), vk::ImageLayout::eGeneral, readbackBuffer.GetBuffer(), region);
+		pOutput->TransitionLayout(cmd, vk::AccessFlagBits::eShaderRead, vk::ImageLayout::eGeneral, vk::PipelineStageFlagBits::eFragmentShader);
+
+		vk::MemoryBarrier readbackBarrier{};
+		readbackBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+		readbackBarrier.dstAccessMask = vk::AccessFlagBits::eHostRead;
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, {}, readbackBarrier, {}, {});
+
+		VulkanCommandBuffer::End(cmd);
+		m_pRenderCtx->graphicsQueue.Submit({}, {}, {}, cmd, nullptr);
+		m_pRenderCtx->graphicsQueue.WaitIdle();
+		m_pRenderCtx->commandPool->FreeCommandBuffer(cmd);
+
+		// The readback memory isn't necessarily host coherent.
+		readbackBuffer.Invalidate();
+		const u8* pTexels = static_cast<const u8*>(readbackBuffer.Map());
+		std::vector<u8> texels(pTexels, pTexels + size);
+		readbackBuffer.Unmap();
+		return texels;
+	}
+
+	const char* VulkanRaytracer::GetResolutionModeName(RTResolutionMode mode)
+	{
+		switch (mode)
+		{
+		case RTResolutionMode::Full: return "Full";
+		case RTResolutionMode::Half: return "Half";
+		case RTResolutionMode::Quarter: return "Quarter";
+		case RTResolutionMode::Checkerboard: return "Checkerboard";
+		default: return "Unknown";
+		}
 	}
 
 	void VulkanRaytracer::Resize(u32 width, u32 height)
@@ -66,37 +315,32 @@ namespace Hyper
 		m_OutputWidth = width;
 		m_OutputHeight = height;
 		m_pOutputImage->Resize(width, height);
+		const glm::uvec2 traceSize = GetTraceSize(RTResolutionMode::Checkerboard, width, height);
+		m_pTraceImage->Resize(traceSize.x, traceSize.y);
+
+		// Every set is rewritten the next time its frame traces rays.
+		for (RTFrameData& frameData : m_FrameDatas)
+		{
+			frameData.tlasVersion = 0;
+		}
 	}
 
 	void VulkanRaytracer::CreateDescriptorSet()
 	{
 		// Create descriptor set layout
 		m_DescLayout = DescriptorSetLayoutBuilder(m_pRenderCtx->device)
-			.AddBinding(vk::DescriptorType::eAccelerationStructureKHR, static_cast<u32>(RaytracerBindings::Acceleration), 1, vk::ShaderStageFlagBits::eRaygenKHR | vk::ShaderStageFlagBits::eClosestHitKHR)
+			.AddBinding(vk::DescriptorType::eAccelerationStructureKHR, static_cast<u32>(RaytracerBindings::Acceleration), 1, vk::ShaderStageFlagBits::eRaygenKHR)
 			.AddBinding(vk::DescriptorType::eStorageImage, static_cast<u32>(RaytracerBindings::OutputImage), 1, vk::ShaderStageFlagBits::eRaygenKHR)
-			.AddBinding(vk::DescriptorType::eUniformBuffer, static_cast<u32>(RaytracerBindings::CameraBuffer), 1, vk::ShaderStageFlagBits::eRaygenKHR)
+			.AddBinding(vk::DescriptorType::eUniformBufferDynamic, static_cast<u32>(RaytracerBindings::CameraBuffer), 1, vk::ShaderStageFlagBits::eRaygenKHR)
+			.AddBinding(vk::DescriptorType::eSampledImage, static_cast<u32>(RaytracerBindings::GBufferDepth), 1, vk::ShaderStageFlagBits::eRaygenKHR)
+			.AddBinding(vk::DescriptorType::eSampledImage, static_cast<u32>(RaytracerBindings::GBufferNormal), 1, vk::ShaderStageFlagBits::eRaygenKHR)
+			.AddBinding(vk::DescriptorType::eStorageImage, static_cast<u32>(RaytracerBindings::TraceImage), 1, vk::ShaderStageFlagBits::eRaygenKHR)
 			.Build();
 
-		// Create descriptor pool
-		m_pPool = std::make_unique<DescriptorPool>(DescriptorPool::Builder(m_pRenderCtx->device)
-			.AddSize(vk::DescriptorType::eAccelerationStructureKHR, 1 * m_NumFrames)
-			.AddSize(vk::DescriptorType::eStorageImage, 1 * m_NumFrames)
-			.AddSize(vk::DescriptorType::eUniformBuffer, 1 * m_NumFrames)
-			.SetMaxSets(m_NumFrames)
-			.SetFlags({})
-			.Build());
-
-		// Allocate descriptor set
+		// Allocate descriptor set, which is written the first time its frame traces rays
 		for (u32 i = 0; i < m_NumFrames; i++)
 		{
-			auto descriptorSets = m_pPool->Allocate({ m_DescLayout });
-			m_FrameDatas.emplace_back(VulkanBuffer{
-				m_pRenderCtx, sizeof(RTCameraData), vk::BufferUsageFlagBits::eUniformBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU, "RT Camera buffer"
-				},
-				descriptorSets[0]
-			);
-
-			UpdateDescriptors(i);
+			m_FrameDatas.push_back(RTFrameData{ m_pRenderCtx->pDescriptorAllocator->Allocate(m_DescLayout) });
 		}
 
 		HPR_CORE_LOG_INFO("Created ray tracing descriptor set!");
@@ -105,6 +349,7 @@ namespace Hyper
 	void VulkanRaytracer::CreatePipeline()
 	{
 		m_pShader = m_pRenderCtx->pShaderLibrary->GetShader("RTShadows");
+		const std::vector<vk::PipelineShaderStageCreateInfo> stages = m_pShader->GetAllShaderStages();
 
 		vk::RayTracingShaderGroupCreateInfoKHR group = {};
 		group.anyHitShader = VK_SHADER_UNUSED_KHR;
@@ -114,28 +359,30 @@ namespace Hyper
 
 		// Raygen
 		group.type = vk::RayTracingShaderGroupTypeKHR::eGeneral;
-		group.generalShader = static_cast<u32>(RaytracerShaderStageIndices::Raygen);
+		group.generalShader = GetStageIndex(stages, vk::ShaderStageFlagBits::eRaygenKHR);
 		m_ShaderGroups.push_back(group);
 
 		// Miss
 		group.type = vk::RayTracingShaderGroupTypeKHR::eGeneral;
-		group.generalShader = static_cast<u32>(RaytracerShaderStageIndices::Miss);
+		group.generalShader = GetStageIndex(stages, vk::ShaderStageFlagBits::eMissKHR);
 		m_ShaderGroups.push_back(group);
 
-		// Closest hit
+		// Shadow rays only need to know whether they hit anything, so the group only has an any hit for geometry that isn't opaque.
 		group.type = vk::RayTracingShaderGroupTypeKHR::eTrianglesHitGroup;
 		group.generalShader = VK_SHADER_UNUSED_KHR;
-		group.closestHitShader = static_cast<u32>(RaytracerShaderStageIndices::ClosestHit);
+		group.closestHitShader = VK_SHADER_UNUSED_KHR;
+		group.anyHitShader = GetStageIndex(stages, vk::ShaderStageFlagBits::eAnyHitKHR);
 		m_ShaderGroups.push_back(group);
 
 		// Push const (We're not using this atm)
 		vk::PushConstantRange pushConst = {};
-		pushConst.stageFlags = vk::ShaderStageFlagBits::eRaygenKHR | vk::ShaderStageFlagBits::eClosestHitKHR | vk::ShaderStageFlagBits::eMissKHR;
+		pushConst.stageFlags = s_PushConstantStages;
 		pushConst.offset = 0;
 		pushConst.size = sizeof(RTPushConstants);
 
 		// Automatic shader reflection has issues with RT shaders, so we'll just use our custom one here.
-		const std::vector descriptorLayouts = { m_DescLayout };
+		// Set 1 is the material library's, for the any-hit shader.
+		const std::vector descriptorLayouts = { m_DescLayout, m_pRenderCtx->pMaterialLibrary->GetRayTracingDescriptorLayout() };
 		const std::vector<vk::PushConstantRange> pushConstants = { pushConst };
 
 		const RayTracingPipelineSpecification rtPipelineSpecification{
@@ -144,7 +391,8 @@ namespace Hyper
 			.layouts = descriptorLayouts,
 			.pushConstants = pushConstants,
 			.shaderGroupCreateInfos = m_ShaderGroups,
-			.rayRecursionDepth = 2 < m_pRenderCtx->rtProperties.maxRayRecursionDepth ? 2 : m_pRenderCtx->rtProperties.maxRayRecursionDepth,
+			// Only the raygen shader traces rays.
+			.rayRecursionDepth = 1,
 			.dynamicStates = {},
 			.flags = {}
 		};
@@ -222,34 +470,44 @@ namespace Hyper
 		HPR_CORE_LOG_INFO("Created ray tracing SBT!");
 	}
 
-	void VulkanRaytracer::UpdateDescriptors(u32 frameIdx)
+	void VulkanRaytracer::CreateUpsamplePipeline()
+	{
+		m_pUpsampleShader = m_pRenderCtx->pShaderLibrary->GetShader("RTUpsample");
+		m_pUpsamplePipeline = std::make_unique<VulkanComputePipeline>(m_pRenderCtx, ComputePipelineSpecification{
+			.debugName = "Ray tracing upsample pipeline",
+			.pShader = m_pUpsampleShader,
+			.flags = {}
+		});
+	}
+
+	void VulkanRaytracer::UpdateDescriptors(u32 frameIdx, const VulkanAccelerationStructure* pAcceleration, const RenderTarget* pGBuffer)
 	{
 		// Write descriptor set
 		vk::WriteDescriptorSetAccelerationStructureKHR descASInfo{};
-		descASInfo.setAccelerationStructures(m_AccelerationStructure->GetTLAS().handle);
+		descASInfo.setAccelerationStructures(pAcceleration->GetTLAS().handle);
 
 		vk::DescriptorImageInfo imageInfo = {};
 		imageInfo.sampler = vk::Sampler{};
 		imageInfo.imageView = m_pOutputImage->GetColorImage()->GetImageView();
 		imageInfo.imageLayout = vk::ImageLayout::eGeneral; // ImageLayout NEEDS to be VK_IMAGE_LAYOUT_GENERAL when StorageImage
 
-		RTFrameData& frameData = m_FrameDatas[frameIdx];
-		{
-			// hacky workaround - TODO: make this not hacky :)
-			void* mapped = frameData.rtCameraUniform.Map();
-			memcpy(mapped, &m_CameraData, sizeof(RTCameraData));
-			frameData.rtCameraUniform.Unmap();
-		}
+		// Read with Load, so they don't need a sampler.
+		const vk::DescriptorImageInfo depthInfo{ {}, pGBuffer->GetDepthSampleView(), vk::ImageLayout::eGeneral };
+		const vk::DescriptorImageInfo normalInfo{ {}, pGBuffer->GetNormalImage()->GetImageView(), vk::ImageLayout::eGeneral };
+		const vk::DescriptorImageInfo traceInfo{ {}, m_pTraceImage->GetImageView(), vk::ImageLayout::eGeneral };
 
-		vk::DescriptorBufferInfo cameraInfo = {};
-		cameraInfo.buffer = frameData.rtCameraUniform.GetBuffer();
-		cameraInfo.offset = 0;
-		cameraInfo.range = sizeof(RTCameraData);
+		RTFrameData& frameData = m_FrameDatas[frameIdx];
+		const vk::DescriptorBufferInfo cameraInfo = m_pRenderCtx->pUniformRing->GetDescriptorInfo<RTCameraData>(frameIdx);
 
 		DescriptorWriter writer(m_pRenderCtx->device, frameData.descriptorSet);
 		writer.WriteAccelStructure(&descASInfo, static_cast<u32>(RaytracerBindings::Acceleration));
 		writer.WriteImage(imageInfo, static_cast<u32>(RaytracerBindings::OutputImage), vk::DescriptorType::eStorageImage);
-		writer.WriteBuffer(cameraInfo, static_cast<u32>(RaytracerBindings::CameraBuffer), vk::DescriptorType::eUniformBuffer);
+		writer.WriteBuffer(cameraInfo, static_cast<u32>(RaytracerBindings::CameraBuffer), vk::DescriptorType::eUniformBufferDynamic);
+		writer.WriteImage(depthInfo, static_cast<u32>(RaytracerBindings::GBufferDepth), vk::DescriptorType::eSampledImage);
+		writer.WriteImage(normalInfo, static_cast<u32>(RaytracerBindings::GBufferNormal), vk::DescriptorType::eSampledImage);
+		writer.WriteImage(traceInfo, static_cast<u32>(RaytracerBindings::TraceImage), vk::DescriptorType::eStorageImage);
 		writer.Write();
+
+		frameData.tlasVersion = pAcceleration->GetTlasVersion();
 	}
 }
@@ -1,15 +1,17 @@
 ﻿#pragma once
 #include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
 
 #include "VulkanBuffer.h"
 
 namespace Hyper
 {
 	class VulkanRayTracingPipeline;
+	class VulkanComputePipeline;
+	class VulkanImage;
 	struct LightingSettings;
 	class FlyCamera;
 	class VulkanAccelerationStructure;
-	class DescriptorPool;
 	class RenderTarget;
 	class VulkanShader;
 	struct RenderContext;
@@ -24,12 +26,48 @@ namespace Hyper
 	{
 		glm::vec3 sunDirection;
 		u32 frameNr;
+		// The any-hit shader reads the UVs of masked geometry from the geometry pool, through the GeometryData of the hit geometry.
+		// The pool's buffers are replaced when it grows, so their addresses are pushed every frame.
+		vk::DeviceAddress vertexBufferAddress;
+		vk::DeviceAddress indexBufferAddress;
+		vk::DeviceAddress geometryBufferAddress;
+		// Distance between the traced pixels, see RTResolutionMode. Checkerboard rows are shifted by a pixel every other row and frame.
+		glm::uvec2 pixelStride;
+		u32 checkerboard;
+	};
+
+	// How many of the output's pixels trace a shadow ray. All modes but Full trace into a smaller image,
+	// which a depth-aware upsample pass fills the output's other pixels from.
+	enum class RTResolutionMode : u32
+	{
+		Full,
+		// Every second pixel in both directions.
+		Half,
+		// Every fourth pixel in both directions.
+		Quarter,
+		// Every second pixel of a row, alternating between rows and frames.
+		Checkerboard,
+		Count
+	};
+
+	// Cost and error of a resolution mode, traced for the same frame as the full resolution output.
+	struct RTModeComparison
+	{
+		// Trace and upsample, averaged over a few runs.
+		f32 gpuTimeMs;
+		// Mean absolute difference with the full resolution output, where 1 is lit and 0 is shadow.
+		f32 meanDifference;
+		// Fraction of the pixels that are lit in one output and shadowed in the other.
+		f32 flippedPixels;
+		bool isValid;
 	};
 
 	struct RTFrameData
 	{
-		VulkanBuffer rtCameraUniform;
+		// The camera is written to the frame's uniform ring, so this is only rewritten when the images or the TLAS change.
 		vk::DescriptorSet descriptorSet;
+		// Version of the TLAS the set points at, zero when the set has to be rewritten.
+		u32 tlasVersion{};
 	};
 
 	enum class RaytracerBindings : u32
@@ -37,13 +75,10 @@ namespace Hyper
 		Acceleration = 0,
 		OutputImage = 1,
 		CameraBuffer = 2,
-	};
-
-	enum class RaytracerShaderStageIndices : u32
-	{
-		Raygen = 0,
-		Miss,
-		ClosestHit,
+		GBufferDepth = 3,
+		GBufferNormal = 4,
+		// Written instead of the output image by the modes that trace fewer pixels.
+		TraceImage = 5,
 	};
 
 	// Temp helper functions (yes, they're from the nvpro samples for now)
@@ -68,36 +103,74 @@ namespace Hyper
 	class VulkanRaytracer
 	{
 	public:
-		VulkanRaytracer(RenderContext* pRenderCtx, const VulkanAccelerationStructure* accel, u32 numFrames, u32 outputWidth, u32 outputHeight);
+		VulkanRaytracer(RenderContext* pRenderCtx, u32 numFrames, u32 outputWidth, u32 outputHeight);
 		~VulkanRaytracer();
 
-		void RayTrace(vk::CommandBuffer cmd, FlyCamera* pCamera, u32 frameIdx, const LightingSettings& lightingSettings);
+		// Traces the acceleration structure, which has to be built. It may be a different one every frame.
+		// Shadow rays start at the surfaces in the depth and normals of the G-buffer, which has to be the output's size.
+		// Modes other than Full upsample their result into the output.
+		void RayTrace(vk::CommandBuffer cmd, const VulkanAccelerationStructure* pAcceleration, const RenderTarget* pGBuffer, FlyCamera* pCamera, u32 frameIdx,
+			const LightingSettings& lightingSettings);
 		void Resize(u32 width, u32 height);
 
+		// Traces the G-buffer in every mode in submits of their own, and compares their outputs with the full resolution one.
+		// The G-buffer has to be the one of the last submitted frame, and the camera the one it was drawn with. Waits for the GPU to be idle.
+		void CompareModes(const VulkanAccelerationStructure* pAcceleration, const RenderTarget* pGBuffer, FlyCamera* pCamera, u32 frameIdx,
+			const LightingSettings& lightingSettings);
+
+		void SetResolutionMode(RTResolutionMode mode) { m_ResolutionMode = mode; }
+		[[nodiscard]] RTResolutionMode GetResolutionMode() const { return m_ResolutionMode; }
+		[[nodiscard]] const std::array<RTModeComparison, static_cast<size_t>(RTResolutionMode::Count)>& GetModeComparisons() const { return m_ModeComparisons; }
+		[[nodiscard]] static const char* GetResolutionModeName(RTResolutionMode mode);
+
 		[[nodiscard]] const RenderTarget* GetOutputImage() const { return m_pOutputImage.get(); }
+		// GPU time of the last trace and upsample that finished, measured with timestamp queries.
+		[[nodiscard]] f32 GetTraceTimeMs() const { return m_TraceTimeMs; }
+		// Pixels of the output, whichever mode fills them.
+		[[nodiscard]] u32 GetPixelCount() const { return m_OutputWidth * m_OutputHeight; }
 
 	private:
 		void CreateDescriptorSet();
 		void CreatePipeline();
 		void CreateShaderBindingTable();
+		void CreateUpsamplePipeline();
 
-		void UpdateDescriptors(u32 frameIdx);
+		// Records the trace and the upsample, between the two timestamps at the query index. The camera has to be written to the frame's uniform ring.
+		void Record(vk::CommandBuffer cmd, const VulkanAccelerationStructure* pAcceleration, const RenderTarget* pGBuffer, FlyCamera* pCamera, u32 frameIdx,
+			u32 cameraOffset, const LightingSettings& lightingSettings, RTResolutionMode mode, u32 queryIdx);
+		void Upsample(vk::CommandBuffer cmd, const RenderTarget* pGBuffer, FlyCamera* pCamera, u32 frameIdx, RTResolutionMode mode);
+		// Copies the output image to the CPU, in a submit of its own.
+		[[nodiscard]] std::vector<u8> ReadBackOutput();
+
+		// Points the frame's descriptor set at the TLAS, the images and the frame's uniform ring. The set can't be in use.
+		void UpdateDescriptors(u32 frameIdx, const VulkanAccelerationStructure* pAcceleration, const RenderTarget* pGBuffer);
 
 	private:
 		RenderContext* m_pRenderCtx;
-		const VulkanAccelerationStructure* m_AccelerationStructure;
 		const u32 m_NumFrames;
 
 		vk::DescriptorSetLayout m_DescLayout;
-		std::unique_ptr<DescriptorPool> m_pPool;
 		RTCameraData m_CameraData;
 		std::vector<RTFrameData> m_FrameDatas;
 
+		// Two timestamps around the trace of every frame in flight, and two after those for CompareModes.
+		vk::QueryPool m_TimestampPool;
+		std::vector<bool> m_TimestampsWritten;
+		f32 m_TimestampPeriod{};
+		f32 m_TraceTimeMs{};
+
 		RTPushConstants m_RtPushConstants{};
 
 		u32 m_OutputWidth = 1920;
 		u32 m_OutputHeight = 1080;
 		std::unique_ptr<RenderTarget> m_pOutputImage;
+		// Large enough for any mode other than Full, the checkerboard traces the most pixels of those.
+		std::unique_ptr<VulkanImage> m_pTraceImage;
+		RTResolutionMode m_ResolutionMode{ RTResolutionMode::Full };
+		std::array<RTModeComparison, static_cast<size_t>(RTResolutionMode::Count)> m_ModeComparisons{};
+
+		VulkanShader* m_pUpsampleShader;
+		std::unique_ptr<VulkanComputePipeline> m_pUpsamplePipeline;
 		std::vector<vk::RayTracingShaderGroupCreateInfoKHR> m_ShaderGroups;
 		VulkanShader* m_pShader;
 		std::unique_ptr<VulkanRayTracingPipeline> m_RtPipeline;
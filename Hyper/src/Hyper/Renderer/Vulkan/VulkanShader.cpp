@@ -11,6 +11,23 @@
 
 namespace Hyper
 {
+	// Descriptor count of an image or sampler resource, which can be an array. Unbounded arrays are bindless tables.
+	static u32 GetDescriptorCount(const spirv_cross::Compiler& compiler, const spirv_cross::Resource& resource, vk::DescriptorBindingFlags& outBindingFlags)
+	{
+		const spirv_cross::SPIRType& type = compiler.get_type(resource.type_id);
+		outBindingFlags = {};
+		if (type.array.empty())
+			return 1;
+
+		if (type.array[0] == 0)
+		{
+			outBindingFlags = vk::DescriptorBindingFlagBits::ePartiallyBound | vk::DescriptorBindingFlagBits::eUpdateAfterBind;
+			return BindlessDescriptorCount;
+		}
+
+		return type.array[0];
+	}
+
 	VulkanShader::VulkanShader(RenderContext* pRenderCtx, std::unordered_map<ShaderStageType, std::filesystem::path> shaders)
 		: m_pRenderCtx(pRenderCtx), m_Id(UUID{})
 	{
@@ -80,6 +97,7 @@ namespace Hyper
 			case ShaderStageType::RayGen:
 			case ShaderStageType::Miss:
 			case ShaderStageType::ClosestHit:
+			case ShaderStageType::AnyHit:
 				doReflection = false;
 				break;
 
@@ -98,10 +116,15 @@ namespace Hyper
 			for (const auto& descriptorSet : m_DescriptorSetBindings)
 			{
 				auto builder = DescriptorSetLayoutBuilder(m_pRenderCtx->device);
+				bool updateAfterBind = false;
 				for (const auto& [binding, descriptor] : descriptorSet)
 				{
-					builder = builder.AddBinding(descriptor.descType, binding, 1, descriptor.stageFlags);
+					builder = builder.AddBinding(descriptor.descType, binding, descriptor.count, descriptor.stageFlags, descriptor.bindingFlags);
+					if (descriptor.bindingFlags & vk::DescriptorBindingFlagBits::eUpdateAfterBind)
+						updateAfterBind = true;
 				}
+				if (updateAfterBind)
+					builder = builder.SetFlags(vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool);
 
 				m_DescriptorLayouts.push_back(builder.Build());
 			}
@@ -177,8 +200,9 @@ namespace Hyper
 				break;
 			}
 
+			// Uniforms are written to the frame's uniform ring, the offset of their slice is passed when binding.
 			m_DescriptorSetBindings[descriptorSet][binding] = {
-				.descType = vk::DescriptorType::eUniformBuffer,
+				.descType = vk::DescriptorType::eUniformBufferDynamic,
 				.stageFlags = static_cast<vk::ShaderStageFlagBits>(stage)
 			};
 
@@ -193,6 +217,8 @@ namespace Hyper
 			const auto& name = resource.name;
 			u32 binding = compiler.get_decoration(resource.id, spv::DecorationBinding);
 			u32 descriptorSet = compiler.get_decoration(resource.id, spv::DecorationDescriptorSet);
+			vk::DescriptorBindingFlags bindingFlags;
+			const u32 count = GetDescriptorCount(compiler, resource, bindingFlags);
 
 			if (descriptorSet >= m_DescriptorSetBindings.size())
 				m_DescriptorSetBindings.resize(descriptorSet + 1);
@@ -205,11 +231,14 @@ namespace Hyper
 
 			m_DescriptorSetBindings[descriptorSet][binding] = {
 				.descType = vk::DescriptorType::eCombinedImageSampler,
-				.stageFlags = static_cast<vk::ShaderStageFlagBits>(stage)
+				.stageFlags = static_cast<vk::ShaderStageFlagBits>(stage),
+				.count = count,
+				.bindingFlags = bindingFlags
 			};
 
 			HPR_VKLOG_INFO("Combined Image Sampler: '{}'", name);
 			HPR_VKLOG_INFO("  binding: {}", binding);
+			HPR_VKLOG_INFO("  count: {}", count);
 			HPR_VKLOG_INFO("  set: {}", descriptorSet);
 		}
 
@@ -219,6 +248,8 @@ namespace Hyper
 			const auto& name = resource.name;
 			u32 binding = compiler.get_decoration(resource.id, spv::DecorationBinding);
 			u32 descriptorSet = compiler.get_decoration(resource.id, spv::DecorationDescriptorSet);
+			vk::DescriptorBindingFlags bindingFlags;
+			const u32 count = GetDescriptorCount(compiler, resource, bindingFlags);
 
 			if (descriptorSet >= m_DescriptorSetBindings.size())
 				m_DescriptorSetBindings.resize(descriptorSet + 1);
@@ -241,12 +272,15 @@ namespace Hyper
 			{
 				m_DescriptorSetBindings[descriptorSet][binding] = {
 					.descType = vk::DescriptorType::eSampledImage,
-					.stageFlags = static_cast<vk::ShaderStageFlagBits>(stage)
+					.stageFlags = static_cast<vk::ShaderStageFlagBits>(stage),
+					.count = count,
+					.bindingFlags = bindingFlags
 				};
 			}
 
 			HPR_VKLOG_INFO("Separate Image: '{}'", name);
 			HPR_VKLOG_INFO("  binding: {}", binding);
+			HPR_VKLOG_INFO("  count: {}", count);
 			HPR_VKLOG_INFO("  set: {}", descriptorSet);
 		}
 
@@ -256,6 +290,8 @@ namespace Hyper
 			const auto& name = resource.name;
 			u32 binding = compiler.get_decoration(resource.id, spv::DecorationBinding);
 			u32 descriptorSet = compiler.get_decoration(resource.id, spv::DecorationDescriptorSet);
+			vk::DescriptorBindingFlags bindingFlags;
+			const u32 count = GetDescriptorCount(compiler, resource, bindingFlags);
 
 			if (descriptorSet >= m_DescriptorSetBindings.size())
 				m_DescriptorSetBindings.resize(descriptorSet + 1);
@@ -278,12 +314,15 @@ namespace Hyper
 			{
 				m_DescriptorSetBindings[descriptorSet][binding] = {
 					.descType = vk::DescriptorType::eSampler,
-					.stageFlags = static_cast<vk::ShaderStageFlagBits>(stage)
+					.stageFlags = static_cast<vk::ShaderStageFlagBits>(stage),
+					.count = count,
+					.bindingFlags = bindingFlags
 				};
 			}
 
 			HPR_VKLOG_INFO("Separate sampler: '{}'", name);
 			HPR_VKLOG_INFO("  binding: {}", binding);
+			HPR_VKLOG_INFO("  count: {}", count);
 			HPR_VKLOG_INFO("  set: {}", descriptorSet);
 		}
 
@@ -9,9 +9,11 @@ namespace Hyper
 	{
 		Vertex = vk::ShaderStageFlagBits::eVertex,
 		Fragment = vk::ShaderStageFlagBits::eFragment,
+		Compute = vk::ShaderStageFlagBits::eCompute,
 		RayGen = vk::ShaderStageFlagBits::eRaygenKHR,
 		Miss = vk::ShaderStageFlagBits::eMissKHR,
 		ClosestHit = vk::ShaderStageFlagBits::eClosestHitKHR,
+		AnyHit = vk::ShaderStageFlagBits::eAnyHitKHR,
 	};
 
 	struct ShaderModule
@@ -24,6 +26,9 @@ namespace Hyper
 	{
 		vk::DescriptorType descType;
 		vk::ShaderStageFlags stageFlags;
+		// Unbounded arrays get BindlessDescriptorCount descriptors, and are partially bound and updatable after binding.
+		u32 count{ 1 };
+		vk::DescriptorBindingFlags bindingFlags{};
 	};
 
 	struct ShaderPushConstant
@@ -0,0 +1,181 @@
+﻿#include "HyperPCH.h"
+#include "Bounds.h"
+
+#include <immintrin.h>
+#include <glm/geometric.hpp>
+
+#include "Hyper/Renderer/Vulkan/Vertex.h"
+
+namespace Hyper
+{
+	f32 AABB::GetSurfaceArea() const
+	{
+		if (!IsValid())
+			return 0.0f;
+
+		const glm::vec3 size = max - min;
+		return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+	}
+
+	void AABB::Grow(const glm::vec3& point)
+	{
+		min = glm::min(min, point);
+		max = glm::max(max, point);
+	}
+
+	void AABB::Grow(const AABB& other)
+	{
+		min = glm::min(min, other.min);
+		max = glm::max(max, other.max);
+	}
+
+	bool AABB::Overlaps(const AABB& other) const
+	{
+		return min.x <= other.max.x && max.x >= other.min.x
+			&& min.y <= other.max.y && max.y >= other.min.y
+			&& min.z <= other.max.z && max.z >= other.min.z;
+	}
+
+	bool AABB::Contains(const glm::vec3& point) const
+	{
+		return point.x >= min.x && point.x <= max.x
+			&& point.y >= min.y && point.y <= max.y
+			&& point.z >= min.z && point.z <= max.z;
+	}
+
+	bool AABB::Contains(const AABB& other) const
+	{
+		return other.min.x >= min.x && other.max.x <= max.x
+			&& other.min.y >= min.y && other.max.y <= max.y
+			&& other.min.z >= min.z && other.max.z <= max.z;
+	}
+
+	f32 AABB::DistanceSquared(const glm::vec3& point) const
+	{
+		const glm::vec3 delta = glm::max(glm::max(min - point, point - max), glm::vec3{ 0.0f });
+		return glm::dot(delta, delta);
+	}
+
+	bool AABB::IntersectRay(const Ray& ray, f32 maxDistance, f32& outDistance) const
+	{
+		// Division by zero gives +-inf here, which the min/max below handle correctly.
+		const glm::vec3 invDirection = 1.0f / ray.direction;
+		const glm::vec3 t0 = (min - ray.origin) * invDirection;
+		const glm::vec3 t1 = (max - ray.origin) * invDirection;
+		const glm::vec3 tNear = glm::min(t0, t1);
+		const glm::vec3 tFar = glm::max(t0, t1);
+
+		const f32 entry = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, 0.0f));
+		const f32 exit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, maxDistance));
+		if (entry > exit)
+			return false;
+
+		outDistance = entry;
+		return true;
+	}
+
+	AABB AABB::Transformed(const glm::mat4& transform) const
+	{
+		if (!IsValid())
+			return {};
+
+		// Arvo's method: transform the center, and project the extents onto the absolute value of the rotation/scale part.
+		const glm::vec3 center = GetCenter();
+		const glm::vec3 extents = GetExtents();
+
+		const glm::vec3 newCenter = glm::vec3(transform * glm::vec4(center, 1.0f));
+		const glm::vec3 newExtents =
+			glm::abs(glm::vec3(transform[0])) * extents.x +
+			glm::abs(glm::vec3(transform[1])) * extents.y +
+			glm::abs(glm::vec3(transform[2])) * extents.z;
+
+		return AABB{ newCenter - newExtents, newCenter + newExtents };
+	}
+
+	AABB AABB::Union(const AABB& a, const AABB& b)
+	{
+		return AABB{ glm::min(a.min, b.min), glm::max(a.max, b.max) };
+	}
+
+	BoundingSphere BoundingSphere::FromAABB(const AABB& aabb)
+	{
+		if (!aabb.IsValid())
+			return {};
+
+		return BoundingSphere{ aabb.GetCenter(), glm::length(aabb.GetExtents()) };
+	}
+
+	BoundingSphere BoundingSphere::Transformed(const glm::mat4& transform) const
+	{
+		const glm::vec3 axisX = glm::vec3(transform[0]);
+		const glm::vec3 axisY = glm::vec3(transform[1]);
+		const glm::vec3 axisZ = glm::vec3(transform[2]);
+		const f32 maxScaleSq = glm::max(glm::max(glm::dot(axisX, axisX), glm::dot(axisY, axisY)), glm::dot(axisZ, axisZ));
+
+		return BoundingSphere{ glm::vec3(transform * glm::vec4(center, 1.0f)), radius * glm::sqrt(maxScaleSq) };
+	}
+
+	namespace Bounds
+	{
+		AABB ComputeAABB(const std::vector<VertexPosNormTex>& vertices)
+		{
+			if (vertices.empty())
+				return {};
+
+			// The position is followed by the normal in the vertex struct, so an unaligned 4-wide load
+			// at the position never reads past the end of the vertex. The w lane is simply ignored.
+			static_assert(offsetof(VertexPosNormTex, position) + sizeof(f32) * 4 <= sizeof(VertexPosNormTex));
+
+			const size_t count = vertices.size();
+			const f32* pFirst = &vertices[0].position.x;
+			__m128 min0 = _mm_loadu_ps(pFirst);
+			__m128 max0 = min0;
+			__m128 min1 = min0;
+			__m128 max1 = min0;
+
+			// Two independent accumulators to hide the min/max latency.
+			size_t i = 1;
+			for (; i + 1 < count; i += 2)
+			{
+				const __m128 p0 = _mm_loadu_ps(&vertices[i].position.x);
+				const __m128 p1 = _mm_loadu_ps(&vertices[i + 1].position.x);
+				min0 = _mm_min_ps(min0, p0);
+				max0 = _mm_max_ps(max0, p0);
+				min1 = _mm_min_ps(min1, p1);
+				max1 = _mm_max_ps(max1, p1);
+			}
+			if (i < count)
+			{
+				const __m128 p = _mm_loadu_ps(&vertices[i].position.x);
+				min0 = _mm_min_ps(min0, p);
+				max0 = _mm_max_ps(max0, p);
+			}
+
+			alignas(16) f32 minResult[4];
+			alignas(16) f32 maxResult[4];
+			_mm_store_ps(minResult, _mm_min_ps(min0, min1));
+			_mm_store_ps(maxResult, _mm_max_ps(max0, max1));
+
+			return AABB{
+				glm::vec3{ minResult[0], minResult[1], minResult[2] },
+				glm::vec3{ maxResult[0], maxResult[1], maxResult[2] }
+			};
+		}
+
+		BoundingSphere ComputeSphere(const std::vector<VertexPosNormTex>& vertices, const AABB& aabb)
+		{
+			if (vertices.empty() || !aabb.IsValid())
+				return {};
+
+			const glm::vec3 center = aabb.GetCenter();
+			f32 maxDistSq = 0.0f;
+			for (const VertexPosNormTex& vertex : vertices)
+			{
+				const glm::vec3 delta = vertex.position - center;
+				maxDistSq = glm::max(maxDistSq, glm::dot(delta, delta));
+			}
+
+			return BoundingSphere{ center, glm::sqrt(maxDistSq) };
+		}
+	}
+}
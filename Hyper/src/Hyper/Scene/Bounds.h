@@ -0,0 +1,66 @@
+﻿#pragma once
+#include <limits>
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+
+namespace Hyper
+{
+	struct VertexPosNormTex;
+
+	struct Ray
+	{
+		glm::vec3 origin{};
+		// Doesn't need to be normalized, but hit distances are expressed in multiples of it.
+		glm::vec3 direction{ 0.0f, 0.0f, 1.0f };
+	};
+
+	struct AABB
+	{
+		// Default constructed boxes are "inverted", so that growing them with any point results in a valid box.
+		glm::vec3 min{ std::numeric_limits<f32>::max() };
+		glm::vec3 max{ std::numeric_limits<f32>::lowest() };
+
+		[[nodiscard]] bool IsValid() const { return min.x <= max.x && min.y <= max.y && min.z <= max.z; }
+		[[nodiscard]] glm::vec3 GetCenter() const { return (min + max) * 0.5f; }
+		[[nodiscard]] glm::vec3 GetExtents() const { return (max - min) * 0.5f; }
+		[[nodiscard]] f32 GetSurfaceArea() const;
+
+		void Grow(const glm::vec3& point);
+		void Grow(const AABB& other);
+
+		[[nodiscard]] bool Overlaps(const AABB& other) const;
+		[[nodiscard]] bool Contains(const glm::vec3& point) const;
+		[[nodiscard]] bool Contains(const AABB& other) const;
+		[[nodiscard]] f32 DistanceSquared(const glm::vec3& point) const;
+
+		// Slab test. Returns true if the ray hits the box between 0 and maxDistance, with the entry distance in outDistance.
+		// A ray starting inside of the box hits it at distance 0.
+		[[nodiscard]] bool IntersectRay(const Ray& ray, f32 maxDistance, f32& outDistance) const;
+
+		// Returns the AABB enclosing this box after it has been transformed by the given matrix.
+		[[nodiscard]] AABB Transformed(const glm::mat4& transform) const;
+
+		[[nodiscard]] static AABB Union(const AABB& a, const AABB& b);
+	};
+
+	struct BoundingSphere
+	{
+		glm::vec3 center{};
+		f32 radius{};
+
+		[[nodiscard]] static BoundingSphere FromAABB(const AABB& aabb);
+
+		// Returns the sphere enclosing this sphere after it has been transformed by the given matrix.
+		// Non-uniform scale is handled conservatively by using the largest axis scale.
+		[[nodiscard]] BoundingSphere Transformed(const glm::mat4& transform) const;
+	};
+
+	namespace Bounds
+	{
+		// Computes the AABB of the vertex positions, using SSE min/max over the positions.
+		AABB ComputeAABB(const std::vector<VertexPosNormTex>& vertices);
+
+		// Computes a sphere centered on the AABB center that encloses all vertices.
+		BoundingSphere ComputeSphere(const std::vector<VertexPosNormTex>& vertices, const AABB& aabb);
+	}
+}
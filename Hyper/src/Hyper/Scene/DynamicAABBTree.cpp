@@ -0,0 +1,519 @@
+﻿#include "HyperPCH.h"
+#include "DynamicAABBTree.h"
+
+#include <cassert>
+#include <queue>
+
+#include "Frustum.h"
+#include "Hyper/Debug/Profiler.h"
+
+namespace Hyper
+{
+	// Traversal stack size. The tree is kept balanced, so even millions of objects stay far below this.
+	static constexpr u32 s_MaxStackSize = 256;
+
+	DynamicAABBTree::DynamicAABBTree(f32 margin)
+		: m_Margin(margin)
+	{
+	}
+
+	i32 DynamicAABBTree::CreateProxy(const AABB& aabb, u32 userData)
+	{
+		const i32 proxyId = AllocateNode();
+
+		TreeNode& node = m_Nodes[proxyId];
+		node.aabb = aabb;
+		node.fatAABB = AABB{ aabb.min - glm::vec3{ m_Margin }, aabb.max + glm::vec3{ m_Margin } };
+		node.userData = userData;
+
+		InsertLeaf(proxyId);
+		m_ProxyCount++;
+
+		return proxyId;
+	}
+
+	void DynamicAABBTree::DestroyProxy(i32 proxyId)
+	{
+		assert(m_Nodes[proxyId].IsLeaf());
+
+		RemoveLeaf(proxyId);
+		FreeNode(proxyId);
+		m_ProxyCount--;
+	}
+
+	bool DynamicAABBTree::MoveProxy(i32 proxyId, const AABB& aabb)
+	{
+		assert(m_Nodes[proxyId].IsLeaf());
+
+		m_Nodes[proxyId].aabb = aabb;
+		if (m_Nodes[proxyId].fatAABB.Contains(aabb))
+			return false;
+
+		RemoveLeaf(proxyId);
+		m_Nodes[proxyId].fatAABB = AABB{ aabb.min - glm::vec3{ m_Margin }, aabb.max + glm::vec3{ m_Margin } };
+		InsertLeaf(proxyId);
+
+		return true;
+	}
+
+	void DynamicAABBTree::Clear()
+	{
+		m_Nodes.clear();
+		m_Root = NullNode;
+		m_FreeList = NullNode;
+		m_ProxyCount = 0;
+	}
+
+	void DynamicAABBTree::QueryOverlaps(const AABB& aabb, std::vector<u32>& outResults) const
+	{
+		HPR_PROFILE_SCOPE();
+
+		if (m_Root == NullNode)
+			return;
+
+		std::array<i32, s_MaxStackSize> stack;
+		u32 stackSize = 0;
+		stack[stackSize++] = m_Root;
+
+		while (stackSize > 0)
+		{
+			const TreeNode& node = m_Nodes[stack[--stackSize]];
+			if (!node.fatAABB.Overlaps(aabb))
+				continue;
+
+			if (node.IsLeaf())
+			{
+				if (node.aabb.Overlaps(aabb))
+					outResults.push_back(node.userData);
+			}
+			else
+			{
+				assert(stackSize + 2 <= s_MaxStackSize);
+				stack[stackSize++] = node.child1;
+				stack[stackSize++] = node.child2;
+			}
+		}
+	}
+
+	void DynamicAABBTree::QueryFrustum(const Frustum& frustum, std::vector<u32>& outResults) const
+	{
+		HPR_PROFILE_SCOPE();
+
+		if (m_Root == NullNode)
+			return;
+
+		// Once a node is completely inside of the frustum, its whole subtree is visible without further tests.
+		struct StackEntry
+		{
+			i32 nodeId;
+			bool isInside;
+		};
+		std::array<StackEntry, s_MaxStackSize> stack;
+		u32 stackSize = 0;
+		stack[stackSize++] = StackEntry{ m_Root, false };
+
+		while (stackSize > 0)
+		{
+			const StackEntry entry = stack[--stackSize];
+			const TreeNode& node = m_Nodes[entry.nodeId];
+
+			bool isInside = entry.isInside;
+			if (!isInside)
+			{
+				const Frustum::Containment containment = frustum.Classify(node.IsLeaf() ? node.aabb : node.fatAABB);
+				if (containment == Frustum::Containment::Outside)
+					continue;
+
+				isInside = containment == Frustum::Containment::Inside;
+			}
+
+			if (node.IsLeaf())
+			{
+				outResults.push_back(node.userData);
+			}
+			else
+			{
+				assert(stackSize + 2 <= s_MaxStackSize);
+				stack[stackSize++] = StackEntry{ node.child1, isInside };
+				stack[stackSize++] = StackEntry{ node.child2, isInside };
+			}
+		}
+	}
+
+	bool DynamicAABBTree::RaycastClosest(const Ray& ray, f32 maxDistance, RayHit& outHit, const RayCallback& callback) const
+	{
+		HPR_PROFILE_SCOPE();
+
+		if (m_Root == NullNode)
+			return false;
+
+		f32 closest = maxDistance;
+		bool hasHit = false;
+
+		std::array<i32, s_MaxStackSize> stack;
+		u32 stackSize = 0;
+		stack[stackSize++] = m_Root;
+
+		while (stackSize > 0)
+		{
+			const TreeNode& node = m_Nodes[stack[--stackSize]];
+
+			f32 distance;
+			if (node.IsLeaf())
+			{
+				if (!node.aabb.IntersectRay(ray, closest, distance))
+					continue;
+
+				if (callback)
+				{
+					distance = callback(node.userData, ray, closest);
+					if (distance < 0.0f || distance >= closest)
+						continue;
+				}
+
+				closest = distance;
+				outHit = RayHit{ node.userData, distance };
+				hasHit = true;
+				continue;
+			}
+
+			if (!node.fatAABB.IntersectRay(ray, closest, distance))
+				continue;
+
+			// Visit the closest child first, so the hit distance shrinks as quickly as possible.
+			f32 distance1 = std::numeric_limits<f32>::max();
+			f32 distance2 = std::numeric_limits<f32>::max();
+			const bool hit1 = m_Nodes[node.child1].fatAABB.IntersectRay(ray, closest, distance1);
+			const bool hit2 = m_Nodes[node.child2].fatAABB.IntersectRay(ray, closest, distance2);
+
+			assert(stackSize + 2 <= s_MaxStackSize);
+			if (distance1 <= distance2)
+			{
+				if (hit2) stack[stackSize++] = node.child2;
+				if (hit1) stack[stackSize++] = node.child1;
+			}
+			else
+			{
+				if (hit1) stack[stackSize++] = node.child1;
+				if (hit2) stack[stackSize++] = node.child2;
+			}
+		}
+
+		return hasHit;
+	}
+
+	void DynamicAABBTree::QueryNearest(const glm::vec3& point, u32 k, std::vector<u32>& outResults) const
+	{
+		HPR_PROFILE_SCOPE();
+
+		if (m_Root == NullNode || k == 0)
+			return;
+
+		// Best-first search. A fat AABB is never further away than the objects in it, so when a leaf comes out
+		// of the queue, nothing that is still in the queue can be closer.
+		using QueueEntry = std::pair<f32, i32>;
+		std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<>> queue;
+		queue.emplace(m_Nodes[m_Root].fatAABB.DistanceSquared(point), m_Root);
+
+		u32 found = 0;
+		while (!queue.empty() && found < k)
+		{
+			const i32 nodeId = queue.top().second;
+			queue.pop();
+
+			const TreeNode& node = m_Nodes[nodeId];
+			if (node.IsLeaf())
+			{
+				outResults.push_back(node.userData);
+				found++;
+				continue;
+			}
+
+			for (const i32 childId : { node.child1, node.child2 })
+			{
+				const TreeNode& child = m_Nodes[childId];
+				// Leaves are queued with their exact bounds, so they come out in the right order.
+				queue.emplace(child.IsLeaf() ? child.aabb.DistanceSquared(point) : child.fatAABB.DistanceSquared(point), childId);
+			}
+		}
+	}
+
+	f32 DynamicAABBTree::GetAreaRatio() const
+	{
+		if (m_Root == NullNode)
+			return 0.0f;
+
+		f32 totalArea = 0.0f;
+		for (const TreeNode& node : m_Nodes)
+		{
+			// Free nodes have a negative height, and leaves a height of 0.
+			if (node.height > 0)
+				totalArea += node.fatAABB.GetSurfaceArea();
+		}
+
+		return totalArea / m_Nodes[m_Root].fatAABB.GetSurfaceArea();
+	}
+
+	i32 DynamicAABBTree::AllocateNode()
+	{
+		i32 nodeId;
+		if (m_FreeList == NullNode)
+		{
+			nodeId = static_cast<i32>(m_Nodes.size());
+			m_Nodes.emplace_back();
+		}
+		else
+		{
+			nodeId = m_FreeList;
+			m_FreeList = m_Nodes[nodeId].parentOrNext;
+		}
+
+		m_Nodes[nodeId] = TreeNode{};
+		m_Nodes[nodeId].height = 0;
+
+		return nodeId;
+	}
+
+	void DynamicAABBTree::FreeNode(i32 nodeId)
+	{
+		m_Nodes[nodeId] = TreeNode{};
+		m_Nodes[nodeId].parentOrNext = m_FreeList;
+		m_FreeList = nodeId;
+	}
+
+	void DynamicAABBTree::InsertLeaf(i32 leaf)
+	{
+		if (m_Root == NullNode)
+		{
+			m_Root = leaf;
+			m_Nodes[leaf].parentOrNext = NullNode;
+			return;
+		}
+
+		// Find the best sibling for the new leaf, using the surface area heuristic.
+		const AABB leafAABB = m_Nodes[leaf].fatAABB;
+		i32 index = m_Root;
+		while (!m_Nodes[index].IsLeaf())
+		{
+			const TreeNode& node = m_Nodes[index];
+
+			const f32 area = node.fatAABB.GetSurfaceArea();
+			const f32 combinedArea = AABB::Union(node.fatAABB, leafAABB).GetSurfaceArea();
+
+			// Cost of creating a new parent for this node and the new leaf.
+			const f32 cost = 2.0f * combinedArea;
+			// Minimum cost of pushing the leaf further down the tree.
+			const f32 inheritanceCost = 2.0f * (combinedArea - area);
+
+			const auto descendCost = [&](i32 childId)
+			{
+				const TreeNode& child = m_Nodes[childId];
+				const f32 newArea = AABB::Union(leafAABB, child.fatAABB).GetSurfaceArea();
+				return (child.IsLeaf() ? newArea : newArea - child.fatAABB.GetSurfaceArea()) + inheritanceCost;
+			};
+			const f32 cost1 = descendCost(node.child1);
+			const f32 cost2 = descendCost(node.child2);
+
+			if (cost < cost1 && cost < cost2)
+				break;
+
+			index = cost1 < cost2 ? node.child1 : node.child2;
+		}
+
+		const i32 sibling = index;
+		const i32 oldParent = m_Nodes[sibling].parentOrNext;
+		const i32 newParent = AllocateNode();
+
+		TreeNode& parent = m_Nodes[newParent];
+		parent.parentOrNext = oldParent;
+		parent.fatAABB = AABB::Union(leafAABB, m_Nodes[sibling].fatAABB);
+		parent.height = m_Nodes[sibling].height + 1;
+		parent.child1 = sibling;
+		parent.child2 = leaf;
+		m_Nodes[sibling].parentOrNext = newParent;
+		m_Nodes[leaf].parentOrNext = newParent;
+
+		if (oldParent != NullNode)
+		{
+			if (m_Nodes[oldParent].child1 == sibling)
+				m_Nodes[oldParent].child1 = newParent;
+			else
+				m_Nodes[oldParent].child2 = newParent;
+		}
+		else
+		{
+			m_Root = newParent;
+		}
+
+		RefitAncestors(newParent);
+	}
+
+	void DynamicAABBTree::RemoveLeaf(i32 leaf)
+	{
+		if (leaf == m_Root)
+		{
+			m_Root = NullNode;
+			return;
+		}
+
+		const i32 parent = m_Nodes[leaf].parentOrNext;
+		const i32 grandParent = m_Nodes[parent].parentOrNext;
+		const i32 sibling = m_Nodes[parent].child1 == leaf ? m_Nodes[parent].child2 : m_Nodes[parent].child1;
+
+		// The sibling takes the place of the parent.
+		if (grandParent != NullNode)
+		{
+			if (m_Nodes[grandParent].child1 == parent)
+				m_Nodes[grandParent].child1 = sibling;
+			else
+				m_Nodes[grandParent].child2 = sibling;
+
+			m_Nodes[sibling].parentOrNext = grandParent;
+			FreeNode(parent);
+
+			RefitAncestors(grandParent);
+		}
+		else
+		{
+			m_Root = sibling;
+			m_Nodes[sibling].parentOrNext = NullNode;
+			FreeNode(parent);
+		}
+
+		m_Nodes[leaf].parentOrNext = NullNode;
+	}
+
+	void DynamicAABBTree::RefitAncestors(i32 nodeId)
+	{
+		while (nodeId != NullNode)
+		{
+			nodeId = Balance(nodeId);
+
+			TreeNode& node = m_Nodes[nodeId];
+			const TreeNode& child1 = m_Nodes[node.child1];
+			const TreeNode& child2 = m_Nodes[node.child2];
+
+			node.height = 1 + std::max(child1.height, child2.height);
+			node.fatAABB = AABB::Union(child1.fatAABB, child2.fatAABB);
+
+			nodeId = node.parentOrNext;
+		}
+	}
+
+	i32 DynamicAABBTree::Balance(i32 iA)
+	{
+		// Performs a left or right rotation if node A is imbalanced. Returns the new root of this subtree.
+		TreeNode& A = m_Nodes[iA];
+		if (A.IsLeaf() || A.height < 2)
+			return iA;
+
+		const i32 iB = A.child1;
+		const i32 iC = A.child2;
+		TreeNode& B = m_Nodes[iB];
+		TreeNode& C = m_Nodes[iC];
+
+		const i32 balance = C.height - B.height;
+
+		// Rotate C up.
+		if (balance > 1)
+		{
+			const i32 iF = C.child1;
+			const i32 iG = C.child2;
+			TreeNode& F = m_Nodes[iF];
+			TreeNode& G = m_Nodes[iG];
+
+			// Swap A and C.
+			C.child1 = iA;
+			C.parentOrNext = A.parentOrNext;
+			A.parentOrNext = iC;
+
+			if (C.parentOrNext != NullNode)
+			{
+				if (m_Nodes[C.parentOrNext].child1 == iA)
+					m_Nodes[C.parentOrNext].child1 = iC;
+				else
+					m_Nodes[C.parentOrNext].child2 = iC;
+			}
+			else
+			{
+				m_Root = iC;
+			}
+
+			// Keep the highest of F and G under C.
+			if (F.height > G.height)
+			{
+				C.child2 = iF;
+				A.child2 = iG;
+				G.parentOrNext = iA;
+				A.fatAABB = AABB::Union(B.fatAABB, G.fatAABB);
+				C.fatAABB = AABB::Union(A.fatAABB, F.fatAABB);
+				A.height = 1 + std::max(B.height, G.height);
+				C.height = 1 + std::max(A.height, F.height);
+			}
+			else
+			{
+				C.child2 = iG;
+				A.child2 = iF;
+				F.parentOrNext = iA;
+				A.fatAABB = AABB::Union(B.fatAABB, F.fatAABB);
+				C.fatAABB = AABB::Union(A.fatAABB, G.fatAABB);
+				A.height = 1 + std::max(B.height, F.height);
+				C.height = 1 + std::max(A.height, G.height);
+			}
+
+			return iC;
+		}
+
+		// Rotate B up.
+		if (balance < -1)
+		{
+			const i32 iD = B.child1;
+			const i32 iE = B.child2;
+			TreeNode& D = m_Nodes[iD];
+			TreeNode& E = m_Nodes[iE];
+
+			// Swap A and B.
+			B.child1 = iA;
+			B.parentOrNext = A.parentOrNext;
+			A.parentOrNext = iB;
+
+			if (B.parentOrNext != NullNode)
+			{
+				if (m_Nodes[B.parentOrNext].child1 == iA)
+					m_Nodes[B.parentOrNext].child1 = iB;
+				else
+					m_Nodes[B.parentOrNext].child2 = iB;
+			}
+			else
+			{
+				m_Root = iB;
+			}
+
+			// Keep the highest of D and E under B.
+			if (D.height > E.height)
+			{
+				B.child2 = iD;
+				A.child1 = iE;
+				E.parentOrNext = iA;
+				A.fatAABB = AABB::Union(C.fatAABB, E.fatAABB);
+				B.fatAABB = AABB::Union(A.fatAABB, D.fatAABB);
+				A.height = 1 + std::max(C.height, E.height);
+				B.height = 1 + std::max(A.height, D.height);
+			}
+			else
+			{
+				B.child2 = iE;
+				A.child1 = iD;
+				D.parentOrNext = iA;
+				A.fatAABB = AABB::Union(C.fatAABB, D.fatAABB);
+				B.fatAABB = AABB::Union(A.fatAABB, E.fatAABB);
+				A.height = 1 + std::max(C.height, D.height);
+				B.height = 1 + std::max(A.height, E.height);
+			}
+
+			return iB;
+		}
+
+		return iA;
+	}
+}
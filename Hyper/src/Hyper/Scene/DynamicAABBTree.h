@@ -0,0 +1,92 @@
+﻿#pragma once
+#include <functional>
+
+#include "Bounds.h"
+
+namespace Hyper
+{
+	class Frustum;
+
+	// Dynamic bounding volume hierarchy, in the style of the Box2D/Bullet dynamic trees.
+	// Leaves store a "fat" AABB that is slightly bigger than the object, so small movements don't touch the tree at all.
+	// Objects that move out of their fat AABB are removed and reinserted, and the tree is kept balanced with AVL rotations.
+	class DynamicAABBTree
+	{
+	public:
+		static constexpr i32 NullNode = -1;
+
+		struct RayHit
+		{
+			u32 userData;
+			f32 distance;
+		};
+
+		// Called for each leaf whose bounds are hit by the ray. Returns the exact hit distance for the object,
+		// or a negative value if the object itself isn't hit. Used to refine hits, e.g. against triangles.
+		using RayCallback = std::function<f32(u32 userData, const Ray& ray, f32 maxDistance)>;
+
+	public:
+		// margin is the amount the fat AABBs are grown by on every side.
+		explicit DynamicAABBTree(f32 margin = 0.1f);
+
+		i32 CreateProxy(const AABB& aabb, u32 userData);
+		void DestroyProxy(i32 proxyId);
+		// Updates the bounds of a proxy. Returns true if it had to be reinserted into the tree.
+		bool MoveProxy(i32 proxyId, const AABB& aabb);
+		void Clear();
+
+		[[nodiscard]] u32 GetUserData(i32 proxyId) const { return m_Nodes[proxyId].userData; }
+		[[nodiscard]] const AABB& GetFatAABB(i32 proxyId) const { return m_Nodes[proxyId].fatAABB; }
+		[[nodiscard]] const AABB& GetAABB(i32 proxyId) const { return m_Nodes[proxyId].aabb; }
+
+		// Appends the user data of all objects whose bounds overlap the given box.
+		void QueryOverlaps(const AABB& aabb, std::vector<u32>& outResults) const;
+		// Appends the user data of all objects whose bounds are (partially) inside the frustum.
+		void QueryFrustum(const Frustum& frustum, std::vector<u32>& outResults) const;
+		// Finds the closest object hit by the ray. Without a callback, the object bounds are used as the hit shape.
+		bool RaycastClosest(const Ray& ray, f32 maxDistance, RayHit& outHit, const RayCallback& callback = {}) const;
+		// Appends up to k objects, sorted by the distance from the point to their bounds, closest first.
+		void QueryNearest(const glm::vec3& point, u32 k, std::vector<u32>& outResults) const;
+
+		[[nodiscard]] u32 GetProxyCount() const { return m_ProxyCount; }
+		[[nodiscard]] u32 GetHeight() const { return m_Root == NullNode ? 0 : static_cast<u32>(m_Nodes[m_Root].height); }
+		// Sum of all internal node areas, relative to the root. Lower is better.
+		[[nodiscard]] f32 GetAreaRatio() const;
+
+	private:
+		struct TreeNode
+		{
+			// Bounds used by the tree. For leaves, this is the fat AABB.
+			AABB fatAABB;
+			// Exact object bounds, only valid for leaves.
+			AABB aabb;
+
+			// Parent when in use, next free node when in the free list.
+			i32 parentOrNext{ NullNode };
+			i32 child1{ NullNode };
+			i32 child2{ NullNode };
+			// Leaves have height 0, free nodes -1.
+			i32 height{ -1 };
+
+			u32 userData{};
+
+			[[nodiscard]] bool IsLeaf() const { return child1 == NullNode; }
+		};
+
+		i32 AllocateNode();
+		void FreeNode(i32 nodeId);
+
+		void InsertLeaf(i32 leaf);
+		void RemoveLeaf(i32 leaf);
+		i32 Balance(i32 nodeId);
+		void RefitAncestors(i32 nodeId);
+
+	private:
+		f32 m_Margin;
+
+		std::vector<TreeNode> m_Nodes;
+		i32 m_Root{ NullNode };
+		i32 m_FreeList{ NullNode };
+		u32 m_ProxyCount{};
+	};
+}
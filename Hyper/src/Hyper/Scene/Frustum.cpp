@@ -0,0 +1,191 @@
+﻿#include "HyperPCH.h"
+#include "Frustum.h"
+
+#include <bit>
+#include <immintrin.h>
+#include <glm/geometric.hpp>
+
+#include "Hyper/Debug/Profiler.h"
+
+namespace Hyper
+{
+	static constexpr u32 s_BatchPadding = 8;
+
+	void AABBList::Resize(u32 count)
+	{
+		m_Count = count;
+
+		const u32 paddedCount = (count + s_BatchPadding - 1) / s_BatchPadding * s_BatchPadding;
+		m_MinX.resize(paddedCount, 0.0f);
+		m_MinY.resize(paddedCount, 0.0f);
+		m_MinZ.resize(paddedCount, 0.0f);
+		m_MaxX.resize(paddedCount, 0.0f);
+		m_MaxY.resize(paddedCount, 0.0f);
+		m_MaxZ.resize(paddedCount, 0.0f);
+	}
+
+	void AABBList::Set(u32 idx, const AABB& aabb)
+	{
+		m_MinX[idx] = aabb.min.x;
+		m_MinY[idx] = aabb.min.y;
+		m_MinZ[idx] = aabb.min.z;
+		m_MaxX[idx] = aabb.max.x;
+		m_MaxY[idx] = aabb.max.y;
+		m_MaxZ[idx] = aabb.max.z;
+	}
+
+	Frustum::Frustum(const glm::mat4& viewProjection)
+	{
+		// Gribb-Hartmann plane extraction. glm matrices are column-major, so gather the rows first.
+		const glm::mat4& m = viewProjection;
+		const glm::vec4 row0{ m[0][0], m[1][0], m[2][0], m[3][0] };
+		const glm::vec4 row1{ m[0][1], m[1][1], m[2][1], m[3][1] };
+		const glm::vec4 row2{ m[0][2], m[1][2], m[2][2], m[3][2] };
+		const glm::vec4 row3{ m[0][3], m[1][3], m[2][3], m[3][3] };
+
+		m_Planes[Left] = row3 + row0;
+		m_Planes[Right] = row3 - row0;
+		m_Planes[Bottom] = row3 + row1;
+		m_Planes[Top] = row3 - row1;
+		// The projection uses the default -1..1 clip depth range. With a 0..1 range this plane would be row2 alone,
+		// which is strictly inside this one, so this is conservative either way.
+		m_Planes[Near] = row3 + row2;
+		m_Planes[Far] = row3 - row2;
+
+		for (glm::vec4& plane : m_Planes)
+		{
+			plane /= glm::length(glm::vec3(plane));
+		}
+	}
+
+	bool Frustum::Intersects(const AABB& aabb) const
+	{
+		for (const glm::vec4& plane : m_Planes)
+		{
+			// Test the corner that is furthest along the plane normal (the "positive vertex").
+			const glm::vec3 positive{
+				plane.x > 0.0f ? aabb.max.x : aabb.min.x,
+				plane.y > 0.0f ? aabb.max.y : aabb.min.y,
+				plane.z > 0.0f ? aabb.max.z : aabb.min.z,
+			};
+
+			if (glm::dot(glm::vec3(plane), positive) + plane.w < 0.0f)
+				return false;
+		}
+
+		return true;
+	}
+
+	Frustum::Containment Frustum::Classify(const AABB& aabb) const
+	{
+		Containment result = Containment::Inside;
+		for (const glm::vec4& plane : m_Planes)
+		{
+			const glm::vec3 positive{
+				plane.x > 0.0f ? aabb.max.x : aabb.min.x,
+				plane.y > 0.0f ? aabb.max.y : aabb.min.y,
+				plane.z > 0.0f ? aabb.max.z : aabb.min.z,
+			};
+			if (glm::dot(glm::vec3(plane), positive) + plane.w < 0.0f)
+				return Containment::Outside;
+
+			// The corner furthest behind the plane (the "negative vertex") tells whether the box straddles it.
+			const glm::vec3 negative{
+				plane.x > 0.0f ? aabb.min.x : aabb.max.x,
+				plane.y > 0.0f ? aabb.min.y : aabb.max.y,
+				plane.z > 0.0f ? aabb.min.z : aabb.max.z,
+			};
+			if (glm::dot(glm::vec3(plane), negative) + plane.w < 0.0f)
+				result = Containment::Intersecting;
+		}
+
+		return result;
+	}
+
+	bool Frustum::Intersects(const BoundingSphere& sphere) const
+	{
+		for (const glm::vec4& plane : m_Planes)
+		{
+			if (glm::dot(glm::vec3(plane), sphere.center) + plane.w < -sphere.radius)
+				return false;
+		}
+
+		return true;
+	}
+
+	u32 Frustum::Cull(const AABBList& boxes, std::vector<u32>& outVisibleIndices) const
+	{
+		HPR_PROFILE_SCOPE();
+
+		// Per plane, pick the array holding the positive vertex coordinate up front, so the kernel doesn't need to select per box.
+		struct PlaneData
+		{
+			f32 x, y, z, w;
+			const f32* pX;
+			const f32* pY;
+			const f32* pZ;
+		};
+		std::array<PlaneData, Plane::Count> planes{};
+		for (u32 p = 0; p < Plane::Count; p++)
+		{
+			const glm::vec4& plane = m_Planes[p];
+			planes[p] = PlaneData{
+				plane.x, plane.y, plane.z, plane.w,
+				plane.x > 0.0f ? boxes.m_MaxX.data() : boxes.m_MinX.data(),
+				plane.y > 0.0f ? boxes.m_MaxY.data() : boxes.m_MinY.data(),
+				plane.z > 0.0f ? boxes.m_MaxZ.data() : boxes.m_MinZ.data(),
+			};
+		}
+
+		const u32 count = boxes.GetCount();
+		const size_t startSize = outVisibleIndices.size();
+
+		const auto appendVisible = [&](u32 batchStart, u32 mask)
+		{
+			while (mask)
+			{
+				const u32 bit = std::countr_zero(mask);
+				const u32 idx = batchStart + bit;
+				if (idx >= count)
+					break;
+
+				outVisibleIndices.push_back(idx);
+				mask &= mask - 1;
+			}
+		};
+
+#ifdef __AVX__
+		for (u32 i = 0; i < count; i += 8)
+		{
+			__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (const PlaneData& plane : planes)
+			{
+				__m256 dist = _mm256_set1_ps(plane.w);
+				dist = _mm256_add_ps(dist, _mm256_mul_ps(_mm256_set1_ps(plane.x), _mm256_loadu_ps(plane.pX + i)));
+				dist = _mm256_add_ps(dist, _mm256_mul_ps(_mm256_set1_ps(plane.y), _mm256_loadu_ps(plane.pY + i)));
+				dist = _mm256_add_ps(dist, _mm256_mul_ps(_mm256_set1_ps(plane.z), _mm256_loadu_ps(plane.pZ + i)));
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(dist, _mm256_setzero_ps(), _CMP_GE_OQ));
+			}
+
+			appendVisible(i, static_cast<u32>(_mm256_movemask_ps(inside)));
+		}
+#else
+		for (u32 i = 0; i < count; i += 4)
+		{
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (const PlaneData& plane : planes)
+			{
+				__m128 dist = _mm_set1_ps(plane.w);
+				dist = _mm_add_ps(dist, _mm_mul_ps(_mm_set1_ps(plane.x), _mm_loadu_ps(plane.pX + i)));
+				dist = _mm_add_ps(dist, _mm_mul_ps(_mm_set1_ps(plane.y), _mm_loadu_ps(plane.pY + i)));
+				dist = _mm_add_ps(dist, _mm_mul_ps(_mm_set1_ps(plane.z), _mm_loadu_ps(plane.pZ + i)));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(dist, _mm_setzero_ps()));
+			}
+
+			appendVisible(i, static_cast<u32>(_mm_movemask_ps(inside)));
+		}
+#endif
+
+		return static_cast<u32>(outVisibleIndices.size() - startSize);
+	}
+}
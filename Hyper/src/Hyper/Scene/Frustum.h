@@ -0,0 +1,69 @@
+﻿#pragma once
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+#include "Bounds.h"
+
+namespace Hyper
+{
+	// Structure-of-arrays storage for AABBs, so they can be culled several boxes at a time.
+	// The arrays are padded to a multiple of 8, which means the culling kernels never need a scalar tail.
+	class AABBList
+	{
+	public:
+		void Resize(u32 count);
+		void Set(u32 idx, const AABB& aabb);
+
+		[[nodiscard]] u32 GetCount() const { return m_Count; }
+
+	private:
+		friend class Frustum;
+
+		u32 m_Count{};
+		std::vector<f32> m_MinX, m_MinY, m_MinZ;
+		std::vector<f32> m_MaxX, m_MaxY, m_MaxZ;
+	};
+
+	class Frustum
+	{
+	public:
+		enum Plane : u32
+		{
+			Left = 0,
+			Right,
+			Bottom,
+			Top,
+			Near,
+			Far,
+			Count,
+		};
+
+		enum class Containment
+		{
+			Outside,
+			Intersecting,
+			Inside,
+		};
+
+	public:
+		Frustum() = default;
+		// Extracts the world-space frustum planes from a (projection * view) matrix.
+		explicit Frustum(const glm::mat4& viewProjection);
+
+		[[nodiscard]] bool Intersects(const AABB& aabb) const;
+		[[nodiscard]] bool Intersects(const BoundingSphere& sphere) const;
+		// Like Intersects, but also tells whether the box is completely inside, so hierarchies can skip testing their children.
+		[[nodiscard]] Containment Classify(const AABB& aabb) const;
+
+		// Tests all boxes in the list and appends the indices of the ones that are (partially) inside the frustum.
+		// Uses AVX to test 8 boxes at a time when it is available, otherwise SSE to test 4 at a time.
+		// Returns the amount of visible boxes.
+		u32 Cull(const AABBList& boxes, std::vector<u32>& outVisibleIndices) const;
+
+		[[nodiscard]] const std::array<glm::vec4, Plane::Count>& GetPlanes() const { return m_Planes; }
+
+	private:
+		// Planes are stored as (normal, distance), with the normals pointing inwards.
+		std::array<glm::vec4, Plane::Count> m_Planes{};
+	};
+}
@@ -7,10 +7,7 @@
 #include "imgui.h"
 #include "Hyper/Core/Context.h"
 #include "Hyper/Debug/Profiler.h"
-#include "Hyper/Renderer/MaterialLibrary.h"
 #include "Hyper/Renderer/Mesh.h"
-#include "Hyper/Renderer/RenderContext.h"
-#include "Hyper/Renderer/Renderer.h"
 
 namespace Hyper
 {
@@ -19,30 +16,6 @@ namespace Hyper
 	{
 	}
 
-	void Node::Draw(RenderContext* pRenderCtx, const vk::CommandBuffer& cmd, const vk::PipelineLayout& pipelineLayout)
-	{
-		HPR_PROFILE_SCOPE();
-
-		MaterialLibrary* materialLibrary = pRenderCtx->pMaterialLibrary;
-
-		ModelMatrixPushConst pushConst{};
-		pushConst.modelMatrix = m_WorldTransform;
-		cmd.pushConstants<ModelMatrixPushConst>(pipelineLayout, vk::ShaderStageFlagBits::eVertex, 0, pushConst);
-
-		for (const auto& mesh : m_Meshes)
-		{
-			const Material& material = materialLibrary->GetMaterial(mesh->GetMaterialId());
-			material.Bind(cmd, pipelineLayout);
-
-			mesh->Draw(cmd);
-		}
-
-		for (const auto& child : m_pChildren)
-		{
-			child->Draw(pRenderCtx, cmd, pipelineLayout);
-		}
-	}
-
 	void Node::Update(float /*dt*/)
 	{
 		if (m_TransformDirty)
@@ -65,7 +38,63 @@ namespace Hyper
 
 
 		if (isEdited)
-			m_TransformDirty = true;
+			OnTransformEdited();
+
+		if (ImGui::Checkbox("Static", &m_Static))
+			m_StaticChanged = true;
+
+		if (ImGui::CollapsingHeader("Bounds"))
+		{
+			if (m_HierarchyBounds.IsValid())
+			{
+				ImGui::Text("Hierarchy min: %.2f, %.2f, %.2f", m_HierarchyBounds.min.x, m_HierarchyBounds.min.y, m_HierarchyBounds.min.z);
+				ImGui::Text("Hierarchy max: %.2f, %.2f, %.2f", m_HierarchyBounds.max.x, m_HierarchyBounds.max.y, m_HierarchyBounds.max.z);
+				ImGui::Text("Hierarchy sphere radius: %.2f", m_HierarchySphere.radius);
+			}
+			else
+			{
+				ImGui::Text("No geometry in hierarchy");
+			}
+
+			for (u32 i = 0; i < m_MeshWorldBounds.size(); i++)
+			{
+				const AABB& bounds = m_MeshWorldBounds[i];
+				ImGui::Text("Mesh %u: (%.2f, %.2f, %.2f) - (%.2f, %.2f, %.2f)", i,
+					bounds.min.x, bounds.min.y, bounds.min.z, bounds.max.x, bounds.max.y, bounds.max.z);
+			}
+		}
+	}
+
+	void Node::SetTransform(const glm::vec3& position, const glm::vec3& rotation, const glm::vec3& scale)
+	{
+		m_Position = position;
+		m_Rotation = rotation;
+		m_Scale = scale;
+		OnTransformEdited();
+	}
+
+	void Node::SetStatic(bool isStatic)
+	{
+		if (m_Static != isStatic)
+		{
+			m_Static = isStatic;
+			m_StaticChanged = true;
+		}
+	}
+
+	Node* Node::AddChild(std::unique_ptr<Node> pChild)
+	{
+		pChild->m_pParent = this;
+		pChild->m_TransformDirty = true;
+		m_pChildren.push_back(std::move(pChild));
+
+		return m_pChildren.back().get();
+	}
+
+	void Node::AddMesh(std::shared_ptr<Mesh> pMesh)
+	{
+		m_Meshes.push_back(std::move(pMesh));
+		m_TransformDirty = true;
 	}
 
 	void Node::CalculateTransforms(bool calculateChildren)
@@ -80,6 +109,8 @@ namespace Hyper
 			m_WorldTransform = m_pParent->m_WorldTransform * m_LocalTransform;
 		}
 
+		CalculateBounds();
+
 		// Mark all children as dirty as well
 		for (const auto& child : m_pChildren)
 		{
@@ -95,4 +126,47 @@ namespace Hyper
 
 		m_TransformDirty = false;
 	}
+
+	void Node::CalculateBounds()
+	{
+		m_MeshWorldBounds.resize(m_Meshes.size());
+		m_MeshWorldSpheres.resize(m_Meshes.size());
+		m_WorldBounds = AABB{};
+
+		for (u32 i = 0; i < m_Meshes.size(); i++)
+		{
+			m_MeshWorldBounds[i] = m_Meshes[i]->GetLocalBounds().Transformed(m_WorldTransform);
+			m_MeshWorldSpheres[i] = m_Meshes[i]->GetLocalSphere().Transformed(m_WorldTransform);
+			m_WorldBounds.Grow(m_MeshWorldBounds[i]);
+		}
+
+		// Our own bounds changed, so the hierarchy bounds of us and all our ancestors need to be recalculated.
+		for (Node* pNode = this; pNode && !pNode->m_HierarchyBoundsDirty; pNode = pNode->m_pParent)
+		{
+			pNode->m_HierarchyBoundsDirty = true;
+		}
+	}
+
+	void Node::CalculateHierarchyBounds(bool calculateChildren)
+	{
+		m_HierarchyBounds = m_WorldBounds;
+		for (const auto& child : m_pChildren)
+		{
+			if (calculateChildren)
+			{
+				child->CalculateHierarchyBounds(true);
+			}
+
+			m_HierarchyBounds.Grow(child->m_HierarchyBounds);
+		}
+
+		m_HierarchySphere = BoundingSphere::FromAABB(m_HierarchyBounds);
+		m_HierarchyBoundsDirty = false;
+	}
+
+	void Node::OnTransformEdited()
+	{
+		m_TransformDirty = true;
+		SetStatic(false);
+	}
 }
@@ -2,9 +2,10 @@
 #include <glm/vec3.hpp>
 #include <glm/mat4x4.hpp>
 
+#include "Bounds.h"
+
 namespace Hyper
 {
-	struct RenderContext;
 	class Mesh;
 
 	class Node
@@ -12,13 +13,37 @@ namespace Hyper
 	public:
 		Node(const std::string& name);
 		
-		void Draw(RenderContext* pRenderCtx, const vk::CommandBuffer& cmd, const vk::PipelineLayout& pipelineLayout);
 		void Update(float dt);
 
 		void DrawImGui();
 
+		// Moving a static node makes it dynamic, since its meshes may be merged with ones that didn't move.
+		void SetTransform(const glm::vec3& position, const glm::vec3& rotation, const glm::vec3& scale);
+		Node* AddChild(std::unique_ptr<Node> pChild);
+		void AddMesh(std::shared_ptr<Mesh> pMesh);
+
+		// Static nodes aren't expected to move, so their meshes can be merged into a single BLAS. Changing it rebuilds the
+		// acceleration structure.
+		void SetStatic(bool isStatic);
+
+		[[nodiscard]] const std::string& GetName() const { return m_Name; }
+		[[nodiscard]] bool IsStatic() const { return m_Static; }
+		[[nodiscard]] const glm::mat4& GetWorldTransform() const { return m_WorldTransform; }
+
+		// World-space bounds of only this node's own meshes.
+		[[nodiscard]] const AABB& GetWorldBounds() const { return m_WorldBounds; }
+		// World-space bounds of this node's meshes and all of its descendants.
+		[[nodiscard]] const AABB& GetHierarchyBounds() const { return m_HierarchyBounds; }
+		[[nodiscard]] const BoundingSphere& GetHierarchySphere() const { return m_HierarchySphere; }
+
+		[[nodiscard]] const AABB& GetMeshWorldBounds(u32 meshIdx) const { return m_MeshWorldBounds[meshIdx]; }
+		[[nodiscard]] const BoundingSphere& GetMeshWorldSphere(u32 meshIdx) const { return m_MeshWorldSpheres[meshIdx]; }
+
 	private:
 		void CalculateTransforms(bool calculateChildren = false);
+		void CalculateBounds();
+		void CalculateHierarchyBounds(bool calculateChildren = false);
+		void OnTransformEdited();
 
 	private:
 		friend class Scene;
@@ -37,6 +62,16 @@ namespace Hyper
 
 		std::vector<std::shared_ptr<Mesh>> m_Meshes;
 
+		std::vector<AABB> m_MeshWorldBounds;
+		std::vector<BoundingSphere> m_MeshWorldSpheres;
+		AABB m_WorldBounds{};
+		AABB m_HierarchyBounds{};
+		BoundingSphere m_HierarchySphere{};
+
 		bool m_TransformDirty = true;
+		bool m_HierarchyBoundsDirty = true;
+		bool m_Static = false;
+		// Set when the static flag changed, until the scene requested an acceleration structure rebuild for it.
+		bool m_StaticChanged = false;
 	};
 }
@@ -0,0 +1,258 @@
+﻿#include "HyperPCH.h"
+#include "OcclusionCuller.h"
+
+#include <immintrin.h>
+
+#include "Node.h"
+#include "Hyper/Core/JobSystem.h"
+#include "Hyper/Debug/Profiler.h"
+#include "Hyper/Renderer/Mesh.h"
+
+namespace Hyper
+{
+	// Triangles with a vertex closer than this (in view space depth) are skipped instead of clipped.
+	// Skipping an occluder triangle can only make the culling less effective, never wrong.
+	static constexpr f32 s_MinW = 0.001f;
+	// An occludee needs to be behind the occluders by at least this factor, to avoid flat occluders hiding themselves.
+	static constexpr f32 s_DepthBias = 1.001f;
+	// Rows of the depth buffer that one job rasterizes.
+	static constexpr u32 s_BandHeight = 8;
+
+	static_assert(OcclusionCuller::Width % 4 == 0, "Depth buffer rows are processed 4 pixels at a time");
+	static_assert(OcclusionCuller::Height % s_BandHeight == 0, "Depth buffer height must be a multiple of the band height");
+
+	OcclusionCuller::OcclusionCuller(JobSystem* pJobSystem)
+		: m_pJobSystem(pJobSystem)
+	{
+		m_DepthBuffer.resize(Width * Height, 0.0f);
+		m_ThreadTriangles.resize(m_pJobSystem->GetThreadCount());
+	}
+
+	void OcclusionCuller::SetOccluders(std::vector<Occluder> occluders)
+	{
+		m_Occluders = std::move(occluders);
+	}
+
+	void OcclusionCuller::RenderOccluders(const glm::mat4& viewProjection)
+	{
+		HPR_PROFILE_SCOPE();
+
+		m_ViewProjection = viewProjection;
+		std::fill(m_DepthBuffer.begin(), m_DepthBuffer.end(), 0.0f);
+
+		for (auto& triangles : m_ThreadTriangles)
+		{
+			triangles.clear();
+		}
+
+		m_pJobSystem->ParallelFor(static_cast<u32>(m_Occluders.size()), [this](u32 idx, u32 threadIdx)
+		{
+			SetupTriangles(m_Occluders[idx], m_ThreadTriangles[threadIdx]);
+		});
+
+		m_RasterizedTriangleCount = 0;
+		for (const auto& triangles : m_ThreadTriangles)
+		{
+			m_RasterizedTriangleCount += static_cast<u32>(triangles.size());
+		}
+
+		// Every band only touches its own rows of the depth buffer, so they can be rasterized in parallel.
+		m_pJobSystem->ParallelFor(Height / s_BandHeight, [this](u32 band, u32 /*threadIdx*/)
+		{
+			RasterizeBand(band * s_BandHeight, (band + 1) * s_BandHeight);
+		});
+	}
+
+	bool OcclusionCuller::IsOccluded(const AABB& aabb) const
+	{
+		if (!aabb.IsValid())
+			return false;
+
+		f32 minX = std::numeric_limits<f32>::max();
+		f32 minY = std::numeric_limits<f32>::max();
+		f32 maxX = std::numeric_limits<f32>::lowest();
+		f32 maxY = std::numeric_limits<f32>::lowest();
+		f32 minW = std::numeric_limits<f32>::max();
+
+		for (u32 corner = 0; corner < 8; corner++)
+		{
+			const glm::vec4 position{
+				(corner & 1) ? aabb.max.x : aabb.min.x,
+				(corner & 2) ? aabb.max.y : aabb.min.y,
+				(corner & 4) ? aabb.max.z : aabb.min.z,
+				1.0f
+			};
+			const glm::vec4 clip = m_ViewProjection * position;
+
+			// The box crosses the near plane, so the camera might be inside of it.
+			if (clip.w < s_MinW)
+				return false;
+
+			const f32 invW = 1.0f / clip.w;
+			const f32 screenX = (clip.x * invW * 0.5f + 0.5f) * Width;
+			const f32 screenY = (clip.y * invW * 0.5f + 0.5f) * Height;
+			minX = std::min(minX, screenX);
+			maxX = std::max(maxX, screenX);
+			minY = std::min(minY, screenY);
+			maxY = std::max(maxY, screenY);
+			minW = std::min(minW, clip.w);
+		}
+
+		if (maxX < 0.0f || maxY < 0.0f || minX >= static_cast<f32>(Width) || minY >= static_cast<f32>(Height))
+			return false;
+
+		// Start at a multiple of 4 so every row can be tested 4 pixels at a time. Testing a few extra pixels
+		// on the sides only makes the test more conservative.
+		const u32 xBegin = static_cast<u32>(std::clamp(minX, 0.0f, static_cast<f32>(Width - 1))) & ~3u;
+		const u32 xLast = static_cast<u32>(std::clamp(maxX, 0.0f, static_cast<f32>(Width - 1)));
+		const u32 yBegin = static_cast<u32>(std::clamp(minY, 0.0f, static_cast<f32>(Height - 1)));
+		const u32 yLast = static_cast<u32>(std::clamp(maxY, 0.0f, static_cast<f32>(Height - 1)));
+
+		// The closest point of the box, every covered pixel needs an occluder in front of it.
+		const __m128 boxDepth = _mm_set1_ps(s_DepthBias / minW);
+
+		for (u32 y = yBegin; y <= yLast; y++)
+		{
+			const f32* pRow = &m_DepthBuffer[y * Width];
+			for (u32 x = xBegin; x <= xLast; x += 4)
+			{
+				const __m128 depth = _mm_loadu_ps(pRow + x);
+				if (_mm_movemask_ps(_mm_cmple_ps(depth, boxDepth)) != 0)
+					return false;
+			}
+		}
+
+		return true;
+	}
+
+	void OcclusionCuller::SetupTriangles(const Occluder& occluder, std::vector<ScreenTriangle>& outTriangles) const
+	{
+		HPR_PROFILE_SCOPE();
+
+		const glm::mat4 mvp = m_ViewProjection * occluder.pNode->GetWorldTransform();
+		const std::vector<glm::vec3>& positions = occluder.pMesh->GetPositions();
+		const std::vector<u32>& indices = occluder.pMesh->GetIndices();
+
+		std::vector<glm::vec4> clipPositions(positions.size());
+		for (size_t i = 0; i < positions.size(); i++)
+		{
+			clipPositions[i] = mvp * glm::vec4(positions[i], 1.0f);
+		}
+
+		for (size_t i = 0; i + 2 < indices.size(); i += 3)
+		{
+			const glm::vec4& c0 = clipPositions[indices[i + 0]];
+			const glm::vec4& c1 = clipPositions[indices[i + 1]];
+			const glm::vec4& c2 = clipPositions[indices[i + 2]];
+
+			if (c0.w < s_MinW || c1.w < s_MinW || c2.w < s_MinW)
+				continue;
+
+			ScreenTriangle tri{};
+			tri.invW0 = 1.0f / c0.w;
+			tri.invW1 = 1.0f / c1.w;
+			tri.invW2 = 1.0f / c2.w;
+			tri.x0 = (c0.x * tri.invW0 * 0.5f + 0.5f) * Width;
+			tri.y0 = (c0.y * tri.invW0 * 0.5f + 0.5f) * Height;
+			tri.x1 = (c1.x * tri.invW1 * 0.5f + 0.5f) * Width;
+			tri.y1 = (c1.y * tri.invW1 * 0.5f + 0.5f) * Height;
+			tri.x2 = (c2.x * tri.invW2 * 0.5f + 0.5f) * Width;
+			tri.y2 = (c2.y * tri.invW2 * 0.5f + 0.5f) * Height;
+
+			const f32 minX = std::min({ tri.x0, tri.x1, tri.x2 });
+			const f32 maxX = std::max({ tri.x0, tri.x1, tri.x2 });
+			const f32 minY = std::min({ tri.y0, tri.y1, tri.y2 });
+			const f32 maxY = std::max({ tri.y0, tri.y1, tri.y2 });
+			if (maxX < 0.0f || maxY < 0.0f || minX >= static_cast<f32>(Width) || minY >= static_cast<f32>(Height))
+				continue;
+
+			// Occluders are rasterized double sided, so just make the winding consistent.
+			const f32 area = (tri.x1 - tri.x0) * (tri.y2 - tri.y0) - (tri.y1 - tri.y0) * (tri.x2 - tri.x0);
+			if (std::abs(area) < 1e-6f)
+				continue;
+
+			if (area < 0.0f)
+			{
+				std::swap(tri.x1, tri.x2);
+				std::swap(tri.y1, tri.y2);
+				std::swap(tri.invW1, tri.invW2);
+			}
+
+			outTriangles.push_back(tri);
+		}
+	}
+
+	void OcclusionCuller::RasterizeBand(u32 rowBegin, u32 rowEnd)
+	{
+		HPR_PROFILE_SCOPE();
+
+		for (const auto& triangles : m_ThreadTriangles)
+		{
+			for (const ScreenTriangle& tri : triangles)
+			{
+				RasterizeTriangle(tri, rowBegin, rowEnd);
+			}
+		}
+	}
+
+	void OcclusionCuller::RasterizeTriangle(const ScreenTriangle& tri, u32 rowBegin, u32 rowEnd)
+	{
+		const f32 minY = std::min({ tri.y0, tri.y1, tri.y2 });
+		const f32 maxY = std::max({ tri.y0, tri.y1, tri.y2 });
+		if (maxY < static_cast<f32>(rowBegin) || minY >= static_cast<f32>(rowEnd))
+			return;
+
+		const f32 minX = std::min({ tri.x0, tri.x1, tri.x2 });
+		const f32 maxX = std::max({ tri.x0, tri.x1, tri.x2 });
+
+		const u32 yBegin = std::max(rowBegin, static_cast<u32>(std::clamp(minY, 0.0f, static_cast<f32>(Height))));
+		const u32 yEnd = std::min(rowEnd, static_cast<u32>(std::clamp(maxY + 1.0f, 0.0f, static_cast<f32>(Height))));
+		const u32 xBegin = static_cast<u32>(std::clamp(minX, 0.0f, static_cast<f32>(Width - 1))) & ~3u;
+		const u32 xEnd = static_cast<u32>(std::clamp(maxX + 1.0f, 0.0f, static_cast<f32>(Width)));
+
+		// Edge functions in the form E(x, y) = a * x + b * y + c, positive on the inside of the triangle.
+		const f32 a01 = tri.y0 - tri.y1, b01 = tri.x1 - tri.x0, c01 = -(a01 * tri.x0 + b01 * tri.y0);
+		const f32 a12 = tri.y1 - tri.y2, b12 = tri.x2 - tri.x1, c12 = -(a12 * tri.x1 + b12 * tri.y1);
+		const f32 a20 = tri.y2 - tri.y0, b20 = tri.x0 - tri.x2, c20 = -(a20 * tri.x2 + b20 * tri.y2);
+		const f32 invArea = 1.0f / (a01 * tri.x2 + b01 * tri.y2 + c01);
+
+		// 1/w is affine in screen space, so it can be interpolated with the (normalized) edge functions.
+		const __m128 invW0 = _mm_set1_ps(tri.invW0 * invArea);
+		const __m128 invW1 = _mm_set1_ps(tri.invW1 * invArea);
+		const __m128 invW2 = _mm_set1_ps(tri.invW2 * invArea);
+
+		const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+		const __m128 stepE01 = _mm_set1_ps(a01 * 4.0f);
+		const __m128 stepE12 = _mm_set1_ps(a12 * 4.0f);
+		const __m128 stepE20 = _mm_set1_ps(a20 * 4.0f);
+		const __m128 zero = _mm_setzero_ps();
+
+		for (u32 y = yBegin; y < yEnd; y++)
+		{
+			const f32 pixelY = static_cast<f32>(y) + 0.5f;
+			const __m128 pixelX = _mm_add_ps(_mm_set1_ps(static_cast<f32>(xBegin)), laneOffsets);
+
+			__m128 e01 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a01), pixelX), _mm_set1_ps(b01 * pixelY + c01));
+			__m128 e12 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a12), pixelX), _mm_set1_ps(b12 * pixelY + c12));
+			__m128 e20 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a20), pixelX), _mm_set1_ps(b20 * pixelY + c20));
+
+			f32* pRow = &m_DepthBuffer[y * Width];
+			for (u32 x = xBegin; x < xEnd; x += 4)
+			{
+				const __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e01, zero), _mm_cmpge_ps(e12, zero)), _mm_cmpge_ps(e20, zero));
+				if (_mm_movemask_ps(inside) != 0)
+				{
+					// e12 weighs vertex 0, e20 vertex 1 and e01 vertex 2.
+					const __m128 depth = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e12, invW0), _mm_mul_ps(e20, invW1)), _mm_mul_ps(e01, invW2));
+					const __m128 current = _mm_loadu_ps(pRow + x);
+					const __m128 closest = _mm_max_ps(current, depth);
+					_mm_storeu_ps(pRow + x, _mm_or_ps(_mm_and_ps(inside, closest), _mm_andnot_ps(inside, current)));
+				}
+
+				e01 = _mm_add_ps(e01, stepE01);
+				e12 = _mm_add_ps(e12, stepE12);
+				e20 = _mm_add_ps(e20, stepE20);
+			}
+		}
+	}
+}
@@ -0,0 +1,68 @@
+﻿#pragma once
+#include <glm/mat4x4.hpp>
+
+#include "Bounds.h"
+
+namespace Hyper
+{
+	class JobSystem;
+	class Mesh;
+	class Node;
+
+	struct Occluder
+	{
+		const Node* pNode;
+		const Mesh* pMesh;
+	};
+
+	// CPU occlusion culler. A small set of large occluders is rasterized into a low resolution depth buffer,
+	// which mesh bounds are then tested against before any draw commands are recorded.
+	// The buffer stores 1/w per pixel (bigger is closer), since that interpolates linearly in screen space.
+	class OcclusionCuller
+	{
+	public:
+		static constexpr u32 Width = 256;
+		static constexpr u32 Height = 128;
+
+		// Meshes with more triangles than this are never used as an occluder, they'd take too long to rasterize.
+		static constexpr u32 MaxOccluderTriangles = 4096;
+
+	public:
+		explicit OcclusionCuller(JobSystem* pJobSystem);
+
+		void SetOccluders(std::vector<Occluder> occluders);
+
+		// Clears the depth buffer and rasterizes all occluders with the given camera, spread over the job system's threads.
+		void RenderOccluders(const glm::mat4& viewProjection);
+
+		// Returns true if the box is completely hidden behind the occluders rendered in the last RenderOccluders call.
+		[[nodiscard]] bool IsOccluded(const AABB& aabb) const;
+
+		[[nodiscard]] u32 GetOccluderCount() const { return static_cast<u32>(m_Occluders.size()); }
+		[[nodiscard]] u32 GetRasterizedTriangleCount() const { return m_RasterizedTriangleCount; }
+		[[nodiscard]] const std::vector<f32>& GetDepthBuffer() const { return m_DepthBuffer; }
+
+	private:
+		struct ScreenTriangle
+		{
+			f32 x0, y0, x1, y1, x2, y2;
+			f32 invW0, invW1, invW2;
+		};
+
+		void SetupTriangles(const Occluder& occluder, std::vector<ScreenTriangle>& outTriangles) const;
+		void RasterizeBand(u32 rowBegin, u32 rowEnd);
+		void RasterizeTriangle(const ScreenTriangle& tri, u32 rowBegin, u32 rowEnd);
+
+	private:
+		JobSystem* m_pJobSystem;
+
+		std::vector<Occluder> m_Occluders;
+		glm::mat4 m_ViewProjection{ 1.0f };
+
+		// Screen space triangles, one list per thread so the setup doesn't need any synchronization.
+		std::vector<std::vector<ScreenTriangle>> m_ThreadTriangles;
+		u32 m_RasterizedTriangleCount{};
+
+		std::vector<f32> m_DepthBuffer;
+	};
+}
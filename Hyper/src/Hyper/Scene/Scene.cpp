@@ -1,15 +1,26 @@
 ﻿#include "HyperPCH.h"
 #include "Scene.h"
 
+#include <cassert>
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
 #include <assimp/scene.h>
 #include <glm/gtx/matrix_decompose.hpp>
 #include <glm/gtx/quaternion.hpp>
 #include <glm/gtx/transform.hpp>
+#include <glm/gtc/constants.hpp>
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/ext/matrix_transform.hpp>
 
 #include "imgui.h"
+#include "OcclusionCuller.h"
+#include "TestScenes.h"
 #include "Hyper/Core/Context.h"
+#include "Hyper/Core/JobSystem.h"
+#include "Hyper/Core/Window.h"
+#include "Hyper/Debug/Benchmarks.h"
+#include "Hyper/Debug/Profiler.h"
+#include "Hyper/Input/Input.h"
 #include "Hyper/Renderer/MaterialLibrary.h"
 #include "Hyper/Renderer/Mesh.h"
 #include "Hyper/Renderer/RenderContext.h"
@@ -19,6 +30,16 @@
 
 namespace Hyper
 {
+	// Upper limit of occluders that get rasterized every frame.
+	static constexpr u32 s_MaxOccluders = 64;
+
+	// Render queue pass and pipeline of the scene geometry. There's only one of each for now.
+	static constexpr u32 s_GeometryPass = 0;
+	static constexpr u32 s_StaticGeometryPipeline = 0;
+
+	// Degrees per second that mesh nodes turn around their z axis when spinning them is enabled.
+	static constexpr f32 s_SpinSpeed = 45.0f;
+
 	Scene::Scene(Context* pContext)
 		: Subsystem(pContext)
 		, m_pRenderCtx(nullptr)
@@ -68,66 +89,386 @@ namespace Hyper
 			HPR_CORE_LOG_TRACE("  {} ({})", key.C_Str(), type);
 		}
 
-		m_TempMaterialMappings.clear();
-		LoadMaterials(scene, filePath);
+		const auto [it, isNewModel] = m_ImportedModels.try_emplace(filePath.lexically_normal().string());
+		m_pImportingModel = &it->second;
+		if (isNewModel)
+		{
+			LoadMaterials(scene, filePath);
+			m_pImportingModel->meshes.resize(scene->mNumMeshes);
+		}
+		else
+		{
+			HPR_CORE_LOG_INFO("'{}' was imported before, reusing its meshes and materials", filePath.string());
+		}
+
+		std::unique_ptr<Node> pRootNode = LoadNode(scene, scene->mRootNode, filePath.filename().string());
+		m_pImportingModel = nullptr;
+
+		// Placing the model isn't an edit, so unlike SetTransform it keeps the model static.
+		pRootNode->m_Position = pos;
+		pRootNode->m_Rotation = rot;
+		pRootNode->m_Scale = scale;
+		AddRootNode(std::move(pRootNode));
+	}
 
-		m_RootNodes.push_back(LoadNode(scene, scene->mRootNode, filePath.filename().string()));
-		m_RootNodes.back()->m_Position = pos;
-		m_RootNodes.back()->m_Rotation = rot;
-		m_RootNodes.back()->m_Scale = scale;
+	void Scene::AddRootNode(std::unique_ptr<Node> pNode)
+	{
+		m_RootNodes.push_back(std::move(pNode));
 		m_RootNodes.back()->CalculateTransforms(true);
+		m_RootNodes.back()->CalculateHierarchyBounds(true);
+
+		const AABB& bounds = m_RootNodes.back()->GetHierarchyBounds();
+		HPR_CORE_LOG_INFO("Bounds of '{}': ({}, {}, {}) - ({}, {}, {})", m_RootNodes.back()->GetName(),
+			bounds.min.x, bounds.min.y, bounds.min.z, bounds.max.x, bounds.max.y, bounds.max.z);
+
+		RebuildMeshInstances();
 	}
 
 	void Scene::BuildAccelerationStructure()
 	{
-		m_pAcceleration = std::make_unique<VulkanAccelerationStructure>(m_pRenderCtx);
+		HPR_PROFILE_SCOPE();
 
-		std::function<void(Node*)> addNodeToAccel = [&](Node* pNode)
+		auto pAcceleration = std::make_unique<VulkanAccelerationStructure>(m_pRenderCtx, m_pRenderCtx->imagesInFlight);
+		std::vector<const Node*> accelerationNodes;
+
+		// Static meshes are merged per cluster: the topmost static node above them, whose transform the merged instance follows.
+		const auto getStaticCluster = [](const Node* pNode) -> const Node*
 		{
-			// Add node's meshes
-			u32 meshIdx = 0;
-			for (const auto& mesh : pNode->m_Meshes)
+			if (!pNode->m_Static)
+				return nullptr;
+
+			while (pNode->m_pParent && pNode->m_pParent->m_Static)
 			{
-				glm::mat4 transform = pNode->m_LocalTransform;
-				if (pNode->m_pParent)
-				{
-					transform = pNode->m_pParent->m_WorldTransform * transform;
-				}
+				pNode = pNode->m_pParent;
+			}
+			return pNode;
+		};
 
-				std::string debugName = pNode->m_Name;
-				if (pNode->m_Meshes.size() > 1)
-				{
-					debugName = fmt::format("{} ({})", debugName, meshIdx);
-				}
-				m_pAcceleration->AddMesh(mesh.get(), transform, debugName);
+		// Every TLAS instance remembers the node it follows, so UpdateAccelerationStructure can move them by index.
+		const auto addMeshInstance = [&](const MeshInstance& instance)
+		{
+			const Node* pNode = instance.pNode;
+			std::string debugName = pNode->m_Name;
+			if (pNode->m_Meshes.size() > 1)
+			{
+				debugName = fmt::format("{} ({})", debugName, instance.meshIdx);
+			}
+			pAcceleration->AddMesh(instance.pMesh, pNode->GetWorldTransform(), debugName);
+			accelerationNodes.push_back(pNode);
+		};
+
+		std::vector<const Node*> clusters;
+		std::unordered_map<const Node*, std::vector<u32>> clusterInstances;
+		for (u32 i = 0; i < m_MeshInstances.size(); i++)
+		{
+			const MeshInstance& instance = m_MeshInstances[i];
+			const Node* pCluster = m_MergeStaticMeshes ? getStaticCluster(instance.pNode) : nullptr;
+			if (!pCluster)
+			{
+				addMeshInstance(instance);
+				continue;
+			}
+
+			auto [it, inserted] = clusterInstances.try_emplace(pCluster);
+			if (inserted)
+				clusters.push_back(pCluster);
+			it->second.push_back(i);
+		}
+
+		for (const Node* pCluster : clusters)
+		{
+			const std::vector<u32>& instances = clusterInstances[pCluster];
+			if (instances.size() == 1)
+			{
+				// Keeps sharing the mesh's BLAS with its other instances.
+				addMeshInstance(m_MeshInstances[instances[0]]);
+				continue;
+			}
 
-				meshIdx++;
+			// The meshes are pre-transformed into the cluster's space.
+			const glm::mat4 worldToCluster = glm::inverse(pCluster->GetWorldTransform());
+			std::vector<std::pair<const Mesh*, glm::mat4>> meshes;
+			meshes.reserve(instances.size());
+			for (u32 instanceIdx : instances)
+			{
+				const MeshInstance& instance = m_MeshInstances[instanceIdx];
+				meshes.emplace_back(instance.pMesh, worldToCluster * instance.pNode->GetWorldTransform());
 			}
+			pAcceleration->AddMergedMeshes(meshes, pCluster->GetWorldTransform(), fmt::format("{} (merged)", pCluster->m_Name));
+			accelerationNodes.push_back(pCluster);
+		}
+
+		// Nothing can be traced before the first build, so only startup waits for it.
+		if (!m_pAcceleration)
+		{
+			pAcceleration->Build();
+			m_pAcceleration = std::move(pAcceleration);
+			m_AccelerationNodes = std::move(accelerationNodes);
+			m_AccelerationMergesStaticMeshes = m_MergeStaticMeshes;
+			return;
+		}
+
+		pAcceleration->BeginBuild();
+		m_pPendingAcceleration = std::move(pAcceleration);
+		m_PendingAccelerationNodes = std::move(accelerationNodes);
+		m_PendingAccelerationMergesStaticMeshes = m_MergeStaticMeshes;
+	}
+
+	void Scene::UpdatePendingAccelerationStructure()
+	{
+		// A frame that started before the swap is done once the renderer waited for its fence, which it does imagesInFlight frames
+		// later. One more frame keeps this independent of whether the scene ticks before or after the renderer.
+		const u64 frameNumber = m_pRenderCtx->frameNumber;
+		std::erase_if(m_RetiredAccelerations, [&](const RetiredAcceleration& retired)
+			{
+				return frameNumber > retired.frameNumber + m_pRenderCtx->imagesInFlight;
+			});
+
+		if (!m_pPendingAcceleration || !m_pPendingAcceleration->PollBuild())
+			return;
+
+		m_RetiredAccelerations.push_back(RetiredAcceleration{ std::move(m_pAcceleration), frameNumber });
+		m_pAcceleration = std::move(m_pPendingAcceleration);
+		m_AccelerationNodes = std::move(m_PendingAccelerationNodes);
+		m_PendingAccelerationNodes.clear();
+		m_AccelerationMergesStaticMeshes = m_PendingAccelerationMergesStaticMeshes;
+	}
+
+	void Scene::UpdateAccelerationStructure(const vk::CommandBuffer& cmd, u32 frameIdx)
+	{
+		HPR_PROFILE_SCOPE();
+
+		if (!m_pAcceleration)
+			return;
+
+		// Meshes added after the build aren't in the TLAS.
+		for (u32 i = 0; i < m_AccelerationNodes.size(); i++)
+		{
+			m_pAcceleration->SetInstanceTransform(i, m_AccelerationNodes[i]->GetWorldTransform());
+		}
+		m_pAcceleration->UpdateTlas(cmd, frameIdx);
+	}
+
+	AABB Scene::GetSceneBounds() const
+	{
+		AABB bounds{};
+		for (const auto& node : m_RootNodes)
+		{
+			bounds.Grow(node->GetHierarchyBounds());
+		}
+
+		return bounds;
+	}
+
+	void Scene::QueryNodes(const AABB& bounds, std::vector<Node*>& outNodes) const
+	{
+		std::function<void(Node*)> queryNode = [&](Node* pNode)
+		{
+			if (!pNode->m_HierarchyBounds.Overlaps(bounds))
+				return;
+
+			if (pNode->m_WorldBounds.Overlaps(bounds))
+				outNodes.push_back(pNode);
 
-			// Add children
 			for (const auto& child : pNode->m_pChildren)
 			{
-				addNodeToAccel(child.get());
+				queryNode(child.get());
 			}
 		};
 
 		for (const auto& node : m_RootNodes)
 		{
-			addNodeToAccel(node.get());
+			queryNode(node.get());
 		}
+	}
 
-		m_pAcceleration->Build();
+	void Scene::QueryMeshInstances(const AABB& bounds, std::vector<u32>& outInstances) const
+	{
+		m_SpatialIndex.QueryOverlaps(bounds, outInstances);
 	}
 
-	static Node* selectedNode = nullptr;
+	void Scene::QueryNearestMeshInstances(const glm::vec3& point, u32 k, std::vector<u32>& outInstances) const
+	{
+		m_SpatialIndex.QueryNearest(point, k, outInstances);
+	}
 
-	void Scene::Draw(const vk::CommandBuffer& cmd, const vk::PipelineLayout& pipelineLayout) const
+	bool Scene::Raycast(const Ray& ray, f32 maxDistance, PickResult& outResult) const
 	{
-		for (const auto& node : m_RootNodes)
+		HPR_PROFILE_SCOPE();
+
+		// The tree only accepts hits that are closer than the current closest one, so the last triangle hit stored here is the final one.
+		TriangleBVH::Hit closestTriangleHit{};
+		const auto intersectMesh = [&](u32 instanceIdx, const Ray& worldRay, f32 closestDistance) -> f32
 		{
-			node->Draw(m_pRenderCtx, cmd, pipelineLayout);
+			const MeshInstance& instance = m_MeshInstances[instanceIdx];
+
+			// The direction isn't renormalized, so distances along the object-space ray are the same as in world space.
+			const glm::mat4 worldToObject = glm::inverse(instance.pNode->GetWorldTransform());
+			const Ray objectRay{
+				glm::vec3{ worldToObject * glm::vec4{ worldRay.origin, 1.0f } },
+				glm::vec3{ worldToObject * glm::vec4{ worldRay.direction, 0.0f } }
+			};
+
+			TriangleBVH::Hit hit;
+			if (!instance.pMesh->GetTriangleBVH().Intersect(objectRay, closestDistance, hit))
+				return -1.0f;
+
+			closestTriangleHit = hit;
+			return hit.distance;
+		};
+
+		DynamicAABBTree::RayHit hit;
+		if (!m_SpatialIndex.RaycastClosest(ray, maxDistance, hit, intersectMesh))
+			return false;
+
+		const MeshInstance& instance = m_MeshInstances[hit.userData];
+		outResult = PickResult{
+			.pNode = instance.pNode,
+			.meshIdx = instance.meshIdx,
+			.triangleIdx = closestTriangleHit.triangleIdx,
+			.distance = hit.distance,
+			.position = ray.origin + ray.direction * hit.distance,
+		};
+		return true;
+	}
+
+	bool Scene::Pick(const glm::vec2& windowPos, PickResult& outResult) const
+	{
+		const FlyCamera* pCamera = m_pContext->GetSubsystem<Renderer>()->GetCamera();
+		const Window* pWindow = m_pContext->GetSubsystem<Window>();
+		if (pWindow->GetWidth() == 0 || pWindow->GetHeight() == 0)
+			return false;
+
+		// The projection flips y, so NDC y points down just like window coordinates.
+		const glm::vec2 windowSize{ static_cast<f32>(pWindow->GetWidth()), static_cast<f32>(pWindow->GetHeight()) };
+		const glm::vec2 ndc = windowPos / windowSize * 2.0f - 1.0f;
+
+		glm::vec4 farPoint = pCamera->GetViewProjectionInverse() * glm::vec4{ ndc, 1.0f, 1.0f };
+		farPoint /= farPoint.w;
+
+		const glm::vec3 origin{ pCamera->GetViewInverse()[3] };
+		const glm::vec3 toFar = glm::vec3{ farPoint } - origin;
+		const f32 maxDistance = glm::length(toFar);
+		if (maxDistance <= 0.0f)
+			return false;
+
+		return Raycast(Ray{ origin, toFar / maxDistance }, maxDistance, outResult);
+	}
+
+	void Scene::PrepareDraws(const glm::mat4& viewProjection)
+	{
+		HPR_PROFILE_SCOPE();
+
+		CullMeshInstances(viewProjection);
+		BuildDrawBatches(viewProjection);
+		BuildRenderQueue();
+	}
+
+	void Scene::RecordDraws(const vk::CommandBuffer& cmd, u32 firstDraw, u32 drawCount) const
+	{
+		HPR_PROFILE_SCOPE();
+
+		const std::vector<u32>& drawIndices = m_RenderQueue.GetDrawIndices();
+		assert(firstDraw + drawCount <= drawIndices.size());
+
+		for (u32 i = firstDraw; i < firstDraw + drawCount; i++)
+		{
+			const DrawBatch& batch = m_DrawBatches[drawIndices[i]];
+
+			// The vertex shader finds the draw's data through its first instance, see DrawData.
+			batch.pMesh->Draw(cmd, batch.instanceCount, i);
+		}
+	}
+
+	void Scene::RecordIndirectDraws(const vk::CommandBuffer& cmd, const vk::Buffer& indirectBuffer) const
+	{
+		HPR_PROFILE_SCOPE();
+
+		if (m_IndirectCommands.empty())
+			return;
+
+		constexpr u32 stride = sizeof(vk::DrawIndexedIndirectCommand);
+		cmd.drawIndexedIndirect(indirectBuffer, 0, static_cast<u32>(m_IndirectCommands.size()), stride);
+	}
+
+	void Scene::PrepareGpuDraws()
+	{
+		HPR_PROFILE_SCOPE();
+
+		if (!m_GpuDrawsDirty)
+			return;
+
+		const MaterialLibrary* materialLibrary = m_pRenderCtx->pMaterialLibrary;
+
+		// Group the instances per material, keeping hierarchy order within a material.
+		std::vector<std::pair<const Material*, u32>> sortedInstances;
+		sortedInstances.reserve(m_MeshInstances.size());
+		for (u32 i = 0; i < m_MeshInstances.size(); i++)
+		{
+			sortedInstances.emplace_back(&materialLibrary->GetMaterial(m_MeshInstances[i].pMesh->GetMaterialId()), i);
+		}
+		std::stable_sort(sortedInstances.begin(), sortedInstances.end(),
+			[](const auto& a, const auto& b) { return a.first->GetIndex() < b.first->GetIndex(); });
+
+		m_GpuDrawObjects.clear();
+		m_GpuDrawObjects.reserve(sortedInstances.size());
+		m_GpuInstanceData.clear();
+		m_GpuInstanceData.reserve(sortedInstances.size());
+		m_GpuMaterialDrawRanges.clear();
+		for (const auto& [pMaterial, instanceIdx] : sortedInstances)
+		{
+			const u32 objectIdx = static_cast<u32>(m_GpuDrawObjects.size());
+			if (m_GpuMaterialDrawRanges.empty() || m_GpuMaterialDrawRanges.back().pMaterial != pMaterial)
+				m_GpuMaterialDrawRanges.push_back(MaterialDrawRange{ pMaterial, objectIdx, 0 });
+
+			MaterialDrawRange& range = m_GpuMaterialDrawRanges.back();
+			range.drawCount++;
+
+			const MeshInstance& instance = m_MeshInstances[instanceIdx];
+			const AABB& bounds = instance.pNode->GetMeshWorldBounds(instance.meshIdx);
+			const GeometryPool::Allocation& geometry = instance.pMesh->GetGeometry();
+
+			GpuDrawObject& object = m_GpuDrawObjects.emplace_back();
+			object.boundsMin = bounds.min;
+			object.instanceIdx = objectIdx;
+			object.boundsMax = bounds.max;
+			object.materialIndex = pMaterial->GetIndex();
+			object.indexCount = geometry.indexCount;
+			object.firstIndex = geometry.firstIndex;
+			object.vertexOffset = static_cast<i32>(geometry.vertexOffset);
+			object.firstDraw = range.firstDraw;
+			object.rangeIdx = static_cast<u32>(m_GpuMaterialDrawRanges.size()) - 1;
+
+			m_GpuInstanceData.push_back(InstanceData{ instance.pNode->GetWorldTransform() });
 		}
 
+		m_GpuDrawVersion++;
+		m_GpuDrawsDirty = false;
+	}
+
+	void Scene::RecordIndirectCountDraws(const vk::CommandBuffer& cmd, const vk::Buffer& indirectBuffer, const vk::Buffer& countBuffer,
+		u32 drawOffset, u32 countOffset) const
+	{
+		HPR_PROFILE_SCOPE();
+
+		constexpr u32 stride = sizeof(vk::DrawIndexedIndirectCommand);
+		for (u32 rangeIdx = 0; rangeIdx < m_GpuMaterialDrawRanges.size(); rangeIdx++)
+		{
+			const MaterialDrawRange& range = m_GpuMaterialDrawRanges[rangeIdx];
+			// The range's object count is the upper bound, the actual count is what survived culling.
+			cmd.drawIndexedIndirectCount(indirectBuffer, static_cast<vk::DeviceSize>(drawOffset + range.firstDraw) * stride,
+				countBuffer, static_cast<vk::DeviceSize>(countOffset + rangeIdx) * sizeof(u32), range.drawCount, stride);
+		}
+	}
+
+	u32 Scene::CountFrustumVisible(const glm::mat4& viewProjection) const
+	{
+		std::vector<u32> visibleInstances;
+		return Frustum{ viewProjection }.Cull(m_InstanceBounds, visibleInstances);
+	}
+
+	void Scene::DrawImGui()
+	{
 		if (m_pRenderCtx->drawImGui)
 		{
 			if (ImGui::Begin("Scene hierarchy"))
@@ -135,21 +476,37 @@ namespace Hyper
 				static std::function<void(Node*)> drawNode = [&](Node* pNode)
 				{
 					ImGuiTreeNodeFlags flags = ImGuiTreeNodeFlags_OpenOnArrow | ImGuiTreeNodeFlags_OpenOnDoubleClick | ImGuiTreeNodeFlags_SpanAvailWidth;
-					if (selectedNode == pNode)
+					if (m_pSelectedNode == pNode)
 						flags |= ImGuiTreeNodeFlags_Selected;
 
+					if (m_RevealSelectedNode && m_pSelectedNode)
+					{
+						for (const Node* pParent = m_pSelectedNode->m_pParent; pParent; pParent = pParent->m_pParent)
+						{
+							if (pParent == pNode)
+							{
+								ImGui::SetNextItemOpen(true);
+								break;
+							}
+						}
+					}
+
 					if (pNode->m_pChildren.empty())
 					{
 						flags |= ImGuiTreeNodeFlags_Leaf | ImGuiTreeNodeFlags_NoTreePushOnOpen;
 
 						ImGui::TreeNodeEx(pNode->m_Name.c_str(), flags);
 						if (ImGui::IsItemClicked() && !ImGui::IsItemToggledOpen())
-							selectedNode = pNode;
+							m_pSelectedNode = pNode;
+						if (m_RevealSelectedNode && m_pSelectedNode == pNode)
+							ImGui::SetScrollHereY();
 					}
 					else if (ImGui::TreeNodeEx(pNode->m_Name.c_str(), flags))
 					{
 						if (ImGui::IsItemClicked() && !ImGui::IsItemToggledOpen())
-							selectedNode = pNode;
+							m_pSelectedNode = pNode;
+						if (m_RevealSelectedNode && m_pSelectedNode == pNode)
+							ImGui::SetScrollHereY();
 
 						for (const auto& child : pNode->m_pChildren)
 						{
@@ -164,18 +521,26 @@ namespace Hyper
 				{
 					drawNode(node.get());
 				}
+				m_RevealSelectedNode = false;
 			}
 			ImGui::End();
 
 			if (ImGui::Begin("Node inspector"))
 			{
-				if (selectedNode)
+				if (m_HasPickResult)
 				{
-					selectedNode->DrawImGui();
+					ImGui::Text("Last pick: mesh %u, triangle %u at distance %.3f (%.3f ms)", m_LastPickResult.meshIdx,
+						m_LastPickResult.triangleIdx, m_LastPickResult.distance, m_LastPickTimeMs);
+					ImGui::Separator();
+				}
+
+				if (m_pSelectedNode)
+				{
+					m_pSelectedNode->DrawImGui();
 				}
 				else
 				{
-					ImGui::Text("Select a node first");
+					ImGui::Text("Select a node first, in the hierarchy or by clicking on it in the viewport");
 				}
 			}
 			ImGui::End();
@@ -185,6 +550,71 @@ namespace Hyper
 				ImGui::SliderFloat3("Sun direction", (float*)&m_LightingSettings.sunDir, -1.0f, 1.0f);
 			}
 			ImGui::End();
+
+			if (ImGui::Begin("Culling"))
+			{
+				ImGui::Checkbox("Frustum culling", &m_EnableFrustumCulling);
+				ImGui::Checkbox("Use spatial index", &m_UseSpatialIndex);
+				ImGui::Checkbox("Occlusion culling", &m_EnableOcclusionCulling);
+				ImGui::Text("Visible: %u / %u", m_CullingStats.visibleCount, static_cast<u32>(m_MeshInstances.size()));
+				ImGui::Text("Frustum culled: %u", m_CullingStats.frustumCulledCount);
+				ImGui::Text("Occlusion culled: %u", m_CullingStats.occlusionCulledCount);
+				ImGui::Text("CPU time: %.3f ms", m_CullingStats.cullTimeMs);
+				ImGui::Text("  occluder raster: %.3f ms (%u occluders, %u triangles)", m_CullingStats.occlusionRasterTimeMs,
+					m_pOcclusionCuller->GetOccluderCount(), m_pOcclusionCuller->GetRasterizedTriangleCount());
+				ImGui::Text("  occlusion tests: %.3f ms", m_CullingStats.occlusionTestTimeMs);
+
+				ImGui::Separator();
+				ImGui::Checkbox("GPU instancing", &m_EnableInstancing);
+				ImGui::Text("Draws: %u (%u instances)", m_DrawStats.drawCount, m_DrawStats.instanceCount);
+				ImGui::Checkbox("Sort draws", &m_EnableDrawSorting);
+				ImGui::Text("Material switches: %u (%u unsorted)", m_DrawStats.materialSwitchCount, m_DrawStats.unsortedMaterialSwitchCount);
+				ImGui::Text("CPU time: %.3f ms batching, %.3f ms sorting", m_DrawStats.batchTimeMs, m_DrawStats.sortTimeMs);
+				if (ImGui::Button("Run render queue benchmark"))
+					m_RunRenderQueueBenchmark = true;
+
+				ImGui::Separator();
+				ImGui::Text("Spatial index: %u proxies, height %u, area ratio %.1f", m_SpatialIndex.GetProxyCount(),
+					m_SpatialIndex.GetHeight(), m_SpatialIndex.GetAreaRatio());
+				ImGui::Text("  reinserted last update: %u", m_SpatialIndexReinsertCount);
+				if (ImGui::Button("Run spatial index benchmark"))
+					m_RunSpatialIndexBenchmark = true;
+
+				ImGui::Separator();
+				if (ImGui::Button("Run culling benchmark"))
+					m_RunCullingBenchmark = true;
+
+				if (m_BenchmarkTotalDraws > 0)
+				{
+					ImGui::Text("Average over the benchmark views (%u draws per view):", m_BenchmarkTotalDraws);
+					ImGui::Text("  frustum culled: %u, occlusion culled: %u, drawn: %u", m_BenchmarkStats.frustumCulledCount,
+						m_BenchmarkStats.occlusionCulledCount, m_BenchmarkStats.visibleCount);
+					ImGui::Text("  CPU time: %.3f ms (raster %.3f ms, tests %.3f ms)", m_BenchmarkStats.cullTimeMs,
+						m_BenchmarkStats.occlusionRasterTimeMs, m_BenchmarkStats.occlusionTestTimeMs);
+				}
+			}
+			ImGui::End();
+
+			if (m_pAcceleration)
+			{
+				m_pAcceleration->DrawImGui();
+
+				// Appends to the window of the acceleration structure.
+				if (ImGui::Begin("Acceleration structures"))
+				{
+					ImGui::Checkbox("Spin mesh nodes", &m_SpinMeshNodes);
+					if (ImGui::Checkbox("Merge static meshes", &m_MergeStaticMeshes))
+						m_RebuildAcceleration = true;
+					if (ImGui::Button("Rebuild"))
+						m_RebuildAcceleration = true;
+					if (m_pPendingAcceleration)
+					{
+						ImGui::SameLine();
+						ImGui::Text("Building in the background...");
+					}
+				}
+				ImGui::End();
+			}
 		}
 	}
 
@@ -197,7 +627,11 @@ namespace Hyper
 			.sunDir = { 0.2f, 0.1f, 0.7f }
 		};
 
+		m_pOcclusionCuller = std::make_unique<OcclusionCuller>(m_pContext->GetSubsystem<JobSystem>());
+
 		ImportModel("res/models/Sponza/Sponza.gltf", glm::vec3{ 0.0f }, glm::vec3{ 90.0f, 0.0f, 0.0f }, glm::vec3{ 0.01f });
+		// To load a procedural test scene instead, swap the line above for one of the functions in TestScenes.h, e.g.
+		// TestScenes::CreateOcclusionScene(this);
 
 		BuildAccelerationStructure();
 
@@ -209,26 +643,109 @@ namespace Hyper
 		// Wait till the renderer is done processing all render commands.
 		m_pContext->GetSubsystem<Renderer>()->WaitIdle();
 
+		m_pPendingAcceleration.reset();
+		m_PendingAccelerationNodes.clear();
+		m_RetiredAccelerations.clear();
 		m_pAcceleration.reset();
+		m_AccelerationNodes.clear();
+		m_pOcclusionCuller.reset();
+		m_pSelectedNode = nullptr;
+		m_HasPickResult = false;
+		m_MeshInstances.clear();
+		m_VisibleInstances.clear();
+		m_SpatialIndex.Clear();
+		m_DrawBatches.clear();
+		m_DrawBatchLookup.clear();
+		m_GpuDrawObjects.clear();
+		m_GpuInstanceData.clear();
+		m_GpuMaterialDrawRanges.clear();
 		m_RootNodes.clear();
+		m_ImportedModels.clear();
 	}
 
 	void Scene::OnTick(f32 dt)
 	{
+		// Rebuilds run on the compute queue while the frames keep tracing the current TLAS. A rebuild that's requested while
+		// another one is still building starts once that one is swapped in.
+		UpdatePendingAccelerationStructure();
+		if (m_RebuildAcceleration && !m_pPendingAcceleration)
+		{
+			BuildAccelerationStructure();
+			m_RebuildAcceleration = false;
+		}
+
+		if (m_SpinMeshNodes)
+		{
+			// Moves every dynamic mesh instance, to measure the TLAS update of the whole scene.
+			std::function<void(Node*)> spinNode = [&](Node* pNode)
+			{
+				if (!pNode->m_Meshes.empty() && !pNode->m_Static)
+				{
+					pNode->m_Rotation.z += s_SpinSpeed * dt;
+					pNode->m_TransformDirty = true;
+				}
+
+				for (const auto& pChild : pNode->m_pChildren)
+				{
+					spinNode(pChild.get());
+				}
+			};
+
+			for (const auto& node : m_RootNodes)
+			{
+				spinNode(node.get());
+			}
+		}
+
 		std::function<void(Node*)> updateNode = [&](Node* pNode)
 		{
 			pNode->Update(dt);
 
+			// Merged static meshes only follow their cluster's node, so the clusters are rebuilt when a node joins or leaves one.
+			if (pNode->m_StaticChanged)
+			{
+				pNode->m_StaticChanged = false;
+				m_RebuildAcceleration = true;
+			}
+
 			for (const auto& pChild : pNode->m_pChildren)
 			{
 				updateNode(pChild.get());
 			}
+
+			// Children are updated first, so their hierarchy bounds are already up to date here.
+			if (pNode->m_HierarchyBoundsDirty)
+			{
+				pNode->CalculateHierarchyBounds();
+				m_GpuDrawsDirty = true;
+			}
 		};
 
 		for (const auto& node : m_RootNodes)
 		{
 			updateNode(node.get());
 		}
+
+		UpdateInstanceBounds();
+		UpdatePicking();
+
+		if (m_RunCullingBenchmark)
+		{
+			RunCullingBenchmark();
+			m_RunCullingBenchmark = false;
+		}
+
+		if (m_RunSpatialIndexBenchmark)
+		{
+			Benchmarks::RunSpatialIndexBenchmark();
+			m_RunSpatialIndexBenchmark = false;
+		}
+
+		if (m_RunRenderQueueBenchmark)
+		{
+			Benchmarks::RunRenderQueueBenchmark();
+			m_RunRenderQueueBenchmark = false;
+		}
 	}
 
 	static u64 nodeId = 0;
@@ -242,6 +759,8 @@ namespace Hyper
 		}
 		std::unique_ptr<Node> node = std::make_unique<Node>(nodeName);
 		node->m_Id = ++nodeId;
+		// Imported models are level geometry, which stays where it was placed.
+		node->m_Static = true;
 
 		auto t = pNode->mTransformation;
 		glm::mat4 transform = glm::mat4{
@@ -281,7 +800,14 @@ namespace Hyper
 
 			const u32 meshId = pNode->mMeshes[m];
 			const auto aiMesh = pScene->mMeshes[meshId];
-			const UUID materialId = m_TempMaterialMappings[aiMesh->mMaterialIndex];
+			std::shared_ptr<Mesh>& pMesh = m_pImportingModel->meshes[meshId];
+			if (pMesh)
+			{
+				node->m_Meshes.push_back(pMesh);
+				continue;
+			}
+
+			const UUID materialId = m_pImportingModel->materialIds[aiMesh->mMaterialIndex];
 
 			// Load vertices
 			for (u32 v = 0; v < aiMesh->mNumVertices; v++)
@@ -320,7 +846,8 @@ namespace Hyper
 				}
 			}
 
-			node->m_Meshes.push_back(std::make_shared<Mesh>(m_pRenderCtx, materialId, vertices, indices, aiMesh->mNumFaces));
+			pMesh = std::make_shared<Mesh>(m_pRenderCtx, materialId, vertices, indices, aiMesh->mNumFaces);
+			node->m_Meshes.push_back(pMesh);
 		}
 
 		for (u32 c = 0; c < pNode->mNumChildren; c++)
@@ -337,7 +864,7 @@ namespace Hyper
 	{
 		MaterialLibrary* materialLibrary = m_pRenderCtx->pMaterialLibrary;
 
-		m_TempMaterialMappings.resize(pScene->mNumMaterials);
+		m_pImportingModel->materialIds.resize(pScene->mNumMaterials);
 
 		for (u32 m = 0; m < pScene->mNumMaterials; m++)
 		{
@@ -390,7 +917,7 @@ namespace Hyper
 			}
 
 			Material& material = materialLibrary->CreateMaterial(materialName);
-			m_TempMaterialMappings[m] = material.GetId();
+			m_pImportingModel->materialIds[m] = material.GetId();
 			HPR_CORE_LOG_INFO("Created material with id '{}'", material.GetId());
 
 			if (AI_SUCCESS == pMat->GetTexture(aiTextureType_DIFFUSE, 0, &texturePath))
@@ -416,4 +943,362 @@ namespace Hyper
 			material.PostLoadInititalize();
 		}
 	}
+
+	void Scene::RebuildMeshInstances()
+	{
+		m_MeshInstances.clear();
+		m_SpatialIndex.Clear();
+
+		std::function<void(Node*)> addNode = [&](Node* pNode)
+		{
+			for (u32 m = 0; m < pNode->m_Meshes.size(); m++)
+			{
+				const u32 instanceIdx = static_cast<u32>(m_MeshInstances.size());
+				const i32 proxyId = m_SpatialIndex.CreateProxy(pNode->GetMeshWorldBounds(m), instanceIdx);
+				m_MeshInstances.push_back(MeshInstance{ pNode, pNode->m_Meshes[m].get(), m, proxyId });
+			}
+
+			for (const auto& child : pNode->m_pChildren)
+			{
+				addNode(child.get());
+			}
+		};
+
+		for (const auto& node : m_RootNodes)
+		{
+			addNode(node.get());
+		}
+
+		m_InstanceBounds.Resize(static_cast<u32>(m_MeshInstances.size()));
+		UpdateInstanceBounds();
+		m_GpuDrawsDirty = true;
+
+		SelectOccluders();
+	}
+
+	void Scene::SelectOccluders()
+	{
+		HPR_PROFILE_SCOPE();
+
+		// Rank the meshes by their world space area. Big, simple meshes like walls and floors hide the most for the least triangles.
+		std::vector<std::pair<f32, Occluder>> candidates;
+		for (const MeshInstance& instance : m_MeshInstances)
+		{
+			const Mesh* pMesh = instance.pMesh;
+			if (pMesh->GetTriCount() == 0 || pMesh->GetTriCount() > OcclusionCuller::MaxOccluderTriangles)
+				continue;
+
+			const glm::mat3 transform{ instance.pNode->GetWorldTransform() };
+			const std::vector<glm::vec3>& positions = pMesh->GetPositions();
+			const std::vector<u32>& indices = pMesh->GetIndices();
+
+			f32 area = 0.0f;
+			for (size_t i = 0; i + 2 < indices.size(); i += 3)
+			{
+				const glm::vec3 p0 = transform * positions[indices[i + 0]];
+				const glm::vec3 p1 = transform * positions[indices[i + 1]];
+				const glm::vec3 p2 = transform * positions[indices[i + 2]];
+				area += 0.5f * glm::length(glm::cross(p1 - p0, p2 - p0));
+			}
+
+			candidates.emplace_back(area, Occluder{ instance.pNode, pMesh });
+		}
+
+		const size_t occluderCount = std::min(candidates.size(), static_cast<size_t>(s_MaxOccluders));
+		std::partial_sort(candidates.begin(), candidates.begin() + occluderCount, candidates.end(),
+			[](const auto& a, const auto& b) { return a.first > b.first; });
+
+		std::vector<Occluder> occluders;
+		occluders.reserve(occluderCount);
+		for (size_t i = 0; i < occluderCount; i++)
+		{
+			occluders.push_back(candidates[i].second);
+		}
+
+		HPR_CORE_LOG_INFO("Selected {} occluders out of {} candidates", occluders.size(), candidates.size());
+		m_pOcclusionCuller->SetOccluders(std::move(occluders));
+	}
+
+	void Scene::UpdateInstanceBounds()
+	{
+		HPR_PROFILE_SCOPE();
+
+		// Instances that stay within their fat bounds don't touch the tree, so static scenes only pay for the containment tests.
+		m_SpatialIndexReinsertCount = 0;
+		for (u32 i = 0; i < m_MeshInstances.size(); i++)
+		{
+			const MeshInstance& instance = m_MeshInstances[i];
+			const AABB& bounds = instance.pNode->GetMeshWorldBounds(instance.meshIdx);
+			m_InstanceBounds.Set(i, bounds);
+			if (m_SpatialIndex.MoveProxy(instance.proxyId, bounds))
+				m_SpatialIndexReinsertCount++;
+		}
+	}
+
+	void Scene::CullMeshInstances(const glm::mat4& viewProjection)
+	{
+		HPR_PROFILE_SCOPE();
+
+		using Clock = std::chrono::high_resolution_clock;
+		const auto toMs = [](Clock::duration duration) { return std::chrono::duration<f32, std::milli>(duration).count(); };
+
+		const auto startTime = Clock::now();
+
+		m_VisibleInstances.clear();
+		if (m_EnableFrustumCulling)
+		{
+			const Frustum frustum{ viewProjection };
+			if (m_UseSpatialIndex)
+			{
+				m_SpatialIndex.QueryFrustum(frustum, m_VisibleInstances);
+				// Keep hierarchy order, so the draw batches come out the same as without the spatial index.
+				std::sort(m_VisibleInstances.begin(), m_VisibleInstances.end());
+			}
+			else
+			{
+				frustum.Cull(m_InstanceBounds, m_VisibleInstances);
+			}
+		}
+		else
+		{
+			for (u32 i = 0; i < m_MeshInstances.size(); i++)
+			{
+				m_VisibleInstances.push_back(i);
+			}
+		}
+		const u32 frustumVisibleCount = static_cast<u32>(m_VisibleInstances.size());
+
+		const auto rasterStartTime = Clock::now();
+		auto testStartTime = rasterStartTime;
+		if (m_EnableOcclusionCulling && m_pOcclusionCuller->GetOccluderCount() > 0)
+		{
+			m_pOcclusionCuller->RenderOccluders(viewProjection);
+			testStartTime = Clock::now();
+
+			std::erase_if(m_VisibleInstances, [this](u32 instanceIdx)
+			{
+				const MeshInstance& instance = m_MeshInstances[instanceIdx];
+				return m_pOcclusionCuller->IsOccluded(instance.pNode->GetMeshWorldBounds(instance.meshIdx));
+			});
+		}
+
+		const auto endTime = Clock::now();
+
+		m_CullingStats.visibleCount = static_cast<u32>(m_VisibleInstances.size());
+		m_CullingStats.frustumCulledCount = static_cast<u32>(m_MeshInstances.size()) - frustumVisibleCount;
+		m_CullingStats.occlusionCulledCount = frustumVisibleCount - m_CullingStats.visibleCount;
+		m_CullingStats.cullTimeMs = toMs(endTime - startTime);
+		m_CullingStats.occlusionRasterTimeMs = toMs(testStartTime - rasterStartTime);
+		m_CullingStats.occlusionTestTimeMs = toMs(endTime - testStartTime);
+	}
+
+	void Scene::BuildDrawBatches(const glm::mat4& viewProjection)
+	{
+		HPR_PROFILE_SCOPE();
+
+		using Clock = std::chrono::high_resolution_clock;
+		const auto startTime = Clock::now();
+
+		m_DrawBatches.clear();
+		m_InstanceData.resize(m_VisibleInstances.size());
+
+		// The w row of the view-projection gives the depth along the view direction.
+		const glm::vec4 depthRow{ viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3] };
+		const auto getViewDepth = [&](const MeshInstance& instance)
+		{
+			return glm::dot(depthRow, glm::vec4{ instance.pNode->GetMeshWorldBounds(instance.meshIdx).GetCenter(), 1.0f });
+		};
+
+		if (m_EnableInstancing)
+		{
+			// Count the visible occurrences of every mesh, in order of first appearance.
+			m_DrawBatchLookup.clear();
+			for (const u32 instanceIdx : m_VisibleInstances)
+			{
+				const Mesh* pMesh = m_MeshInstances[instanceIdx].pMesh;
+				const auto [it, isNewBatch] = m_DrawBatchLookup.try_emplace(pMesh, static_cast<u32>(m_DrawBatches.size()));
+				if (isNewBatch)
+					m_DrawBatches.push_back(DrawBatch{ m_MeshInstances[instanceIdx].pMesh, 0, 0, std::numeric_limits<f32>::max() });
+
+				DrawBatch& batch = m_DrawBatches[it->second];
+				batch.instanceCount++;
+				batch.viewDepth = std::min(batch.viewDepth, getViewDepth(m_MeshInstances[instanceIdx]));
+			}
+
+			// Give every batch its own range in the instance buffer, and fill it.
+			u32 firstInstance = 0;
+			for (DrawBatch& batch : m_DrawBatches)
+			{
+				batch.firstInstance = firstInstance;
+				firstInstance += batch.instanceCount;
+				batch.instanceCount = 0;
+			}
+
+			for (const u32 instanceIdx : m_VisibleInstances)
+			{
+				const MeshInstance& instance = m_MeshInstances[instanceIdx];
+				DrawBatch& batch = m_DrawBatches[m_DrawBatchLookup[instance.pMesh]];
+				m_InstanceData[batch.firstInstance + batch.instanceCount] = InstanceData{ instance.pNode->GetWorldTransform() };
+				batch.instanceCount++;
+			}
+		}
+		else
+		{
+			for (u32 i = 0; i < m_VisibleInstances.size(); i++)
+			{
+				const MeshInstance& instance = m_MeshInstances[m_VisibleInstances[i]];
+				m_DrawBatches.push_back(DrawBatch{ instance.pMesh, i, 1, getViewDepth(instance) });
+				m_InstanceData[i] = InstanceData{ instance.pNode->GetWorldTransform() };
+			}
+		}
+
+		m_DrawStats.batchTimeMs = std::chrono::duration<f32, std::milli>(Clock::now() - startTime).count();
+	}
+
+	void Scene::BuildRenderQueue()
+	{
+		HPR_PROFILE_SCOPE();
+
+		const MaterialLibrary* materialLibrary = m_pRenderCtx->pMaterialLibrary;
+
+		m_RenderQueue.Clear();
+		m_RenderQueue.Reserve(static_cast<u32>(m_DrawBatches.size()));
+
+		u32 lastMaterialIdx = std::numeric_limits<u32>::max();
+		m_DrawStats.unsortedMaterialSwitchCount = 0;
+		for (u32 i = 0; i < m_DrawBatches.size(); i++)
+		{
+			const DrawBatch& batch = m_DrawBatches[i];
+			const u32 materialIdx = materialLibrary->GetMaterial(batch.pMesh->GetMaterialId()).GetIndex();
+			m_RenderQueue.Add(RenderQueue::MakeKey(s_GeometryPass, s_StaticGeometryPipeline, materialIdx, batch.viewDepth), i);
+
+			if (materialIdx != lastMaterialIdx)
+			{
+				m_DrawStats.unsortedMaterialSwitchCount++;
+				lastMaterialIdx = materialIdx;
+			}
+		}
+
+		using Clock = std::chrono::high_resolution_clock;
+		const auto startTime = Clock::now();
+
+		if (m_EnableDrawSorting)
+			m_RenderQueue.Sort();
+
+		m_DrawStats.sortTimeMs = std::chrono::duration<f32, std::milli>(Clock::now() - startTime).count();
+
+		// Lay out the draws in their recorded order, both as draw data for the vertex shader and as indirect commands.
+		// Materials are bindless, so switching between them costs nothing on the CPU, but sorted draws still read their
+		// textures more coherently.
+		const u32 drawCount = m_RenderQueue.GetCount();
+		m_DrawData.clear();
+		m_DrawData.reserve(drawCount);
+		m_IndirectCommands.clear();
+		m_IndirectCommands.reserve(drawCount);
+		lastMaterialIdx = std::numeric_limits<u32>::max();
+		m_DrawStats.materialSwitchCount = 0;
+		for (const u32 batchIdx : m_RenderQueue.GetDrawIndices())
+		{
+			const DrawBatch& batch = m_DrawBatches[batchIdx];
+			const u32 materialIdx = materialLibrary->GetMaterial(batch.pMesh->GetMaterialId()).GetIndex();
+
+			const u32 drawIdx = static_cast<u32>(m_DrawData.size());
+			m_DrawData.push_back(DrawData{ batch.firstInstance, materialIdx });
+			m_IndirectCommands.push_back(batch.pMesh->GetIndirectCommand(batch.instanceCount, drawIdx));
+
+			if (materialIdx != lastMaterialIdx)
+			{
+				m_DrawStats.materialSwitchCount++;
+				lastMaterialIdx = materialIdx;
+			}
+		}
+
+		m_DrawStats.drawCount = drawCount;
+		m_DrawStats.instanceCount = static_cast<u32>(m_InstanceData.size());
+	}
+
+	void Scene::RunCullingBenchmark()
+	{
+		HPR_PROFILE_SCOPE();
+
+		// Fly a fixed circle through the scene at a quarter of its height, looking at the center.
+		// The views only depend on the scene bounds, so runs on the same scene are directly comparable.
+		static constexpr u32 viewCount = 128;
+
+		const AABB bounds = GetSceneBounds();
+		if (!bounds.IsValid())
+			return;
+
+		const glm::vec3 center = bounds.GetCenter();
+		const glm::vec3 extents = bounds.GetExtents();
+		const f32 eyeHeight = bounds.min.z + extents.z * 0.5f;
+		const f32 farPlane = std::max(100.0f, glm::length(extents) * 2.0f);
+
+		glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.01f, farPlane);
+		projection[1][1] *= -1;
+
+		const CullingStats previousStats = m_CullingStats;
+		CullingStats total{};
+		for (u32 i = 0; i < viewCount; i++)
+		{
+			const f32 angle = glm::two_pi<f32>() * static_cast<f32>(i) / static_cast<f32>(viewCount);
+			const glm::vec3 eye{ center.x + std::cos(angle) * extents.x * 0.7f, center.y + std::sin(angle) * extents.y * 0.7f, eyeHeight };
+			const glm::vec3 target{ center.x, center.y, eyeHeight };
+			const glm::mat4 view = glm::lookAtRH(eye, target, glm::vec3{ 0.0f, 0.0f, 1.0f });
+
+			CullMeshInstances(projection * view);
+
+			total.visibleCount += m_CullingStats.visibleCount;
+			total.frustumCulledCount += m_CullingStats.frustumCulledCount;
+			total.occlusionCulledCount += m_CullingStats.occlusionCulledCount;
+			total.cullTimeMs += m_CullingStats.cullTimeMs;
+			total.occlusionRasterTimeMs += m_CullingStats.occlusionRasterTimeMs;
+			total.occlusionTestTimeMs += m_CullingStats.occlusionTestTimeMs;
+		}
+		m_CullingStats = previousStats;
+
+		m_BenchmarkTotalDraws = static_cast<u32>(m_MeshInstances.size());
+		m_BenchmarkStats = CullingStats{
+			.visibleCount = total.visibleCount / viewCount,
+			.frustumCulledCount = total.frustumCulledCount / viewCount,
+			.occlusionCulledCount = total.occlusionCulledCount / viewCount,
+			.cullTimeMs = total.cullTimeMs / viewCount,
+			.occlusionRasterTimeMs = total.occlusionRasterTimeMs / viewCount,
+			.occlusionTestTimeMs = total.occlusionTestTimeMs / viewCount,
+		};
+
+		HPR_CORE_LOG_INFO("Culling benchmark ({} views, {} draws, frustum culling {}, occlusion culling {}):", viewCount, m_BenchmarkTotalDraws,
+			m_EnableFrustumCulling ? "on" : "off", m_EnableOcclusionCulling ? "on" : "off");
+		HPR_CORE_LOG_INFO("  frustum culled {}, occlusion culled {}, drawn {}", m_BenchmarkStats.frustumCulledCount,
+			m_BenchmarkStats.occlusionCulledCount, m_BenchmarkStats.visibleCount);
+		HPR_CORE_LOG_INFO("  {:.3f} ms per view (occluder raster {:.3f} ms, occlusion tests {:.3f} ms)", m_BenchmarkStats.cullTimeMs,
+			m_BenchmarkStats.occlusionRasterTimeMs, m_BenchmarkStats.occlusionTestTimeMs);
+	}
+
+	void Scene::UpdatePicking()
+	{
+		// Left click picks, right click is used by the camera. Clicks on ImGui windows are left to ImGui.
+		const bool isPickButtonDown = m_pContext->GetSubsystem<Input>()->GetMouseButton(MouseButton::Left);
+		const bool isClicked = isPickButtonDown && !m_WasPickButtonDown;
+		m_WasPickButtonDown = isPickButtonDown;
+
+		if (!isClicked || ImGui::GetIO().WantCaptureMouse)
+			return;
+
+		using Clock = std::chrono::high_resolution_clock;
+		const auto startTime = Clock::now();
+
+		PickResult result;
+		const bool hasHit = Pick(m_pContext->GetSubsystem<Input>()->GetMousePos(), result);
+
+		m_LastPickTimeMs = std::chrono::duration<f32, std::milli>(Clock::now() - startTime).count();
+		m_HasPickResult = hasHit;
+		if (!hasHit)
+			return;
+
+		m_LastPickResult = result;
+		m_pSelectedNode = result.pNode;
+		m_RevealSelectedNode = true;
+		HPR_CORE_LOG_INFO("Picked '{}' (mesh {}, triangle {}) in {:.3f} ms", result.pNode->GetName(), result.meshIdx, result.triangleIdx, m_LastPickTimeMs);
+	}
 }
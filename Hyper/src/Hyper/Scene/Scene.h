@@ -1,8 +1,12 @@
 ﻿#pragma once
+#include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 
+#include "DynamicAABBTree.h"
+#include "Frustum.h"
 #include "Node.h"
 #include "Hyper/Core/Subsystem.h"
+#include "Hyper/Renderer/RenderQueue.h"
 #include "Hyper/Renderer/Vulkan/VulkanBuffer.h"
 
 struct aiScene;
@@ -11,13 +15,107 @@ struct aiNode;
 namespace Hyper
 {
 	class VulkanAccelerationStructure;
+	class Material;
 	class Model;
+	class OcclusionCuller;
 
 	struct LightingSettings
 	{
 		glm::vec3 sunDir;
 	};
 
+	// Per-instance data read by the geometry pass vertex shader, matches InstanceData in StaticGeometry.vert.hlsl.
+	struct InstanceData
+	{
+		glm::mat4 modelMatrix;
+	};
+
+	// Per-draw data read by the geometry pass vertex shader, matches DrawData in StaticGeometry.vert.hlsl.
+	// Every draw passes its index into the draw data buffer as its first instance, which the shader reads as BaseInstance.
+	struct DrawData
+	{
+		// Where the instances of the draw start in the instance buffer.
+		u32 firstInstance;
+		u32 materialIndex;
+	};
+
+	// Mesh instance as read by the GPU culling pass, matches DrawObject in DrawCulling.comp.hlsl.
+	struct GpuDrawObject
+	{
+		// World-space bounds.
+		glm::vec3 boundsMin;
+		u32 instanceIdx;
+		glm::vec3 boundsMax;
+		u32 materialIndex;
+		u32 indexCount;
+		u32 firstIndex;
+		i32 vertexOffset;
+		// First slot of the object's material range in the output buffers of the culling pass.
+		u32 firstDraw;
+		u32 rangeIdx;
+		u32 padding[3];
+	};
+
+	// Consecutive GPU culled objects that use the same material, whose surviving draws are recorded as a single indirect count draw.
+	struct MaterialDrawRange
+	{
+		const Material* pMaterial;
+		u32 firstDraw;
+		u32 drawCount;
+	};
+
+	// All visible occurrences of a mesh, drawn with a single instanced draw.
+	struct DrawBatch
+	{
+		Mesh* pMesh;
+		u32 firstInstance;
+		u32 instanceCount;
+		// View depth of the closest instance, used to sort the batches front to back.
+		f32 viewDepth;
+	};
+
+	// Flattened reference to a single mesh in the node hierarchy, so the renderer can work on a plain list.
+	struct MeshInstance
+	{
+		Node* pNode;
+		Mesh* pMesh;
+		u32 meshIdx;
+		// Proxy of the instance in the scene's spatial index.
+		i32 proxyId;
+	};
+
+	struct PickResult
+	{
+		Node* pNode;
+		u32 meshIdx;
+		// Triangle within the mesh, as an index into its index buffer divided by 3.
+		u32 triangleIdx;
+		f32 distance;
+		glm::vec3 position;
+	};
+
+	struct CullingStats
+	{
+		u32 visibleCount;
+		u32 frustumCulledCount;
+		u32 occlusionCulledCount;
+		f32 cullTimeMs;
+		f32 occlusionRasterTimeMs;
+		f32 occlusionTestTimeMs;
+	};
+
+	struct DrawStats
+	{
+		u32 drawCount;
+		u32 instanceCount;
+		// Times consecutive draws change material. Materials are bindless, so this only affects texture cache coherence.
+		u32 materialSwitchCount;
+		// Material switches in the unsorted order of the draws.
+		u32 unsortedMaterialSwitchCount;
+		f32 batchTimeMs;
+		f32 sortTimeMs;
+	};
+
 	class Scene : public Subsystem
 	{
 	public:
@@ -25,30 +123,175 @@ namespace Hyper
 		~Scene() override;
 
 		void ImportModel(const std::filesystem::path& filePath, const glm::vec3& pos = glm::vec3{ 0.0f }, const glm::vec3& rot = glm::vec3{ 0.0f }, const glm::vec3& scale = glm::vec3{ 1.0f });
+		// Adds a fully built node hierarchy to the scene, and calculates its transforms and bounds.
+		void AddRootNode(std::unique_ptr<Node> pNode);
 
+		// Builds an acceleration structure of the current mesh instances. The first build waits for it to finish, later ones
+		// build in the background on the compute queue, and replace the current one once OnTick sees them finish.
 		void BuildAccelerationStructure();
+		// Moves the TLAS instances to their node's current transform, and records the TLAS update if any of them moved.
+		// Has to be recorded before the frame traces rays.
+		void UpdateAccelerationStructure(const vk::CommandBuffer& cmd, u32 frameIdx);
 
-		void Draw(const vk::CommandBuffer& cmd, const vk::PipelineLayout& pipelineLayout) const;
+		// Bounds of all the geometry in the scene.
+		[[nodiscard]] AABB GetSceneBounds() const;
+		// Collects all nodes whose own meshes overlap the given world-space box. Subtrees are skipped using their hierarchy bounds.
+		void QueryNodes(const AABB& bounds, std::vector<Node*>& outNodes) const;
+		// Collects the indices of all mesh instances whose world bounds overlap the given box, using the spatial index.
+		void QueryMeshInstances(const AABB& bounds, std::vector<u32>& outInstances) const;
+		// Collects the indices of the k mesh instances closest to the point, closest first.
+		void QueryNearestMeshInstances(const glm::vec3& point, u32 k, std::vector<u32>& outInstances) const;
+		// Finds the closest triangle hit by a world-space ray. The spatial index finds the candidate meshes, which are then
+		// tested against their triangle BVHs in object space.
+		bool Raycast(const Ray& ray, f32 maxDistance, PickResult& outResult) const;
+		// Casts a ray from the camera through the given window position (in pixels, from the top left).
+		bool Pick(const glm::vec2& windowPos, PickResult& outResult) const;
+
+		// Culls all mesh instances and groups the visible ones per mesh, so every mesh is drawn with a single instanced draw.
+		// Fills the instance data, draw data and indirect commands, which have to be uploaded before recording the draws.
+		void PrepareDraws(const glm::mat4& viewProjection);
+		// Records the draws in [firstDraw, firstDraw + drawCount) of the sorted list prepared by PrepareDraws.
+		// Doesn't modify the scene, so different ranges can be recorded into different command buffers at the same time.
+		// Materials are bindless, so the material library's descriptor set has to be bound beforehand.
+		void RecordDraws(const vk::CommandBuffer& cmd, u32 firstDraw, u32 drawCount) const;
+		// Records all prepared draws as a single multi-draw indirect call, reading the commands from indirectBuffer,
+		// which has to contain the indirect commands of PrepareDraws.
+		void RecordIndirectDraws(const vk::CommandBuffer& cmd, const vk::Buffer& indirectBuffer) const;
+		// Lays out every mesh instance for culling on the GPU, grouped per material. Only rebuilds the list when instances were
+		// added or moved since the last call, which bumps the version returned by GetGpuDrawVersion.
+		void PrepareGpuDraws();
+		// Records one indirect count draw per material range of PrepareGpuDraws, reading the commands from indirectBuffer and the
+		// draw count of every range from countBuffer. Both are written by the GPU culling pass, drawOffset and countOffset select
+		// which of its phases is drawn.
+		void RecordIndirectCountDraws(const vk::CommandBuffer& cmd, const vk::Buffer& indirectBuffer, const vk::Buffer& countBuffer,
+			u32 drawOffset, u32 countOffset) const;
+		// Frustum culls all mesh instances on the CPU, without occlusion culling, and returns how many are visible.
+		// Used as the reference for the GPU culling pass.
+		[[nodiscard]] u32 CountFrustumVisible(const glm::mat4& viewProjection) const;
+		void DrawImGui();
 
 		bool OnInitialize() override;
 		void OnShutdown() override;
 		void OnTick(f32 dt) override;
 
+		[[nodiscard]] RenderContext* GetRenderContext() const { return m_pRenderCtx; }
 		[[nodiscard]] VulkanAccelerationStructure* GetAccelerationStructure() const { return m_pAcceleration.get(); }
+		// Whether the current acceleration structure merged static meshes, which lags behind the setting while a rebuild is building.
+		[[nodiscard]] bool IsMergingStaticMeshes() const { return m_AccelerationMergesStaticMeshes; }
 		[[nodiscard]] const LightingSettings& GetLightingSettings() const { return m_LightingSettings; }
+		[[nodiscard]] const CullingStats& GetCullingStats() const { return m_CullingStats; }
+		[[nodiscard]] const DrawStats& GetDrawStats() const { return m_DrawStats; }
+		[[nodiscard]] bool IsFrustumCullingEnabled() const { return m_EnableFrustumCulling; }
+		[[nodiscard]] u32 GetDrawCount() const { return m_RenderQueue.GetCount(); }
+		[[nodiscard]] const std::vector<InstanceData>& GetInstanceData() const { return m_InstanceData; }
+		[[nodiscard]] const std::vector<DrawData>& GetDrawData() const { return m_DrawData; }
+		[[nodiscard]] const std::vector<vk::DrawIndexedIndirectCommand>& GetIndirectCommands() const { return m_IndirectCommands; }
+		[[nodiscard]] const std::vector<GpuDrawObject>& GetGpuDrawObjects() const { return m_GpuDrawObjects; }
+		[[nodiscard]] const std::vector<InstanceData>& GetGpuInstanceData() const { return m_GpuInstanceData; }
+		[[nodiscard]] u32 GetGpuMaterialRangeCount() const { return static_cast<u32>(m_GpuMaterialDrawRanges.size()); }
+		[[nodiscard]] u32 GetGpuDrawVersion() const { return m_GpuDrawVersion; }
+		[[nodiscard]] const std::vector<MeshInstance>& GetMeshInstances() const { return m_MeshInstances; }
+		[[nodiscard]] const DynamicAABBTree& GetSpatialIndex() const { return m_SpatialIndex; }
+		[[nodiscard]] Node* GetSelectedNode() const { return m_pSelectedNode; }
 
 	private:
 		std::unique_ptr<Node> LoadNode(const aiScene* pScene, const aiNode* pNode, const std::string& overwriteName = "");
 		void LoadMaterials(const aiScene* pScene, const std::filesystem::path& filePath);
 
+		void RebuildMeshInstances();
+		// Swaps in the pending acceleration structure once its build is done, and destroys retired ones that are no longer in use.
+		void UpdatePendingAccelerationStructure();
+		void SelectOccluders();
+		void UpdateInstanceBounds();
+		void CullMeshInstances(const glm::mat4& viewProjection);
+		void RunCullingBenchmark();
+		void UpdatePicking();
+		void BuildDrawBatches(const glm::mat4& viewProjection);
+		void BuildRenderQueue();
+
 	private:
 		RenderContext* m_pRenderCtx;
 
 		std::vector<std::unique_ptr<Node>> m_RootNodes;
 		std::unique_ptr<VulkanAccelerationStructure> m_pAcceleration;
+		// Node followed by every TLAS instance, which is the cluster node for merged static meshes.
+		std::vector<const Node*> m_AccelerationNodes;
+		// Rebuild that's still building in the background, while the frames keep tracing the current one.
+		std::unique_ptr<VulkanAccelerationStructure> m_pPendingAcceleration;
+		std::vector<const Node*> m_PendingAccelerationNodes;
+		// Replaced acceleration structures, destroyed once the frames that may still trace them are done.
+		struct RetiredAcceleration
+		{
+			std::unique_ptr<VulkanAccelerationStructure> pAcceleration;
+			u64 frameNumber;
+		};
+		std::vector<RetiredAcceleration> m_RetiredAccelerations;
+		// Merges the meshes of static nodes into a BLAS per cluster of static nodes, instead of a TLAS instance per mesh.
+		bool m_MergeStaticMeshes{ true };
+		bool m_AccelerationMergesStaticMeshes{};
+		bool m_PendingAccelerationMergesStaticMeshes{};
+		bool m_RebuildAcceleration{ false };
+		// Turns every dynamic node with meshes a bit each tick, which moves their instances in the TLAS.
+		bool m_SpinMeshNodes{ false };
 
-		std::vector<UUID> m_TempMaterialMappings;
+		// Meshes and materials of every imported file. Importing the same file again, or nodes referencing the same mesh,
+		// reuse these instead of creating copies, so their occurrences can be drawn instanced.
+		struct ImportedModel
+		{
+			std::vector<UUID> materialIds;
+			// Indexed by the mesh index in the file, created the first time a node uses them.
+			std::vector<std::shared_ptr<Mesh>> meshes;
+		};
+		std::unordered_map<std::string, ImportedModel> m_ImportedModels;
+		ImportedModel* m_pImportingModel{};
 
 		LightingSettings m_LightingSettings{};
+
+		std::vector<MeshInstance> m_MeshInstances;
+		AABBList m_InstanceBounds;
+		std::vector<u32> m_VisibleInstances;
+		DynamicAABBTree m_SpatialIndex{};
+		// Amount of instances that moved out of their fat bounds during the last update.
+		u32 m_SpatialIndexReinsertCount{};
+		bool m_EnableFrustumCulling{ true };
+		// Cull through the spatial index instead of testing every instance.
+		bool m_UseSpatialIndex{ false };
+		bool m_EnableOcclusionCulling{ true };
+		CullingStats m_CullingStats{};
+		std::unique_ptr<OcclusionCuller> m_pOcclusionCuller;
+
+		bool m_RunCullingBenchmark{ false };
+		CullingStats m_BenchmarkStats{};
+		u32 m_BenchmarkTotalDraws{};
+
+		bool m_RunSpatialIndexBenchmark{ false };
+		bool m_RunRenderQueueBenchmark{ false };
+
+		bool m_EnableInstancing{ true };
+		std::vector<DrawBatch> m_DrawBatches;
+		std::unordered_map<const Mesh*, u32> m_DrawBatchLookup;
+		std::vector<InstanceData> m_InstanceData;
+		bool m_EnableDrawSorting{ true };
+		RenderQueue m_RenderQueue;
+		// Draws in their sorted order.
+		std::vector<DrawData> m_DrawData;
+		std::vector<vk::DrawIndexedIndirectCommand> m_IndirectCommands;
+		DrawStats m_DrawStats{};
+
+		// Every mesh instance grouped per material, for culling on the GPU. Every object has its own instance,
+		// and a range's draw slots are the range's objects, so the culling pass can never overflow them.
+		std::vector<GpuDrawObject> m_GpuDrawObjects;
+		std::vector<InstanceData> m_GpuInstanceData;
+		std::vector<MaterialDrawRange> m_GpuMaterialDrawRanges;
+		u32 m_GpuDrawVersion{};
+		bool m_GpuDrawsDirty{ true };
+
+		Node* m_pSelectedNode{};
+		// Opens the hierarchy window up to the selected node, after it was picked in the viewport.
+		bool m_RevealSelectedNode{ false };
+		bool m_WasPickButtonDown{ false };
+		bool m_HasPickResult{ false };
+		PickResult m_LastPickResult{};
+		f32 m_LastPickTimeMs{};
 	};
 }
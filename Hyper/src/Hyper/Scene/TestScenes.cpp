@@ -0,0 +1,178 @@
+﻿#include "HyperPCH.h"
+#include "TestScenes.h"
+
+#include <random>
+
+#include "Scene.h"
+#include "Hyper/Renderer/MaterialLibrary.h"
+#include "Hyper/Renderer/Mesh.h"
+#include "Hyper/Renderer/RenderContext.h"
+#include "Hyper/Renderer/Vulkan/Vertex.h"
+
+namespace Hyper::TestScenes
+{
+	static UUID CreateDefaultMaterial(RenderContext* pRenderCtx, const std::string& name)
+	{
+		Material& material = pRenderCtx->pMaterialLibrary->CreateMaterial(name);
+		material.LoadTexture(MaterialTextureType::Albedo, "res/textures/default-white.png");
+		material.LoadTexture(MaterialTextureType::Normal, "res/textures/default-normal.png", false);
+		material.PostLoadInititalize();
+
+		return material.GetId();
+	}
+
+	// Unit cube centered around the origin, with per-face normals so it can be scaled into walls, floors, etc.
+	// The size is baked into the vertices, so differently sized cubes end up as different meshes.
+	static std::shared_ptr<Mesh> CreateCubeMesh(RenderContext* pRenderCtx, const UUID& materialId, const glm::vec3& size = glm::vec3{ 1.0f })
+	{
+		std::vector<VertexPosNormTex> vertices;
+		std::vector<u32> indices;
+
+		const std::array<glm::vec3, 6> normals = {
+			glm::vec3{ 1.0f, 0.0f, 0.0f }, glm::vec3{ -1.0f, 0.0f, 0.0f },
+			glm::vec3{ 0.0f, 1.0f, 0.0f }, glm::vec3{ 0.0f, -1.0f, 0.0f },
+			glm::vec3{ 0.0f, 0.0f, 1.0f }, glm::vec3{ 0.0f, 0.0f, -1.0f },
+		};
+
+		for (const glm::vec3& normal : normals)
+		{
+			// Build a tangent frame for the face, so the four corners can be generated from it.
+			const glm::vec3 tangent = std::abs(normal.z) > 0.5f ? glm::vec3{ 1.0f, 0.0f, 0.0f } : glm::vec3{ 0.0f, 0.0f, 1.0f };
+			const glm::vec3 binormal = glm::cross(normal, tangent);
+
+			const u32 firstVertex = static_cast<u32>(vertices.size());
+			const std::array<glm::vec2, 4> corners = {
+				glm::vec2{ -1.0f, -1.0f }, glm::vec2{ 1.0f, -1.0f }, glm::vec2{ 1.0f, 1.0f }, glm::vec2{ -1.0f, 1.0f }
+			};
+			for (const glm::vec2& corner : corners)
+			{
+				const glm::vec3 position = (normal + tangent * corner.x + binormal * corner.y) * 0.5f * size;
+				const glm::vec2 uv = corner * 0.5f + 0.5f;
+				vertices.emplace_back(VertexPosNormTex{ position, normal, tangent, binormal, uv });
+			}
+
+			indices.insert(indices.end(), { firstVertex, firstVertex + 1, firstVertex + 2, firstVertex, firstVertex + 2, firstVertex + 3 });
+		}
+
+		return std::make_shared<Mesh>(pRenderCtx, materialId, vertices, indices, static_cast<u32>(indices.size() / 3));
+	}
+
+	void CreateOcclusionScene(Scene* pScene, u32 seed)
+	{
+		static constexpr u32 gridSize = 6;
+		static constexpr f32 cellSize = 12.0f;
+		static constexpr u32 boxCount = 4000;
+
+		RenderContext* pRenderCtx = pScene->GetRenderContext();
+		const UUID materialId = CreateDefaultMaterial(pRenderCtx, "OcclusionScene_Default");
+		const std::shared_ptr<Mesh> pCube = CreateCubeMesh(pRenderCtx, materialId);
+
+		std::mt19937 rng{ seed };
+		std::uniform_real_distribution<f32> unit{ 0.0f, 1.0f };
+
+		const f32 halfWorld = gridSize * cellSize * 0.5f;
+
+		auto pRoot = std::make_unique<Node>("OcclusionScene");
+
+		auto pGround = std::make_unique<Node>("Ground");
+		pGround->SetTransform(glm::vec3{ 0.0f, 0.0f, -0.1f }, glm::vec3{ 0.0f }, glm::vec3{ halfWorld * 2.0f, halfWorld * 2.0f, 0.2f });
+		pGround->AddMesh(pCube);
+		pRoot->AddChild(std::move(pGround));
+
+		// One wall per grid cell, randomly oriented along x or y.
+		for (u32 y = 0; y < gridSize; y++)
+		{
+			for (u32 x = 0; x < gridSize; x++)
+			{
+				const glm::vec3 center{ (x + 0.5f) * cellSize - halfWorld, (y + 0.5f) * cellSize - halfWorld, 3.0f };
+				const f32 rotation = unit(rng) < 0.5f ? 0.0f : 90.0f;
+
+				auto pWall = std::make_unique<Node>(fmt::format("Wall {}", y * gridSize + x));
+				pWall->SetTransform(center, glm::vec3{ 0.0f, 0.0f, rotation }, glm::vec3{ cellSize * 0.8f, 0.5f, 6.0f });
+				pWall->AddMesh(pCube);
+				pRoot->AddChild(std::move(pWall));
+			}
+		}
+
+		for (u32 i = 0; i < boxCount; i++)
+		{
+			const f32 size = 0.3f + unit(rng) * 0.7f;
+			const glm::vec3 position{ (unit(rng) * 2.0f - 1.0f) * halfWorld, (unit(rng) * 2.0f - 1.0f) * halfWorld, size * 0.5f };
+
+			auto pBox = std::make_unique<Node>(fmt::format("Box {}", i));
+			pBox->SetTransform(position, glm::vec3{ 0.0f, 0.0f, unit(rng) * 360.0f }, glm::vec3{ size });
+			pBox->AddMesh(pCube);
+			pRoot->AddChild(std::move(pBox));
+		}
+
+		pRoot->SetTransform(glm::vec3{ 0.0f }, glm::vec3{ 0.0f }, glm::vec3{ 1.0f });
+		pScene->AddRootNode(std::move(pRoot));
+	}
+
+	void CreateInstancingScene(Scene* pScene, u32 instanceCount, u32 seed)
+	{
+		static constexpr f32 spacing = 2.0f;
+
+		RenderContext* pRenderCtx = pScene->GetRenderContext();
+		const UUID materialId = CreateDefaultMaterial(pRenderCtx, "InstancingScene_Default");
+		const std::shared_ptr<Mesh> pCube = CreateCubeMesh(pRenderCtx, materialId);
+
+		std::mt19937 rng{ seed };
+		std::uniform_real_distribution<f32> unit{ 0.0f, 1.0f };
+
+		const u32 gridSize = static_cast<u32>(std::ceil(std::sqrt(static_cast<f32>(instanceCount))));
+		const f32 halfWorld = gridSize * spacing * 0.5f;
+
+		auto pRoot = std::make_unique<Node>("InstancingScene");
+		for (u32 i = 0; i < instanceCount; i++)
+		{
+			const f32 size = 0.5f + unit(rng) * 0.8f;
+			const glm::vec3 position{ (i % gridSize + 0.5f) * spacing - halfWorld, (i / gridSize + 0.5f) * spacing - halfWorld, size * 0.5f };
+			const glm::vec3 rotation{ unit(rng) * 30.0f, unit(rng) * 30.0f, unit(rng) * 360.0f };
+
+			auto pInstance = std::make_unique<Node>(fmt::format("Instance {}", i));
+			pInstance->SetTransform(position, rotation, glm::vec3{ size });
+			pInstance->AddMesh(pCube);
+			pRoot->AddChild(std::move(pInstance));
+		}
+
+		pRoot->SetTransform(glm::vec3{ 0.0f }, glm::vec3{ 0.0f }, glm::vec3{ 1.0f });
+		pScene->AddRootNode(std::move(pRoot));
+	}
+
+	void CreateDrawCallScene(Scene* pScene, u32 drawCount, u32 materialCount, u32 seed)
+	{
+		static constexpr f32 spacing = 2.0f;
+
+		RenderContext* pRenderCtx = pScene->GetRenderContext();
+
+		std::vector<UUID> materialIds;
+		materialIds.reserve(materialCount);
+		for (u32 i = 0; i < materialCount; i++)
+		{
+			materialIds.push_back(CreateDefaultMaterial(pRenderCtx, fmt::format("DrawCallScene_Material{}", i)));
+		}
+
+		std::mt19937 rng{ seed };
+		std::uniform_real_distribution<f32> unit{ 0.0f, 1.0f };
+		std::uniform_int_distribution<u32> materialDistribution{ 0, std::max(materialCount, 1u) - 1 };
+
+		const u32 gridSize = static_cast<u32>(std::ceil(std::sqrt(static_cast<f32>(drawCount))));
+		const f32 halfWorld = gridSize * spacing * 0.5f;
+
+		auto pRoot = std::make_unique<Node>("DrawCallScene");
+		for (u32 i = 0; i < drawCount; i++)
+		{
+			const glm::vec3 size{ 0.4f + unit(rng) * 1.2f, 0.4f + unit(rng) * 1.2f, 0.4f + unit(rng) * 2.0f };
+			const glm::vec3 position{ (i % gridSize + 0.5f) * spacing - halfWorld, (i / gridSize + 0.5f) * spacing - halfWorld, size.z * 0.5f };
+
+			auto pBox = std::make_unique<Node>(fmt::format("Box {}", i));
+			pBox->SetTransform(position, glm::vec3{ 0.0f, 0.0f, unit(rng) * 360.0f }, glm::vec3{ 1.0f });
+			pBox->AddMesh(CreateCubeMesh(pRenderCtx, materialIds[materialDistribution(rng)], size));
+			pRoot->AddChild(std::move(pBox));
+		}
+
+		pRoot->SetTransform(glm::vec3{ 0.0f }, glm::vec3{ 0.0f }, glm::vec3{ 1.0f });
+		pScene->AddRootNode(std::move(pRoot));
+	}
+}
@@ -0,0 +1,23 @@
+﻿#pragma once
+
+namespace Hyper
+{
+	class Scene;
+
+	// Procedural scenes for measuring the scene systems. Everything is generated from a fixed seed,
+	// so numbers are comparable between runs and between machines.
+	namespace TestScenes
+	{
+		// A grid of tall walls, with lots of small boxes scattered in between.
+		// From most viewpoints the majority of the boxes is hidden behind a wall, which makes it a good test for occlusion culling.
+		void CreateOcclusionScene(Scene* pScene, u32 seed = 1337);
+
+		// A square field of randomly rotated and scaled copies of a single mesh, for measuring draw submission.
+		// With instancing, the whole field is a single draw.
+		void CreateInstancingScene(Scene* pScene, u32 instanceCount = 10000, u32 seed = 1337);
+
+		// A square field of boxes that all have their own mesh, spread over a few materials. Instancing can't merge any of them,
+		// so every visible box is a separate draw, for measuring command recording. Creating this many meshes takes a while.
+		void CreateDrawCallScene(Scene* pScene, u32 drawCount = 50000, u32 materialCount = 16, u32 seed = 1337);
+	}
+}
@@ -0,0 +1,273 @@
+﻿#include "HyperPCH.h"
+#include "TriangleBVH.h"
+
+#include <cassert>
+#include <numeric>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+#include "Hyper/Debug/Profiler.h"
+
+namespace Hyper
+{
+	static constexpr u32 s_BinCount = 16;
+	static constexpr u32 s_MaxLeafSize = 4;
+	// Limits the traversal stack. Splits stop at this depth, which only happens for badly degenerate meshes.
+	static constexpr u32 s_MaxDepth = 48;
+	static constexpr u32 s_MaxStackSize = s_MaxDepth + 2;
+
+	static bool IntersectBounds(const AABB& bounds, const Ray& ray, const glm::vec3& invDirection, f32 maxDistance, f32& outDistance)
+	{
+		const glm::vec3 t0 = (bounds.min - ray.origin) * invDirection;
+		const glm::vec3 t1 = (bounds.max - ray.origin) * invDirection;
+		const glm::vec3 tNear = glm::min(t0, t1);
+		const glm::vec3 tFar = glm::max(t0, t1);
+
+		const f32 entry = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, 0.0f));
+		const f32 exit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, maxDistance));
+		outDistance = entry;
+		return entry <= exit;
+	}
+
+	u32 TriangleBVH::Split::GetBin(const glm::vec3& centroid) const
+	{
+		const f32 bin = (centroid[axis] - centroidMin) * binScale;
+		return std::min(static_cast<u32>(std::max(bin, 0.0f)), s_BinCount - 1);
+	}
+
+	void TriangleBVH::Build(const std::vector<glm::vec3>& positions, const std::vector<u32>& indices)
+	{
+		HPR_PROFILE_SCOPE();
+
+		m_Nodes.clear();
+		m_Triangles.clear();
+		m_TriangleIndices.clear();
+		m_Depth = 0;
+
+		const u32 triangleCount = static_cast<u32>(indices.size() / 3);
+		if (triangleCount == 0)
+			return;
+
+		std::vector<AABB> triangleBounds(triangleCount);
+		std::vector<glm::vec3> centroids(triangleCount);
+		for (u32 t = 0; t < triangleCount; t++)
+		{
+			AABB& bounds = triangleBounds[t];
+			bounds.Grow(positions[indices[t * 3 + 0]]);
+			bounds.Grow(positions[indices[t * 3 + 1]]);
+			bounds.Grow(positions[indices[t * 3 + 2]]);
+			centroids[t] = bounds.GetCenter();
+		}
+
+		m_TriangleIndices.resize(triangleCount);
+		std::iota(m_TriangleIndices.begin(), m_TriangleIndices.end(), 0);
+
+		const auto calculateBounds = [&](BVHNode& node)
+		{
+			node.bounds = AABB{};
+			for (u32 i = node.leftFirst; i < node.leftFirst + node.triangleCount; i++)
+			{
+				node.bounds.Grow(triangleBounds[m_TriangleIndices[i]]);
+			}
+		};
+
+		m_Nodes.reserve(static_cast<size_t>(triangleCount) * 2);
+		m_Nodes.push_back(BVHNode{ AABB{}, 0, triangleCount });
+		calculateBounds(m_Nodes[0]);
+
+		std::vector<std::pair<u32, u32>> stack{ { 0, 0 } };
+		while (!stack.empty())
+		{
+			const auto [nodeIdx, depth] = stack.back();
+			stack.pop_back();
+			m_Depth = std::max(m_Depth, depth);
+
+			const BVHNode node = m_Nodes[nodeIdx];
+			if (node.triangleCount <= s_MaxLeafSize || depth >= s_MaxDepth)
+				continue;
+
+			Split split;
+			if (!FindBestSplit(node, centroids, triangleBounds, split))
+				continue;
+
+			const auto first = m_TriangleIndices.begin() + node.leftFirst;
+			const auto middle = std::partition(first, first + node.triangleCount, [&](u32 triangleIdx)
+			{
+				return split.GetBin(centroids[triangleIdx]) <= split.bin;
+			});
+
+			const u32 leftCount = static_cast<u32>(middle - first);
+			if (leftCount == 0 || leftCount == node.triangleCount)
+				continue;
+
+			const u32 leftIdx = static_cast<u32>(m_Nodes.size());
+			m_Nodes.push_back(BVHNode{ AABB{}, node.leftFirst, leftCount });
+			m_Nodes.push_back(BVHNode{ AABB{}, node.leftFirst + leftCount, node.triangleCount - leftCount });
+			calculateBounds(m_Nodes[leftIdx]);
+			calculateBounds(m_Nodes[leftIdx + 1]);
+
+			m_Nodes[nodeIdx].leftFirst = leftIdx;
+			m_Nodes[nodeIdx].triangleCount = 0;
+
+			stack.emplace_back(leftIdx, depth + 1);
+			stack.emplace_back(leftIdx + 1, depth + 1);
+		}
+
+		m_Triangles.reserve(triangleCount);
+		for (const u32 t : m_TriangleIndices)
+		{
+			const glm::vec3& v0 = positions[indices[t * 3 + 0]];
+			const glm::vec3& v1 = positions[indices[t * 3 + 1]];
+			const glm::vec3& v2 = positions[indices[t * 3 + 2]];
+			m_Triangles.push_back(Triangle{ v0, v1 - v0, v2 - v0 });
+		}
+	}
+
+	bool TriangleBVH::FindBestSplit(const BVHNode& node, const std::vector<glm::vec3>& centroids, const std::vector<AABB>& triangleBounds, Split& outSplit) const
+	{
+		AABB centroidBounds{};
+		for (u32 i = node.leftFirst; i < node.leftFirst + node.triangleCount; i++)
+		{
+			centroidBounds.Grow(centroids[m_TriangleIndices[i]]);
+		}
+
+		// Splitting is only worth it if it's cheaper than intersecting all triangles in the node.
+		f32 bestCost = static_cast<f32>(node.triangleCount) * node.bounds.GetSurfaceArea();
+		bool found = false;
+
+		for (u32 axis = 0; axis < 3; axis++)
+		{
+			const f32 extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+			if (extent <= 0.0f)
+				continue;
+
+			const Split split{ axis, 0, centroidBounds.min[axis], static_cast<f32>(s_BinCount) / extent };
+
+			std::array<AABB, s_BinCount> binBounds{};
+			std::array<u32, s_BinCount> binCounts{};
+			for (u32 i = node.leftFirst; i < node.leftFirst + node.triangleCount; i++)
+			{
+				const u32 triangleIdx = m_TriangleIndices[i];
+				const u32 bin = split.GetBin(centroids[triangleIdx]);
+				binBounds[bin].Grow(triangleBounds[triangleIdx]);
+				binCounts[bin]++;
+			}
+
+			// Sweep from the right to get the cost of everything after each split, then from the left to combine.
+			std::array<f32, s_BinCount> rightCosts{};
+			AABB rightBounds{};
+			u32 rightCount = 0;
+			for (u32 b = s_BinCount - 1; b > 0; b--)
+			{
+				rightBounds.Grow(binBounds[b]);
+				rightCount += binCounts[b];
+				rightCosts[b - 1] = rightCount > 0 ? static_cast<f32>(rightCount) * rightBounds.GetSurfaceArea() : 0.0f;
+			}
+
+			AABB leftBounds{};
+			u32 leftCount = 0;
+			for (u32 b = 0; b < s_BinCount - 1; b++)
+			{
+				leftBounds.Grow(binBounds[b]);
+				leftCount += binCounts[b];
+				if (leftCount == 0 || leftCount == node.triangleCount)
+					continue;
+
+				const f32 cost = static_cast<f32>(leftCount) * leftBounds.GetSurfaceArea() + rightCosts[b];
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					outSplit = split;
+					outSplit.bin = b;
+					found = true;
+				}
+			}
+		}
+
+		return found;
+	}
+
+	bool TriangleBVH::Intersect(const Ray& ray, f32 maxDistance, Hit& outHit) const
+	{
+		HPR_PROFILE_SCOPE();
+
+		if (m_Nodes.empty())
+			return false;
+
+		// Division by zero gives +-inf here, which the slab test handles correctly.
+		const glm::vec3 invDirection = 1.0f / ray.direction;
+
+		f32 closest = maxDistance;
+		bool hasHit = false;
+
+		f32 distance;
+		if (!IntersectBounds(m_Nodes[0].bounds, ray, invDirection, closest, distance))
+			return false;
+
+		std::array<u32, s_MaxStackSize> stack;
+		u32 stackSize = 0;
+		stack[stackSize++] = 0;
+
+		while (stackSize > 0)
+		{
+			const BVHNode& node = m_Nodes[stack[--stackSize]];
+
+			if (node.IsLeaf())
+			{
+				// Möller-Trumbore
+				for (u32 i = node.leftFirst; i < node.leftFirst + node.triangleCount; i++)
+				{
+					const Triangle& triangle = m_Triangles[i];
+
+					const glm::vec3 p = glm::cross(ray.direction, triangle.edge2);
+					const f32 determinant = glm::dot(triangle.edge1, p);
+					if (std::abs(determinant) < 1e-12f)
+						continue;
+
+					const f32 invDeterminant = 1.0f / determinant;
+					const glm::vec3 s = ray.origin - triangle.v0;
+					const f32 u = glm::dot(s, p) * invDeterminant;
+					if (u < 0.0f || u > 1.0f)
+						continue;
+
+					const glm::vec3 q = glm::cross(s, triangle.edge1);
+					const f32 v = glm::dot(ray.direction, q) * invDeterminant;
+					if (v < 0.0f || u + v > 1.0f)
+						continue;
+
+					const f32 t = glm::dot(triangle.edge2, q) * invDeterminant;
+					if (t < 0.0f || t >= closest)
+						continue;
+
+					closest = t;
+					outHit = Hit{ m_TriangleIndices[i], t, u, v };
+					hasHit = true;
+				}
+				continue;
+			}
+
+			// Visit the closest child first, so the hit distance shrinks as quickly as possible.
+			f32 distance1, distance2;
+			const bool hit1 = IntersectBounds(m_Nodes[node.leftFirst].bounds, ray, invDirection, closest, distance1);
+			const bool hit2 = IntersectBounds(m_Nodes[node.leftFirst + 1].bounds, ray, invDirection, closest, distance2);
+
+			assert(stackSize + 2 <= s_MaxStackSize);
+			if (hit1 && hit2)
+			{
+				const bool firstIsCloser = distance1 <= distance2;
+				stack[stackSize++] = firstIsCloser ? node.leftFirst + 1 : node.leftFirst;
+				stack[stackSize++] = firstIsCloser ? node.leftFirst : node.leftFirst + 1;
+			}
+			else if (hit1)
+			{
+				stack[stackSize++] = node.leftFirst;
+			}
+			else if (hit2)
+			{
+				stack[stackSize++] = node.leftFirst + 1;
+			}
+		}
+
+		return hasHit;
+	}
+}
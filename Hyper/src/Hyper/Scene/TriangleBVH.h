@@ -0,0 +1,72 @@
+﻿#pragma once
+#include <glm/vec3.hpp>
+
+#include "Bounds.h"
+
+namespace Hyper
+{
+	// Static bounding volume hierarchy over the triangles of a single mesh, in object space.
+	// Built once with binned SAH when the mesh is created, and used for exact CPU ray casts like picking.
+	class TriangleBVH
+	{
+	public:
+		struct Hit
+		{
+			// Index of the triangle in the mesh's index buffer, divided by 3.
+			u32 triangleIdx;
+			f32 distance;
+			// Barycentric coordinates of the hit, relative to the second and third vertex.
+			f32 u, v;
+		};
+
+	public:
+		void Build(const std::vector<glm::vec3>& positions, const std::vector<u32>& indices);
+
+		// Finds the closest triangle hit by the ray, closer than maxDistance. Triangles are hit from both sides.
+		bool Intersect(const Ray& ray, f32 maxDistance, Hit& outHit) const;
+
+		[[nodiscard]] u32 GetNodeCount() const { return static_cast<u32>(m_Nodes.size()); }
+		[[nodiscard]] u32 GetTriangleCount() const { return static_cast<u32>(m_Triangles.size()); }
+		[[nodiscard]] u32 GetDepth() const { return m_Depth; }
+
+	private:
+		struct BVHNode
+		{
+			AABB bounds;
+			// First child for internal nodes (the second child directly follows it), first triangle for leaves.
+			u32 leftFirst;
+			u32 triangleCount;
+
+			[[nodiscard]] bool IsLeaf() const { return triangleCount > 0; }
+		};
+
+		// Triangles are stored in leaf order, with the edges precomputed for the intersection test.
+		struct Triangle
+		{
+			glm::vec3 v0;
+			glm::vec3 edge1;
+			glm::vec3 edge2;
+		};
+
+		// Triangles are split by the bin their centroid falls into, along a single axis.
+		struct Split
+		{
+			u32 axis;
+			u32 bin;
+			f32 centroidMin;
+			f32 binScale;
+
+			[[nodiscard]] u32 GetBin(const glm::vec3& centroid) const;
+		};
+
+		// Returns true and the split if splitting the node is cheaper than keeping it as a leaf.
+		bool FindBestSplit(const BVHNode& node, const std::vector<glm::vec3>& centroids, const std::vector<AABB>& triangleBounds, Split& outSplit) const;
+
+	private:
+		std::vector<BVHNode> m_Nodes;
+		std::vector<Triangle> m_Triangles;
+		// Original triangle index for every triangle in m_Triangles.
+		std::vector<u32> m_TriangleIndices;
+		u32 m_Depth{};
+	};
+}
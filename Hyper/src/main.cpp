@@ -5,9 +5,18 @@
 #endif
 
 #include "Hyper/Core/Application.h"
+#include "Hyper/Core/Logger.h"
+#include "Hyper/Debug/HeadlessChecks.h"
 
-int main()
+int main(int argc, char** argv)
 {
+	// Runs the GPU culling pass without a window and exits, with a non-zero code when it doesn't match the CPU.
+	if (argc > 1 && strcmp(argv[1], "--gpu-culling-check") == 0)
+	{
+		Hyper::Logger::Init();
+		return Hyper::HeadlessChecks::RunGpuCullingCheck() ? 0 : 1;
+	}
+
 	Hyper::Application app{};
 	app.Run();
 	return 0;